@@ -0,0 +1,70 @@
+#include "benchbus.h"
+#include <QCoreApplication>
+#include <QDBusConnection>
+#include <QDBusConnectionInterface>
+#include <QDeadlineTimer>
+#include <QThread>
+#include <cstdio>
+
+namespace {
+constexpr char ModemManagerService[] = "org.freedesktop.ModemManager1";
+constexpr int StartupTimeoutMs = 5000;
+}
+
+BenchBus::~BenchBus()
+{
+    stopMock();
+    if (m_daemon.state() != QProcess::NotRunning) {
+        m_daemon.terminate();
+        m_daemon.waitForFinished(1000);
+    }
+}
+
+bool BenchBus::start()
+{
+    m_daemon.start("dbus-daemon", {"--session", "--nofork", "--print-address"});
+    if (!m_daemon.waitForStarted(StartupTimeoutMs) ||
+        !m_daemon.waitForReadyRead(StartupTimeoutMs)) {
+        std::fprintf(stderr, "bench: could not start dbus-daemon\n");
+        return false;
+    }
+    const QByteArray address = m_daemon.readLine().trimmed();
+    qputenv("DBUS_SESSION_BUS_ADDRESS", address);
+    qputenv("CELLULARPI_MODEM_BUS", "session");
+    return true;
+}
+
+bool BenchBus::startMock(const QStringList &arguments)
+{
+    stopMock();
+    m_mock.setProcessChannelMode(QProcess::ForwardedErrorChannel);
+    m_mock.start(QCoreApplication::applicationDirPath() + "/mockmodemmanager", arguments);
+    if (!m_mock.waitForStarted(StartupTimeoutMs) || !waitForService(true, StartupTimeoutMs)) {
+        std::fprintf(stderr, "bench: mock ModemManager did not come up\n");
+        return false;
+    }
+    return true;
+}
+
+void BenchBus::stopMock()
+{
+    if (m_mock.state() == QProcess::NotRunning) {
+        return;
+    }
+    m_mock.terminate();
+    m_mock.waitForFinished(1000);
+    waitForService(false, StartupTimeoutMs);
+}
+
+bool BenchBus::waitForService(bool registered, int timeoutMs)
+{
+    QDBusConnectionInterface *bus = QDBusConnection::sessionBus().interface();
+    const QDeadlineTimer deadline(timeoutMs);
+    while (!deadline.hasExpired()) {
+        if (bus && bus->isServiceRegistered(ModemManagerService).value() == registered) {
+            return true;
+        }
+        QThread::msleep(10);
+    }
+    return false;
+}
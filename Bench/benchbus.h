@@ -0,0 +1,29 @@
+#ifndef BENCHBUS_H
+#define BENCHBUS_H
+
+#include <QProcess>
+#include <QStringList>
+
+// Private session bus with a mock ModemManager on it.
+//
+// start() spawns a dbus-daemon and exports its address as
+// DBUS_SESSION_BUS_ADDRESS, so it must run before anything in the process
+// touches QDBusConnection::sessionBus(). CELLULARPI_MODEM_BUS is set too,
+// which points ModemDBusManager (and therefore Modem) at that bus.
+class BenchBus {
+public:
+    BenchBus() = default;
+    ~BenchBus();
+
+    bool start();
+    bool startMock(const QStringList& arguments = {});
+    void stopMock();
+
+private:
+    QProcess m_daemon;
+    QProcess m_mock;
+
+    static bool waitForService(bool registered, int timeoutMs);
+};
+
+#endif // BENCHBUS_H
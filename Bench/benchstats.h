@@ -0,0 +1,47 @@
+#ifndef BENCHSTATS_H
+#define BENCHSTATS_H
+
+#include <QList>
+#include <algorithm>
+#include <cstdio>
+#include <numeric>
+
+struct LatencySummary {
+    int count{0};
+    double mean{0};
+    double p50{0};
+    double p99{0};
+    double max{0};
+};
+
+inline LatencySummary summarize(QList<double> samples)
+{
+    LatencySummary summary;
+    summary.count = samples.size();
+    if (samples.isEmpty()) {
+        return summary;
+    }
+    std::sort(samples.begin(), samples.end());
+    const auto at = [&samples](double quantile) {
+        return samples.at(qMin<qsizetype>(samples.size() - 1, qsizetype(quantile * samples.size())));
+    };
+    summary.mean = std::accumulate(samples.cbegin(), samples.cend(), 0.0) / samples.size();
+    summary.p50 = at(0.50);
+    summary.p99 = at(0.99);
+    summary.max = samples.last();
+    return summary;
+}
+
+inline void printSummaryHeader(const char *unit)
+{
+    std::printf("%-28s %8s %10s %10s %10s %10s  (%s)\n",
+                "case", "count", "mean", "p50", "p99", "max", unit);
+}
+
+inline void printSummary(const char *name, const LatencySummary &summary)
+{
+    std::printf("%-28s %8d %10.3f %10.3f %10.3f %10.3f\n",
+                name, summary.count, summary.mean, summary.p50, summary.p99, summary.max);
+}
+
+#endif // BENCHSTATS_H
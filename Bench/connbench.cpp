@@ -0,0 +1,156 @@
+// Where REST request time goes under RestClient's connection settings:
+// keep-alive on and off, connections expiring between requests (the
+// cellular link idling out), TLS session tickets and prewarming against
+// that, and the HTTP/1 connection cap under a burst. Prints the mean of
+// each phase of RestResponse::timing per scenario.
+//
+// Without a URL a local plain-HTTP server is used, which shows connection
+// reuse but no TLS; pass an https URL to see handshakes and resumption.
+//
+// usage: connbench [url] [requests] [idle gap ms]
+
+#include "benchstats.h"
+#include "restclient.h"
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTimer>
+#include <cstdio>
+#include <functional>
+
+namespace {
+
+// Answers every request on a connection with a small JSON body
+class EchoServer : public QTcpServer {
+public:
+    EchoServer()
+    {
+        connect(this, &QTcpServer::newConnection, this, [this]() {
+            while (QTcpSocket *socket = nextPendingConnection()) {
+                connect(socket, &QTcpSocket::readyRead, socket, [socket]() {
+                    // Bodies are empty, so every header block is one request
+                    const QByteArray data = socket->readAll();
+                    for (qsizetype at = data.indexOf("\r\n\r\n"); at >= 0;
+                         at = data.indexOf("\r\n\r\n", at + 4)) {
+                        socket->write("HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n"
+                                      "Content-Length: 11\r\n\r\n{\"ok\":true}");
+                    }
+                });
+                connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+            }
+        });
+    }
+};
+
+struct Scenario {
+    const char *name;
+    std::function<void(RestClient &)> configure;
+    int gapMs{0};
+    bool prewarmBeforeEach{false};
+    int burst{1};
+};
+
+void wait(int ms)
+{
+    QEventLoop loop;
+    QTimer::singleShot(ms, &loop, &QEventLoop::quit);
+    loop.exec();
+}
+
+void run(const Scenario &scenario, const QUrl &url, int requests)
+{
+    RestClient client;
+    client.setCacheEnabled(false);
+    client.setBaseUrl(url.adjusted(QUrl::RemovePath | QUrl::RemoveQuery));
+    scenario.configure(client);
+    const QString endpoint = url.path().isEmpty() ? QStringLiteral("/") : url.path();
+
+    QList<double> total;
+    RestResponse::Timing sum;
+    int failed = 0;
+    for (int i = 0; i < requests; ++i) {
+        if (i > 0 && scenario.gapMs > 0) {
+            wait(scenario.gapMs);
+        }
+        if (scenario.prewarmBeforeEach) {
+            // What autoPrewarm does when the network comes back, ahead of
+            // whatever the user does next
+            client.prewarm();
+            wait(300);
+        }
+        QEventLoop loop;
+        int remaining = scenario.burst;
+        for (int b = 0; b < scenario.burst; ++b) {
+            client.get(endpoint, [&](const RestResponse &response) {
+                total << response.elapsedMs;
+                sum.dnsMs += response.timing.dnsMs;
+                sum.connectMs += response.timing.connectMs;
+                sum.sendMs += response.timing.sendMs;
+                sum.ttfbMs += response.timing.ttfbMs;
+                sum.transferMs += response.timing.transferMs;
+                failed += response.ok ? 0 : 1;
+                if (--remaining == 0) {
+                    loop.quit();
+                }
+            });
+        }
+        loop.exec();
+    }
+
+    const double n = qMax<qsizetype>(1, total.size());
+    const LatencySummary summary = summarize(total);
+    std::printf("%-24s %6lld %6d %8.2f %8.2f %8.2f %8.2f %8.2f %8.2f %8.2f %6d\n", scenario.name,
+                qlonglong(total.size()), client.connectionsOpened(), sum.dnsMs / n, sum.connectMs / n,
+                sum.sendMs / n, sum.ttfbMs / n, sum.transferMs / n, summary.p50, summary.p99, failed);
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    const QStringList args = app.arguments();
+    const int requests = args.size() > 2 ? args.at(2).toInt() : 10;
+    const int gapMs = args.size() > 3 ? args.at(3).toInt() : 1500;
+
+    EchoServer server;
+    QUrl url;
+    if (args.size() > 1 && !args.at(1).isEmpty()) {
+        url = QUrl(args.at(1));
+    } else {
+        if (!server.listen(QHostAddress::LocalHost)) {
+            std::fprintf(stderr, "listen failed: %s\n", qPrintable(server.errorString()));
+            return 1;
+        }
+        url = QUrl(QString("http://127.0.0.1:%1/status").arg(server.serverPort()));
+    }
+
+    // keepAliveTimeout is in seconds; the idle gap has to outlast it
+    const int expiring = qMax(1, gapMs / 1000 - 1);
+    const QList<Scenario> scenarios{
+        {"no keep-alive", [](RestClient &c) { c.setKeepAlive(false); }},
+        {"keep-alive", [](RestClient &) {}},
+        {"idle, no tickets", [=](RestClient &c) {
+             c.setKeepAliveTimeout(expiring);
+             c.setTlsSessionReuse(false);
+         }, gapMs},
+        {"idle, tickets", [=](RestClient &c) { c.setKeepAliveTimeout(expiring); }, gapMs},
+        {"idle, tickets+prewarm", [=](RestClient &c) { c.setKeepAliveTimeout(expiring); }, gapMs, true},
+        {"burst 20, 1 conn, h1", [](RestClient &c) {
+             c.setHttp2Enabled(false);
+             c.setMaxConnections(1);
+         }, 0, false, 20},
+        {"burst 20, 6 conn, h1", [](RestClient &c) { c.setHttp2Enabled(false); }, 0, false, 20},
+        {"burst 20, h2", [](RestClient &) {}, 0, false, 20},
+    };
+
+    std::printf("%s\n", qPrintable(url.toString()));
+    std::printf("%-24s %6s %6s %8s %8s %8s %8s %8s %8s %8s %6s  (ms)\n", "scenario", "reqs", "conns",
+                "dns", "connect", "send", "ttfb", "transfer", "p50", "p99", "failed");
+    for (const Scenario &scenario : scenarios) {
+        run(scenario, url, requests);
+    }
+    return 0;
+}
@@ -0,0 +1,160 @@
+// Pushing messages into the headless core over the control socket, the
+// way a local service would: one "send" frame per message, one frame with
+// all of them, and one "bulk" frame. Runs a ControlServer with the real
+// Modem against the mock ModemManager and a client on the socket; prints
+// how fast the frames are accepted (time to the last reply) and how fast
+// the messages are sent (time to the last "sent"/"failed" event).
+//
+// usage: controlbench [messages] [maxInFlight]
+
+#include "benchbus.h"
+#include "controlprotocol.h"
+#include "controlserver.h"
+#include "modem.h"
+#include "restclient.h"
+#include <QCborArray>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QFile>
+#include <QLocalSocket>
+#include <QStandardPaths>
+#include <QTemporaryDir>
+#include <QTimer>
+#include <cstdio>
+#include <functional>
+#include <memory>
+
+namespace {
+
+struct Result {
+    double acceptedMs{0};
+    double doneMs{0};
+    int sent{0};
+    int failed{0};
+};
+
+QString recipient(int i)
+{
+    return QString("+2547%1").arg(i, 8, 10, QChar('0'));
+}
+
+// Writes the frames, then waits until every reply and expected events arrived
+Result run(const QString &socketName, const QList<QCborMap> &frames, int messages, bool bulk)
+{
+    Result result;
+    QLocalSocket socket;
+    socket.connectToServer(socketName);
+    if (!socket.waitForConnected(5000)) {
+        return result;
+    }
+    socket.write(ControlProtocol::encode({{QStringLiteral("cmd"), QStringLiteral("subscribe")}}));
+
+    QEventLoop loop;
+    QByteArray buffer;
+    int replies = -1;   // the subscribe reply
+    int finished = 0;
+    QElapsedTimer clock;
+    QObject::connect(&socket, &QLocalSocket::readyRead, &loop, [&]() {
+        buffer += socket.readAll();
+        QList<QCborMap> incoming;
+        ControlProtocol::decode(buffer, incoming);
+        for (const QCborMap &message : std::as_const(incoming)) {
+            const QString event = message.value(QStringLiteral("event")).toString();
+            if (event.isEmpty()) {
+                if (++replies == frames.size()) {
+                    result.acceptedMs = clock.nsecsElapsed() / 1e6;
+                }
+            } else if (event == QLatin1String("sent") || event == QLatin1String("failed")) {
+                ++(event == QLatin1String("sent") ? result.sent : result.failed);
+                if (!bulk && result.sent + result.failed == messages) {
+                    finished = 1;
+                }
+            } else if (event == QLatin1String("bulkFinished")) {
+                result.sent = int(message.value(QStringLiteral("sent")).toInteger());
+                result.failed = int(message.value(QStringLiteral("failed")).toInteger());
+                finished = 1;
+            }
+            if (finished && replies == frames.size()) {
+                result.doneMs = clock.nsecsElapsed() / 1e6;
+                loop.quit();
+            }
+        }
+    });
+
+    clock.start();
+    for (const QCborMap &frame : frames) {
+        socket.write(ControlProtocol::encode(frame));
+    }
+    QTimer::singleShot(300000, &loop, &QEventLoop::quit);
+    loop.exec();
+    return result;
+}
+
+void report(const char *name, const Result &result, int frames)
+{
+    std::printf("%-18s %8d %12.1f %12.0f %12.1f %12.0f %6d %6d\n", name, frames, result.acceptedMs,
+                result.acceptedMs > 0 ? frames * 1000.0 / result.acceptedMs : 0.0, result.doneMs,
+                result.doneMs > 0 ? (result.sent + result.failed) * 1000.0 / result.doneMs : 0.0,
+                result.sent, result.failed);
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QStandardPaths::setTestModeEnabled(true);
+    QCoreApplication app(argc, argv);
+    const QStringList args = app.arguments();
+    const int messages = args.size() > 1 ? args.at(1).toInt() : 2000;
+    const int maxInFlight = args.size() > 2 ? args.at(2).toInt() : 16;
+
+    BenchBus bus;
+    if (!bus.start() || !bus.startMock({"--create-latency-ms", "2", "--send-latency-ms", "5"})) {
+        return 1;
+    }
+    QFile::remove(QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/outbox.journal");
+
+    Modem modem;
+    modem.setMaxInFlight(maxInFlight);
+    modem.setModemRateLimit(0);
+    modem.setDestinationRateLimit(0);
+    modem.start();
+    RestClient client;
+    QTemporaryDir runtime;
+    ControlServer server(&modem, &client);
+    if (!server.listen(runtime.filePath("control.sock"))) {
+        std::fprintf(stderr, "listen failed: %s\n", qPrintable(server.errorString()));
+        return 1;
+    }
+    // Let the modem show up on the bus
+    QElapsedTimer wait;
+    wait.start();
+    while (modem.modemCount() == 0 && wait.elapsed() < 10000) {
+        QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents, 50);
+    }
+
+    std::printf("%-18s %8s %12s %12s %12s %12s %6s %6s\n", "mode", "frames", "accepted ms", "frames/s",
+                "sent ms", "msgs/s", "sent", "failed");
+
+    QList<QCborMap> single;
+    QCborArray all;
+    QCborArray recipients;
+    for (int i = 0; i < messages; ++i) {
+        single.append({{QStringLiteral("cmd"), QStringLiteral("send")}, {QStringLiteral("id"), i},
+                       {QStringLiteral("to"), recipient(i)}, {QStringLiteral("text"), QStringLiteral("benchmark")}});
+        all.append(QCborMap{{QStringLiteral("to"), recipient(i)}, {QStringLiteral("text"), QStringLiteral("benchmark")}});
+        recipients.append(recipient(i));
+    }
+    report("frame per message", run(server.serverName(), single, messages, false), single.size());
+
+    const QList<QCborMap> batched{{{QStringLiteral("cmd"), QStringLiteral("send")},
+                                   {QStringLiteral("messages"), all}}};
+    report("one send frame", run(server.serverName(), batched, messages, false), 1);
+
+    const QList<QCborMap> bulk{{{QStringLiteral("cmd"), QStringLiteral("bulk")},
+                                {QStringLiteral("recipients"), recipients},
+                                {QStringLiteral("text"), QStringLiteral("benchmark")}}};
+    report("bulk frame", run(server.serverName(), bulk, messages, true), 1);
+    return 0;
+}
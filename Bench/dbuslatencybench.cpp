@@ -0,0 +1,118 @@
+// Per-message D-Bus latency of the SMS hot path against the mock
+// ModemManager: the old introspecting QDBusInterface-per-SMS path versus
+// ModemDBusManager's precompiled asynchronous calls.
+//
+// usage: dbuslatencybench [messages]
+
+#include "benchbus.h"
+#include "benchstats.h"
+#include "modemdbusmanager.h"
+#include "modemmanagerproxy.h"
+#include <QCoreApplication>
+#include <QDBusInterface>
+#include <QDBusPendingReply>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QTimer>
+
+namespace {
+
+const QString ModemPath = QStringLiteral("/org/freedesktop/ModemManager1/Modem/0");
+
+QVariantMap smsProperties(int index)
+{
+    return {{"number", QString("+2547%1").arg(index, 8, 10, QChar('0'))},
+            {"text", QStringLiteral("benchmark")}};
+}
+
+// What handleCreateSMSResponse used to do: a QDBusInterface per message,
+// whose constructor introspects the new object synchronously
+void runIntrospecting(const QDBusConnection &connection, int count,
+                      QList<double> &total, QList<double> &blocked)
+{
+    QDBusInterface messaging(ModemManagerProxy::Service, ModemPath,
+                             ModemManagerProxy::MessagingInterface, connection);
+    for (int i = 0; i < count; ++i) {
+        QElapsedTimer timer;
+        timer.start();
+        QDBusPendingReply<QDBusObjectPath> created = messaging.asyncCall("Create", smsProperties(i));
+        created.waitForFinished();
+
+        QElapsedTimer blockedTimer;
+        blockedTimer.start();
+        QDBusInterface sms(ModemManagerProxy::Service, created.value().path(),
+                           ModemManagerProxy::SmsInterface, connection);
+        blocked << blockedTimer.nsecsElapsed() / 1e6;
+
+        QDBusPendingCall sent = sms.asyncCall("Send");
+        sent.waitForFinished();
+        total << timer.nsecsElapsed() / 1e6;
+    }
+}
+
+// The current path: one message at a time through ModemDBusManager, while a
+// 1 ms timer records how long the event loop was kept from running
+void runAsync(const QDBusConnection &connection, int count,
+              QList<double> &total, QList<double> &stalls)
+{
+    ModemDBusManager manager(connection);
+    // Measure the D-Bus path, not the pacing
+    manager.setRateLimits({0, 1, 0, 1});
+    QEventLoop loop;
+    if (!manager.isReady()) {
+        QObject::connect(&manager, &ModemDBusManager::readyChanged, &loop, &QEventLoop::quit);
+        QTimer::singleShot(5000, &loop, &QEventLoop::quit);
+        loop.exec();
+    }
+
+    QElapsedTimer tick;
+    QTimer ticker;
+    ticker.setInterval(1);
+    QObject::connect(&ticker, &QTimer::timeout, [&]() {
+        stalls << tick.nsecsElapsed() / 1e6;
+        tick.restart();
+    });
+
+    int sent = 0;
+    QObject::connect(&manager, &ModemDBusManager::smsResult,
+                     [&](SmsHandle, bool, const SmsTimeline &timeline) {
+                         total << timeline.totalMs();
+                         if (++sent < count) {
+                             manager.sendSMS(smsProperties(sent)["number"].toString(), "benchmark");
+                         } else {
+                             loop.quit();
+                         }
+                     });
+
+    tick.start();
+    ticker.start();
+    manager.sendSMS(smsProperties(0)["number"].toString(), "benchmark");
+    loop.exec();
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    const int count = app.arguments().size() > 1 ? app.arguments().at(1).toInt() : 500;
+
+    BenchBus bus;
+    if (!bus.start() || !bus.startMock()) {
+        return 1;
+    }
+    const QDBusConnection connection = QDBusConnection::sessionBus();
+
+    QList<double> introspectingTotal, introspectingBlocked;
+    runIntrospecting(connection, count, introspectingTotal, introspectingBlocked);
+
+    QList<double> asyncTotal, asyncStalls;
+    runAsync(connection, count, asyncTotal, asyncStalls);
+
+    printSummaryHeader("ms");
+    printSummary("introspecting: create+send", summarize(introspectingTotal));
+    printSummary("introspecting: blocked", summarize(introspectingBlocked));
+    printSummary("async proxy: create+send", summarize(asyncTotal));
+    printSummary("async proxy: loop tick gap", summarize(asyncStalls));
+    return 0;
+}
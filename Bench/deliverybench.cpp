@@ -0,0 +1,182 @@
+// Delivery reports end to end: the real Modem against the mock ModemManager
+// sending reports a while after each Send. Compares sending without reports,
+// with reports, with a share of them undeliverable and with reports that
+// never come; prints the enqueue-to-report latency, send throughput, and
+// how much resident memory each message still waiting for its report costs.
+//
+// usage: deliverybench [messages] [maxInFlight] [deliveryLatencyMs]
+
+#include "benchbus.h"
+#include "benchstats.h"
+#include "modem.h"
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QFile>
+#include <QStandardPaths>
+#include <QTimer>
+#include <cstdio>
+#include <memory>
+#include <unistd.h>
+
+namespace {
+
+struct Scenario {
+    const char *name;
+    bool reports;
+    QStringList mockArguments;
+    bool expectReports;
+};
+
+struct Result {
+    QList<double> latencies;
+    int sent{0};
+    int failed{0};
+    int delivered{0};
+    int undelivered{0};
+    double sendMs{0};
+    qint64 rssGrowthBytes{0};
+};
+
+const QStringList BaseLatency{"--create-latency-ms", "5", "--send-latency-ms", "20",
+                              "--latency-jitter-ms", "10"};
+
+qint64 residentBytes()
+{
+    QFile statm(QStringLiteral("/proc/self/statm"));
+    if (!statm.open(QIODevice::ReadOnly)) {
+        return 0;
+    }
+    return statm.readAll().split(' ').value(1).toLongLong() * sysconf(_SC_PAGESIZE);
+}
+
+bool waitForModem(Modem *modem)
+{
+    if (modem->modemCount() > 0) {
+        return true;
+    }
+    QEventLoop loop;
+    QObject::connect(modem, &Modem::modemsChanged, &loop, [&]() {
+        if (modem->modemCount() > 0) {
+            loop.quit();
+        }
+    });
+    QTimer::singleShot(10000, &loop, &QEventLoop::quit);
+    loop.exec();
+    return modem->modemCount() > 0;
+}
+
+// Spread over a few networks, as the per-network histograms would see it
+QString recipient(int i)
+{
+    static const char *const prefixes[] = {"+2547", "+2541", "+4915", "+4476"};
+    return QString("%1%2").arg(prefixes[i % 4]).arg(i, 8, 10, QChar('0'));
+}
+
+Result run(Modem *modem, int messages, bool expectReports)
+{
+    Result result;
+    QEventLoop loop;
+    QElapsedTimer clock;
+    bool sending = true;
+    const qint64 rssBefore = residentBytes();
+
+    const auto finished = [&](bool success) {
+        ++(success ? result.sent : result.failed);
+        if (result.sent + result.failed == messages) {
+            result.sendMs = clock.nsecsElapsed() / 1e6;
+            // Everything sent, nothing reported yet when reports are slow
+            result.rssGrowthBytes = residentBytes() - rssBefore;
+            sending = false;
+        }
+    };
+    const auto done = [&]() {
+        if (!sending && (!expectReports || result.delivered + result.undelivered == result.sent)) {
+            loop.quit();
+        }
+    };
+    QObject::connect(modem, &Modem::smsSent, &loop, [&]() {
+        finished(true);
+        done();
+    });
+    QObject::connect(modem, &Modem::smsFailed, &loop, [&]() {
+        finished(false);
+        done();
+    });
+    QObject::connect(modem, &Modem::smsDelivered, &loop, [&](const QString &, double latencyMs) {
+        result.latencies << latencyMs;
+        ++result.delivered;
+        done();
+    });
+    QObject::connect(modem, &Modem::smsUndelivered, &loop, [&]() {
+        ++result.undelivered;
+        done();
+    });
+
+    clock.start();
+    for (int i = 0; i < messages; ++i) {
+        modem->sendSMS(recipient(i), "benchmark");
+    }
+    QTimer::singleShot(300000, &loop, &QEventLoop::quit);
+    loop.exec();
+    return result;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QStandardPaths::setTestModeEnabled(true);
+    QCoreApplication app(argc, argv);
+    const QStringList args = app.arguments();
+    const int messages = args.size() > 1 ? args.at(1).toInt() : 2000;
+    const int maxInFlight = args.size() > 2 ? args.at(2).toInt() : 8;
+    const QString deliveryLatency = args.size() > 3 ? args.at(3) : QStringLiteral("2000");
+
+    const QStringList reporting = BaseLatency + QStringList{"--delivery-latency-ms", deliveryLatency};
+    const Scenario scenarios[] = {
+        {"reports off", false, BaseLatency, false},
+        {"reports on", true, reporting, true},
+        {"10% undelivered", true, reporting + QStringList{"--delivery-failure-rate", "0.1"}, true},
+        {"no report comes", true, BaseLatency, false},
+    };
+
+    BenchBus bus;
+    if (!bus.start()) {
+        return 1;
+    }
+
+    std::printf("%d messages per scenario, maxInFlight %d, reports %s ms after Send\n",
+                messages, maxInFlight, qPrintable(deliveryLatency));
+    printSummaryHeader("ms, enqueue to delivery report");
+    for (const Scenario &scenario : scenarios) {
+        if (!bus.startMock(scenario.mockArguments)) {
+            return 1;
+        }
+        QFile::remove(QStandardPaths::writableLocation(QStandardPaths::AppDataLocation)
+                      + "/outbox.journal");
+
+        auto modem = std::make_unique<Modem>();
+        modem->setMaxInFlight(maxInFlight);
+        modem->setModemRateLimit(0);
+        modem->setDestinationRateLimit(0);
+        modem->setDeliveryReports(scenario.reports);
+        modem->start();
+        if (!waitForModem(modem.get())) {
+            std::fprintf(stderr, "deliverybench: no modem for scenario %s\n", scenario.name);
+            return 1;
+        }
+
+        const Result result = run(modem.get(), messages, scenario.expectReports);
+        printSummary(scenario.name, summarize(result.latencies));
+        std::printf("%-28s %8.1f msgs/sec sent, %d sent, %d failed, %d delivered, %d undelivered, "
+                    "%.0f bytes RSS per sent message\n", "",
+                    result.sendMs > 0 ? result.sent * 1000.0 / result.sendMs : 0.0,
+                    result.sent, result.failed, result.delivered, result.undelivered,
+                    result.sent > 0 ? double(result.rssGrowthBytes) / result.sent : 0.0);
+
+        modem.reset();
+        bus.stopMock();
+    }
+    return 0;
+}
@@ -0,0 +1,153 @@
+// Frame time of an animated QML scene versus SMS throughput through the
+// real Modem class against the mock ModemManager. Three phases:
+//   idle            - animation only
+//   sending         - animation while a burst of SMS is sent
+//   sending+busy UI - same, with every frame burning GUI-thread time
+//
+// usage: frametimebench [messages] [busy ms per frame]
+
+#include "benchbus.h"
+#include "benchstats.h"
+#include "modem.h"
+#include <QGuiApplication>
+#include <QQmlApplicationEngine>
+#include <QQuickWindow>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QFile>
+#include <QStandardPaths>
+#include <QTimer>
+
+namespace {
+
+constexpr char Scene[] = R"(
+import QtQuick
+Window {
+    width: 320; height: 240; visible: true
+    Rectangle {
+        anchors.centerIn: parent; width: 120; height: 120; color: "steelblue"
+        RotationAnimation on rotation { from: 0; to: 360; duration: 1000; loops: Animation.Infinite }
+    }
+}
+)";
+
+struct Phase {
+    QList<double> frames;
+    QList<double> smsLatency;
+    double throughput{0};
+};
+
+class FrameRecorder : public QObject {
+public:
+    FrameRecorder(QQuickWindow *window, int busyMs) : m_busyMs(busyMs)
+    {
+        connect(window, &QQuickWindow::frameSwapped, this, [this]() {
+            if (m_timer.isValid()) {
+                frames << m_timer.nsecsElapsed() / 1e6;
+            }
+            m_timer.restart();
+            if (m_busyMs > 0) {
+                QElapsedTimer busy;
+                busy.start();
+                while (busy.elapsed() < m_busyMs) {
+                }
+            }
+        }, Qt::DirectConnection);
+    }
+    QList<double> frames;
+
+private:
+    QElapsedTimer m_timer;
+    int m_busyMs;
+};
+
+Phase runPhase(QQuickWindow *window, Modem *modem, int messages, int busyMs)
+{
+    Phase phase;
+    QEventLoop loop;
+    FrameRecorder recorder(window, busyMs);
+
+    QHash<QString, qint64> sentAt;
+    QElapsedTimer clock;
+    clock.start();
+    int remaining = messages;
+    const auto finished = [&](const QString &recipient) {
+        phase.smsLatency << (clock.nsecsElapsed() - sentAt.take(recipient)) / 1e6;
+        if (--remaining == 0) {
+            loop.quit();
+        }
+    };
+    const QMetaObject::Connection sent = QObject::connect(modem, &Modem::smsSent, finished);
+    const QMetaObject::Connection failed = QObject::connect(modem, &Modem::smsFailed, finished);
+
+    if (messages == 0) {
+        QTimer::singleShot(2000, &loop, &QEventLoop::quit);
+    } else {
+        for (int i = 0; i < messages; ++i) {
+            const QString recipient = QString("+2547%1").arg(i, 8, 10, QChar('0'));
+            sentAt.insert(recipient, clock.nsecsElapsed());
+            modem->sendSMS(recipient, "benchmark");
+        }
+        QTimer::singleShot(120000, &loop, &QEventLoop::quit);
+    }
+    loop.exec();
+
+    QObject::disconnect(sent);
+    QObject::disconnect(failed);
+    phase.frames = recorder.frames;
+    phase.throughput = modem->throughput();
+    return phase;
+}
+
+void report(const char *name, const Phase &phase)
+{
+    const QByteArray frames = QByteArray(name) + ": frame ms";
+    const QByteArray latency = QByteArray(name) + ": sms ms";
+    printSummary(frames.constData(), summarize(phase.frames));
+    if (!phase.smsLatency.isEmpty()) {
+        printSummary(latency.constData(), summarize(phase.smsLatency));
+        std::printf("%-28s %8.1f msgs/sec\n", name, phase.throughput);
+    }
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QStandardPaths::setTestModeEnabled(true);
+    QQuickWindow::setGraphicsApi(QSGRendererInterface::Software);
+    QGuiApplication app(argc, argv);
+    const int messages = app.arguments().size() > 1 ? app.arguments().at(1).toInt() : 500;
+    const int busyMs = app.arguments().size() > 2 ? app.arguments().at(2).toInt() : 12;
+
+    BenchBus bus;
+    if (!bus.start() || !bus.startMock({"--create-latency-ms", "5", "--send-latency-ms", "20"})) {
+        return 1;
+    }
+    QFile::remove(QStandardPaths::writableLocation(QStandardPaths::AppDataLocation)
+                  + "/outbox.journal");
+
+    QQmlApplicationEngine engine;
+    engine.loadData(Scene);
+    auto *window = qobject_cast<QQuickWindow *>(engine.rootObjects().value(0));
+    if (!window) {
+        return 1;
+    }
+
+    Modem modem;
+    modem.setMaxInFlight(8);
+    // Measure the pipeline, not the pacing
+    modem.setModemRateLimit(0);
+    modem.setDestinationRateLimit(0);
+    modem.start();
+
+    const Phase idle = runPhase(window, &modem, 0, 0);
+    const Phase sending = runPhase(window, &modem, messages, 0);
+    const Phase busy = runPhase(window, &modem, messages, busyMs);
+
+    printSummaryHeader("ms");
+    report("idle", idle);
+    report("sending", sending);
+    report("sending+busy UI", busy);
+    return 0;
+}
@@ -0,0 +1,135 @@
+// Inbound SMS pipeline against the mock ModemManager: an inbound flood of
+// multipart messages is ingested, persisted and deleted from modem storage
+// by ModemDBusManager, then paged through InboxModel.
+//
+// Doubles as the pipeline's end-to-end check: exits non-zero if a message
+// is lost, stored incomplete or twice, or left in modem storage.
+//
+// usage: inboundbench [messages] [msgs/sec] [parts] [storage capacity]
+
+#include "benchbus.h"
+#include "benchstats.h"
+#include "inboxmodel.h"
+#include "modemdbusmanager.h"
+#include "smsinbox.h"
+#include <QCoreApplication>
+#include <QDBusMessage>
+#include <QDBusReply>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QSet>
+#include <QTemporaryDir>
+#include <QTimer>
+#include <cstdio>
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    const QStringList args = app.arguments();
+    const int count = args.size() > 1 ? args.at(1).toInt() : 2000;
+    const double rate = args.size() > 2 ? args.at(2).toDouble() : 200.0;
+    const int parts = args.size() > 3 ? args.at(3).toInt() : 2;
+    const int capacity = args.size() > 4 ? args.at(4).toInt() : 100;
+
+    BenchBus bus;
+    // A head start for the mock checks the Messaging.List catch-up path too
+    if (!bus.start() ||
+        !bus.startMock({"--inbound-count", QString::number(count),
+                        "--inbound-rate", QString::number(rate),
+                        "--inbound-parts", QString::number(parts),
+                        "--storage-capacity", QString::number(capacity)})) {
+        return 1;
+    }
+
+    QTemporaryDir dir;
+    const QString inboxPath = dir.filePath("inbox.log");
+    QFile reader(inboxPath);
+
+    ModemDBusManager manager(QDBusConnection::sessionBus());
+    manager.setInboxPath(inboxPath);
+
+    QEventLoop loop;
+    QList<double> latencies;
+    QList<qint64> offsets;
+    QSet<QString> numbers;
+    int incomplete = 0;
+    int duplicates = 0;
+    QElapsedTimer wall;
+
+    QObject::connect(&manager, &ModemDBusManager::inboxOpened,
+                     [&](const QString &, const QList<qint64> &) {
+                         reader.open(QIODevice::ReadOnly);
+                     });
+    QObject::connect(&manager, &ModemDBusManager::inboxMessagesStored,
+                     [&](const QList<qint64> &stored) {
+                         const QDateTime now = QDateTime::currentDateTime();
+                         for (qint64 offset : stored) {
+                             const std::optional<InboundSms> sms = SmsInbox::read(reader, offset);
+                             if (!sms || !sms->text.endsWith("#end")) {
+                                 ++incomplete;
+                             } else {
+                                 latencies << double(sms->timestamp.msecsTo(now));
+                             }
+                             if (sms && numbers.contains(sms->number)) {
+                                 ++duplicates;
+                             } else if (sms) {
+                                 numbers.insert(sms->number);
+                             }
+                         }
+                         offsets << stored;
+                         if (offsets.size() >= count) {
+                             loop.quit();
+                         }
+                     });
+
+    wall.start();
+    manager.initialize();
+    const int timeoutMs = int(count / rate * 1000) + 30000;
+    QTimer::singleShot(timeoutMs, &loop, &QEventLoop::quit);
+    loop.exec();
+    const qint64 elapsedMs = wall.elapsed();
+
+    // Give the last deletes a moment before asking the mock about storage
+    QTimer::singleShot(500, &loop, &QEventLoop::quit);
+    loop.exec();
+    const QDBusMessage statsCall = QDBusMessage::createMethodCall(
+        "org.freedesktop.ModemManager1", "/org/freedesktop/ModemManager1",
+        "org.cellularpi.Mock", "Stats");
+    const QDBusReply<QVariantMap> statsReply = QDBusConnection::sessionBus().call(statsCall);
+    const QVariantMap stats = statsReply.value();
+
+    // Page through the whole inbox the way a scrolling ListView would
+    InboxModel model;
+    model.reset(inboxPath, offsets);
+    QList<double> pageMs;
+    int row = 0;
+    while (true) {
+        QElapsedTimer page;
+        page.start();
+        for (; row < model.rowCount(); ++row) {
+            model.data(model.index(row), InboxModel::TextRole);
+        }
+        pageMs << page.nsecsElapsed() / 1e6;
+        if (!model.canFetchMore(QModelIndex())) {
+            break;
+        }
+        model.fetchMore(QModelIndex());
+    }
+
+    std::printf("%d messages x %d parts at %.0f msgs/sec, modem storage %d\n",
+                count, parts, rate, capacity);
+    std::printf("stored %lld in %lld ms (%.1f msgs/sec)\n",
+                static_cast<long long>(offsets.size()), static_cast<long long>(elapsedMs),
+                elapsedMs > 0 ? offsets.size() * 1000.0 / elapsedMs : 0.0);
+    std::printf("modem storage: max %d, left %d, overflowed %d, deleted %d\n",
+                stats.value("maxStored").toInt(), stats.value("stored").toInt(),
+                stats.value("overflowed").toInt(), stats.value("deleted").toInt());
+    printSummaryHeader("ms");
+    printSummary("delivered -> persisted", summarize(latencies));
+    printSummary("model page (decode)", summarize(pageMs));
+
+    const bool ok = offsets.size() == count && incomplete == 0 && duplicates == 0 &&
+                    stats.value("overflowed").toInt() == 0 && stats.value("stored").toInt() == 0;
+    std::printf("%s (incomplete %d, duplicates %d)\n", ok ? "PASS" : "FAIL", incomplete, duplicates);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,62 @@
+// Enqueue throughput of SmsJournal per durability level.
+//
+// usage: journalbench [messages] [message length]
+
+#include "smsjournal.h"
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QTemporaryDir>
+#include <cstdio>
+
+namespace {
+
+struct Result {
+    const char *name;
+    qint64 elapsedNs;
+    qint64 bytes;
+};
+
+Result run(SmsJournal::Durability durability, const char *name, int count, const QString &text)
+{
+    QTemporaryDir dir;
+    SmsJournal journal(dir.filePath("outbox.journal"), durability);
+    journal.open();
+
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < count; ++i) {
+        journal.append(QString("+2547%1").arg(i, 8, 10, QChar('0')), text);
+    }
+    // Every level ends fully committed so the numbers are comparable
+    journal.sync();
+    return {name, timer.nsecsElapsed(), journal.logicalSize()};
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    const QStringList args = app.arguments();
+    const int count = args.size() > 1 ? args.at(1).toInt() : 20000;
+    const int length = args.size() > 2 ? args.at(2).toInt() : 140;
+    const QString text(length, QChar('x'));
+
+    const Result results[] = {
+        run(SmsJournal::Durability::None, "none", count, text),
+        run(SmsJournal::Durability::Batched, "batched fsync", count, text),
+        run(SmsJournal::Durability::PerMessage, "per-message fsync", count, text),
+    };
+
+    std::printf("%d messages of %d chars\n", count, length);
+    std::printf("%-20s %12s %14s %12s\n", "durability", "total ms", "msgs/sec", "us/msg");
+    for (const Result &result : results) {
+        const double seconds = result.elapsedNs / 1e9;
+        std::printf("%-20s %12.1f %14.0f %12.2f\n",
+                    result.name,
+                    result.elapsedNs / 1e6,
+                    seconds > 0 ? count / seconds : 0.0,
+                    result.elapsedNs / 1e3 / count);
+    }
+    return 0;
+}
@@ -0,0 +1,223 @@
+// GUI-thread stalls while large JSON responses come in, decoded on the
+// event loop (QNetworkAccessManager + QJsonDocument::fromJson, the way
+// RestClient used to) versus through RestClient, with the body served as
+// application/json and without a Content-Type. A local HTTP server serves
+// arrays of the requested sizes; a 1 ms timer on the main thread records
+// how late each of its ticks is.
+//
+// usage: jsondecodebench [sizes in MB, comma separated] [repetitions]
+
+#include "benchstats.h"
+#include "restclient.h"
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QJsonDocument>
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTimer>
+#include <QUrlQuery>
+#include <cstdio>
+
+namespace {
+
+constexpr int TICK_MS = 1;
+constexpr qint64 WRITE_CHUNK = 64 * 1024;
+
+QByteArray makeArray(qint64 bytes)
+{
+    QByteArray body("[");
+    body.reserve(bytes + 256);
+    for (int i = 0; body.size() < bytes; ++i) {
+        if (i > 0) {
+            body += ',';
+        }
+        body += QByteArray(R"({"id":)") + QByteArray::number(i)
+                + R"(,"name":"item )" + QByteArray::number(i)
+                + R"(","tags":["alpha","beta"],"value":)" + QByteArray::number(i * 0.5)
+                + R"(,"active":true})";
+    }
+    body += ']';
+    return body;
+}
+
+// Answers GET /array?mb=N with a JSON array of about N megabytes, without
+// a Content-Type header when untyped=1 is added
+class PayloadServer : public QTcpServer {
+public:
+    PayloadServer()
+    {
+        connect(this, &QTcpServer::newConnection, this, [this]() {
+            while (QTcpSocket *socket = nextPendingConnection()) {
+                connect(socket, &QTcpSocket::readyRead, socket, [this, socket]() { serve(socket); });
+                connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+            }
+        });
+    }
+
+private:
+    QHash<int, QByteArray> m_bodies;
+
+    void serve(QTcpSocket *socket)
+    {
+        const QByteArray request = socket->readAll();
+        const QByteArray target = request.mid(4, request.indexOf(' ', 4) - 4);
+        const QUrlQuery query(QUrl(QString::fromLatin1(target)).query());
+        const int mb = query.queryItemValue("mb").toInt();
+        const bool untyped = query.queryItemValue("untyped") == "1";
+        auto body = m_bodies.find(mb);
+        if (body == m_bodies.end()) {
+            body = m_bodies.insert(mb, makeArray(qint64(mb) * 1024 * 1024));
+        }
+        socket->write(QByteArray("HTTP/1.1 200 OK\r\n")
+                      + (untyped ? "" : "Content-Type: application/json\r\n")
+                      + "Content-Length: " + QByteArray::number(body->size())
+                      + "\r\nConnection: close\r\n\r\n");
+        for (qint64 offset = 0; offset < body->size(); offset += WRITE_CHUNK) {
+            socket->write(body->mid(offset, WRITE_CHUNK));
+        }
+        socket->disconnectFromHost();
+    }
+};
+
+// How late each tick of a TICK_MS timer fires, i.e. how long the event
+// loop was blocked
+class StallMonitor : public QObject {
+public:
+    StallMonitor()
+    {
+        m_timer.setTimerType(Qt::PreciseTimer);
+        m_timer.setInterval(TICK_MS);
+        connect(&m_timer, &QTimer::timeout, this, [this]() {
+            stalls << qMax(0.0, m_clock.nsecsElapsed() / 1e6 - TICK_MS);
+            m_clock.restart();
+        });
+    }
+    void start()
+    {
+        stalls.clear();
+        m_clock.start();
+        m_timer.start();
+    }
+    void stop() { m_timer.stop(); }
+    QList<double> stalls;
+
+private:
+    QTimer m_timer;
+    QElapsedTimer m_clock;
+};
+
+struct Run {
+    double wallMs{0};
+    QList<double> stalls;
+    bool ok{false};
+};
+
+Run baseline(QNetworkAccessManager &manager, const QUrl &url, StallMonitor &monitor)
+{
+    Run run;
+    QEventLoop loop;
+    QElapsedTimer clock;
+    monitor.start();
+    clock.start();
+    QNetworkReply *reply = manager.get(QNetworkRequest(url));
+    QObject::connect(reply, &QNetworkReply::finished, &loop, [&]() {
+        const QJsonDocument json = QJsonDocument::fromJson(reply->readAll());
+        // What handing it to QML costs on top of the parse
+        const QVariant variant = json.toVariant();
+        run.ok = variant.isValid();
+        reply->deleteLater();
+        loop.quit();
+    });
+    loop.exec();
+    run.wallMs = clock.nsecsElapsed() / 1e6;
+    monitor.stop();
+    run.stalls = monitor.stalls;
+    return run;
+}
+
+Run restClient(RestClient &client, const QString &endpoint, StallMonitor &monitor)
+{
+    Run run;
+    QEventLoop loop;
+    QElapsedTimer clock;
+    monitor.start();
+    clock.start();
+    client.get(endpoint, [&](const RestResponse &response) {
+        run.ok = response.ok && response.jsonVariant.isValid();
+        loop.quit();
+    });
+    loop.exec();
+    run.wallMs = clock.nsecsElapsed() / 1e6;
+    monitor.stop();
+    run.stalls = monitor.stalls;
+    return run;
+}
+
+void report(const char *mode, int mb, const QList<Run> &runs)
+{
+    QList<double> wall;
+    QList<double> stalls;
+    bool ok = true;
+    for (const Run &run : runs) {
+        wall << run.wallMs;
+        stalls += run.stalls;
+        ok = ok && run.ok;
+    }
+    const LatencySummary stall = summarize(stalls);
+    std::printf("%-10s %6d %12.1f %12.2f %12.2f  %s\n", mode, mb, summarize(wall).p50, stall.p99,
+                stall.max, ok ? "ok" : "FAILED");
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    const QStringList args = app.arguments();
+    QList<int> sizes{1, 5, 10, 25, 50};
+    if (args.size() > 1) {
+        sizes.clear();
+        for (const QString &size : args.at(1).split(',', Qt::SkipEmptyParts)) {
+            sizes << size.toInt();
+        }
+    }
+    const int repetitions = args.size() > 2 ? args.at(2).toInt() : 3;
+
+    PayloadServer server;
+    if (!server.listen(QHostAddress::LocalHost)) {
+        std::fprintf(stderr, "listen failed: %s\n", qPrintable(server.errorString()));
+        return 1;
+    }
+    const QUrl base(QString("http://127.0.0.1:%1").arg(server.serverPort()));
+
+    QNetworkAccessManager manager;
+    RestClient client;
+    client.setBaseUrl(base);
+    client.setCacheEnabled(false);
+    // A listener makes RestClient build the QML view as well, like the baseline
+    QObject::connect(&client, &RestClient::finished, &client, [](int, const QVariantMap &) {});
+
+    StallMonitor monitor;
+    std::printf("%-10s %6s %12s %12s %12s\n", "mode", "MB", "wall p50 ms", "stall p99", "stall max");
+    for (const int mb : sizes) {
+        const QString endpoint = QString("/array?mb=%1").arg(mb);
+        // Warm the server's copy of the body
+        baseline(manager, base.resolved(QUrl(endpoint)), monitor);
+
+        QList<Run> onEventLoop;
+        QList<Run> offThread;
+        QList<Run> untyped;
+        for (int i = 0; i < repetitions; ++i) {
+            onEventLoop << baseline(manager, base.resolved(QUrl(endpoint)), monitor);
+            offThread << restClient(client, endpoint, monitor);
+            untyped << restClient(client, endpoint + "&untyped=1", monitor);
+        }
+        report("inline", mb, onEventLoop);
+        report("restclient", mb, offThread);
+        report("untyped", mb, untyped);
+    }
+    return 0;
+}
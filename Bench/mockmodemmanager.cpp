@@ -0,0 +1,440 @@
+#include "mockmodemmanager.h"
+#include <QDBusArgument>
+#include <QDBusMessage>
+#include <QDBusMetaType>
+#include <QDBusObjectPath>
+#include <QTimer>
+#include <QRandomGenerator>
+#include <QDateTime>
+
+namespace {
+
+constexpr char Service[] = "org.freedesktop.ModemManager1";
+constexpr char ManagerPath[] = "/org/freedesktop/ModemManager1";
+constexpr char ObjectManagerInterface[] = "org.freedesktop.DBus.ObjectManager";
+constexpr char ModemInterface[] = "org.freedesktop.ModemManager1.Modem";
+constexpr char Modem3gppInterface[] = "org.freedesktop.ModemManager1.Modem.Modem3gpp";
+constexpr char MessagingInterface[] = "org.freedesktop.ModemManager1.Modem.Messaging";
+constexpr char SmsInterface[] = "org.freedesktop.ModemManager1.Sms";
+constexpr char PropertiesInterface[] = "org.freedesktop.DBus.Properties";
+constexpr char MockInterface[] = "org.cellularpi.Mock";
+
+constexpr uint SmsStateReceiving = 2;
+constexpr uint SmsStateReceived = 3;
+constexpr uint DeliveryStateReceived = 0x00;
+constexpr uint DeliveryStateNotObtainable = 0x43;
+constexpr int ModemStateSearching = 7;
+constexpr int ModemStateRegistered = 8;
+constexpr uint RegistrationHome = 1;
+constexpr uint RegistrationSearching = 2;
+constexpr uint AccessTechnologyLte = 1 << 14;
+constexpr int INJECT_TICK_MS = 10;
+constexpr int PART_LENGTH = 150;
+
+// Modem.SignalQuality is a (ub) struct
+QVariant signalQuality(uint percent)
+{
+    QDBusArgument quality;
+    quality.beginStructure();
+    quality << percent << true;
+    quality.endStructure();
+    return QVariant::fromValue(quality);
+}
+
+} // namespace
+
+MockModemManager::MockModemManager(const QDBusConnection &connection, const MockConfig &config,
+                                   QObject *parent)
+    : QDBusVirtualObject(parent)
+    , m_connection(connection)
+    , m_config(config)
+{
+    qDBusRegisterMetaType<InterfaceMap>();
+    qDBusRegisterMetaType<ManagedObjects>();
+}
+
+bool MockModemManager::registerOnBus()
+{
+    if (!m_connection.registerVirtualObject(ManagerPath, this, QDBusConnection::SubPath) ||
+        !m_connection.registerService(Service)) {
+        return false;
+    }
+    if (m_config.modemDelayMs > 0) {
+        QTimer::singleShot(m_config.modemDelayMs, this, &MockModemManager::addModems);
+    } else {
+        m_modemsPresent = true;
+    }
+    if (m_config.inboundCount > 0) {
+        QTimer::singleShot(m_config.inboundDelayMs, this, &MockModemManager::startInbound);
+    }
+    if (m_config.vanishEveryMs > 0) {
+        auto *timer = new QTimer(this);
+        timer->setInterval(m_config.vanishEveryMs);
+        connect(timer, &QTimer::timeout, this, &MockModemManager::vanish);
+        timer->start();
+    }
+    if (m_config.radioDownEveryMs > 0) {
+        auto *timer = new QTimer(this);
+        timer->setInterval(m_config.radioDownEveryMs);
+        connect(timer, &QTimer::timeout, this, [this]() {
+            setRadioDown(true);
+            QTimer::singleShot(m_config.radioDownForMs, this, [this]() { setRadioDown(false); });
+        });
+        timer->start();
+    }
+    return true;
+}
+
+MockModemManager::InterfaceMap MockModemManager::modemInterfaces() const
+{
+    InterfaceMap interfaces;
+    interfaces.insert(ModemInterface, QVariantMap{
+        {"Manufacturer", "CellularPi mock"},
+        {"State", m_radioDown ? ModemStateSearching : ModemStateRegistered},
+        {"AccessTechnologies", AccessTechnologyLte},
+        {"SignalQuality", signalQuality(m_radioDown ? 0 : uint(m_config.signalQuality))}});
+    interfaces.insert(Modem3gppInterface, QVariantMap{
+        {"RegistrationState", m_radioDown ? RegistrationSearching : RegistrationHome}});
+    interfaces.insert(MessagingInterface, QVariantMap());
+    return interfaces;
+}
+
+void MockModemManager::addModems()
+{
+    m_modemsPresent = true;
+    for (int i = 0; i < m_config.modems; ++i) {
+        QDBusMessage added = QDBusMessage::createSignal(ManagerPath, ObjectManagerInterface,
+                                                        "InterfacesAdded");
+        added << QVariant::fromValue(QDBusObjectPath(modemPath(i)))
+              << QVariant::fromValue(modemInterfaces());
+        m_connection.send(added);
+    }
+}
+
+QString MockModemManager::introspect(const QString &path) const
+{
+    if (path == QLatin1String(ManagerPath)) {
+        return QString("<interface name=\"%1\">"
+                       "<method name=\"GetManagedObjects\">"
+                       "<arg type=\"a{oa{sa{sv}}}\" direction=\"out\"/>"
+                       "</method></interface>").arg(ObjectManagerInterface);
+    }
+    if (isModemPath(path)) {
+        return QString("<interface name=\"%1\">"
+                       "<method name=\"Create\">"
+                       "<arg name=\"properties\" type=\"a{sv}\" direction=\"in\"/>"
+                       "<arg name=\"path\" type=\"o\" direction=\"out\"/>"
+                       "</method></interface>").arg(MessagingInterface);
+    }
+    if (m_smsPaths.contains(path)) {
+        return QString("<interface name=\"%1\"><method name=\"Send\"/></interface>")
+            .arg(SmsInterface);
+    }
+    return QString();
+}
+
+bool MockModemManager::handleMessage(const QDBusMessage &message, const QDBusConnection &)
+{
+    const QString interface = message.interface();
+    const QString member = message.member();
+
+    if (interface == QLatin1String(ObjectManagerInterface) && member == QLatin1String("GetManagedObjects")) {
+        handleGetManagedObjects(message);
+        return true;
+    }
+    if (interface == QLatin1String(MessagingInterface) && member == QLatin1String("Create")) {
+        handleCreate(message);
+        return true;
+    }
+    if (interface == QLatin1String(SmsInterface) && member == QLatin1String("Send")) {
+        handleSend(message);
+        return true;
+    }
+    if (interface == QLatin1String(MessagingInterface) && member == QLatin1String("List")) {
+        handleList(message);
+        return true;
+    }
+    if (interface == QLatin1String(MessagingInterface) && member == QLatin1String("Delete")) {
+        handleDelete(message);
+        return true;
+    }
+    if (interface == QLatin1String(PropertiesInterface) && member == QLatin1String("GetAll")) {
+        handleGetAll(message);
+        return true;
+    }
+    if (interface == QLatin1String(MockInterface) && member == QLatin1String("Stats")) {
+        handleStats(message);
+        return true;
+    }
+    return false;
+}
+
+QString MockModemManager::modemPath(int index) const
+{
+    return QString("%1/Modem/%2").arg(ManagerPath).arg(index);
+}
+
+bool MockModemManager::isModemPath(const QString &path) const
+{
+    if (!m_modemsPresent) {
+        return false;
+    }
+    for (int i = 0; i < m_config.modems; ++i) {
+        if (path == modemPath(i)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void MockModemManager::handleGetManagedObjects(const QDBusMessage &message)
+{
+    ManagedObjects objects;
+    for (int i = 0; m_modemsPresent && i < m_config.modems; ++i) {
+        objects.insert(QDBusObjectPath(modemPath(i)), modemInterfaces());
+    }
+    m_connection.send(message.createReply(QVariant::fromValue(objects)));
+}
+
+void MockModemManager::handleCreate(const QDBusMessage &message)
+{
+    if (!isModemPath(message.path())) {
+        m_connection.send(message.createErrorReply(QDBusError::UnknownObject, "No such modem"));
+        return;
+    }
+    if (injectError(message, m_config.createErrorRate, m_config.createLatencyMs)) {
+        return;
+    }
+    const QString path = QString("%1/SMS/%2").arg(ManagerPath).arg(m_nextSms++);
+    m_smsPaths.insert(path);
+    const QVariantMap properties = qdbus_cast<QVariantMap>(message.arguments().value(0));
+    if (properties.value("delivery-report-request").toBool()) {
+        m_reportRequested.insert(path);
+    }
+    replyLater(message.createReply(QVariant::fromValue(QDBusObjectPath(path))),
+               m_config.createLatencyMs);
+}
+
+void MockModemManager::handleSend(const QDBusMessage &message)
+{
+    if (!m_smsPaths.contains(message.path())) {
+        m_connection.send(message.createErrorReply(QDBusError::UnknownObject, "No such SMS"));
+        return;
+    }
+    if (m_radioDown) {
+        replyLater(message.createErrorReply(QDBusError::Failed, "No network"), m_config.sendLatencyMs);
+        return;
+    }
+    if (injectError(message, m_config.sendErrorRate, m_config.sendLatencyMs)) {
+        return;
+    }
+    if (m_reportRequested.remove(message.path()) && m_config.deliveryLatencyMs >= 0) {
+        // Kept for its report, the client deletes it once that came; after
+        // the Send reply however much jitter that gets
+        reportDeliveryLater(message.path(), m_config.sendLatencyMs + m_config.latencyJitterMs
+                                                + m_config.deliveryLatencyMs);
+    } else {
+        // A sent message stays in modem storage until someone deletes it; the
+        // mock forgets it right away to keep long benchmark runs flat
+        m_smsPaths.remove(message.path());
+    }
+    replyLater(message.createReply(), m_config.sendLatencyMs);
+}
+
+void MockModemManager::reportDeliveryLater(const QString &smsPath, int delayMs)
+{
+    if (m_config.latencyJitterMs > 0) {
+        delayMs += int(QRandomGenerator::global()->bounded(m_config.latencyJitterMs + 1));
+    }
+    QTimer::singleShot(delayMs, this, [this, smsPath]() {
+        // Deleted, or lost in a restart
+        if (!m_smsPaths.contains(smsPath)) {
+            return;
+        }
+        const bool failed = QRandomGenerator::global()->generateDouble() < m_config.deliveryFailureRate;
+        QDBusMessage signal = QDBusMessage::createSignal(smsPath, PropertiesInterface, "PropertiesChanged");
+        signal << QString(SmsInterface)
+               << QVariantMap{{"DeliveryState", failed ? DeliveryStateNotObtainable : DeliveryStateReceived}}
+               << QStringList();
+        m_connection.send(signal);
+    });
+}
+
+void MockModemManager::replyLater(const QDBusMessage &reply, int delayMs)
+{
+    if (m_config.latencyJitterMs > 0) {
+        delayMs += int(QRandomGenerator::global()->bounded(m_config.latencyJitterMs + 1));
+    }
+    if (delayMs <= 0) {
+        m_connection.send(reply);
+        return;
+    }
+    QTimer::singleShot(delayMs, this, [this, reply]() { m_connection.send(reply); });
+}
+
+void MockModemManager::startInbound()
+{
+    auto *timer = new QTimer(this);
+    timer->setInterval(INJECT_TICK_MS);
+    timer->setTimerType(Qt::PreciseTimer);
+    connect(timer, &QTimer::timeout, this, [this, timer]() {
+        m_injectBudget += m_config.inboundRate * INJECT_TICK_MS / 1000.0;
+        while (m_injectBudget >= 1.0 && m_injected < m_config.inboundCount) {
+            m_injectBudget -= 1.0;
+            injectInbound();
+        }
+        if (m_injected >= m_config.inboundCount) {
+            timer->stop();
+            timer->deleteLater();
+        }
+    });
+    timer->start();
+}
+
+int MockModemManager::storedOn(int modem) const
+{
+    int stored = 0;
+    for (const Inbound &sms : m_inbound) {
+        stored += sms.modem == modem ? 1 : 0;
+    }
+    return stored;
+}
+
+void MockModemManager::injectInbound()
+{
+    const int index = m_injected++;
+    const int modem = index % qMax(1, m_config.modems);
+    if (!m_modemsPresent || storedOn(modem) >= m_config.storageCapacity) {
+        ++m_overflowed;
+        return;
+    }
+
+    // Self-describing text so the receiving side can tell a complete
+    // message from a partial one
+    const int parts = qMax(1, m_config.inboundParts);
+    Inbound sms;
+    sms.modem = modem;
+    sms.number = QString("+2547%1").arg(index, 8, 10, QChar('0'));
+    sms.text = QString("inbound %1 ").arg(index).leftJustified(parts * PART_LENGTH - 4, '.') + "#end";
+    sms.timestamp = QDateTime::currentDateTime().toString(Qt::ISODateWithMs);
+    sms.state = parts > 1 ? SmsStateReceiving : SmsStateReceived;
+
+    const QString path = QString("%1/SMS/%2").arg(ManagerPath).arg(m_nextSms++);
+    m_inbound.insert(path, sms);
+    m_maxStored = qMax(m_maxStored, int(m_inbound.size()));
+
+    if (parts > 1) {
+        QTimer::singleShot(m_config.partDelayMs * (parts - 1), this, [this, path]() {
+            const auto it = m_inbound.find(path);
+            if (it != m_inbound.end()) {
+                it->state = SmsStateReceived;
+            }
+        });
+    }
+
+    QDBusMessage added = QDBusMessage::createSignal(modemPath(modem), MessagingInterface, "Added");
+    added << QVariant::fromValue(QDBusObjectPath(path)) << true;
+    m_connection.send(added);
+}
+
+void MockModemManager::handleList(const QDBusMessage &message)
+{
+    if (!isModemPath(message.path())) {
+        m_connection.send(message.createErrorReply(QDBusError::UnknownObject, "No such modem"));
+        return;
+    }
+    QList<QDBusObjectPath> paths;
+    for (auto it = m_inbound.cbegin(); it != m_inbound.cend(); ++it) {
+        if (modemPath(it->modem) == message.path()) {
+            paths.append(QDBusObjectPath(it.key()));
+        }
+    }
+    m_connection.send(message.createReply(QVariant::fromValue(paths)));
+}
+
+void MockModemManager::handleDelete(const QDBusMessage &message)
+{
+    const QString path = message.arguments().value(0).value<QDBusObjectPath>().path();
+    if (m_inbound.remove(path) > 0) {
+        ++m_deleted;
+    } else if (!m_smsPaths.remove(path)) {
+        m_connection.send(message.createErrorReply(QDBusError::UnknownObject, "No such SMS"));
+        return;
+    }
+    m_connection.send(message.createReply());
+}
+
+void MockModemManager::handleGetAll(const QDBusMessage &message)
+{
+    const auto it = m_inbound.constFind(message.path());
+    if (it == m_inbound.constEnd()) {
+        m_connection.send(message.createErrorReply(QDBusError::UnknownObject, "No such SMS"));
+        return;
+    }
+    // Until the last part is in, only the first one is readable
+    const bool complete = it->state == SmsStateReceived;
+    const QVariantMap properties{
+        {"State", it->state},
+        {"PduType", uint(1)},
+        {"Number", it->number},
+        {"Text", complete ? it->text : it->text.left(PART_LENGTH)},
+        {"Timestamp", it->timestamp},
+    };
+    m_connection.send(message.createReply(QVariant::fromValue(properties)));
+}
+
+void MockModemManager::handleStats(const QDBusMessage &message)
+{
+    const QVariantMap stats{
+        {"injected", m_injected},
+        {"stored", int(m_inbound.size())},
+        {"maxStored", m_maxStored},
+        {"overflowed", m_overflowed},
+        {"deleted", m_deleted},
+        {"injectedErrors", m_injectedErrors},
+        {"vanished", m_vanishCount},
+    };
+    m_connection.send(message.createReply(QVariant::fromValue(stats)));
+}
+
+bool MockModemManager::injectError(const QDBusMessage &message, double errorRate, int delayMs)
+{
+    if (errorRate <= 0 || m_config.errorTypes.isEmpty() ||
+        QRandomGenerator::global()->generateDouble() >= errorRate) {
+        return false;
+    }
+    const QDBusError::ErrorType type = m_config.errorTypes.at(
+        int(QRandomGenerator::global()->bounded(int(m_config.errorTypes.size()))));
+    ++m_injectedErrors;
+    replyLater(message.createErrorReply(type, "Injected by mockmodemmanager"), delayMs);
+    return true;
+}
+
+void MockModemManager::setRadioDown(bool down)
+{
+    m_radioDown = down;
+    const InterfaceMap interfaces = modemInterfaces();
+    for (int i = 0; m_modemsPresent && i < m_config.modems; ++i) {
+        for (const QString &interface : {QString(ModemInterface), QString(Modem3gppInterface)}) {
+            QDBusMessage changed = QDBusMessage::createSignal(modemPath(i), PropertiesInterface,
+                                                              "PropertiesChanged");
+            changed << interface << interfaces.value(interface) << QStringList();
+            m_connection.send(changed);
+        }
+    }
+}
+
+void MockModemManager::vanish()
+{
+    ++m_vanishCount;
+    m_connection.unregisterService(Service);
+    m_modemsPresent = false;
+
+    QTimer::singleShot(m_config.vanishForMs, this, [this]() {
+        // Objects do not survive a restart
+        m_smsPaths.clear();
+        m_reportRequested.clear();
+        m_modemsPresent = true;
+        m_connection.registerService(Service);
+    });
+}
@@ -0,0 +1,130 @@
+#ifndef MOCKMODEMMANAGER_H
+#define MOCKMODEMMANAGER_H
+
+#include <QDBusVirtualObject>
+#include <QDBusConnection>
+#include <QDBusObjectPath>
+#include <QMap>
+#include <QSet>
+#include <QVariantMap>
+#include <QDBusError>
+#include <QList>
+
+// Behaviour knobs of the fake ModemManager
+struct MockConfig {
+    int createLatencyMs{0};
+    int sendLatencyMs{0};
+    // Each reply is delayed by up to this much more, uniformly
+    int latencyJitterMs{0};
+    int modems{1};
+    // Modems show up (InterfacesAdded) this long after the service does
+    int modemDelayMs{0};
+
+    // Inbound traffic: inboundCount messages at inboundRate msgs/sec, each
+    // made of inboundParts parts that arrive partDelayMs apart, starting
+    // inboundDelayMs after registration. Messages beyond storageCapacity
+    // stored per modem are lost, as on a full SIM.
+    int inboundCount{0};
+    double inboundRate{100.0};
+    int inboundParts{1};
+    int partDelayMs{50};
+    int inboundDelayMs{0};
+    int storageCapacity{255};
+
+    // Error injection: this share of Create / Send calls fails with one of
+    // errorTypes, picked at random
+    double createErrorRate{0.0};
+    double sendErrorRate{0.0};
+    QList<QDBusError::ErrorType> errorTypes{QDBusError::Failed};
+
+    // Service disappearance: every vanishEveryMs the service drops off the
+    // bus for vanishForMs and comes back with its SMS objects gone, like a
+    // ModemManager restart
+    int vanishEveryMs{0};
+    int vanishForMs{500};
+
+    // Delivery reports: a message created with delivery-report-request gets
+    // its final DeliveryState this long after the Send reply, -1 for never.
+    // deliveryFailureRate of them are reported undeliverable.
+    int deliveryLatencyMs{-1};
+    double deliveryFailureRate{0.0};
+
+    // Radio: modems report State, SignalQuality and RegistrationState.
+    // Every radioDownEveryMs the radio loses the network for radioDownForMs;
+    // Send fails meanwhile, as it does on a real modem that is searching.
+    int signalQuality{80};
+    int radioDownEveryMs{0};
+    int radioDownForMs{2000};
+};
+
+// Minimal org.freedesktop.ModemManager1 for benchmarks.
+//
+// Serves the object tree under /org/freedesktop/ModemManager1 as a virtual
+// object so every path (modems, created SMS objects) is answered without
+// registering a QObject per path. Replies are sent after the configured
+// latency, which keeps the mock itself non-blocking. Inbound messages are
+// announced with Messaging.Added; org.cellularpi.Mock.Stats() reports how
+// storage fared.
+class MockModemManager : public QDBusVirtualObject {
+    Q_OBJECT
+public:
+    using InterfaceMap = QMap<QString, QVariantMap>;
+    using ManagedObjects = QMap<QDBusObjectPath, InterfaceMap>;
+
+    MockModemManager(const QDBusConnection& connection, const MockConfig& config,
+                     QObject* parent = nullptr);
+
+    bool registerOnBus();
+
+    QString introspect(const QString& path) const override;
+    bool handleMessage(const QDBusMessage& message, const QDBusConnection& connection) override;
+
+private:
+    QDBusConnection m_connection;
+    MockConfig m_config;
+    quint64 m_nextSms{0};
+    bool m_modemsPresent{false};
+    bool m_radioDown{false};
+    QSet<QString> m_smsPaths;
+    QSet<QString> m_reportRequested;
+
+    struct Inbound {
+        int modem{0};
+        uint state{0};
+        QString number;
+        QString text;
+        QString timestamp;
+    };
+    QMap<QString, Inbound> m_inbound;
+    int m_injected{0};
+    int m_overflowed{0};
+    int m_deleted{0};
+    int m_maxStored{0};
+    double m_injectBudget{0.0};
+    int m_vanishCount{0};
+    int m_injectedErrors{0};
+
+    QString modemPath(int index) const;
+    bool isModemPath(const QString& path) const;
+    InterfaceMap modemInterfaces() const;
+    void addModems();
+    void handleGetManagedObjects(const QDBusMessage& message);
+    void handleCreate(const QDBusMessage& message);
+    void handleSend(const QDBusMessage& message);
+    void replyLater(const QDBusMessage& reply, int delayMs);
+    void reportDeliveryLater(const QString& smsPath, int delayMs);
+    // Error reply instead of the real one, rolled against errorRate
+    bool injectError(const QDBusMessage& message, double errorRate, int delayMs);
+    void vanish();
+    void setRadioDown(bool down);
+
+    void startInbound();
+    void injectInbound();
+    int storedOn(int modem) const;
+    void handleList(const QDBusMessage& message);
+    void handleDelete(const QDBusMessage& message);
+    void handleGetAll(const QDBusMessage& message);
+    void handleStats(const QDBusMessage& message);
+};
+
+#endif // MOCKMODEMMANAGER_H
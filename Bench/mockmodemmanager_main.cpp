@@ -0,0 +1,103 @@
+// Fake org.freedesktop.ModemManager1 on the session bus, see BenchBus
+
+#include "mockmodemmanager.h"
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QHash>
+#include <cstdio>
+
+namespace {
+
+// "Failed,NoReply" -> error types, by their QDBusError enum names
+QList<QDBusError::ErrorType> parseErrorTypes(const QString &names)
+{
+    static const QHash<QString, QDBusError::ErrorType> known{
+        {"Failed", QDBusError::Failed},
+        {"NoReply", QDBusError::NoReply},
+        {"Timeout", QDBusError::Timeout},
+        {"TimedOut", QDBusError::TimedOut},
+        {"InvalidArgs", QDBusError::InvalidArgs},
+        {"UnknownObject", QDBusError::UnknownObject},
+        {"ServiceUnknown", QDBusError::ServiceUnknown},
+        {"LimitsExceeded", QDBusError::LimitsExceeded},
+        {"AccessDenied", QDBusError::AccessDenied},
+    };
+    QList<QDBusError::ErrorType> types;
+    for (const QString &name : names.split(',', Qt::SkipEmptyParts)) {
+        const auto it = known.constFind(name.trimmed());
+        if (it == known.constEnd()) {
+            std::fprintf(stderr, "mockmodemmanager: unknown error type %s\n", qPrintable(name));
+            continue;
+        }
+        types.append(*it);
+    }
+    return types;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    const QCommandLineOption createLatency("create-latency-ms", "Create reply delay", "ms", "0");
+    const QCommandLineOption sendLatency("send-latency-ms", "Send reply delay", "ms", "0");
+    const QCommandLineOption modems("modems", "Number of messaging modems", "count", "1");
+    const QCommandLineOption modemDelay("modem-delay-ms", "Announce modems this late", "ms", "0");
+    const QCommandLineOption inboundCount("inbound-count", "Inbound messages to deliver", "count", "0");
+    const QCommandLineOption inboundRate("inbound-rate", "Inbound messages per second", "rate", "100");
+    const QCommandLineOption inboundParts("inbound-parts", "Parts per inbound message", "count", "1");
+    const QCommandLineOption partDelay("part-delay-ms", "Delay between parts", "ms", "50");
+    const QCommandLineOption inboundDelay("inbound-delay-ms", "Start inbound traffic this late", "ms", "0");
+    const QCommandLineOption storage("storage-capacity", "Stored messages per modem", "count", "255");
+    const QCommandLineOption jitter("latency-jitter-ms", "Extra random reply delay", "ms", "0");
+    const QCommandLineOption createErrors("create-error-rate", "Share of failing Create calls", "0..1", "0");
+    const QCommandLineOption sendErrors("send-error-rate", "Share of failing Send calls", "0..1", "0");
+    const QCommandLineOption errorTypes("error-types", "Injected QDBusError types", "Failed,NoReply,...", "Failed");
+    const QCommandLineOption vanishEvery("vanish-every-ms", "Drop off the bus this often", "ms", "0");
+    const QCommandLineOption vanishFor("vanish-for-ms", "Stay away this long", "ms", "500");
+    const QCommandLineOption deliveryLatency("delivery-latency-ms",
+                                             "Delivery report delay after Send, -1 for none", "ms", "-1");
+    const QCommandLineOption deliveryFailures("delivery-failure-rate", "Share of undeliverable messages",
+                                              "0..1", "0");
+    const QCommandLineOption signal("signal-quality", "Reported signal quality", "percent", "80");
+    const QCommandLineOption radioDownEvery("radio-down-every-ms", "Lose the network this often", "ms", "0");
+    const QCommandLineOption radioDownFor("radio-down-for-ms", "Stay without network this long", "ms", "2000");
+    parser.addOptions({createLatency, sendLatency, modems, modemDelay,
+                       inboundCount, inboundRate, inboundParts, partDelay, inboundDelay, storage,
+                       jitter, createErrors, sendErrors, errorTypes, vanishEvery, vanishFor,
+                       deliveryLatency, deliveryFailures, signal, radioDownEvery, radioDownFor});
+    parser.process(app);
+
+    MockConfig config;
+    config.createLatencyMs = parser.value(createLatency).toInt();
+    config.sendLatencyMs = parser.value(sendLatency).toInt();
+    config.modems = parser.value(modems).toInt();
+    config.modemDelayMs = parser.value(modemDelay).toInt();
+    config.inboundCount = parser.value(inboundCount).toInt();
+    config.inboundRate = parser.value(inboundRate).toDouble();
+    config.inboundParts = parser.value(inboundParts).toInt();
+    config.partDelayMs = parser.value(partDelay).toInt();
+    config.inboundDelayMs = parser.value(inboundDelay).toInt();
+    config.storageCapacity = parser.value(storage).toInt();
+    config.latencyJitterMs = parser.value(jitter).toInt();
+    config.createErrorRate = parser.value(createErrors).toDouble();
+    config.sendErrorRate = parser.value(sendErrors).toDouble();
+    config.errorTypes = parseErrorTypes(parser.value(errorTypes));
+    config.vanishEveryMs = parser.value(vanishEvery).toInt();
+    config.vanishForMs = parser.value(vanishFor).toInt();
+    config.deliveryLatencyMs = parser.value(deliveryLatency).toInt();
+    config.deliveryFailureRate = parser.value(deliveryFailures).toDouble();
+    config.signalQuality = parser.value(signal).toInt();
+    config.radioDownEveryMs = parser.value(radioDownEvery).toInt();
+    config.radioDownForMs = parser.value(radioDownFor).toInt();
+
+    MockModemManager manager(QDBusConnection::sessionBus(), config);
+    if (!manager.registerOnBus()) {
+        std::fprintf(stderr, "mockmodemmanager: failed to register on the session bus\n");
+        return 1;
+    }
+    return app.exec();
+}
@@ -0,0 +1,151 @@
+// End-to-end SMS throughput and latency of the real Modem class against
+// the mock ModemManager, across scenarios the hardware throws at it:
+// plain latency, several modems, injected D-Bus errors of the kinds
+// shouldRetryOperation() handles, ModemManager dropping off the bus, and
+// radio dropouts with and without link pacing.
+//
+// usage: modembench [messages] [maxInFlight] [scenario name filter]
+
+#include "benchbus.h"
+#include "benchstats.h"
+#include "modem.h"
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QFile>
+#include <QStandardPaths>
+#include <QTimer>
+#include <memory>
+
+namespace {
+
+struct Scenario {
+    const char *name;
+    QStringList mockArguments;
+    bool linkPacing{true};
+};
+
+struct Result {
+    QList<double> latencies;
+    int sent{0};
+    int failed{0};
+    double elapsedMs{0};
+};
+
+const QStringList BaseLatency{"--create-latency-ms", "5", "--send-latency-ms", "20",
+                              "--latency-jitter-ms", "10"};
+
+bool waitForModem(Modem *modem)
+{
+    if (modem->modemCount() > 0) {
+        return true;
+    }
+    QEventLoop loop;
+    QObject::connect(modem, &Modem::modemsChanged, &loop, [&]() {
+        if (modem->modemCount() > 0) {
+            loop.quit();
+        }
+    });
+    QTimer::singleShot(10000, &loop, &QEventLoop::quit);
+    loop.exec();
+    return modem->modemCount() > 0;
+}
+
+Result run(Modem *modem, int messages)
+{
+    Result result;
+    QEventLoop loop;
+    QHash<QString, qint64> sentAt;
+    QElapsedTimer clock;
+    clock.start();
+
+    int remaining = messages;
+    const auto finished = [&](const QString &recipient, bool success) {
+        result.latencies << (clock.nsecsElapsed() - sentAt.take(recipient)) / 1e6;
+        ++(success ? result.sent : result.failed);
+        if (--remaining == 0) {
+            loop.quit();
+        }
+    };
+    QObject::connect(modem, &Modem::smsSent, &loop, [&](const QString &r) { finished(r, true); });
+    QObject::connect(modem, &Modem::smsFailed, &loop, [&](const QString &r) { finished(r, false); });
+
+    for (int i = 0; i < messages; ++i) {
+        const QString recipient = QString("+2547%1").arg(i, 8, 10, QChar('0'));
+        sentAt.insert(recipient, clock.nsecsElapsed());
+        modem->sendSMS(recipient, "benchmark");
+    }
+    QTimer::singleShot(300000, &loop, &QEventLoop::quit);
+    loop.exec();
+    result.elapsedMs = clock.nsecsElapsed() / 1e6;
+    return result;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QStandardPaths::setTestModeEnabled(true);
+    QCoreApplication app(argc, argv);
+    const QStringList args = app.arguments();
+    const int messages = args.size() > 1 ? args.at(1).toInt() : 1000;
+    const int maxInFlight = args.size() > 2 ? args.at(2).toInt() : 8;
+    const QString filter = args.size() > 3 ? args.at(3) : QString();
+
+    const Scenario scenarios[] = {
+        {"baseline", BaseLatency},
+        {"2 modems", BaseLatency + QStringList{"--modems", "2"}},
+        {"4 modems", BaseLatency + QStringList{"--modems", "4"}},
+        {"5% create Failed", BaseLatency + QStringList{"--create-error-rate", "0.05"}},
+        {"5% send mixed errors", BaseLatency + QStringList{
+             "--send-error-rate", "0.05",
+             "--error-types", "Failed,InvalidArgs,UnknownObject,NoReply"}},
+        {"service flapping", BaseLatency + QStringList{
+             "--vanish-every-ms", "3000", "--vanish-for-ms", "300"}},
+        {"radio dropouts", BaseLatency + QStringList{
+             "--radio-down-every-ms", "3000", "--radio-down-for-ms", "1000"}},
+        {"radio dropouts, unpaced", BaseLatency + QStringList{
+             "--radio-down-every-ms", "3000", "--radio-down-for-ms", "1000"}, false},
+    };
+
+    BenchBus bus;
+    if (!bus.start()) {
+        return 1;
+    }
+
+    std::printf("%d messages per scenario, maxInFlight %d\n", messages, maxInFlight);
+    printSummaryHeader("ms");
+    for (const Scenario &scenario : scenarios) {
+        if (!filter.isEmpty() && !QString(scenario.name).contains(filter)) {
+            continue;
+        }
+        if (!bus.startMock(scenario.mockArguments)) {
+            return 1;
+        }
+        // Every scenario starts with an empty outbox
+        QFile::remove(QStandardPaths::writableLocation(QStandardPaths::AppDataLocation)
+                      + "/outbox.journal");
+
+        auto modem = std::make_unique<Modem>();
+        modem->setMaxInFlight(maxInFlight);
+        // Measure the pipeline, not the pacing
+        modem->setModemRateLimit(0);
+        modem->setDestinationRateLimit(0);
+        modem->setLinkPacing(scenario.linkPacing);
+        modem->start();
+        if (!waitForModem(modem.get())) {
+            std::fprintf(stderr, "modembench: no modem for scenario %s\n", scenario.name);
+            return 1;
+        }
+
+        const Result result = run(modem.get(), messages);
+        printSummary(scenario.name, summarize(result.latencies));
+        std::printf("%-28s %8.1f msgs/sec, %d sent, %d failed\n", "",
+                    result.elapsedMs > 0 ? result.sent * 1000.0 / result.elapsedMs : 0.0,
+                    result.sent, result.failed);
+
+        modem.reset();
+        bus.stopMock();
+    }
+    return 0;
+}
@@ -0,0 +1,212 @@
+// Delivery reports competing with polling on a link that gets slower the
+// more requests share it. A local HTTP server answers each request after
+// a base delay plus a share per request already in progress. Polling GETs
+// are fired in a burst at the start and a report POST goes out every
+// report interval; the latency of both is printed per scenario:
+//
+//   unbounded   every call on the wire at once, one priority (as before)
+//   scheduled   4 concurrent, polling Low, reports High (one slot reserved)
+//   deadline    as scheduled, polls given up after the poll timeout
+//   flaky       as scheduled, a fifth of the polls answered 503 and retried
+//
+// usage: schedbench [polls] [reports] [base delay ms] [per active ms]
+
+#include "benchstats.h"
+#include "restclient.h"
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTimer>
+#include <cstdio>
+#include <functional>
+
+namespace {
+
+constexpr int REPORT_INTERVAL_MS = 200;
+constexpr int POLL_TIMEOUT_MS = 2000;
+
+// Keep-alive HTTP/1.1 server with a response time that grows with load
+class SlowServer : public QTcpServer {
+public:
+    SlowServer(int baseMs, int perActiveMs)
+        : m_baseMs(baseMs)
+        , m_perActiveMs(perActiveMs)
+    {
+        connect(this, &QTcpServer::newConnection, this, [this]() {
+            while (QTcpSocket *socket = nextPendingConnection()) {
+                connect(socket, &QTcpSocket::readyRead, socket, [this, socket]() { read(socket); });
+                connect(socket, &QTcpSocket::disconnected, socket, [this, socket]() {
+                    m_buffers.remove(socket);
+                    socket->deleteLater();
+                });
+            }
+        });
+    }
+
+    void reset(int failEvery)
+    {
+        m_failEvery = failEvery;
+        m_polls = 0;
+        peakActive = 0;
+    }
+
+    int peakActive{0};
+
+private:
+    int m_baseMs;
+    int m_perActiveMs;
+    int m_active{0};
+    int m_failEvery{0};
+    int m_polls{0};
+    QHash<QTcpSocket *, QByteArray> m_buffers;
+
+    void read(QTcpSocket *socket)
+    {
+        QByteArray &buffer = m_buffers[socket];
+        buffer += socket->readAll();
+        for (;;) {
+            const qsizetype headEnd = buffer.indexOf("\r\n\r\n");
+            if (headEnd < 0) {
+                return;
+            }
+            const QByteArray head = buffer.left(headEnd).toLower();
+            const qsizetype lengthAt = head.indexOf("content-length:");
+            const qsizetype length = lengthAt < 0
+                                         ? 0
+                                         : head.mid(lengthAt + 15, head.indexOf('\r', lengthAt) - lengthAt - 15)
+                                               .trimmed()
+                                               .toLongLong();
+            if (buffer.size() < headEnd + 4 + length) {
+                return;
+            }
+            respond(socket, head.startsWith("get "));
+            buffer.remove(0, headEnd + 4 + length);
+        }
+    }
+
+    void respond(QTcpSocket *socket, bool poll)
+    {
+        const bool fail = poll && m_failEvery > 0 && ++m_polls % m_failEvery == 0;
+        ++m_active;
+        peakActive = qMax(peakActive, m_active);
+        QTimer::singleShot(m_baseMs + m_perActiveMs * (m_active - 1), socket, [this, socket, fail]() {
+            --m_active;
+            socket->write(fail ? QByteArray("HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\n\r\n")
+                               : QByteArray("HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n"
+                                            "Content-Length: 11\r\n\r\n{\"ok\":true}"));
+        });
+    }
+};
+
+struct Scenario {
+    const char *name;
+    std::function<void(RestClient &)> configure;
+    RequestOptions poll;
+    RequestOptions report;
+    int failEvery{0};
+};
+
+void run(const Scenario &scenario, SlowServer &server, const QUrl &base, int polls, int reports)
+{
+    server.reset(scenario.failEvery);
+    RestClient client;
+    client.setCacheEnabled(false);
+    client.setBaseUrl(base);
+    scenario.configure(client);
+
+    QList<double> pollMs;
+    QList<double> reportMs;
+    int pollsFailed = 0;
+    int reportsFailed = 0;
+    int remaining = polls + reports;
+    QEventLoop loop;
+    QElapsedTimer wall;
+    wall.start();
+
+    // Distinct URLs, so nothing is coalesced
+    for (int i = 0; i < polls; ++i) {
+        client.get(QString("/poll/%1").arg(i), [&](const RestResponse &response) {
+            pollMs << response.elapsedMs;
+            pollsFailed += response.ok ? 0 : 1;
+            if (--remaining == 0) {
+                loop.quit();
+            }
+        }, scenario.poll);
+    }
+    int sent = 0;
+    QTimer reportTimer;
+    QObject::connect(&reportTimer, &QTimer::timeout, &loop, [&]() {
+        if (sent++ == reports) {
+            reportTimer.stop();
+            return;
+        }
+        client.post("/reports", QVariantMap{{"ok", true}}, [&](const RestResponse &response) {
+            reportMs << response.elapsedMs;
+            reportsFailed += response.ok ? 0 : 1;
+            if (--remaining == 0) {
+                loop.quit();
+            }
+        }, scenario.report);
+    });
+    reportTimer.start(REPORT_INTERVAL_MS);
+    loop.exec();
+
+    const LatencySummary report = summarize(reportMs);
+    const LatencySummary poll = summarize(pollMs);
+    std::printf("%-10s %10.1f %10.1f %8d %10.1f %10.1f %8d %8d %8d %10.0f\n", scenario.name, report.p50,
+                report.p99, reportsFailed, poll.p50, poll.p99, pollsFailed, client.retriedRequests(),
+                server.peakActive, wall.nsecsElapsed() / 1e6);
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    const QStringList args = app.arguments();
+    const int polls = args.size() > 1 ? args.at(1).toInt() : 200;
+    const int reports = args.size() > 2 ? args.at(2).toInt() : 20;
+    const int baseMs = args.size() > 3 ? args.at(3).toInt() : 50;
+    const int perActiveMs = args.size() > 4 ? args.at(4).toInt() : 40;
+
+    SlowServer server(baseMs, perActiveMs);
+    if (!server.listen(QHostAddress::LocalHost)) {
+        std::fprintf(stderr, "listen failed: %s\n", qPrintable(server.errorString()));
+        return 1;
+    }
+    const QUrl base(QString("http://127.0.0.1:%1").arg(server.serverPort()));
+
+    const auto scheduled = [](RestClient &c) {
+        c.setMaxConcurrentRequests(4);
+        c.setReservedRequests(1);
+    };
+    RequestOptions low;
+    low.priority = RequestScheduler::Priority::Low;
+    low.timeoutMs = 0;
+    RequestOptions lowDeadline = low;
+    lowDeadline.timeoutMs = POLL_TIMEOUT_MS;
+    RequestOptions high;
+    high.priority = RequestScheduler::Priority::High;
+    high.timeoutMs = 0;
+    RequestOptions normal;
+    normal.timeoutMs = 0;
+
+    const QList<Scenario> scenarios{
+        {"unbounded", [](RestClient &c) {
+             c.setMaxConcurrentRequests(100000);
+             c.setReservedRequests(0);
+         }, normal, normal},
+        {"scheduled", scheduled, low, high},
+        {"deadline", scheduled, lowDeadline, high},
+        {"flaky", scheduled, low, high, 5},
+    };
+
+    std::printf("%-10s %10s %10s %8s %10s %10s %8s %8s %8s %10s  (ms)\n", "scenario", "report p50",
+                "report p99", "failed", "poll p50", "poll p99", "failed", "retries", "peak", "wall");
+    for (const Scenario &scenario : scenarios) {
+        run(scenario, server, base, polls, reports);
+    }
+    return 0;
+}
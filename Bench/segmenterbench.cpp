@@ -0,0 +1,96 @@
+// Throughput of SmsSegmenter over generated corpora.
+//
+// usage: segmenterbench [messages] [mean message length]
+
+#include "smssegmenter.h"
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QRandomGenerator>
+#include <QStringList>
+#include <cstdio>
+
+namespace {
+
+// Each corpus is drawn from one alphabet, so every message lands on the
+// same code path: all-basic GSM-7, GSM-7 with extension characters,
+// typography that transliterates to GSM-7, and true UCS-2 text
+struct Corpus {
+    const char *name;
+    QString alphabet;
+};
+
+QStringList generate(const QString &alphabet, int count, int meanLength)
+{
+    QRandomGenerator random(42);
+    QStringList messages;
+    messages.reserve(count);
+    for (int i = 0; i < count; ++i) {
+        const int length = meanLength / 2 + int(random.bounded(meanLength + 1));
+        QString text(length, Qt::Uninitialized);
+        for (int j = 0; j < length; ++j) {
+            text[j] = alphabet.at(int(random.bounded(alphabet.size())));
+        }
+        messages.append(text);
+    }
+    return messages;
+}
+
+template<typename Fn>
+double timeNs(const QStringList &messages, Fn &&fn)
+{
+    QElapsedTimer timer;
+    timer.start();
+    for (const QString &message : messages) {
+        fn(message);
+    }
+    return double(timer.nsecsElapsed());
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    const QStringList args = app.arguments();
+    const int count = args.size() > 1 ? args.at(1).toInt() : 200000;
+    const int meanLength = args.size() > 2 ? args.at(2).toInt() : 200;
+
+    const Corpus corpora[] = {
+        {"gsm7", QStringLiteral("abcdefghijklmnopqrstuvwxyz ABCXYZ 0123456789.,!?")},
+        {"gsm7 + extension", QStringLiteral("abcdefghijklmnopqrstuvwxyz {}[]~|^€ 0123")},
+        {"typographic", QStringLiteral("abcdefghij klmnop ‘’“”–… áíóú")},
+        {"ucs2", QStringLiteral("абвгдежзийклмнопрст 你好世界 abc")},
+    };
+
+    std::printf("%d messages, mean %d chars\n", count, meanLength);
+    std::printf("%-18s %-12s %12s %14s %12s %10s\n",
+                "corpus", "operation", "total ms", "msgs/sec", "MB/s", "segments");
+    for (const Corpus &corpus : corpora) {
+        const QStringList messages = generate(corpus.alphabet, count, meanLength);
+        qint64 bytes = 0;
+        for (const QString &message : messages) {
+            bytes += message.size() * qsizetype(sizeof(QChar));
+        }
+
+        qint64 segments = 0;
+        const double analyzeNs = timeNs(messages, [&segments](const QString &message) {
+            segments += SmsSegmenter::analyze(message).segments;
+        });
+        qint64 transliteratedSegments = 0;
+        const double transliterateNs = timeNs(messages, [&transliteratedSegments](const QString &message) {
+            transliteratedSegments +=
+                SmsSegmenter::analyze(SmsSegmenter::transliterate(message)).segments;
+        });
+
+        const auto print = [&](const char *operation, double ns, qint64 totalSegments) {
+            std::printf("%-18s %-12s %12.1f %14.0f %12.1f %10lld\n",
+                        corpus.name, operation, ns / 1e6,
+                        ns > 0 ? count / (ns / 1e9) : 0.0,
+                        ns > 0 ? bytes / (ns / 1e9) / 1e6 : 0.0,
+                        static_cast<long long>(totalSegments));
+        };
+        print("analyze", analyzeNs, segments);
+        print("translit", transliterateNs, transliteratedSegments);
+    }
+    return 0;
+}
@@ -0,0 +1,218 @@
+// Bytes on the air per reported record: one POST per record, as RestClient
+// callers did so far, versus BatchUploader batches with and without gzip.
+// A local HTTP server counts the bytes of every request and response and
+// unpacks the batches to check nothing was lost. HTTP bytes are measured;
+// the on-air column adds an estimate of what TCP/IP and TLS put around
+// them (per 1400 byte segment and per TLS record, no handshakes: the
+// connections are kept alive). A last run fails the first requests with
+// 503 and checks that the spooled batches arrive complete and in order.
+//
+// usage: uploadbench [records] [max records per batch]
+
+#include "batchuploader.h"
+#include "gzip.h"
+#include "restclient.h"
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QStandardPaths>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTemporaryDir>
+#include <cstdio>
+#include <functional>
+
+namespace {
+
+constexpr int SEGMENT_BYTES = 1400;
+constexpr int IP_TCP_HEADER_BYTES = 40;
+constexpr int TLS_RECORD_BYTES = 16 * 1024;
+constexpr int TLS_RECORD_OVERHEAD = 29;
+
+double onAir(qint64 httpBytes, qint64 messages)
+{
+    const qint64 segments = (httpBytes + SEGMENT_BYTES - 1) / SEGMENT_BYTES;
+    const qint64 tlsRecords = messages + httpBytes / TLS_RECORD_BYTES;
+    return httpBytes + segments * IP_TCP_HEADER_BYTES + tlsRecords * TLS_RECORD_OVERHEAD;
+}
+
+// Keep-alive HTTP/1.1 sink that answers every request with {} (or 503)
+class CountingServer : public QTcpServer {
+public:
+    CountingServer()
+    {
+        connect(this, &QTcpServer::newConnection, this, [this]() {
+            while (QTcpSocket *socket = nextPendingConnection()) {
+                connect(socket, &QTcpSocket::readyRead, socket, [this, socket]() { read(socket); });
+                connect(socket, &QTcpSocket::disconnected, socket, [this, socket]() {
+                    m_buffers.remove(socket);
+                    socket->deleteLater();
+                });
+            }
+        });
+    }
+
+    void reset(int failFirst = 0)
+    {
+        requests = 0;
+        requestBytes = 0;
+        responseBytes = 0;
+        records = 0;
+        outOfOrder = 0;
+        m_lastSequence = 0;
+        m_failRemaining = failFirst;
+    }
+
+    qint64 requests{0};
+    qint64 requestBytes{0};
+    qint64 responseBytes{0};
+    qint64 records{0};
+    int outOfOrder{0};
+
+private:
+    QHash<QTcpSocket *, QByteArray> m_buffers;
+    quint64 m_lastSequence{0};
+    int m_failRemaining{0};
+
+    static QByteArray header(const QByteArray &head, const QByteArray &name)
+    {
+        for (const QByteArray &line : head.split('\n')) {
+            const qsizetype colon = line.indexOf(':');
+            if (colon > 0 && line.left(colon).trimmed().toLower() == name) {
+                return line.mid(colon + 1).trimmed();
+            }
+        }
+        return {};
+    }
+
+    void read(QTcpSocket *socket)
+    {
+        QByteArray &buffer = m_buffers[socket];
+        buffer += socket->readAll();
+        for (;;) {
+            const qsizetype headEnd = buffer.indexOf("\r\n\r\n");
+            if (headEnd < 0) {
+                return;
+            }
+            const QByteArray head = buffer.left(headEnd);
+            const qsizetype length = header(head, "content-length").toLongLong();
+            const qsizetype total = headEnd + 4 + length;
+            if (buffer.size() < total) {
+                return;
+            }
+            handle(socket, head, buffer.mid(headEnd + 4, length), total);
+            buffer.remove(0, total);
+        }
+    }
+
+    void handle(QTcpSocket *socket, const QByteArray &head, const QByteArray &body, qint64 size)
+    {
+        ++requests;
+        requestBytes += size;
+
+        QByteArray response;
+        if (m_failRemaining > 0) {
+            --m_failRemaining;
+            response = "HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\n\r\n";
+        } else {
+            const QByteArray json = header(head, "content-encoding") == "gzip" ? Gzip::decompress(body)
+                                                                               : body;
+            const QJsonDocument document = QJsonDocument::fromJson(json);
+            records += document.isArray() ? document.array().size() : document.isObject() ? 1 : 0;
+            const QByteArray sequence = header(head, "x-batch-sequence");
+            if (!sequence.isEmpty()) {
+                if (sequence.toULongLong() <= m_lastSequence) {
+                    ++outOfOrder;
+                }
+                m_lastSequence = sequence.toULongLong();
+            }
+            response = "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: 2\r\n\r\n{}";
+        }
+        responseBytes += response.size();
+        socket->write(response);
+    }
+};
+
+QVariantMap makeRecord(int i)
+{
+    return {{"type", "delivery"},
+            {"recipient", QString("+2547%1").arg(i, 8, 10, QChar('0'))},
+            {"ok", i % 17 != 0},
+            {"modem", QString("/org/freedesktop/ModemManager1/Modem/%1").arg(i % 2)},
+            {"latencyMs", 800 + (i * 37) % 900},
+            {"ts", 1760000000000LL + i * 250LL}};
+}
+
+void waitFor(const std::function<bool()> &done, int timeoutMs)
+{
+    QElapsedTimer clock;
+    clock.start();
+    while (!done() && clock.elapsed() < timeoutMs) {
+        QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents, 50);
+    }
+}
+
+void report(const char *name, const CountingServer &server, int records)
+{
+    const double perRecord = records > 0 ? 1.0 / records : 0;
+    const double air = onAir(server.requestBytes, server.requests)
+                       + onAir(server.responseBytes, server.requests);
+    std::printf("%-14s %8lld %8lld %12.1f %12.1f %12.1f  %s\n", name, server.requests, server.records,
+                server.requestBytes * perRecord, server.responseBytes * perRecord, air * perRecord,
+                server.records == records && server.outOfOrder == 0 ? "PASS" : "FAIL");
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QStandardPaths::setTestModeEnabled(true);
+    const QStringList args = app.arguments();
+    const int records = args.size() > 1 ? args.at(1).toInt() : 1000;
+    const int batchRecords = args.size() > 2 ? args.at(2).toInt() : 100;
+
+    CountingServer server;
+    if (!server.listen(QHostAddress::LocalHost)) {
+        std::fprintf(stderr, "listen failed: %s\n", qPrintable(server.errorString()));
+        return 1;
+    }
+    RestClient client;
+    client.setBaseUrl(QUrl(QString("http://127.0.0.1:%1").arg(server.serverPort())));
+
+    std::printf("%-14s %8s %8s %12s %12s %12s\n", "mode", "requests", "records", "req B/rec",
+                "resp B/rec", "on-air B/rec");
+
+    // One request per record
+    server.reset();
+    int done = 0;
+    for (int i = 0; i < records; ++i) {
+        client.post("/reports", makeRecord(i), [&done](const RestResponse &) { ++done; });
+    }
+    waitFor([&]() { return done == records; }, 60000);
+    report("per-record", server, records);
+
+    QTemporaryDir spool;
+    const auto runBatched = [&](const char *name, bool compress, int failFirst) {
+        server.reset(failFirst);
+        BatchUploader uploader;
+        uploader.setSpoolPath(spool.filePath(name));
+        uploader.setClient(&client);
+        uploader.setEndpoint("/reports");
+        uploader.setMaxRecords(batchRecords);
+        uploader.setMaxBytes(1024 * 1024);
+        uploader.setCompress(compress);
+        for (int i = 0; i < records; ++i) {
+            uploader.append(makeRecord(i));
+        }
+        uploader.flush();
+        waitFor([&]() { return uploader.recordsSent() == records; }, 120000);
+        report(name, server, records);
+    };
+    runBatched("batched", false, 0);
+    runBatched("batched+gzip", true, 0);
+    runBatched("outage", true, 2);
+    return 0;
+}
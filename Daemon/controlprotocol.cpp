@@ -0,0 +1,44 @@
+#include "controlprotocol.h"
+#include <QCborValue>
+#include <QtEndian>
+
+namespace ControlProtocol {
+
+QByteArray encode(const QCborMap &message)
+{
+    const QByteArray payload = message.toCborValue().toCbor();
+    QByteArray frame(HEADER_BYTES, Qt::Uninitialized);
+    qToBigEndian<quint32>(quint32(payload.size()), frame.data());
+    frame += payload;
+    return frame;
+}
+
+bool decode(QByteArray &buffer, QList<QCborMap> &messages)
+{
+    qsizetype offset = 0;
+    bool ok = true;
+    while (buffer.size() - offset >= HEADER_BYTES) {
+        const quint32 length = qFromBigEndian<quint32>(buffer.constData() + offset);
+        if (length > quint32(MAX_FRAME_BYTES)) {
+            ok = false;
+            break;
+        }
+        if (buffer.size() - offset - HEADER_BYTES < qsizetype(length)) {
+            break;
+        }
+        QCborParserError error;
+        const QCborValue value = QCborValue::fromCbor(buffer.constData() + offset + HEADER_BYTES,
+                                                      qsizetype(length), &error);
+        if (error.error != QCborError::NoError || !value.isMap()) {
+            ok = false;
+            break;
+        }
+        messages.append(value.toMap());
+        offset += HEADER_BYTES + length;
+    }
+    // One move for all the frames taken
+    buffer.remove(0, offset);
+    return ok;
+}
+
+} // namespace ControlProtocol
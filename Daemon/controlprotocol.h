@@ -0,0 +1,41 @@
+#ifndef CONTROLPROTOCOL_H
+#define CONTROLPROTOCOL_H
+
+#include <QByteArray>
+#include <QCborMap>
+#include <QList>
+
+// Framing of the headless control socket: every message is a CBOR map
+// preceded by its length as a 32-bit big-endian integer. CBOR keeps
+// frames small and needs no text escaping; any language has a codec.
+//
+// Requests carry "cmd" and an optional "id" echoed in the reply:
+//   send     {to, text} or {messages: [{to, text}, ...]} -> {queued}
+//   bulk     {recipients, text, variables?} -> {batch, accepted,
+//            duplicates, rejected}, then "bulkProgress" / "bulkFinished"
+//            events for the batch on the same connection
+//   status   -> {queued, inFlight, throughput, modemCount, modems, radio,
+//            rest}
+//   metrics  -> {text} in Prometheus text format
+//   rest     {method, endpoint, body?, priority?, timeout?} -> {status,
+//            ok, error, elapsedMs, body}
+//   subscribe -> "sent" / "failed" events {to} for every message, then
+//            "delivered" {to, latencyMs} / "undelivered" {to, reason}
+//            once its delivery report is in
+// Replies have "ok" and, when it is false, "error". Events have "event"
+// instead of "id".
+namespace ControlProtocol {
+
+static constexpr int HEADER_BYTES = 4;
+static constexpr int MAX_FRAME_BYTES = 16 * 1024 * 1024;
+
+QByteArray encode(const QCborMap& message);
+
+// Moves the complete frames at the front of buffer into messages. False
+// when a frame is oversized or not a CBOR map; the connection is beyond
+// repair then, as the stream cannot be resynchronised.
+bool decode(QByteArray& buffer, QList<QCborMap>& messages);
+
+} // namespace ControlProtocol
+
+#endif // CONTROLPROTOCOL_H
@@ -0,0 +1,330 @@
+#include "controlserver.h"
+#include "controlprotocol.h"
+#include "logging.h"
+#include "metricsregistry.h"
+#include "modem.h"
+#include "restclient.h"
+#include <QCborArray>
+#include <QDir>
+#include <QFileInfo>
+#include <QLocalServer>
+#include <QLocalSocket>
+
+ControlServer::ControlServer(Modem *modem, RestClient *client, QObject *parent)
+    : QObject(parent)
+    , m_modem(modem)
+    , m_client(client)
+{
+    connect(m_modem, &Modem::bulkQueued, this,
+            [this](int batchId, int accepted, int duplicates, const QStringList &rejected) {
+                const PendingBulk pending = m_pendingBulks.take(batchId);
+                if (!pending.socket) {
+                    return;
+                }
+                m_batchOwners.insert(batchId, pending.socket);
+                reply(pending.socket, pending.id,
+                      {{QStringLiteral("batch"), batchId},
+                       {QStringLiteral("accepted"), accepted},
+                       {QStringLiteral("duplicates"), duplicates},
+                       {QStringLiteral("rejected"), QCborArray::fromStringList(rejected)}});
+            });
+    connect(m_modem, &Modem::bulkProgress, this, [this](int batchId, int sent, int failed, int total) {
+        // A dropped update is superseded by the next one or by bulkFinished
+        if (QLocalSocket *socket = m_batchOwners.value(batchId)) {
+            writeEvent(socket, ControlProtocol::encode({{QStringLiteral("event"), QStringLiteral("bulkProgress")},
+                                                        {QStringLiteral("batch"), batchId},
+                                                        {QStringLiteral("sent"), sent},
+                                                        {QStringLiteral("failed"), failed},
+                                                        {QStringLiteral("total"), total}}));
+        }
+    });
+    connect(m_modem, &Modem::bulkFinished, this, [this](int batchId, int sent, int failed) {
+        // Written past the backlog limit too: one frame per batch, and the
+        // client would otherwise wait for it forever
+        if (QLocalSocket *socket = m_batchOwners.take(batchId)) {
+            socket->write(ControlProtocol::encode({{QStringLiteral("event"), QStringLiteral("bulkFinished")},
+                                                   {QStringLiteral("batch"), batchId},
+                                                   {QStringLiteral("sent"), sent},
+                                                   {QStringLiteral("failed"), failed}}));
+        }
+    });
+    connect(m_modem, &Modem::smsSent, this, [this](const QString &recipient) {
+        broadcast({{QStringLiteral("event"), QStringLiteral("sent")}, {QStringLiteral("to"), recipient}});
+    });
+    connect(m_modem, &Modem::smsFailed, this, [this](const QString &recipient) {
+        broadcast({{QStringLiteral("event"), QStringLiteral("failed")}, {QStringLiteral("to"), recipient}});
+    });
+    connect(m_modem, &Modem::smsDelivered, this, [this](const QString &recipient, double latencyMs) {
+        broadcast({{QStringLiteral("event"), QStringLiteral("delivered")}, {QStringLiteral("to"), recipient},
+                   {QStringLiteral("latencyMs"), latencyMs}});
+    });
+    connect(m_modem, &Modem::smsUndelivered, this, [this](const QString &recipient, const QString &reason) {
+        broadcast({{QStringLiteral("event"), QStringLiteral("undelivered")}, {QStringLiteral("to"), recipient},
+                   {QStringLiteral("reason"), reason}});
+    });
+}
+
+ControlServer::~ControlServer()
+{
+    // The sockets go with the server, their disconnected() must not reach us
+    for (auto connection = m_connections.cbegin(); connection != m_connections.cend(); ++connection) {
+        connection.key()->disconnect(this);
+    }
+    m_server.reset();
+}
+
+bool ControlServer::listen(const QString &name)
+{
+    m_server = std::make_unique<QLocalServer>();
+    m_server->setSocketOptions(QLocalServer::UserAccessOption | QLocalServer::GroupAccessOption);
+    if (QDir::isAbsolutePath(name)) {
+        QDir().mkpath(QFileInfo(name).absolutePath());
+    }
+    // A previous instance that crashed leaves its socket file behind
+    QLocalServer::removeServer(name);
+    if (!m_server->listen(name)) {
+        CPI_LOG_ERROR("control", "Cannot listen", {{"socket", name}, {"error", m_server->errorString()}});
+        return false;
+    }
+    connect(m_server.get(), &QLocalServer::newConnection, this, &ControlServer::acceptConnections);
+    CPI_LOG_INFO("control", "Listening", {{"socket", m_server->fullServerName()}});
+    return true;
+}
+
+QString ControlServer::serverName() const
+{
+    return m_server ? m_server->fullServerName() : QString();
+}
+
+QString ControlServer::errorString() const
+{
+    return m_server ? m_server->errorString() : QString();
+}
+
+int ControlServer::connectionCount() const
+{
+    return m_connections.size();
+}
+
+void ControlServer::acceptConnections()
+{
+    while (QLocalSocket *socket = m_server->nextPendingConnection()) {
+        m_connections.insert(socket, Connection());
+        connect(socket, &QLocalSocket::readyRead, this, [this, socket]() { read(socket); });
+        connect(socket, &QLocalSocket::disconnected, this, [this, socket]() {
+            m_connections.remove(socket);
+            socket->deleteLater();
+        });
+    }
+}
+
+void ControlServer::read(QLocalSocket *socket)
+{
+    const auto connection = m_connections.find(socket);
+    if (connection == m_connections.end()) {
+        return;
+    }
+    connection->buffer += socket->readAll();
+    QList<QCborMap> requests;
+    const bool ok = ControlProtocol::decode(connection->buffer, requests);
+    for (const QCborMap &request : std::as_const(requests)) {
+        handle(socket, request);
+    }
+    if (!ok) {
+        CPI_LOG_WARNING("control", "Malformed frame, closing connection");
+        socket->disconnectFromServer();
+    }
+}
+
+void ControlServer::handle(QLocalSocket *socket, const QCborMap &request)
+{
+    const QCborValue id = request.value(QStringLiteral("id"));
+    const QString command = request.value(QStringLiteral("cmd")).toString();
+    if (command == QLatin1String("send")) {
+        send(socket, request);
+    } else if (command == QLatin1String("bulk")) {
+        bulk(socket, request);
+    } else if (command == QLatin1String("status")) {
+        reply(socket, id, status());
+    } else if (command == QLatin1String("metrics")) {
+        reply(socket, id, {{QStringLiteral("text"),
+                            QString::fromUtf8(MetricsRegistry::instance().prometheusText())}});
+    } else if (command == QLatin1String("rest")) {
+        rest(socket, request);
+    } else if (command == QLatin1String("subscribe")) {
+        m_connections[socket].subscribed = true;
+        reply(socket, id, {});
+    } else {
+        fail(socket, id, QStringLiteral("Unknown command: ") + command);
+    }
+}
+
+void ControlServer::send(QLocalSocket *socket, const QCborMap &request)
+{
+    const QCborValue id = request.value(QStringLiteral("id"));
+    const QCborArray messages = request.contains(QStringLiteral("messages"))
+                                    ? request.value(QStringLiteral("messages")).toArray()
+                                    : QCborArray{request};
+    QList<QPair<QString, QString>> batch;
+    batch.reserve(messages.size());
+    for (const QCborValue &value : messages) {
+        const QCborMap message = value.toMap();
+        const QString to = message.value(QStringLiteral("to")).toString();
+        const QString text = message.value(QStringLiteral("text")).toString();
+        if (to.isEmpty() || text.isEmpty()) {
+            continue;
+        }
+        batch.append({to, text});
+    }
+    if (batch.isEmpty()) {
+        fail(socket, id, QStringLiteral("No message with both to and text"));
+        return;
+    }
+    // One queued call and one journal commit however many there are
+    m_modem->sendSMSBatch(batch);
+    reply(socket, id, {{QStringLiteral("queued"), int(batch.size())},
+                       {QStringLiteral("skipped"), int(messages.size() - batch.size())}});
+}
+
+void ControlServer::bulk(QLocalSocket *socket, const QCborMap &request)
+{
+    const QCborValue id = request.value(QStringLiteral("id"));
+    QStringList recipients;
+    for (const QCborValue &recipient : request.value(QStringLiteral("recipients")).toArray()) {
+        recipients.append(recipient.toString());
+    }
+    const QString text = request.value(QStringLiteral("text")).toString();
+    if (recipients.isEmpty() || text.isEmpty()) {
+        fail(socket, id, QStringLiteral("bulk needs recipients and text"));
+        return;
+    }
+    const QVariantMap variables = request.value(QStringLiteral("variables")).toMap().toVariantMap();
+    // The reply waits for Modem::bulkQueued, which reports what was accepted
+    const int batchId = m_modem->sendBulk(recipients, text, variables);
+    m_pendingBulks.insert(batchId, {socket, id});
+}
+
+void ControlServer::rest(QLocalSocket *socket, const QCborMap &request)
+{
+    const QCborValue id = request.value(QStringLiteral("id"));
+    const QString method = request.value(QStringLiteral("method")).toString(QStringLiteral("GET")).toUpper();
+    const QString endpoint = request.value(QStringLiteral("endpoint")).toString();
+    if (endpoint.isEmpty()) {
+        fail(socket, id, QStringLiteral("rest needs an endpoint"));
+        return;
+    }
+
+    RequestOptions options;
+    options.priority = RequestScheduler::Priority(
+        qBound<qint64>(0, request.value(QStringLiteral("priority")).toInteger(int(options.priority)),
+                       RequestScheduler::PRIORITY_COUNT - 1));
+    options.timeoutMs = int(request.value(QStringLiteral("timeout")).toInteger(options.timeoutMs));
+
+    // Maps and arrays are sent as JSON, byte strings and text as they are
+    const QCborValue body = request.value(QStringLiteral("body"));
+    const QVariant data = body.isByteArray() ? QVariant(body.toByteArray()) : body.toVariant();
+
+    auto callback = [socket = QPointer<QLocalSocket>(socket), id](const RestResponse &response) {
+        if (!socket) {
+            return;
+        }
+        // Bodies decoded while streaming are only kept as JSON
+        const QByteArray responseBody = response.body.isEmpty() && !response.json.isNull()
+                                            ? response.json.toJson(QJsonDocument::Compact)
+                                            : response.body;
+        QCborMap result{{QStringLiteral("ok"), response.ok},
+                        {QStringLiteral("status"), response.status},
+                        {QStringLiteral("elapsedMs"), response.elapsedMs},
+                        {QStringLiteral("attempts"), response.attempts},
+                        {QStringLiteral("body"), responseBody}};
+        if (!response.ok) {
+            result.insert(QStringLiteral("error"), response.error);
+        }
+        reply(socket, id, std::move(result));
+    };
+
+    if (method == QLatin1String("GET")) {
+        m_client->get(endpoint, std::move(callback), options);
+    } else if (method == QLatin1String("POST")) {
+        m_client->post(endpoint, data, std::move(callback), options);
+    } else if (method == QLatin1String("PUT")) {
+        m_client->put(endpoint, data, std::move(callback), options);
+    } else if (method == QLatin1String("DELETE")) {
+        m_client->deleteResource(endpoint, std::move(callback), options);
+    } else {
+        fail(socket, id, QStringLiteral("Unsupported method: ") + method);
+    }
+}
+
+QCborMap ControlServer::status() const
+{
+    return {
+        {QStringLiteral("queued"), m_modem->queued()},
+        {QStringLiteral("inFlight"), m_modem->inFlight()},
+        {QStringLiteral("throughput"), m_modem->throughput()},
+        {QStringLiteral("modemCount"), m_modem->modemCount()},
+        {QStringLiteral("modems"), QCborArray::fromVariantList(m_modem->modemStats())},
+        {QStringLiteral("radio"), QCborArray::fromVariantList(m_modem->radio())},
+        {QStringLiteral("rest"), QCborMap{
+            {QStringLiteral("queued"), m_client->queuedRequests()},
+            {QStringLiteral("active"), m_client->activeRequests()},
+            {QStringLiteral("pendingReports"), m_client->reports()->pendingRecords()},
+        }},
+        {QStringLiteral("connections"), int(m_connections.size())},
+    };
+}
+
+void ControlServer::broadcast(const QCborMap &event)
+{
+    QByteArray frame;
+    for (auto connection = m_connections.cbegin(); connection != m_connections.cend(); ++connection) {
+        if (connection->subscribed) {
+            if (frame.isEmpty()) {
+                frame = ControlProtocol::encode(event);
+            }
+            writeEvent(connection.key(), frame);
+        }
+    }
+}
+
+bool ControlServer::writeEvent(QLocalSocket *socket, const QByteArray &frame)
+{
+    const auto connection = m_connections.find(socket);
+    if (connection == m_connections.end()) {
+        return false;
+    }
+    if (socket->bytesToWrite() > MAX_EVENT_BACKLOG) {
+        static Counter &dropped = MetricsRegistry::instance().counter(
+            "cellularpi_control_events_dropped_total",
+            "Control socket events dropped for clients that do not keep up");
+        dropped.increment();
+        if (!connection->lagging) {
+            connection->lagging = true;
+            CPI_LOG_WARNING("control", "Client not reading, dropping events",
+                            {{"backlogBytes", socket->bytesToWrite()}});
+        }
+        return false;
+    }
+    if (connection->lagging) {
+        connection->lagging = false;
+        CPI_LOG_INFO("control", "Client caught up, events resumed");
+    }
+    socket->write(frame);
+    return true;
+}
+
+void ControlServer::reply(QLocalSocket *socket, const QCborValue &id, QCborMap result)
+{
+    if (!id.isUndefined()) {
+        result.insert(QStringLiteral("id"), id);
+    }
+    if (!result.contains(QStringLiteral("ok"))) {
+        result.insert(QStringLiteral("ok"), true);
+    }
+    socket->write(ControlProtocol::encode(result));
+}
+
+void ControlServer::fail(QLocalSocket *socket, const QCborValue &id, const QString &error)
+{
+    reply(socket, id, {{QStringLiteral("ok"), false}, {QStringLiteral("error"), error}});
+}
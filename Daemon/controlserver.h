@@ -0,0 +1,75 @@
+#ifndef CONTROLSERVER_H
+#define CONTROLSERVER_H
+
+#include <QCborMap>
+#include <QHash>
+#include <QObject>
+#include <QPointer>
+#include <QString>
+#include <memory>
+
+class Modem;
+class RestClient;
+class QLocalServer;
+class QLocalSocket;
+
+// Drives Modem and RestClient from local services over a Unix domain
+// socket, see ControlProtocol for the frames and commands. Requests are
+// handled in arrival order on the thread of the server; replies to
+// asynchronous commands (bulk, rest) come when their result does, so a
+// client matches them by id. Events are dropped for a connection whose
+// unsent output passes MAX_EVENT_BACKLOG, so a client that stops reading
+// cannot grow the daemon's memory. The socket is readable by the owner
+// and its group only.
+class ControlServer : public QObject {
+    Q_OBJECT
+public:
+    ControlServer(Modem* modem, RestClient* client, QObject* parent = nullptr);
+    ~ControlServer() override;
+
+    // A full path, or a name under the runtime directory
+    bool listen(const QString& name);
+    QString serverName() const;
+    QString errorString() const;
+    int connectionCount() const;
+
+private:
+    static constexpr qint64 MAX_EVENT_BACKLOG = 1024 * 1024;
+
+    struct Connection {
+        QByteArray buffer;
+        bool subscribed{false};
+        // Events are being dropped for it, see writeEvent()
+        bool lagging{false};
+    };
+
+    // A bulk send waiting for Modem::bulkQueued
+    struct PendingBulk {
+        QPointer<QLocalSocket> socket;
+        QCborValue id;
+    };
+
+    Modem* m_modem;
+    RestClient* m_client;
+    std::unique_ptr<QLocalServer> m_server;
+    QHash<QLocalSocket*, Connection> m_connections;
+    QHash<int, PendingBulk> m_pendingBulks;
+    // Batch id -> the connection that gets its progress events
+    QHash<int, QPointer<QLocalSocket>> m_batchOwners;
+
+    void acceptConnections();
+    void read(QLocalSocket* socket);
+    void handle(QLocalSocket* socket, const QCborMap& request);
+    void send(QLocalSocket* socket, const QCborMap& request);
+    void bulk(QLocalSocket* socket, const QCborMap& request);
+    void rest(QLocalSocket* socket, const QCborMap& request);
+    QCborMap status() const;
+    void broadcast(const QCborMap& event);
+    // False when the event was dropped because socket is not keeping up
+    bool writeEvent(QLocalSocket* socket, const QByteArray& frame);
+
+    static void reply(QLocalSocket* socket, const QCborValue& id, QCborMap result);
+    static void fail(QLocalSocket* socket, const QCborValue& id, const QString& error);
+};
+
+#endif // CONTROLSERVER_H
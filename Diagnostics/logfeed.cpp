@@ -0,0 +1,67 @@
+#include "logfeed.h"
+#include <QDateTime>
+#include <QMetaMethod>
+
+LogFeed::LogFeed(QObject *parent)
+    : QObject{parent}
+{
+    m_timer.setInterval(DEFAULT_INTERVAL_MS);
+    connect(&m_timer, &QTimer::timeout, this, &LogFeed::deliver);
+    m_timer.start();
+}
+
+int LogFeed::interval() const
+{
+    return m_timer.interval();
+}
+
+void LogFeed::setInterval(int intervalMs)
+{
+    intervalMs = qMax(16, intervalMs);
+    if (m_timer.interval() == intervalMs)
+        return;
+    m_timer.setInterval(intervalMs);
+    emit intervalChanged();
+}
+
+LogFeed::Level LogFeed::minimumLevel() const
+{
+    return m_minimumLevel;
+}
+
+void LogFeed::setMinimumLevel(Level level)
+{
+    if (m_minimumLevel == level)
+        return;
+    m_minimumLevel = level;
+    emit minimumLevelChanged();
+}
+
+void LogFeed::deliver()
+{
+    int skipped = 0;
+    QList<Log::Entry> entries = Log::takeEntries(&skipped);
+    entries.removeIf([minimum = Log::Level(m_minimumLevel)](const Log::Entry &entry) {
+        return entry.level < minimum;
+    });
+    if (entries.isEmpty() && skipped == 0) {
+        return;
+    }
+
+    emit batchReady(entries, skipped);
+
+    if (!isSignalConnected(QMetaMethod::fromSignal(&LogFeed::entriesAdded))) {
+        return;
+    }
+    QVariantList list;
+    list.reserve(entries.size());
+    for (const Log::Entry &entry : std::as_const(entries)) {
+        list.append(QVariantMap{
+            {"time", QDateTime::fromMSecsSinceEpoch(entry.timestampMs)},
+            {"level", int(entry.level)},
+            {"source", entry.source},
+            {"text", entry.text},
+        });
+    }
+    emit entriesAdded(list, skipped);
+}
@@ -0,0 +1,53 @@
+#ifndef LOGFEED_H
+#define LOGFEED_H
+
+#include <QQmlEngine>
+#include <QTimer>
+#include <QVariantList>
+#include "logging.h"
+
+// Throttled view of the log for the UI. Collects whatever the writer thread
+// rendered since the last tick and emits it as one batch, so a burst of a
+// thousand lines costs the GUI thread a handful of signals, not a thousand.
+class LogFeed : public QObject {
+    Q_OBJECT
+    QML_ELEMENT
+    QML_SINGLETON
+
+    Q_PROPERTY(int interval READ interval WRITE setInterval NOTIFY intervalChanged)
+    Q_PROPERTY(Level minimumLevel READ minimumLevel WRITE setMinimumLevel NOTIFY minimumLevelChanged)
+public:
+    enum Level {
+        Debug = int(Log::Level::Debug),
+        Info = int(Log::Level::Info),
+        Warning = int(Log::Level::Warning),
+        Error = int(Log::Level::Error)
+    };
+    Q_ENUM(Level)
+
+    explicit LogFeed(QObject *parent = nullptr);
+
+    int interval() const;
+    void setInterval(int intervalMs);
+    // Entries below this are left out of the batches, they still reach the file
+    Level minimumLevel() const;
+    void setMinimumLevel(Level level);
+
+signals:
+    void intervalChanged();
+    void minimumLevelChanged();
+    // C++ consumers
+    void batchReady(const QList<Log::Entry> &entries, int skipped);
+    // QML: {time, level, source, text} per entry, oldest first
+    void entriesAdded(const QVariantList &entries, int skipped);
+
+private:
+    static constexpr int DEFAULT_INTERVAL_MS = 250;
+
+    QTimer m_timer;
+    Level m_minimumLevel{Info};
+
+    void deliver();
+};
+
+#endif // LOGFEED_H
@@ -0,0 +1,264 @@
+#include "logging.h"
+#include "boundedqueue.h"
+#include "metricsregistry.h"
+#include <QByteArray>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonValue>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+namespace {
+
+constexpr std::size_t QUEUE_CAPACITY = 8192;
+constexpr int IDLE_SLEEP_MS = 20;
+constexpr int MAX_BATCH = 512;
+
+class Writer {
+public:
+    static Writer& instance()
+    {
+        static Writer writer;
+        return writer;
+    }
+
+    ~Writer() { stop(); }
+
+    bool isRunning() const { return m_running.load(std::memory_order_acquire); }
+
+    bool push(Log::Record&& record)
+    {
+        if (m_queue.tryPush(std::move(record))) {
+            return true;
+        }
+        m_dropped.increment();
+        return false;
+    }
+
+    void start(const Log::WriterOptions& options)
+    {
+        stop();
+        m_options = options;
+        m_stopping.store(false, std::memory_order_relaxed);
+        m_running.store(true, std::memory_order_release);
+        m_thread = std::thread([this] { run(); });
+    }
+
+    void stop()
+    {
+        if (!m_thread.joinable()) {
+            return;
+        }
+        m_stopping.store(true, std::memory_order_relaxed);
+        m_thread.join();
+        m_running.store(false, std::memory_order_release);
+    }
+
+    QList<Log::Entry> takeEntries(int* skipped)
+    {
+        std::lock_guard<std::mutex> locker(m_entriesMutex);
+        if (skipped) {
+            *skipped = std::exchange(m_skipped, 0);
+        }
+        return std::exchange(m_entries, {});
+    }
+
+private:
+    BoundedQueue<Log::Record> m_queue{QUEUE_CAPACITY};
+    Counter& m_dropped = MetricsRegistry::instance().counter(
+        "cellularpi_log_dropped_total", "Log records dropped on a full queue");
+    Counter& m_written = MetricsRegistry::instance().counter(
+        "cellularpi_log_records_total", "Log records written");
+    std::atomic<bool> m_running{false};
+    std::atomic<bool> m_stopping{false};
+    std::thread m_thread;
+    Log::WriterOptions m_options;
+
+    // Only the writer thread touches the file
+    QFile m_file;
+
+    // Handed from the writer thread to LogFeed on the GUI thread
+    std::mutex m_entriesMutex;
+    QList<Log::Entry> m_entries;
+    int m_skipped{0};
+
+    Writer() = default;
+
+    QString filePath(int index) const
+    {
+        const QString path = m_options.directory + '/' + m_options.baseName + ".jsonl";
+        return index == 0 ? path : path + '.' + QString::number(index);
+    }
+
+    void openFile()
+    {
+        if (m_options.directory.isEmpty()) {
+            return;
+        }
+        QDir().mkpath(m_options.directory);
+        m_file.setFileName(filePath(0));
+        if (!m_file.open(QIODevice::WriteOnly | QIODevice::Append)) {
+            qWarning("[Log] Cannot open %s: %s", qPrintable(m_file.fileName()),
+                     qPrintable(m_file.errorString()));
+        }
+    }
+
+    // cellularpi.jsonl -> .1 -> .2 ... the oldest falls off the end
+    void rotate()
+    {
+        m_file.close();
+        QFile::remove(filePath(m_options.maxFiles));
+        for (int i = m_options.maxFiles - 1; i >= 0; --i) {
+            QFile::rename(filePath(i), filePath(i + 1));
+        }
+        openFile();
+    }
+
+    void run()
+    {
+        openFile();
+        QByteArray lines;
+        QList<Log::Entry> entries;
+        Log::Record record;
+        for (;;) {
+            // Read the flag before draining, so nothing queued before
+            // stop() is left behind
+            const bool stopping = m_stopping.load(std::memory_order_relaxed);
+            int count = 0;
+            while (count < MAX_BATCH && m_queue.tryPop(record)) {
+                render(record, lines, entries);
+                ++count;
+            }
+            if (count > 0) {
+                flush(lines, entries);
+                m_written.increment(count);
+                continue;
+            }
+            if (stopping) {
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(IDLE_SLEEP_MS));
+        }
+        m_file.close();
+    }
+
+    static void render(const Log::Record& record, QByteArray& lines, QList<Log::Entry>& entries)
+    {
+        QJsonObject object{
+            {"ts", QDateTime::fromMSecsSinceEpoch(record.timestampMs).toString(Qt::ISODateWithMs)},
+            {"level", Log::levelName(record.level)},
+            {"source", record.source},
+            {"msg", record.message},
+        };
+        QString text = QString::fromUtf8(record.message);
+        for (int i = 0; i < record.fieldCount; ++i) {
+            const Log::Field& field = record.fields[i];
+            object.insert(field.key, QJsonValue::fromVariant(field.value));
+            text += ' ' + QString::fromUtf8(field.key) + '=' + field.value.toString();
+        }
+        lines += QJsonDocument(object).toJson(QJsonDocument::Compact);
+        lines += '\n';
+        entries.append({record.timestampMs, record.level, QString::fromUtf8(record.source), text});
+    }
+
+    void flush(QByteArray& lines, QList<Log::Entry>& entries)
+    {
+        if (m_file.isOpen()) {
+            m_file.write(lines);
+            m_file.flush();
+            if (m_file.size() >= m_options.maxFileBytes) {
+                rotate();
+            }
+        }
+        lines.clear();
+
+        std::lock_guard<std::mutex> locker(m_entriesMutex);
+        m_entries.append(std::move(entries));
+        entries.clear();
+        // Nobody is draining (no UI, or it is stalled): keep the newest
+        if (m_entries.size() > Log::UI_BACKLOG) {
+            const qsizetype excess = m_entries.size() - Log::UI_BACKLOG;
+            m_entries.remove(0, excess);
+            m_skipped += int(excess);
+        }
+    }
+};
+
+} // namespace
+
+const char* Log::levelName(Level level)
+{
+    switch (level) {
+    case Level::Debug:
+        return "debug";
+    case Level::Info:
+        return "info";
+    case Level::Warning:
+        return "warning";
+    case Level::Error:
+        return "error";
+    case Level::Off:
+        break;
+    }
+    return "off";
+}
+
+void Log::setLevelFromEnvironment()
+{
+    const QByteArray name = qgetenv("CELLULARPI_LOG_LEVEL").trimmed().toLower();
+    if (name.isEmpty()) {
+        return;
+    }
+    for (Level candidate : {Level::Debug, Level::Info, Level::Warning, Level::Error, Level::Off}) {
+        if (name == levelName(candidate)) {
+            setLevel(candidate);
+            return;
+        }
+    }
+    qWarning("Unknown CELLULARPI_LOG_LEVEL '%s', keeping the default", name.constData());
+}
+
+void Log::write(Level level, const char* source, const char* message,
+                std::initializer_list<Field> fields)
+{
+    Writer& writer = Writer::instance();
+    if (!writer.isRunning()) {
+        if (level >= Level::Warning) {
+            qWarning("[%s] %s", source, message);
+        }
+        return;
+    }
+
+    Record record;
+    record.timestampMs = QDateTime::currentMSecsSinceEpoch();
+    record.level = level;
+    record.source = source;
+    record.message = message;
+    Q_ASSERT_X(fields.size() <= MAX_FIELDS, "Log::write", "too many fields");
+    for (const Field& field : fields) {
+        if (record.fieldCount == MAX_FIELDS) {
+            break;
+        }
+        record.fields[record.fieldCount++] = field;
+    }
+    writer.push(std::move(record));
+}
+
+void Log::startWriter(const WriterOptions& options)
+{
+    Writer::instance().start(options);
+}
+
+void Log::stopWriter()
+{
+    Writer::instance().stop();
+}
+
+QList<Log::Entry> Log::takeEntries(int* skipped)
+{
+    return Writer::instance().takeEntries(skipped);
+}
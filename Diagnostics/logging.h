@@ -0,0 +1,121 @@
+#ifndef LOGGING_H
+#define LOGGING_H
+
+#include <QString>
+#include <QVariant>
+#include <QList>
+#include <array>
+#include <atomic>
+#include <initializer_list>
+
+// Levels below this are compiled out of CPI_LOG_* call sites entirely,
+// set with -DCELLULARPI_LOG_MIN_LEVEL=<0 debug .. 3 error>
+#ifndef CELLULARPI_LOG_MIN_LEVEL
+#define CELLULARPI_LOG_MIN_LEVEL 0
+#endif
+
+// Structured, asynchronous logging.
+//
+// A call site names a source, a fixed message and up to MAX_FIELDS
+// key/value fields:
+//     CPI_LOG_DEBUG("modem", "Retry scheduled", {{"sms", handle}, {"delayMs", delayMs}});
+// Below the compile-time floor the statement is discarded; below the runtime
+// threshold it costs one relaxed load and builds nothing. Otherwise the
+// record goes into a lock-free queue and the calling thread returns; a
+// writer thread renders it to rotated JSON-lines files and hands batches
+// to the UI (see LogFeed). A full queue drops the record and counts it.
+namespace Log {
+
+enum class Level : int {
+    Debug,
+    Info,
+    Warning,
+    Error,
+    Off
+};
+
+namespace detail {
+inline std::atomic<int> threshold{static_cast<int>(Level::Info)};
+}
+
+inline bool enabled(Level level)
+{
+    return static_cast<int>(level) >= detail::threshold.load(std::memory_order_relaxed);
+}
+
+inline Level level()
+{
+    return static_cast<Level>(detail::threshold.load(std::memory_order_relaxed));
+}
+
+inline void setLevel(Level level)
+{
+    detail::threshold.store(static_cast<int>(level), std::memory_order_relaxed);
+}
+
+// Reads CELLULARPI_LOG_LEVEL (debug, info, warning, error, off)
+void setLevelFromEnvironment();
+const char* levelName(Level level);
+
+struct Field {
+    const char* key{nullptr};  // string literal
+    QVariant value;
+};
+
+static constexpr int MAX_FIELDS = 6;
+
+struct Record {
+    qint64 timestampMs{0};
+    Level level{Level::Info};
+    const char* source{nullptr};   // string literal
+    const char* message{nullptr};  // string literal
+    std::array<Field, MAX_FIELDS> fields{};
+    int fieldCount{0};
+};
+
+// A record as rendered for display
+struct Entry {
+    qint64 timestampMs{0};
+    Level level{Level::Info};
+    QString source;
+    QString text;  // message followed by key=value pairs
+};
+
+// Never blocks. Without a running writer, warnings and errors go to
+// qWarning() synchronously and everything else is dropped.
+void write(Level level, const char* source, const char* message,
+           std::initializer_list<Field> fields = {});
+
+struct WriterOptions {
+    QString directory;  // empty: no files, UI feed only
+    QString baseName{QStringLiteral("cellularpi")};
+    qint64 maxFileBytes{4 * 1024 * 1024};
+    int maxFiles{5};    // rotated files kept besides the current one
+};
+
+// Starts the writer thread; stopWriter() drains the queue and joins it
+void startWriter(const WriterOptions& options);
+void stopWriter();
+
+// Entries rendered since the last call, oldest first, at most
+// UI_BACKLOG of them; skipped reports how many older ones were discarded
+static constexpr int UI_BACKLOG = 1000;
+QList<Entry> takeEntries(int* skipped = nullptr);
+
+} // namespace Log
+
+#define CPI_LOG(level, source, message, ...)                                              \
+    do {                                                                                  \
+        if constexpr (static_cast<int>(level) >= CELLULARPI_LOG_MIN_LEVEL) {              \
+            if (::Log::enabled(level)) {                                                  \
+                ::Log::write(level, source, message __VA_OPT__(,) __VA_ARGS__);           \
+            }                                                                             \
+        }                                                                                 \
+    } while (false)
+
+#define CPI_LOG_DEBUG(source, message, ...) CPI_LOG(::Log::Level::Debug, source, message __VA_OPT__(,) __VA_ARGS__)
+#define CPI_LOG_INFO(source, message, ...) CPI_LOG(::Log::Level::Info, source, message __VA_OPT__(,) __VA_ARGS__)
+#define CPI_LOG_WARNING(source, message, ...) CPI_LOG(::Log::Level::Warning, source, message __VA_OPT__(,) __VA_ARGS__)
+#define CPI_LOG_ERROR(source, message, ...) CPI_LOG(::Log::Level::Error, source, message __VA_OPT__(,) __VA_ARGS__)
+
+#endif // LOGGING_H
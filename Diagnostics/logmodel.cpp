@@ -0,0 +1,211 @@
+#include "logmodel.h"
+#include <QDateTime>
+#include <algorithm>
+
+LogModel::LogModel(QObject *parent)
+    : QAbstractListModel{parent}
+{
+    m_ring.resize(DEFAULT_CAPACITY);
+}
+
+LogFeed *LogModel::feed() const
+{
+    return m_feed;
+}
+
+void LogModel::setFeed(LogFeed *feed)
+{
+    if (m_feed == feed)
+        return;
+    disconnect(m_feedConnection);
+    m_feed = feed;
+    if (feed) {
+        m_feedConnection = connect(feed, &LogFeed::batchReady, this, &LogModel::append);
+    }
+    emit feedChanged();
+}
+
+int LogModel::capacity() const
+{
+    return m_ring.size();
+}
+
+void LogModel::setCapacity(int capacity)
+{
+    capacity = qMax(1, capacity);
+    if (m_ring.size() == capacity)
+        return;
+
+    beginResetModel();
+    // The newest entries that fit move to the new ring
+    const quint64 first = m_next - qMin<quint64>(held(), capacity);
+    QList<Log::Entry> ring(capacity);
+    for (quint64 sequence = first; sequence < m_next; ++sequence) {
+        ring[sequence % capacity] = std::move(m_ring[sequence % m_ring.size()]);
+    }
+    m_dropped += first - m_first;
+    m_first = first;
+    m_ring = std::move(ring);
+    rebuildRows();
+    endResetModel();
+
+    emit capacityChanged();
+    emit countChanged();
+}
+
+LogFeed::Level LogModel::minimumLevel() const
+{
+    return m_minimumLevel;
+}
+
+void LogModel::setMinimumLevel(LogFeed::Level level)
+{
+    if (m_minimumLevel == level)
+        return;
+    beginResetModel();
+    m_minimumLevel = level;
+    rebuildRows();
+    endResetModel();
+    emit filterChanged();
+    emit countChanged();
+}
+
+QStringList LogModel::sources() const
+{
+    return m_sources;
+}
+
+void LogModel::setSources(const QStringList &sources)
+{
+    if (m_sources == sources)
+        return;
+    beginResetModel();
+    m_sources = sources;
+    rebuildRows();
+    endResetModel();
+    emit filterChanged();
+    emit countChanged();
+}
+
+int LogModel::count() const
+{
+    return m_rows.size();
+}
+
+int LogModel::held() const
+{
+    return int(m_next - m_first);
+}
+
+qint64 LogModel::dropped() const
+{
+    return m_dropped;
+}
+
+void LogModel::append(const QList<Log::Entry> &entries, int skipped)
+{
+    m_dropped += skipped;
+    const quint64 capacity = m_ring.size();
+    // Of a batch larger than the ring only the newest entries get in
+    const qsizetype start = qMax<qsizetype>(0, entries.size() - qsizetype(capacity));
+    m_dropped += start;
+    const quint64 incoming = entries.size() - start;
+
+    // Make room first: the rows of the entries about to be overwritten go
+    if (m_next + incoming - m_first > capacity) {
+        const quint64 first = m_next + incoming - capacity;
+        m_dropped += qint64(qMin(first, m_next) - m_first);
+        const qsizetype gone = std::lower_bound(m_rows.cbegin(), m_rows.cend(), first) - m_rows.cbegin();
+        if (gone > 0) {
+            beginRemoveRows(QModelIndex(), 0, gone - 1);
+            m_rows.remove(0, gone);
+            endRemoveRows();
+        }
+        m_first = first;
+    }
+
+    QList<quint64> added;
+    for (qsizetype i = start; i < entries.size(); ++i) {
+        const quint64 sequence = m_next++;
+        m_ring[sequence % capacity] = entries.at(i);
+        if (accepts(entries.at(i))) {
+            added.append(sequence);
+        }
+    }
+    if (!added.isEmpty()) {
+        beginInsertRows(QModelIndex(), m_rows.size(), m_rows.size() + added.size() - 1);
+        m_rows.append(added);
+        endInsertRows();
+    }
+    if (incoming > 0 || skipped > 0) {
+        emit countChanged();
+    }
+}
+
+void LogModel::clear()
+{
+    beginResetModel();
+    m_first = m_next;
+    m_rows.clear();
+    // Releases the text of the entries, the slots stay
+    m_ring.fill(Log::Entry());
+    endResetModel();
+    emit countChanged();
+}
+
+int LogModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : m_rows.size();
+}
+
+QVariant LogModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() >= m_rows.size()) {
+        return QVariant();
+    }
+    const Log::Entry &logEntry = entry(m_rows.at(index.row()));
+    switch (role) {
+    case TimeRole:
+        return QDateTime::fromMSecsSinceEpoch(logEntry.timestampMs);
+    case LevelRole:
+        return int(logEntry.level);
+    case SourceRole:
+        return logEntry.source;
+    case Qt::DisplayRole:
+    case TextRole:
+        return logEntry.text;
+    default:
+        return QVariant();
+    }
+}
+
+QHash<int, QByteArray> LogModel::roleNames() const
+{
+    return {
+        {TimeRole, "time"},
+        {LevelRole, "level"},
+        {SourceRole, "source"},
+        {TextRole, "text"},
+    };
+}
+
+const Log::Entry &LogModel::entry(quint64 sequence) const
+{
+    return m_ring.at(qsizetype(sequence % quint64(m_ring.size())));
+}
+
+bool LogModel::accepts(const Log::Entry &entry) const
+{
+    return int(entry.level) >= int(m_minimumLevel)
+           && (m_sources.isEmpty() || m_sources.contains(entry.source));
+}
+
+void LogModel::rebuildRows()
+{
+    m_rows.clear();
+    for (quint64 sequence = m_first; sequence < m_next; ++sequence) {
+        if (accepts(entry(sequence))) {
+            m_rows.append(sequence);
+        }
+    }
+}
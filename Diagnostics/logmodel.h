@@ -0,0 +1,88 @@
+#ifndef LOGMODEL_H
+#define LOGMODEL_H
+
+#include <QAbstractListModel>
+#include <QPointer>
+#include <QQmlEngine>
+#include <QStringList>
+#include "logfeed.h"
+
+// The newest log entries as rows for a QML view, oldest first.
+//
+// Entries live in a ring of capacity slots, so memory stays flat however
+// long the process runs: a new batch overwrites the oldest entries and
+// their rows are removed in one go before the new rows are inserted in
+// one go. Rows are sequence numbers into the ring that pass the filter
+// (minimumLevel and, when not empty, sources); changing the filter
+// rebuilds that index and copies no entries. Fed by a LogFeed's batches,
+// so rows arrive once per feed interval, never one at a time.
+class LogModel : public QAbstractListModel {
+    Q_OBJECT
+    QML_ELEMENT
+
+    Q_PROPERTY(LogFeed* feed READ feed WRITE setFeed NOTIFY feedChanged)
+    Q_PROPERTY(int capacity READ capacity WRITE setCapacity NOTIFY capacityChanged)
+    Q_PROPERTY(LogFeed::Level minimumLevel READ minimumLevel WRITE setMinimumLevel NOTIFY filterChanged)
+    Q_PROPERTY(QStringList sources READ sources WRITE setSources NOTIFY filterChanged)
+    Q_PROPERTY(int count READ count NOTIFY countChanged)
+    Q_PROPERTY(int held READ held NOTIFY countChanged)
+    Q_PROPERTY(qint64 dropped READ dropped NOTIFY countChanged)
+public:
+    enum Roles {
+        TimeRole = Qt::UserRole + 1,
+        LevelRole,
+        SourceRole,
+        TextRole
+    };
+
+    explicit LogModel(QObject* parent = nullptr);
+
+    LogFeed* feed() const;
+    void setFeed(LogFeed* feed);
+    int capacity() const;
+    void setCapacity(int capacity);
+    LogFeed::Level minimumLevel() const;
+    void setMinimumLevel(LogFeed::Level level);
+    // Log sources shown ("modem", "rest", ...), all when empty
+    QStringList sources() const;
+    void setSources(const QStringList& sources);
+
+    // Rows passing the filter, entries in the ring, and entries lost to
+    // the ring or skipped by the feed
+    int count() const;
+    int held() const;
+    qint64 dropped() const;
+
+    // Adds a batch, oldest first; what LogFeed::batchReady is connected to
+    void append(const QList<Log::Entry>& entries, int skipped = 0);
+    Q_INVOKABLE void clear();
+
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+    QHash<int, QByteArray> roleNames() const override;
+
+signals:
+    void feedChanged();
+    void capacityChanged();
+    void filterChanged();
+    void countChanged();
+
+private:
+    static constexpr int DEFAULT_CAPACITY = 2000;
+
+    QPointer<LogFeed> m_feed;
+    QMetaObject::Connection m_feedConnection;
+    QList<Log::Entry> m_ring;       // capacity slots, entry n at n % capacity
+    quint64 m_first{0};             // sequence of the oldest entry held
+    quint64 m_next{0};              // sequence the next entry gets
+    QList<quint64> m_rows;          // sequences passing the filter, ascending
+    LogFeed::Level m_minimumLevel{LogFeed::Info};
+    QStringList m_sources;
+    qint64 m_dropped{0};
+
+    const Log::Entry& entry(quint64 sequence) const;
+    bool accepts(const Log::Entry& entry) const;
+    void rebuildRows();
+};
+
+#endif // LOGMODEL_H
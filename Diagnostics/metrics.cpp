@@ -0,0 +1,79 @@
+#include "metrics.h"
+#include "metricsregistry.h"
+
+Metrics::Metrics(QObject *parent)
+    : QObject{parent}
+{
+    connect(&m_exporter, &MetricsExporter::exportError, this, &Metrics::exportError);
+    m_exporter.setFilePath(qEnvironmentVariable("CELLULARPI_METRICS_FILE"));
+    m_exporter.setSocketName(qEnvironmentVariable("CELLULARPI_METRICS_SOCKET"));
+
+    m_refreshTimer.setInterval(DEFAULT_REFRESH_MS);
+    connect(&m_refreshTimer, &QTimer::timeout, this, &Metrics::refresh);
+    m_refreshTimer.start();
+    refresh();
+}
+
+QVariantMap Metrics::values() const
+{
+    return m_values;
+}
+
+int Metrics::refreshInterval() const
+{
+    return m_refreshTimer.interval();
+}
+
+void Metrics::setRefreshInterval(int intervalMs)
+{
+    intervalMs = qMax(100, intervalMs);
+    if (m_refreshTimer.interval() == intervalMs)
+        return;
+    m_refreshTimer.setInterval(intervalMs);
+    emit refreshIntervalChanged();
+}
+
+QString Metrics::exportFile() const
+{
+    return m_exporter.filePath();
+}
+
+void Metrics::setExportFile(const QString &filePath)
+{
+    if (m_exporter.filePath() == filePath)
+        return;
+    m_exporter.setFilePath(filePath);
+    emit exportFileChanged();
+}
+
+QString Metrics::exportSocket() const
+{
+    return m_exporter.socketName();
+}
+
+void Metrics::setExportSocket(const QString &name)
+{
+    if (m_exporter.socketName() == name)
+        return;
+    m_exporter.setSocketName(name);
+    emit exportSocketChanged();
+}
+
+QVariant Metrics::value(const QString &name) const
+{
+    return MetricsRegistry::instance().snapshot().value(name);
+}
+
+QString Metrics::prometheusText() const
+{
+    return QString::fromUtf8(MetricsRegistry::instance().prometheusText());
+}
+
+void Metrics::refresh()
+{
+    QVariantMap values = MetricsRegistry::instance().snapshot();
+    if (values == m_values)
+        return;
+    m_values = std::move(values);
+    emit valuesChanged();
+}
@@ -0,0 +1,53 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <QQmlEngine>
+#include <QVariantMap>
+#include <QTimer>
+#include "metricsexporter.h"
+
+// QML view of MetricsRegistry. Values are copied out on a timer, so bindings
+// on `values` never touch the hot-path atomics more than once per refresh.
+// Export targets default to CELLULARPI_METRICS_FILE and
+// CELLULARPI_METRICS_SOCKET.
+class Metrics : public QObject {
+    Q_OBJECT
+    QML_ELEMENT
+    QML_SINGLETON
+
+    Q_PROPERTY(QVariantMap values READ values NOTIFY valuesChanged)
+    Q_PROPERTY(int refreshInterval READ refreshInterval WRITE setRefreshInterval NOTIFY refreshIntervalChanged)
+    Q_PROPERTY(QString exportFile READ exportFile WRITE setExportFile NOTIFY exportFileChanged)
+    Q_PROPERTY(QString exportSocket READ exportSocket WRITE setExportSocket NOTIFY exportSocketChanged)
+public:
+    explicit Metrics(QObject *parent = nullptr);
+
+    QVariantMap values() const;
+    int refreshInterval() const;
+    void setRefreshInterval(int intervalMs);
+    QString exportFile() const;
+    void setExportFile(const QString &filePath);
+    QString exportSocket() const;
+    void setExportSocket(const QString &name);
+
+    // Series name as exported, e.g. "cellularpi_sms_retries_total{error=\"Failed\"}"
+    Q_INVOKABLE QVariant value(const QString &name) const;
+    Q_INVOKABLE QString prometheusText() const;
+    Q_INVOKABLE void refresh();
+
+signals:
+    void valuesChanged();
+    void refreshIntervalChanged();
+    void exportFileChanged();
+    void exportSocketChanged();
+    void exportError(const QString &message);
+
+private:
+    static constexpr int DEFAULT_REFRESH_MS = 1000;
+
+    QVariantMap m_values;
+    QTimer m_refreshTimer;
+    MetricsExporter m_exporter;
+};
+
+#endif // METRICS_H
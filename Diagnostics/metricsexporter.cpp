@@ -0,0 +1,86 @@
+#include "metricsexporter.h"
+#include "metricsregistry.h"
+#include "logging.h"
+#include <QTimer>
+#include <QSaveFile>
+#include <QLocalServer>
+#include <QLocalSocket>
+
+MetricsExporter::MetricsExporter(QObject *parent)
+    : QObject(parent)
+    , m_fileTimer(std::make_unique<QTimer>(this))
+{
+    m_fileTimer->setInterval(DEFAULT_INTERVAL_MS);
+    connect(m_fileTimer.get(), &QTimer::timeout, this, &MetricsExporter::writeFile);
+}
+
+MetricsExporter::~MetricsExporter() = default;
+
+void MetricsExporter::setFilePath(const QString &filePath)
+{
+    m_filePath = filePath;
+    if (m_filePath.isEmpty()) {
+        m_fileTimer->stop();
+        return;
+    }
+    writeFile();
+    m_fileTimer->start();
+}
+
+QString MetricsExporter::filePath() const
+{
+    return m_filePath;
+}
+
+bool MetricsExporter::setSocketName(const QString &name)
+{
+    m_server.reset();
+    if (name.isEmpty()) {
+        return true;
+    }
+
+    m_server = std::make_unique<QLocalServer>(this);
+    // A previous instance that crashed leaves its socket file behind
+    QLocalServer::removeServer(name);
+    if (!m_server->listen(name)) {
+        CPI_LOG_ERROR("metrics", "Cannot listen", {{"socket", name}, {"error", m_server->errorString()}});
+        emit exportError("[Metrics] Cannot listen on " + name + ": " + m_server->errorString());
+        m_server.reset();
+        return false;
+    }
+    connect(m_server.get(), &QLocalServer::newConnection, this, &MetricsExporter::serveConnections);
+    return true;
+}
+
+QString MetricsExporter::socketName() const
+{
+    return m_server ? m_server->serverName() : QString();
+}
+
+void MetricsExporter::setInterval(int intervalMs)
+{
+    m_fileTimer->setInterval(qMax(100, intervalMs));
+}
+
+void MetricsExporter::writeFile()
+{
+    if (m_filePath.isEmpty()) {
+        return;
+    }
+    QSaveFile file(m_filePath);
+    if (!file.open(QIODevice::WriteOnly)
+        || file.write(MetricsRegistry::instance().prometheusText()) < 0
+        || !file.commit()) {
+        CPI_LOG_ERROR("metrics", "Cannot write", {{"path", m_filePath}, {"error", file.errorString()}});
+        emit exportError("[Metrics] Cannot write " + m_filePath + ": " + file.errorString());
+    }
+}
+
+void MetricsExporter::serveConnections()
+{
+    while (QLocalSocket *socket = m_server->nextPendingConnection()) {
+        connect(socket, &QLocalSocket::disconnected, socket, &QObject::deleteLater);
+        socket->write(MetricsRegistry::instance().prometheusText());
+        socket->disconnectFromServer();
+    }
+}
@@ -0,0 +1,44 @@
+#ifndef METRICSEXPORTER_H
+#define METRICSEXPORTER_H
+
+#include <QObject>
+#include <QString>
+#include <memory>
+
+class QTimer;
+class QLocalServer;
+
+// Publishes MetricsRegistry::prometheusText() for a local scraper.
+//
+// File mode rewrites the file atomically every interval, for node_exporter's
+// textfile collector. Socket mode answers every connection on a local
+// socket with one snapshot and closes it, e.g. `socat - UNIX:/run/cpi.sock`.
+class MetricsExporter : public QObject {
+    Q_OBJECT
+public:
+    explicit MetricsExporter(QObject* parent = nullptr);
+    ~MetricsExporter();
+
+    // An empty path disables the respective output
+    void setFilePath(const QString& filePath);
+    QString filePath() const;
+    bool setSocketName(const QString& name);
+    QString socketName() const;
+    void setInterval(int intervalMs);
+
+    void writeFile();
+
+signals:
+    void exportError(const QString& message);
+
+private:
+    static constexpr int DEFAULT_INTERVAL_MS = 5000;
+
+    QString m_filePath;
+    std::unique_ptr<QTimer> m_fileTimer;
+    std::unique_ptr<QLocalServer> m_server;
+
+    void serveConnections();
+};
+
+#endif // METRICSEXPORTER_H
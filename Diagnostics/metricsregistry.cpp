@@ -0,0 +1,204 @@
+#include "metricsregistry.h"
+#include <QMutexLocker>
+#include <algorithm>
+
+Histogram::Histogram(const QList<double> &upperBounds)
+    : m_upperBounds(upperBounds)
+    , m_buckets(new std::atomic<quint64>[upperBounds.size() + 1])
+{
+    for (qsizetype i = 0; i <= upperBounds.size(); ++i) {
+        m_buckets[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+void Histogram::observe(double value)
+{
+    const auto it = std::lower_bound(m_upperBounds.cbegin(), m_upperBounds.cend(), value);
+    m_buckets[it - m_upperBounds.cbegin()].fetch_add(1, std::memory_order_relaxed);
+    m_count.fetch_add(1, std::memory_order_relaxed);
+    m_sumMicros.fetch_add(quint64(qMax(0.0, value) * 1000.0), std::memory_order_relaxed);
+}
+
+Histogram::Snapshot Histogram::snapshot() const
+{
+    Snapshot snapshot;
+    snapshot.upperBounds = m_upperBounds;
+    snapshot.buckets.reserve(m_upperBounds.size() + 1);
+    for (qsizetype i = 0; i <= m_upperBounds.size(); ++i) {
+        snapshot.buckets.append(m_buckets[i].load(std::memory_order_relaxed));
+    }
+    snapshot.count = m_count.load(std::memory_order_relaxed);
+    snapshot.sum = m_sumMicros.load(std::memory_order_relaxed) / 1000.0;
+    return snapshot;
+}
+
+double Histogram::Snapshot::quantile(double q) const
+{
+    quint64 total = 0;
+    for (quint64 bucket : buckets) {
+        total += bucket;
+    }
+    if (total == 0) {
+        return 0.0;
+    }
+    const double rank = q * total;
+    quint64 seen = 0;
+    for (qsizetype i = 0; i < buckets.size(); ++i) {
+        if (seen + buckets.at(i) >= rank && buckets.at(i) > 0) {
+            const double lower = i > 0 ? upperBounds.at(i - 1) : 0.0;
+            // +Inf bucket: the best we can say is "above the last bound"
+            if (i == upperBounds.size()) {
+                return lower;
+            }
+            const double upper = upperBounds.at(i);
+            return lower + (upper - lower) * (rank - seen) / buckets.at(i);
+        }
+        seen += buckets.at(i);
+    }
+    return upperBounds.isEmpty() ? 0.0 : upperBounds.last();
+}
+
+QList<double> Histogram::latencyBounds()
+{
+    return {1, 2, 5, 10, 20, 50, 100, 200, 500, 1000, 2000, 5000, 10000, 30000};
+}
+
+MetricsRegistry &MetricsRegistry::instance()
+{
+    static MetricsRegistry registry;
+    return registry;
+}
+
+QString MetricsRegistry::renderLabels(const MetricLabels &labels)
+{
+    QStringList parts;
+    for (const auto &label : labels) {
+        QString value = label.second;
+        value.replace('\\', "\\\\").replace('"', "\\\"").replace('\n', "\\n");
+        parts.append(QString("%1=\"%2\"").arg(label.first, value));
+    }
+    return parts.join(',');
+}
+
+MetricsRegistry::Series &MetricsRegistry::series(const QString &name, const QString &help,
+                                                 Type type, const MetricLabels &labels)
+{
+    std::shared_ptr<Family> &family = m_families[name];
+    if (!family) {
+        family = std::make_shared<Family>();
+        family->type = type;
+        family->help = help;
+    }
+    Q_ASSERT_X(family->type == type, "MetricsRegistry", "metric registered with two types");
+    return family->series[renderLabels(labels)];
+}
+
+Counter &MetricsRegistry::counter(const QString &name, const QString &help, const MetricLabels &labels)
+{
+    QMutexLocker locker(&m_mutex);
+    Series &entry = series(name, help, Type::Counter, labels);
+    if (!entry.counter) {
+        entry.labels = renderLabels(labels);
+        entry.counter = std::make_unique<Counter>();
+    }
+    return *entry.counter;
+}
+
+Gauge &MetricsRegistry::gauge(const QString &name, const QString &help, const MetricLabels &labels)
+{
+    QMutexLocker locker(&m_mutex);
+    Series &entry = series(name, help, Type::Gauge, labels);
+    if (!entry.gauge) {
+        entry.labels = renderLabels(labels);
+        entry.gauge = std::make_unique<Gauge>();
+    }
+    return *entry.gauge;
+}
+
+Histogram &MetricsRegistry::histogram(const QString &name, const QString &help,
+                                      const QList<double> &upperBounds, const MetricLabels &labels)
+{
+    QMutexLocker locker(&m_mutex);
+    Series &entry = series(name, help, Type::Histogram, labels);
+    if (!entry.histogram) {
+        entry.labels = renderLabels(labels);
+        entry.histogram = std::make_unique<Histogram>(upperBounds);
+    }
+    return *entry.histogram;
+}
+
+QByteArray MetricsRegistry::prometheusText() const
+{
+    QMutexLocker locker(&m_mutex);
+    QByteArray out;
+    out.reserve(4096);
+
+    const auto seriesName = [](const QString &name, const QString &labels, const QString &extra = {}) {
+        QString all = labels;
+        if (!extra.isEmpty()) {
+            all += (all.isEmpty() ? QString() : QStringLiteral(",")) + extra;
+        }
+        return all.isEmpty() ? name : name + '{' + all + '}';
+    };
+
+    for (auto it = m_families.cbegin(); it != m_families.cend(); ++it) {
+        const QString &name = it.key();
+        const Family &family = **it;
+        const char *type = family.type == Type::Counter ? "counter"
+                           : family.type == Type::Gauge ? "gauge"
+                                                        : "histogram";
+        out += "# HELP " + name.toUtf8() + ' ' + family.help.toUtf8() + '\n';
+        out += "# TYPE " + name.toUtf8() + ' ' + type + '\n';
+
+        for (const auto &[labels, entry] : family.series) {
+            if (entry.counter) {
+                out += seriesName(name, labels).toUtf8() + ' '
+                       + QByteArray::number(entry.counter->value()) + '\n';
+            } else if (entry.gauge) {
+                out += seriesName(name, labels).toUtf8() + ' '
+                       + QByteArray::number(entry.gauge->value()) + '\n';
+            } else if (entry.histogram) {
+                const Histogram::Snapshot snapshot = entry.histogram->snapshot();
+                quint64 cumulative = 0;
+                for (qsizetype i = 0; i < snapshot.buckets.size(); ++i) {
+                    cumulative += snapshot.buckets.at(i);
+                    const QString le = i < snapshot.upperBounds.size()
+                                           ? QString::number(snapshot.upperBounds.at(i))
+                                           : QStringLiteral("+Inf");
+                    out += seriesName(name + "_bucket", labels, "le=\"" + le + '"').toUtf8() + ' '
+                           + QByteArray::number(cumulative) + '\n';
+                }
+                out += seriesName(name + "_sum", labels).toUtf8() + ' '
+                       + QByteArray::number(snapshot.sum, 'g', 12) + '\n';
+                out += seriesName(name + "_count", labels).toUtf8() + ' '
+                       + QByteArray::number(snapshot.count) + '\n';
+            }
+        }
+    }
+    return out;
+}
+
+QVariantMap MetricsRegistry::snapshot() const
+{
+    QMutexLocker locker(&m_mutex);
+    QVariantMap values;
+    for (auto it = m_families.cbegin(); it != m_families.cend(); ++it) {
+        for (const auto &[labels, entry] : (*it)->series) {
+            const QString key = labels.isEmpty() ? it.key() : it.key() + '{' + labels + '}';
+            if (entry.counter) {
+                values.insert(key, entry.counter->value());
+            } else if (entry.gauge) {
+                values.insert(key, entry.gauge->value());
+            } else if (entry.histogram) {
+                const Histogram::Snapshot snapshot = entry.histogram->snapshot();
+                values.insert(key, QVariantMap{
+                                       {"count", snapshot.count},
+                                       {"sum", snapshot.sum},
+                                       {"p50", snapshot.quantile(0.50)},
+                                       {"p99", snapshot.quantile(0.99)},
+                                   });
+            }
+        }
+    }
+    return values;
+}
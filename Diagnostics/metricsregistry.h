@@ -0,0 +1,112 @@
+#ifndef METRICSREGISTRY_H
+#define METRICSREGISTRY_H
+
+#include <QString>
+#include <QList>
+#include <QPair>
+#include <QMap>
+#include <QMutex>
+#include <QVariantMap>
+#include <atomic>
+#include <map>
+#include <memory>
+
+using MetricLabels = QList<QPair<QString, QString>>;
+
+// Monotonic count of events
+class Counter {
+public:
+    void increment(quint64 by = 1) { m_value.fetch_add(by, std::memory_order_relaxed); }
+    quint64 value() const { return m_value.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<quint64> m_value{0};
+};
+
+// Current level of something, e.g. a queue depth
+class Gauge {
+public:
+    void set(qint64 value) { m_value.store(value, std::memory_order_relaxed); }
+    void add(qint64 by) { m_value.fetch_add(by, std::memory_order_relaxed); }
+    qint64 value() const { return m_value.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<qint64> m_value{0};
+};
+
+// Fixed-bucket histogram. observe() is a bucket search plus three relaxed
+// atomic adds; a reader may see a count one ahead of its sum, which is as
+// consistent as a scrape needs to be.
+class Histogram {
+public:
+    explicit Histogram(const QList<double>& upperBounds);
+
+    void observe(double value);
+
+    struct Snapshot {
+        QList<double> upperBounds;
+        QList<quint64> buckets;  // per bucket, not cumulative; last is +Inf
+        quint64 count{0};
+        double sum{0};
+
+        // Estimated by linear interpolation inside the bucket
+        double quantile(double q) const;
+    };
+    Snapshot snapshot() const;
+
+    // Milliseconds, 1 ms to 30 s
+    static QList<double> latencyBounds();
+
+private:
+    const QList<double> m_upperBounds;
+    std::unique_ptr<std::atomic<quint64>[]> m_buckets;
+    std::atomic<quint64> m_count{0};
+    std::atomic<quint64> m_sumMicros{0};
+};
+
+// Process-wide registry of counters, gauges and histograms.
+//
+// Registration and export take a lock; updating a metric never does. The
+// returned references stay valid for the life of the process, so hot paths
+// look a metric up once and keep the reference, e.g.
+//     static Counter &sent = MetricsRegistry::instance().counter(...);
+class MetricsRegistry {
+public:
+    static MetricsRegistry& instance();
+
+    Counter& counter(const QString& name, const QString& help, const MetricLabels& labels = {});
+    Gauge& gauge(const QString& name, const QString& help, const MetricLabels& labels = {});
+    Histogram& histogram(const QString& name, const QString& help,
+                         const QList<double>& upperBounds = Histogram::latencyBounds(),
+                         const MetricLabels& labels = {});
+
+    // Prometheus text exposition format, version 0.0.4
+    QByteArray prometheusText() const;
+    // "name{labels}" -> value; histograms map to {count, sum, p50, p99}
+    QVariantMap snapshot() const;
+
+private:
+    enum class Type { Counter, Gauge, Histogram };
+
+    struct Series {
+        QString labels;  // rendered, e.g. error="Failed"
+        std::unique_ptr<Counter> counter;
+        std::unique_ptr<Gauge> gauge;
+        std::unique_ptr<Histogram> histogram;
+    };
+
+    struct Family {
+        Type type{Type::Counter};
+        QString help;
+        std::map<QString, Series> series;
+    };
+
+    mutable QMutex m_mutex;
+    QMap<QString, std::shared_ptr<Family>> m_families;
+
+    MetricsRegistry() = default;
+    Series& series(const QString& name, const QString& help, Type type, const MetricLabels& labels);
+    static QString renderLabels(const MetricLabels& labels);
+};
+
+#endif // METRICSREGISTRY_H
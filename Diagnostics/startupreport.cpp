@@ -0,0 +1,116 @@
+#include "startupreport.h"
+#include "logging.h"
+#include "metricsregistry.h"
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <array>
+#ifdef Q_OS_LINUX
+#include <unistd.h>
+#endif
+
+namespace Startup {
+
+namespace {
+
+const char *const PHASE_NAMES[PHASE_COUNT] = {"main", "qml_loaded", "first_frame", "modem_ready"};
+
+QElapsedTimer clock;
+// How long the process ran before begin(): exec, loading shared libraries
+// and static initialisers
+qint64 processAgeMs = 0;
+std::array<qint64, PHASE_COUNT> phases{-1, -1, -1, -1};
+bool reported = false;
+
+// From the start time in /proc, which has clock tick (10 ms) resolution
+qint64 readProcessAgeMs()
+{
+#ifdef Q_OS_LINUX
+    QFile stat(QStringLiteral("/proc/self/stat"));
+    QFile uptime(QStringLiteral("/proc/uptime"));
+    if (!stat.open(QIODevice::ReadOnly) || !uptime.open(QIODevice::ReadOnly)) {
+        return 0;
+    }
+    // The command name may contain spaces, the fields after it do not;
+    // starttime is field 22, the 20th after the name
+    const QByteArray line = stat.readAll();
+    const QList<QByteArray> fields = line.mid(line.lastIndexOf(')') + 2).split(' ');
+    if (fields.size() < 20) {
+        return 0;
+    }
+    const double startedS = fields.at(19).toDouble() / double(sysconf(_SC_CLK_TCK));
+    const double uptimeS = uptime.readAll().split(' ').value(0).toDouble();
+    return qMax<qint64>(0, qRound64((uptimeS - startedS) * 1000));
+#else
+    return 0;
+#endif
+}
+
+} // namespace
+
+void begin()
+{
+    if (clock.isValid()) {
+        return;
+    }
+    clock.start();
+    processAgeMs = readProcessAgeMs();
+}
+
+void mark(Phase phase)
+{
+    begin();
+    qint64 &ms = phases[int(phase)];
+    if (ms >= 0) {
+        return;
+    }
+    ms = processAgeMs + clock.elapsed();
+    MetricsRegistry::instance()
+        .gauge("cellularpi_startup_ms", "Milliseconds from process start to each startup phase",
+               {{"phase", PHASE_NAMES[int(phase)]}})
+        .set(ms);
+    CPI_LOG_INFO("startup", "Phase reached", {{"phase", PHASE_NAMES[int(phase)]}, {"ms", ms}});
+}
+
+qint64 elapsedMs(Phase phase)
+{
+    return phases[int(phase)];
+}
+
+void report()
+{
+    if (reported) {
+        return;
+    }
+    reported = true;
+
+    CPI_LOG_INFO("startup", "Startup timing",
+                 {{"version", QCoreApplication::applicationVersion()},
+                  {"mainMs", elapsedMs(Phase::Main)},
+                  {"qmlLoadedMs", elapsedMs(Phase::QmlLoaded)},
+                  {"firstFrameMs", elapsedMs(Phase::FirstFrame)},
+                  {"modemReadyMs", elapsedMs(Phase::ModemReady)}});
+
+    const QString path = qEnvironmentVariable("CELLULARPI_STARTUP_REPORT");
+    if (path.isEmpty()) {
+        return;
+    }
+    QJsonObject record{{"ts", QDateTime::currentMSecsSinceEpoch()},
+                       {"version", QCoreApplication::applicationVersion()}};
+    for (int i = 0; i < PHASE_COUNT; ++i) {
+        if (phases[i] >= 0) {
+            record.insert(QLatin1String(PHASE_NAMES[i]), phases[i]);
+        }
+    }
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        CPI_LOG_WARNING("startup", "Cannot write startup report", {{"file", path}, {"error", file.errorString()}});
+        return;
+    }
+    file.write(QJsonDocument(record).toJson(QJsonDocument::Compact) + '\n');
+}
+
+} // namespace Startup
@@ -0,0 +1,33 @@
+#ifndef STARTUPREPORT_H
+#define STARTUPREPORT_H
+
+#include <QtGlobal>
+
+// Cold start timing, measured from the moment the process was started:
+// main() reached, Main.qml created, first frame on screen, first modem
+// found. Every phase sets cellularpi_startup_ms{phase} as it is reached;
+// report() logs them together and, when CELLULARPI_STARTUP_REPORT names a
+// file, appends them to it as one JSON line with the application version,
+// so releases can be compared. All of it is for the main thread.
+namespace Startup {
+
+enum class Phase {
+    Main,
+    QmlLoaded,
+    FirstFrame,
+    ModemReady
+};
+static constexpr int PHASE_COUNT = 4;
+
+// Starts the clock, first thing in main()
+void begin();
+// Only the first mark of a phase counts
+void mark(Phase phase);
+// -1 until the phase is reached
+qint64 elapsedMs(Phase phase);
+// Once, with the phases reached so far
+void report();
+
+} // namespace Startup
+
+#endif // STARTUPREPORT_H
@@ -0,0 +1,187 @@
+#include "deliverytracker.h"
+
+DeliveryTracker::DeliveryTracker(qint64 timeoutMs)
+    : m_timeoutNs(timeoutMs * 1000000)
+{
+}
+
+void DeliveryTracker::track(const QString &smsPath, const Message &message)
+{
+    if (m_index.contains(smsPath)) {
+        return;
+    }
+    quint32 slot;
+    if (!m_free.empty()) {
+        slot = m_free.back();
+        m_free.pop_back();
+    } else {
+        slot = quint32(m_slots.size());
+        m_slots.emplace_back();
+    }
+    Slot &entry = m_slots[slot];
+    entry.smsPath = smsPath;
+    entry.message = message;
+    entry.used = true;
+    m_index.insert(smsPath, slot);
+    m_expiry.enqueue({slot, entry.generation, message.sentNs + m_timeoutNs});
+}
+
+std::optional<DeliveryTracker::Result> DeliveryTracker::update(const QString &smsPath, uint deliveryState)
+{
+    if (!isFinal(deliveryState)) {
+        return std::nullopt;
+    }
+    const auto it = m_index.constFind(smsPath);
+    if (it == m_index.constEnd()) {
+        return std::nullopt;
+    }
+    return release(*it, isDelivered(deliveryState) ? Outcome::Delivered : Outcome::Failed,
+                   deliveryState);
+}
+
+QList<DeliveryTracker::Result> DeliveryTracker::expire(qint64 nowNs)
+{
+    QList<Result> expired;
+    while (!m_expiry.isEmpty()) {
+        const Expiry &front = m_expiry.head();
+        if (!isLive(front)) {
+            m_expiry.dequeue();
+            continue;
+        }
+        if (front.atNs > nowNs) {
+            break;
+        }
+        const quint32 slot = m_expiry.dequeue().slot;
+        expired.append(release(slot, Outcome::Unknown, 0));
+    }
+    return expired;
+}
+
+qint64 DeliveryTracker::nextExpiryNs() const
+{
+    for (const Expiry &expiry : m_expiry) {
+        if (isLive(expiry)) {
+            return expiry.atNs;
+        }
+    }
+    return 0;
+}
+
+QList<DeliveryTracker::Result> DeliveryTracker::drop(const QString &modemPath)
+{
+    // Collected first, release() may rebuild m_expiry
+    QList<quint32> releasing;
+    for (const Expiry &expiry : std::as_const(m_expiry)) {
+        if (isLive(expiry)
+            && (modemPath.isEmpty() || m_slots[expiry.slot].message.modemPath == modemPath)) {
+            releasing.append(expiry.slot);
+        }
+    }
+    QList<Result> dropped;
+    dropped.reserve(releasing.size());
+    for (quint32 slot : std::as_const(releasing)) {
+        dropped.append(release(slot, Outcome::Unknown, 0));
+    }
+    return dropped;
+}
+
+bool DeliveryTracker::contains(const QString &smsPath) const
+{
+    return m_index.contains(smsPath);
+}
+
+int DeliveryTracker::size() const
+{
+    return int(m_index.size());
+}
+
+bool DeliveryTracker::isFinal(uint deliveryState)
+{
+    return deliveryState < 0x20 || (deliveryState >= 0x40 && deliveryState < 0x100);
+}
+
+bool DeliveryTracker::isDelivered(uint deliveryState)
+{
+    return deliveryState < 0x20;
+}
+
+QString DeliveryTracker::describe(uint deliveryState)
+{
+    // 0x6x are the 0x2x errors after the service centre stopped retrying
+    switch (deliveryState < 0x60 || deliveryState > 0x65 ? deliveryState : deliveryState - 0x40) {
+    case 0x00: return QStringLiteral("Received");
+    case 0x01: return QStringLiteral("Forwarded, unconfirmed");
+    case 0x02: return QStringLiteral("Replaced by the service centre");
+    case 0x20: return QStringLiteral("Congestion");
+    case 0x21: return QStringLiteral("Recipient busy");
+    case 0x22: return QStringLiteral("No response from recipient");
+    case 0x23: return QStringLiteral("Service rejected");
+    case 0x24:
+    case 0x44: return QStringLiteral("Quality of service not available");
+    case 0x25: return QStringLiteral("Error in recipient");
+    case 0x40: return QStringLiteral("Remote procedure error");
+    case 0x41: return QStringLiteral("Incompatible destination");
+    case 0x42: return QStringLiteral("Connection rejected by recipient");
+    case 0x43: return QStringLiteral("Not obtainable");
+    case 0x45: return QStringLiteral("No interworking available");
+    case 0x46: return QStringLiteral("Validity period expired");
+    case 0x47: return QStringLiteral("Deleted by sender");
+    case 0x48: return QStringLiteral("Deleted by the service centre");
+    case 0x49: return QStringLiteral("Message does not exist");
+    case 0x100: return QStringLiteral("No delivery report");
+    default: return QStringLiteral("Delivery state 0x%1").arg(deliveryState, 0, 16);
+    }
+}
+
+QString DeliveryTracker::networkOf(const QString &number)
+{
+    QString digits;
+    bool international = false;
+    for (const QChar c : number) {
+        if (c == u'+' && digits.isEmpty()) {
+            international = true;
+        } else if (c.isDigit()) {
+            digits.append(c);
+        }
+    }
+    if (!international && digits.startsWith(QLatin1String("00"))) {
+        international = true;
+        digits.remove(0, 2);
+    }
+    if (!international || digits.size() < NETWORK_DIGITS) {
+        return QStringLiteral("unknown");
+    }
+    return QStringLiteral("+") + digits.left(NETWORK_DIGITS);
+}
+
+DeliveryTracker::Result DeliveryTracker::release(quint32 slot, Outcome outcome, uint deliveryState)
+{
+    Slot &entry = m_slots[slot];
+    Result result{std::move(entry.smsPath), std::move(entry.message), outcome, deliveryState};
+    m_index.remove(result.smsPath);
+    entry.smsPath = QString();
+    entry.message = Message();
+    entry.used = false;
+    ++entry.generation;
+    m_free.push_back(slot);
+
+    // Released entries stay in the FIFO until they reach its front; rebuild
+    // it when they are the bulk of it, so it stays proportional to size()
+    if (m_expiry.size() > 2 * m_index.size() + 64) {
+        QQueue<Expiry> live;
+        live.reserve(m_index.size());
+        for (const Expiry &expiry : std::as_const(m_expiry)) {
+            if (isLive(expiry)) {
+                live.enqueue(expiry);
+            }
+        }
+        m_expiry.swap(live);
+    }
+    return result;
+}
+
+bool DeliveryTracker::isLive(const Expiry &expiry) const
+{
+    const Slot &entry = m_slots[expiry.slot];
+    return entry.used && entry.generation == expiry.generation;
+}
@@ -0,0 +1,91 @@
+#ifndef DELIVERYTRACKER_H
+#define DELIVERYTRACKER_H
+
+#include <QHash>
+#include <QList>
+#include <QQueue>
+#include <QString>
+#include <optional>
+#include <vector>
+
+// Sent messages whose delivery report is still outstanding, keyed by the
+// SMS object whose DeliveryState the report updates. Entries live in reused
+// vector slots; a FIFO in send order expires those whose report never comes.
+class DeliveryTracker {
+public:
+    enum class Outcome {
+        Delivered,
+        Failed,     // the network gave up, see deliveryState
+        Unknown     // no report in time, or the SMS object went away
+    };
+
+    struct Message {
+        quint64 handle{0};
+        QString number;
+        QString modemPath;
+        qint64 enqueuedNs{0};
+        qint64 sentNs{0};
+    };
+
+    struct Result {
+        QString smsPath;
+        Message message;
+        Outcome outcome{Outcome::Unknown};
+        uint deliveryState{0};
+    };
+
+    // The service centre keeps retrying for hours before it reports failure
+    static constexpr qint64 DEFAULT_TIMEOUT_MS = 4 * 60 * 60 * 1000;
+
+    explicit DeliveryTracker(qint64 timeoutMs = DEFAULT_TIMEOUT_MS);
+
+    void track(const QString& smsPath, const Message& message);
+    // A DeliveryState reported for smsPath. The result once it is final;
+    // temporary errors leave the message waiting.
+    std::optional<Result> update(const QString& smsPath, uint deliveryState);
+    // Messages sent more than the timeout before nowNs, oldest first
+    QList<Result> expire(qint64 nowNs);
+    // When the oldest message expires, 0 when there is none
+    qint64 nextExpiryNs() const;
+    // Messages on modemPath, or all of them for an empty path, as Unknown
+    QList<Result> drop(const QString& modemPath = QString());
+    bool contains(const QString& smsPath) const;
+    int size() const;
+
+    // MMSmsDeliveryState: below 0x20 delivered, 0x20-0x3f the service
+    // centre is still trying, 0x40-0x7f it gave up; 0x100 means no report
+    static bool isFinal(uint deliveryState);
+    static bool isDelivered(uint deliveryState);
+    static QString describe(uint deliveryState);
+    // Groups international numbers by their first NETWORK_DIGITS digits:
+    // the country code and the start of the national number, which in
+    // most numbering plans tells the mobile networks apart
+    static QString networkOf(const QString& number);
+
+private:
+    static constexpr int NETWORK_DIGITS = 5;
+
+    struct Slot {
+        QString smsPath;
+        Message message;
+        quint32 generation{0};  // bumped on release, invalidates m_expiry entries
+        bool used{false};
+    };
+
+    struct Expiry {
+        quint32 slot{0};
+        quint32 generation{0};
+        qint64 atNs{0};
+    };
+
+    qint64 m_timeoutNs;
+    std::vector<Slot> m_slots;
+    std::vector<quint32> m_free;
+    QHash<QString, quint32> m_index;
+    QQueue<Expiry> m_expiry;
+
+    Result release(quint32 slot, Outcome outcome, uint deliveryState);
+    bool isLive(const Expiry& expiry) const;
+};
+
+#endif // DELIVERYTRACKER_H
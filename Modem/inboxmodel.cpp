@@ -0,0 +1,115 @@
+#include "inboxmodel.h"
+
+InboxModel::InboxModel(QObject *parent)
+    : QAbstractListModel(parent)
+{
+}
+
+int InboxModel::count() const
+{
+    return m_offsets.size();
+}
+
+int InboxModel::loaded() const
+{
+    return m_loaded;
+}
+
+void InboxModel::reset(const QString &filePath, const QList<qint64> &offsets)
+{
+    beginResetModel();
+    m_file.close();
+    m_file.setFileName(filePath);
+    m_file.open(QIODevice::ReadOnly);
+    m_cache.clear();
+    m_offsets = offsets;
+    m_loaded = qMin<int>(PAGE_SIZE, m_offsets.size());
+    endResetModel();
+    emit countChanged();
+    emit loadedChanged();
+}
+
+void InboxModel::append(const QList<qint64> &offsets)
+{
+    if (offsets.isEmpty()) {
+        return;
+    }
+    // Newest first, so new records go on top
+    beginInsertRows(QModelIndex(), 0, int(offsets.size()) - 1);
+    m_offsets.append(offsets);
+    m_loaded += offsets.size();
+    endInsertRows();
+    emit countChanged();
+    emit loadedChanged();
+}
+
+int InboxModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : m_loaded;
+}
+
+bool InboxModel::canFetchMore(const QModelIndex &parent) const
+{
+    return !parent.isValid() && m_loaded < m_offsets.size();
+}
+
+void InboxModel::fetchMore(const QModelIndex &parent)
+{
+    if (parent.isValid()) {
+        return;
+    }
+    const int more = qMin<int>(PAGE_SIZE, m_offsets.size() - m_loaded);
+    if (more <= 0) {
+        return;
+    }
+    beginInsertRows(QModelIndex(), m_loaded, m_loaded + more - 1);
+    m_loaded += more;
+    endInsertRows();
+    emit loadedChanged();
+}
+
+const InboundSms *InboxModel::message(int row) const
+{
+    const qint64 offset = m_offsets.at(m_offsets.size() - 1 - row);
+    if (InboundSms *cached = m_cache.object(offset)) {
+        return cached;
+    }
+    std::optional<InboundSms> decoded = SmsInbox::read(m_file, offset);
+    if (!decoded) {
+        return nullptr;
+    }
+    auto *entry = new InboundSms(std::move(*decoded));
+    m_cache.insert(offset, entry);
+    return entry;
+}
+
+QVariant InboxModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() >= m_loaded) {
+        return QVariant();
+    }
+    const InboundSms *sms = message(index.row());
+    if (!sms) {
+        return QVariant();
+    }
+    switch (role) {
+    case NumberRole:
+        return sms->number;
+    case Qt::DisplayRole:
+    case TextRole:
+        return sms->text;
+    case TimestampRole:
+        return sms->timestamp;
+    default:
+        return QVariant();
+    }
+}
+
+QHash<int, QByteArray> InboxModel::roleNames() const
+{
+    return {
+        {NumberRole, "number"},
+        {TextRole, "text"},
+        {TimestampRole, "timestamp"},
+    };
+}
@@ -0,0 +1,63 @@
+#ifndef INBOXMODEL_H
+#define INBOXMODEL_H
+
+#include <QAbstractListModel>
+#include <QQmlEngine>
+#include <QFile>
+#include <QCache>
+#include <QList>
+#include "smsinbox.h"
+
+// Received messages for QML, newest first.
+//
+// Only record offsets are held in memory. Rows are exposed a page at a
+// time through canFetchMore()/fetchMore(), so a ListView pulls in older
+// messages as it scrolls, and records are decoded on first access into a
+// bounded cache. New messages are inserted at the top as they are stored.
+class InboxModel : public QAbstractListModel {
+    Q_OBJECT
+    QML_ELEMENT
+    QML_UNCREATABLE("Provided by Modem.inbox")
+
+    Q_PROPERTY(int count READ count NOTIFY countChanged)
+    Q_PROPERTY(int loaded READ loaded NOTIFY loadedChanged)
+public:
+    enum Roles {
+        NumberRole = Qt::UserRole + 1,
+        TextRole,
+        TimestampRole
+    };
+
+    explicit InboxModel(QObject* parent = nullptr);
+
+    // Messages in the inbox, and how many of them are exposed as rows
+    int count() const;
+    int loaded() const;
+
+    // Starts over on filePath with the given records
+    void reset(const QString& filePath, const QList<qint64>& offsets);
+    void append(const QList<qint64>& offsets);
+
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+    QHash<int, QByteArray> roleNames() const override;
+    bool canFetchMore(const QModelIndex& parent) const override;
+    void fetchMore(const QModelIndex& parent) override;
+
+signals:
+    void countChanged();
+    void loadedChanged();
+
+private:
+    static constexpr int PAGE_SIZE = 50;
+    static constexpr int CACHE_SIZE = 500;
+
+    QList<qint64> m_offsets;        // arrival order
+    int m_loaded{0};                // newest m_loaded records are rows
+    mutable QFile m_file;
+    mutable QCache<qint64, InboundSms> m_cache{CACHE_SIZE};
+
+    const InboundSms* message(int row) const;
+};
+
+#endif // INBOXMODEL_H
@@ -1,25 +1,131 @@
 #include "modem.h"
 #include "modemdbusmanager.h"
+#include "smsjournal.h"
+#include "smssegmenter.h"
+#include "smsbulk.h"
+#include "metricsregistry.h"
+#include "logging.h"
 #include <QtConcurrent>
 #include <QFutureWatcher>
+#include <QStandardPaths>
 
 Modem::Modem(QObject *parent)
     : QObject{parent}
 {
-     setupDBus();
+     m_bulkProgressTimer.setSingleShot(true);
+     m_bulkProgressTimer.setInterval(BULK_PROGRESS_INTERVAL_MS);
+     connect(&m_bulkProgressTimer, &QTimer::timeout, this, &Modem::publishBulkProgress);
+     // Bound by QML before anything is loaded into it
+     m_inbox = new InboxModel(this);
 }
-Modem::~Modem() = default;
 
+Modem::~Modem()
+{
+    m_dbusThread.quit();
+    m_dbusThread.wait();
+}
+
+void Modem::start()
+{
+    if (m_started) {
+        return;
+    }
+    m_started = true;
+    setupDBus();
+    setupJournal();
+}
+
+bool Modem::isStarted() const
+{
+    return m_started;
+}
+
+bool Modem::isReady() const
+{
+    return m_ready;
+}
 
 void Modem::setupDBus() {
-    m_dbusManager = std::make_unique<ModemDBusManager>(this);
-    connect(m_dbusManager.get(), &ModemDBusManager::smsResult,
-            this, &Modem::handleSMSResult);
-    connect(m_dbusManager.get(), &ModemDBusManager::logInfo,
-            this, &Modem::logInfo);
-    connect(m_dbusManager.get(), &ModemDBusManager::logError,
-            this, &Modem::logError);
-    m_dbusManager->initialize();
+    m_dbusThread.setObjectName("ModemDBus");
+    m_dbusManager = new ModemDBusManager;
+    m_dbusManager->setInboxPath(QStandardPaths::writableLocation(QStandardPaths::AppDataLocation)
+                                + "/inbox.log");
+    // Settings made before start(), while the manager is still ours to call
+    m_dbusManager->setSchedulingPolicy(m_schedulingPolicy == WeightedRoundRobin
+                                           ? ModemScheduler::Policy::WeightedRoundRobin
+                                           : ModemScheduler::Policy::LeastOutstanding);
+    m_dbusManager->setRateLimits(m_rateLimits);
+    m_dbusManager->setDeliveryReports(m_deliveryReports);
+    m_dbusManager->setLinkPacing(m_linkPacing);
+    m_dbusManager->moveToThread(&m_dbusThread);
+    connect(&m_dbusThread, &QThread::finished,
+            m_dbusManager, &QObject::deleteLater);
+
+    // Cross-thread, so every one of these is queued
+    connect(m_dbusManager, &ModemDBusManager::smsResult,
+            this, &Modem::handleSMSResult, Qt::QueuedConnection);
+    connect(m_dbusManager, &ModemDBusManager::smsError,
+            this, &Modem::handleSMSError, Qt::QueuedConnection);
+    connect(m_dbusManager, &ModemDBusManager::inboxOpened,
+            m_inbox, &InboxModel::reset, Qt::QueuedConnection);
+    connect(m_dbusManager, &ModemDBusManager::inboxMessagesStored,
+            this, [this](const QList<qint64> &offsets) {
+                m_inbox->append(offsets);
+                emit messagesReceived(int(offsets.size()));
+            }, Qt::QueuedConnection);
+    connect(m_dbusManager, &ModemDBusManager::deliveryReport,
+            this, [this](SmsHandle, const QString &number, bool delivered, double latencyMs,
+                         const QString &reason) {
+                if (delivered) {
+                    emit smsDelivered(number, latencyMs);
+                } else {
+                    emit smsUndelivered(number, reason);
+                }
+            }, Qt::QueuedConnection);
+    connect(m_dbusManager, &ModemDBusManager::readyChanged,
+            this, [this](bool ready) {
+                m_ready = ready;
+                emit readyChanged();
+            }, Qt::QueuedConnection);
+    connect(m_dbusManager, &ModemDBusManager::modemsChanged,
+            this, [this](const QStringList &modems) {
+                m_modems = modems;
+                emit modemsChanged();
+            }, Qt::QueuedConnection);
+    connect(m_dbusManager, &ModemDBusManager::modemStatsChanged,
+            this, [this](const QVariantList &stats) {
+                m_modemStats = stats;
+                emit modemStatsChanged();
+            }, Qt::QueuedConnection);
+    connect(m_dbusManager, &ModemDBusManager::radioChanged,
+            this, [this](const QVariantList &radio) {
+                m_radio = radio;
+                emit radioChanged();
+            }, Qt::QueuedConnection);
+
+    m_dbusThread.start();
+    QMetaObject::invokeMethod(m_dbusManager, &ModemDBusManager::initialize,
+                              Qt::QueuedConnection);
+}
+
+void Modem::setupJournal()
+{
+    const QString path = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation)
+                         + "/outbox.journal";
+    m_journal = std::make_unique<SmsJournal>(path, SmsJournal::Durability::Batched, this);
+
+    if (!m_journal->open()) {
+        // Keep sending, just without crash safety
+        return;
+    }
+
+    // Messages that never got a result before the last shutdown go first
+    const QList<SmsJournal::Entry> pending = m_journal->pendingEntries();
+    const qint64 now = SmsTimeline::now();
+    for (const SmsJournal::Entry &entry : pending) {
+        m_smsQueue.enqueue({entry.phoneNumber, entry.message, now, QString(), entry.sequence});
+    }
+    scheduleProcessing();
 }
 
 void Modem::sendSMS(const QString &phoneNo, const QString &message) {
@@ -32,54 +138,443 @@ void Modem::resend()
     sendSMS(m_mostRecentRecipient, m_mostRecentMessage);
 }
 
-void Modem::queueSMS(const QString &phoneNo, const QString &message) {
-    QMutexLocker locker(&m_mutex);
-    m_smsQueue.enqueue({phoneNo, message});
+void Modem::sendSMSBatch(const QList<QPair<QString, QString>> &messages)
+{
+    if (messages.isEmpty()) {
+        return;
+    }
+    QMetaObject::invokeMethod(this, [this, messages]() { queueBatch(messages); },
+                              Qt::QueuedConnection);
+}
 
-    if (!m_isProcessing) {
-        QMetaObject::invokeMethod(this, "processSMSQueue", Qt::QueuedConnection);
+void Modem::queueBatch(const QList<QPair<QString, QString>> &messages)
+{
+    start();
+    QList<SmsJournal::Entry> entries;
+    entries.reserve(messages.size());
+    for (const auto &[phoneNo, text] : messages) {
+        entries.append({0, phoneNo, m_transliterate ? SmsSegmenter::transliterate(text) : text});
     }
+
+    // One journal commit for all of them, then one processSMSQueue pass
+    const QList<quint64> sequences = m_journal->appendBatch(entries);
+    const qint64 now = SmsTimeline::now();
+    for (qsizetype i = 0; i < entries.size(); ++i) {
+        m_smsQueue.enqueue({entries.at(i).phoneNumber, entries.at(i).message, now, QString(),
+                            sequences.at(i)});
+    }
+    scheduleProcessing();
 }
 
-void Modem::processSMSQueue() {
-    QMutexLocker locker(&m_mutex);
+int Modem::sendBulk(const QStringList &recipients, const QString &messageTemplate,
+                    const QVariantMap &variables)
+{
+    static std::atomic<int> nextBatchId{1};
+    const int batchId = nextBatchId.fetch_add(1, std::memory_order_relaxed);
+    QMetaObject::invokeMethod(this, [this, batchId, recipients, messageTemplate, variables]() {
+            queueBulk(batchId, recipients, messageTemplate, variables);
+        }, Qt::QueuedConnection);
+    return batchId;
+}
+
+void Modem::queueBulk(int batchId, const QStringList &recipients, const QString &messageTemplate,
+                      const QVariantMap &variables)
+{
+    start();
+    const SmsBulk::Batch batch = SmsBulk::prepare(recipients, messageTemplate, variables,
+                                                  m_defaultCountryCode);
+
+    QList<SmsJournal::Entry> entries;
+    entries.reserve(batch.messages.size());
+    for (const SmsBulk::Message &message : batch.messages) {
+        entries.append({0, message.phoneNumber,
+                        m_transliterate ? SmsSegmenter::transliterate(message.text) : message.text});
+    }
+
+    // One journal commit for the batch. A replay after a crash sends the
+    // rest as single messages, the batch id does not survive a restart.
+    const QList<quint64> sequences = m_journal->appendBatch(entries);
+    const qint64 now = SmsTimeline::now();
+    for (qsizetype i = 0; i < entries.size(); ++i) {
+        m_smsQueue.enqueue({entries.at(i).phoneNumber, entries.at(i).message, now, QString(),
+                            sequences.at(i), batchId});
+    }
+
+    CPI_LOG_INFO("modem", "Bulk queued",
+                 {{"batch", batchId}, {"queued", int(entries.size())},
+                  {"duplicates", batch.duplicates}, {"rejected", int(batch.rejected.size())}});
+    emit bulkQueued(batchId, int(entries.size()), batch.duplicates, batch.rejected);
+
+    if (entries.isEmpty()) {
+        emit bulkFinished(batchId, 0, 0);
+        return;
+    }
+    m_bulks.insert(batchId, {int(entries.size()), 0, 0});
+    emit inFlightChanged();
+    scheduleProcessing();
+}
 
-    if (m_isProcessing || m_smsQueue.isEmpty()) {
+void Modem::bulkMessageDone(int batchId, bool success)
+{
+    const auto it = m_bulks.find(batchId);
+    if (it == m_bulks.end()) {
+        return;
+    }
+    ++(success ? it->sent : it->failed);
+
+    if (it->sent + it->failed < it->total) {
+        m_bulkProgressDirty.insert(batchId);
+        if (!m_bulkProgressTimer.isActive()) {
+            m_bulkProgressTimer.start();
+        }
         return;
     }
 
-    m_isProcessing = true;
-    SMSData smsData = m_smsQueue.dequeue();
-    m_mostRecentRecipient = smsData.phoneNumber;
-    m_mostRecentMessage = smsData.message;
+    const BulkProgress done = *it;
+    m_bulks.erase(it);
+    m_bulkProgressDirty.remove(batchId);
+    emit bulkProgress(batchId, done.sent, done.failed, done.total);
+    emit bulkFinished(batchId, done.sent, done.failed);
+    CPI_LOG_INFO("modem", "Bulk finished",
+                 {{"batch", batchId}, {"sent", done.sent}, {"failed", done.failed}});
+}
 
-    emit smsSending(smsData.phoneNumber);
+void Modem::publishBulkProgress()
+{
+    const QSet<int> dirty = std::exchange(m_bulkProgressDirty, {});
+    for (int batchId : dirty) {
+        const auto it = m_bulks.constFind(batchId);
+        if (it != m_bulks.constEnd()) {
+            emit bulkProgress(batchId, it->sent, it->failed, it->total);
+        }
+    }
+}
 
-    emit logInfo("[Modem] Sending SMS over D-Bus");
-    sendSMSOverDBus(smsData);
+InboxModel *Modem::inbox() const
+{
+    return m_inbox;
 }
 
-void Modem::sendSMSOverDBus(const SMSData& smsData) {
-    m_dbusManager->sendSMS(smsData.phoneNumber, smsData.message);
+int Modem::maxInFlight() const
+{
+    return m_maxInFlight;
 }
 
-void Modem::handleSMSResult(bool success) {
-    if (success) {
-        emit smsSent(m_mostRecentRecipient);
-        emit logInfo("SMS sent successfully to " + m_mostRecentRecipient);
-    } else {
-        emit smsFailed(m_mostRecentRecipient);
-        emit logError("Failed to send SMS to " + m_mostRecentRecipient);
+void Modem::setMaxInFlight(int maxInFlight)
+{
+    maxInFlight = qBound(1, maxInFlight, MAX_IN_FLIGHT_LIMIT);
+    if (m_maxInFlight == maxInFlight)
+        return;
+    m_maxInFlight = maxInFlight;
+    emit maxInFlightChanged();
+    // A wider window may let queued messages go out right away
+    scheduleProcessing();
+}
+
+int Modem::inFlight() const
+{
+    return m_inFlight.size();
+}
+
+int Modem::queued() const
+{
+    return m_smsQueue.size();
+}
+
+double Modem::throughput() const
+{
+    return m_throughput;
+}
+
+Modem::SchedulingPolicy Modem::schedulingPolicy() const
+{
+    return m_schedulingPolicy;
+}
+
+void Modem::setSchedulingPolicy(SchedulingPolicy policy)
+{
+    if (m_schedulingPolicy == policy)
+        return;
+    m_schedulingPolicy = policy;
+    emit schedulingPolicyChanged();
+    if (!m_dbusManager) {
+        return;
     }
+    const auto schedulerPolicy = policy == WeightedRoundRobin
+                                     ? ModemScheduler::Policy::WeightedRoundRobin
+                                     : ModemScheduler::Policy::LeastOutstanding;
+    QMetaObject::invokeMethod(m_dbusManager, [manager = m_dbusManager, schedulerPolicy]() {
+            manager->setSchedulingPolicy(schedulerPolicy);
+        }, Qt::QueuedConnection);
+}
+
+int Modem::modemCount() const
+{
+    return m_modems.size();
+}
+
+QVariantList Modem::modemStats() const
+{
+    return m_modemStats;
+}
 
-    QMetaObject::invokeMethod(this, [this]() {
-            QMutexLocker locker(&m_mutex);
-            m_isProcessing = false;
+QVariantList Modem::radio() const
+{
+    return m_radio;
+}
 
-            if (!m_smsQueue.isEmpty()) {
-                QMetaObject::invokeMethod(this, "processSMSQueue",
-                                          Qt::QueuedConnection);
-            }
+bool Modem::linkPacing() const
+{
+    return m_linkPacing;
+}
+
+void Modem::setLinkPacing(bool enabled)
+{
+    if (m_linkPacing == enabled)
+        return;
+    m_linkPacing = enabled;
+    if (m_dbusManager) {
+        QMetaObject::invokeMethod(m_dbusManager, [manager = m_dbusManager, enabled]() {
+                manager->setLinkPacing(enabled);
+            }, Qt::QueuedConnection);
+    }
+    emit linkPacingChanged();
+}
+
+double Modem::modemRateLimit() const
+{
+    return m_rateLimits.modemRate;
+}
+
+void Modem::setModemRateLimit(double rate)
+{
+    rate = qMax(0.0, rate);
+    if (qFuzzyCompare(m_rateLimits.modemRate, rate))
+        return;
+    m_rateLimits.modemRate = rate;
+    applyRateLimits();
+}
+
+double Modem::destinationRateLimit() const
+{
+    return m_rateLimits.destinationRate;
+}
+
+void Modem::setDestinationRateLimit(double rate)
+{
+    rate = qMax(0.0, rate);
+    if (qFuzzyCompare(m_rateLimits.destinationRate, rate))
+        return;
+    m_rateLimits.destinationRate = rate;
+    applyRateLimits();
+}
+
+void Modem::applyRateLimits()
+{
+    if (m_dbusManager) {
+        QMetaObject::invokeMethod(m_dbusManager, [manager = m_dbusManager, limits = m_rateLimits]() {
+                manager->setRateLimits(limits);
+            }, Qt::QueuedConnection);
+    }
+    emit rateLimitsChanged();
+}
+
+bool Modem::deliveryReports() const
+{
+    return m_deliveryReports;
+}
+
+void Modem::setDeliveryReports(bool enabled)
+{
+    if (m_deliveryReports == enabled)
+        return;
+    m_deliveryReports = enabled;
+    if (m_dbusManager) {
+        QMetaObject::invokeMethod(m_dbusManager, [manager = m_dbusManager, enabled]() {
+                manager->setDeliveryReports(enabled);
+            }, Qt::QueuedConnection);
+    }
+    emit deliveryReportsChanged();
+}
+
+QString Modem::defaultCountryCode() const
+{
+    return m_defaultCountryCode;
+}
+
+void Modem::setDefaultCountryCode(const QString &countryCode)
+{
+    if (m_defaultCountryCode == countryCode)
+        return;
+    m_defaultCountryCode = countryCode;
+    emit defaultCountryCodeChanged();
+}
+
+bool Modem::transliterate() const
+{
+    return m_transliterate;
+}
+
+void Modem::setTransliterate(bool transliterate)
+{
+    if (m_transliterate == transliterate)
+        return;
+    m_transliterate = transliterate;
+    emit transliterateChanged();
+}
+
+QVariantMap Modem::segmentInfo(const QString &message) const
+{
+    if (m_transliterate) {
+        return SmsSegmenter::analyze(SmsSegmenter::transliterate(message)).toVariantMap();
+    }
+    return SmsSegmenter::analyze(message).toVariantMap();
+}
+
+void Modem::queueSMS(const QString &phoneNo, const QString &text) {
+    start();
+    // Journal what actually goes out, so a replay sends the same text
+    const QString message = m_transliterate ? SmsSegmenter::transliterate(text) : text;
+    const quint64 sequence = m_journal->append(phoneNo, message);
+    m_smsQueue.enqueue({phoneNo, message, SmsTimeline::now(), QString(), sequence});
+    scheduleProcessing();
+}
+
+// Coalesces back-to-back enqueues into one processSMSQueue pass
+void Modem::scheduleProcessing()
+{
+    updateQueueMetrics();
+    if (m_processScheduled || m_smsQueue.isEmpty() || m_inFlight.size() >= m_maxInFlight) {
+        return;
+    }
+    m_processScheduled = true;
+    QMetaObject::invokeMethod(this, "processSMSQueue", Qt::QueuedConnection);
+}
+
+void Modem::processSMSQueue() {
+    m_processScheduled = false;
+    if (m_smsQueue.isEmpty() || m_inFlight.size() >= m_maxInFlight) {
+        return;
+    }
+
+    if (!m_burstTimer.isValid()) {
+        m_burstTimer.start();
+        m_burstCompleted = 0;
+    }
+
+    // Fill the window: every dispatched message goes straight into the
+    // Create stage, ModemDBusManager serialises the Send stage
+    QList<SmsRequest> requests;
+    QStringList sending;
+    while (!m_smsQueue.isEmpty() && m_inFlight.size() < m_maxInFlight) {
+        const SMSData smsData = m_smsQueue.dequeue();
+        const SmsHandle handle = ModemDBusManager::reserveHandle();
+        m_inFlight.insert(handle, smsData);
+        if (smsData.batchId == 0) {
+            m_mostRecentRecipient = smsData.phoneNumber;
+            m_mostRecentMessage = smsData.message;
+            sending.append(smsData.phoneNumber);
+        }
+        requests.append({handle, smsData.phoneNumber, smsData.message, smsData.enqueuedNs});
+    }
+    sendSMSOverDBus(requests);
+    updateQueueMetrics();
+
+    emit inFlightChanged();
+    // Bulk messages report through bulkProgress instead
+    for (const QString &recipient : std::as_const(sending)) {
+        emit smsSending(recipient);
+    }
+    CPI_LOG_DEBUG("modem", "Dispatched SMS over D-Bus",
+                  {{"count", int(requests.size())}, {"inFlight", int(m_inFlight.size())}});
+}
+
+// One hand-off to the D-Bus thread per batch
+void Modem::sendSMSOverDBus(const QList<SmsRequest> &requests) {
+    QMetaObject::invokeMethod(m_dbusManager, [manager = m_dbusManager, requests]() {
+            manager->submit(requests);
         }, Qt::QueuedConnection);
 }
 
+void Modem::handleSMSError(SmsHandle handle, const QString &error, bool noModem)
+{
+    const auto it = m_inFlight.find(handle);
+    if (it != m_inFlight.end()) {
+        it->lastError = error;
+        it->noModem = noModem;
+    }
+}
+
+void Modem::handleSMSResult(SmsHandle handle, bool success, const SmsTimeline &timeline) {
+    const auto it = m_inFlight.constFind(handle);
+    if (it == m_inFlight.constEnd()) {
+        CPI_LOG_WARNING("modem", "Result for unknown SMS ignored", {{"sms", handle}});
+        return;
+    }
+    const QString recipient = it->phoneNumber;
+    const QString error = it->lastError;
+    const int batchId = it->batchId;
+    // The message has its final result, it must not be replayed. One that
+    // never reached a modem stays in the journal for the next start.
+    if (success || !it->noModem) {
+        m_journal->acknowledge(it->journalSequence);
+    }
+    m_inFlight.erase(it);
+    ++m_burstCompleted;
+    updateThroughput();
+    updateQueueMetrics();
+
+    const bool burstDrained = m_smsQueue.isEmpty() && m_inFlight.isEmpty();
+    const qint64 burstElapsedMs = m_burstTimer.isValid() ? m_burstTimer.elapsed() : 0;
+    if (burstDrained) {
+        m_burstTimer.invalidate();
+    }
+
+    emit inFlightChanged();
+    emit throughputChanged();
+
+    if (batchId != 0) {
+        // Only failures are worth a line each in a bulk send
+        if (!success) {
+            CPI_LOG_WARNING("modem", "Failed to send SMS",
+                            {{"to", recipient}, {"batch", batchId}, {"error", error}});
+        }
+        bulkMessageDone(batchId, success);
+    } else if (success) {
+        emit smsSent(recipient);
+        CPI_LOG_INFO("modem", "SMS sent", {{"to", recipient}});
+    } else {
+        emit smsFailed(recipient);
+        CPI_LOG_ERROR("modem", "Failed to send SMS", {{"to", recipient}, {"error", error}});
+    }
+    if (batchId == 0) {
+        CPI_LOG_DEBUG("modem", "SMS timing",
+                      {{"sms", handle}, {"queueMs", timeline.queueMs()},
+                       {"createMs", timeline.createMs()}, {"sendWaitMs", timeline.sendWaitMs()},
+                       {"sendMs", timeline.sendMs()}, {"attempts", timeline.attempts}});
+    }
+
+    if (burstDrained) {
+        CPI_LOG_INFO("modem", "Burst drained",
+                     {{"count", m_burstCompleted}, {"elapsedMs", burstElapsedMs},
+                      {"msgsPerSec", m_throughput}});
+    } else {
+        scheduleProcessing();
+    }
+}
+
+void Modem::updateQueueMetrics()
+{
+    static Gauge &queued = MetricsRegistry::instance().gauge(
+        "cellularpi_sms_queue_depth", "Messages waiting for an in-flight slot");
+    static Gauge &inFlight = MetricsRegistry::instance().gauge(
+        "cellularpi_sms_in_flight", "Messages handed to the D-Bus thread without a result yet");
+    queued.set(m_smsQueue.size());
+    inFlight.set(m_inFlight.size());
+}
+
+void Modem::updateThroughput()
+{
+    const qint64 elapsedMs = m_burstTimer.isValid() ? m_burstTimer.elapsed() : 0;
+    m_throughput = elapsedMs > 0 ? m_burstCompleted * 1000.0 / elapsedMs : 0.0;
+}
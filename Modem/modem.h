@@ -2,57 +2,236 @@
 #define MODEM_MODULE_H
 
 #include <QQmlEngine>
-#include <QMutex>
 #include <QQueue>
+#include <QHash>
+#include <QThread>
+#include <QElapsedTimer>
+#include <QSet>
+#include <QTimer>
+#include "modemdbusmanager.h"
+#include "inboxmodel.h"
 
-class ModemDBusManager;
+class SmsJournal;
 
+// Thread ownership: Modem, its queue and its journal live on the thread
+// that created it (the GUI thread when QML instantiates the singleton).
+// ModemDBusManager lives on m_dbusThread. The two only exchange queued
+// calls and queued signals, so neither side needs a lock.
+//
+// Construction is cheap and touches neither D-Bus nor the disk; start()
+// opens the journal and brings up the D-Bus thread. The application calls
+// it once the first frame is on screen, sends before that start it.
 class Modem : public QObject {
     Q_OBJECT
     QML_ELEMENT
     QML_SINGLETON
+
+    Q_PROPERTY(int maxInFlight READ maxInFlight WRITE setMaxInFlight NOTIFY maxInFlightChanged)
+    Q_PROPERTY(int inFlight READ inFlight NOTIFY inFlightChanged)
+    Q_PROPERTY(int queued READ queued NOTIFY inFlightChanged)
+    Q_PROPERTY(double throughput READ throughput NOTIFY throughputChanged)
+    Q_PROPERTY(SchedulingPolicy schedulingPolicy READ schedulingPolicy WRITE setSchedulingPolicy NOTIFY schedulingPolicyChanged)
+    Q_PROPERTY(bool ready READ isReady NOTIFY readyChanged)
+    Q_PROPERTY(int modemCount READ modemCount NOTIFY modemsChanged)
+    Q_PROPERTY(QVariantList modemStats READ modemStats NOTIFY modemStatsChanged)
+    Q_PROPERTY(QVariantList radio READ radio NOTIFY radioChanged)
+    Q_PROPERTY(bool linkPacing READ linkPacing WRITE setLinkPacing NOTIFY linkPacingChanged)
+    Q_PROPERTY(bool transliterate READ transliterate WRITE setTransliterate NOTIFY transliterateChanged)
+    Q_PROPERTY(double modemRateLimit READ modemRateLimit WRITE setModemRateLimit NOTIFY rateLimitsChanged)
+    Q_PROPERTY(double destinationRateLimit READ destinationRateLimit WRITE setDestinationRateLimit NOTIFY rateLimitsChanged)
+    Q_PROPERTY(bool deliveryReports READ deliveryReports WRITE setDeliveryReports NOTIFY deliveryReportsChanged)
+    Q_PROPERTY(InboxModel *inbox READ inbox CONSTANT)
+    Q_PROPERTY(QString defaultCountryCode READ defaultCountryCode WRITE setDefaultCountryCode NOTIFY defaultCountryCodeChanged)
 public:
+    // How messages are spread over several messaging-capable modems
+    enum SchedulingPolicy {
+        LeastOutstanding,
+        WeightedRoundRobin
+    };
+    Q_ENUM(SchedulingPolicy)
+
     explicit Modem(QObject *parent = nullptr);
     ~Modem();
 
+    // Opens the journal, replays what it holds and starts modem discovery.
+    // Does nothing when already started.
+    void start();
+    bool isStarted() const;
+    // True while a messaging-capable modem is available
+    bool isReady() const;
+
+    // Safe to call from any thread
     Q_INVOKABLE void sendSMS(const QString &phoneNo, const QString &message);
     Q_INVOKABLE void resend();
+    // Safe to call from any thread. Like sendSMS for each (number, text)
+    // pair, with one hop to the Modem thread and one journal commit for
+    // all of them. Results still come per message as smsSent / smsFailed.
+    void sendSMSBatch(const QList<QPair<QString, QString>> &messages);
+
+    // Safe to call from any thread. Sends messageTemplate to every
+    // recipient: numbers are normalised to E.164 and deduplicated,
+    // {name} placeholders are filled from variables (see SmsBulk::prepare)
+    // and the batch is queued and journalled in one go. Progress comes as
+    // bulkQueued / bulkProgress / bulkFinished for the returned batch id,
+    // not as per-message smsSending / smsSent / smsFailed.
+    Q_INVOKABLE int sendBulk(const QStringList &recipients, const QString &messageTemplate,
+                             const QVariantMap &variables = {});
+
+    // Encoding and segment count the text would be sent with, see
+    // SmsSegmentInfo::toVariantMap(). Honours the transliterate setting.
+    Q_INVOKABLE QVariantMap segmentInfo(const QString &message) const;
+
+    // Pipeline window: how many messages may be handed to D-Bus at once
+    int maxInFlight() const;
+    void setMaxInFlight(int maxInFlight);
+    int inFlight() const;
+    int queued() const;
+    // Completed messages per second over the current (or last) burst
+    double throughput() const;
+
+    SchedulingPolicy schedulingPolicy() const;
+    void setSchedulingPolicy(SchedulingPolicy policy);
+    int modemCount() const;
+    // One map per modem: path, outstanding, sent, failed, latencyMs,
+    // failureRate, throughput
+    QVariantList modemStats() const;
+    // One map per modem: path, link (down/poor/fair/good/unknown),
+    // technology, quality (%), signalDbm, snrDb, roaming, and history
+    // {t, quality, signalDbm, link}: parallel arrays, oldest first, one
+    // sample per RadioTelemetry::SAMPLE_INTERVAL_MS
+    QVariantList radio() const;
+    // Pause a modem while its radio is down and slow it while the link is
+    // weak or roaming, see RadioTelemetry::pacing()
+    bool linkPacing() const;
+    void setLinkPacing(bool enabled);
+    // Rewrite text to GSM-7 where possible before queueing, so that e.g.
+    // typographic quotes do not force a message into UCS-2
+    bool transliterate() const;
+    void setTransliterate(bool transliterate);
+    // Received messages, newest first
+    InboxModel *inbox() const;
+
+    // Ceilings in msgs/sec, 0 disables the limit. The per-modem rate backs
+    // off below its ceiling while a modem reports congestion errors.
+    double modemRateLimit() const;
+    void setModemRateLimit(double rate);
+    double destinationRateLimit() const;
+    void setDestinationRateLimit(double rate);
+    // Ask the network to confirm delivery of each message sent from now on;
+    // the outcome arrives as smsDelivered or smsUndelivered after smsSent
+    bool deliveryReports() const;
+    void setDeliveryReports(bool enabled);
+    // Replaces the trunk prefix of national numbers, e.g. "254"
+    QString defaultCountryCode() const;
+    void setDefaultCountryCode(const QString &countryCode);
 
 signals:
     void smsSending(const QString &recipient);
     void smsSent(const QString &recipient);
     void smsFailed(const QString &recipient);
-    void logInfo(const QString &message);
-    void logError(const QString &message);
+    // latencyMs runs from queueing to the delivery report
+    void smsDelivered(const QString &recipient, double latencyMs);
+    void smsUndelivered(const QString &recipient, const QString &reason);
+    void maxInFlightChanged();
+    void inFlightChanged();
+    void throughputChanged();
+    void schedulingPolicyChanged();
+    void readyChanged();
+    void modemsChanged();
+    void modemStatsChanged();
+    void radioChanged();
+    void linkPacingChanged();
+    void transliterateChanged();
+    void defaultCountryCodeChanged();
+    void rateLimitsChanged();
+    void deliveryReportsChanged();
+    void messagesReceived(int count);
+    void bulkQueued(int batchId, int accepted, int duplicates, const QStringList &rejected);
+    // Throttled to BULK_PROGRESS_INTERVAL_MS, the last one precedes bulkFinished
+    void bulkProgress(int batchId, int sent, int failed, int total);
+    void bulkFinished(int batchId, int sent, int failed);
 
 private slots:
     void queueSMS(const QString &phoneNo, const QString &message);
     void processSMSQueue();
-    void handleSMSResult(bool success);
+    void handleSMSResult(SmsHandle handle, bool success, const SmsTimeline &timeline);
+    void handleSMSError(SmsHandle handle, const QString &error, bool noModem);
 
 private:
     // Structure to hold SMS data
     struct SMSData {
         QString phoneNumber;
         QString message;
+        qint64 enqueuedNs{0};
+        QString lastError;
+        bool noModem{false};        // failed without ever reaching a modem
+        quint64 journalSequence{0};
+        int batchId{0};             // 0 for single sends
+    };
+
+    struct BulkProgress {
+        int total{0};
+        int sent{0};
+        int failed{0};
     };
 
-    // Core components
-    std::unique_ptr<ModemDBusManager> m_dbusManager;
+    static constexpr int DEFAULT_MAX_IN_FLIGHT = 4;
+    static constexpr int MAX_IN_FLIGHT_LIMIT = 64;
+    static constexpr int BULK_PROGRESS_INTERVAL_MS = 250;
+    static constexpr char DEFAULT_COUNTRY_CODE[] = "254";
+
+    // Core components. m_dbusManager is owned by m_dbusThread and deleted
+    // there when the thread finishes.
+    QThread m_dbusThread;
+    ModemDBusManager *m_dbusManager{nullptr};
+    std::unique_ptr<SmsJournal> m_journal;
+    InboxModel *m_inbox{nullptr};
 
     // State tracking
-    bool m_isProcessing{false};
+    int m_maxInFlight{DEFAULT_MAX_IN_FLIGHT};
+    QHash<SmsHandle, SMSData> m_inFlight;
+    QQueue<SMSData> m_smsQueue;
     QString m_mostRecentRecipient;
     QString m_mostRecentMessage;
+    bool m_processScheduled{false};
+    bool m_started{false};
+    bool m_ready{false};
+    bool m_transliterate{false};
+    bool m_deliveryReports{true};
+    QString m_defaultCountryCode{DEFAULT_COUNTRY_CODE};
+    SmsRateLimiter::Limits m_rateLimits;
 
-    // Thread safety
-    QMutex m_mutex;
-    QQueue<SMSData> m_smsQueue;
+    // Bulk batches still running, and which of them have unreported progress
+    QHash<int, BulkProgress> m_bulks;
+    QSet<int> m_bulkProgressDirty;
+    QTimer m_bulkProgressTimer;
+
+    // Throughput accounting for the current burst
+    QElapsedTimer m_burstTimer;
+    int m_burstCompleted{0};
+    double m_throughput{0.0};
+
+    // Mirrors of the D-Bus thread's modem state
+    SchedulingPolicy m_schedulingPolicy{LeastOutstanding};
+    QStringList m_modems;
+    QVariantList m_modemStats;
+    QVariantList m_radio;
+    bool m_linkPacing{true};
 
     // Private methods
     void setupDBus();
-    void sendSMSOverDBus(const SMSData &smsData);
+    void setupJournal();
+    void scheduleProcessing();
+    void sendSMSOverDBus(const QList<SmsRequest> &requests);
     void sendSMSOverGateway(const SMSData& smsData);
+    void updateThroughput();
+    void updateQueueMetrics();
+    void applyRateLimits();
+    void queueBatch(const QList<QPair<QString, QString>> &messages);
+    void queueBulk(int batchId, const QStringList &recipients, const QString &messageTemplate,
+                   const QVariantMap &variables);
+    void bulkMessageDone(int batchId, bool success);
+    void publishBulkProgress();
 };
 
 #endif // MODEM_MODULE_H
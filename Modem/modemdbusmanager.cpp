@@ -1,38 +1,144 @@
 #include "modemdbusmanager.h"
+#include "modemmanagerproxy.h"
+#include "smsreceiver.h"
+#include "metricsregistry.h"
+#include "logging.h"
 #include <QTimer>
 #include <QDBusServiceWatcher>
 #include <QDBusPendingCallWatcher>
 #include <QDBusArgument>
-#include <QMutexLocker>
+#include <QDBusMessage>
+#include <QDBusObjectPath>
 #include <QDBusPendingReply>
+#include <QDateTime>
+#include <chrono>
+#include <climits>
+#include <utility>
+
+namespace {
+
+// Reports take anything from seconds to hours
+const QList<double> DELIVERY_BOUNDS{100, 500, 1000, 2000, 5000, 10000, 30000, 60000,
+                                    300000, 900000, 3600000, 14400000};
+
+// Registered once, updated lock-free from the D-Bus thread
+struct DBusMetrics {
+    MetricsRegistry &registry = MetricsRegistry::instance();
+    Histogram &createLatency = registry.histogram(
+        "cellularpi_dbus_create_duration_ms", "Messaging.Create round trip per attempt");
+    Histogram &sendLatency = registry.histogram(
+        "cellularpi_dbus_send_duration_ms", "Sms.Send round trip per attempt");
+    Histogram &totalLatency = registry.histogram(
+        "cellularpi_sms_total_duration_ms", "Enqueue to final result per message");
+    Counter &sent = registry.counter("cellularpi_sms_sent_total", "Messages sent");
+    Counter &failed = registry.counter("cellularpi_sms_failed_total", "Messages given up on");
+    Counter &reconnects = registry.counter(
+        "cellularpi_modem_reconnects_total", "ModemManager came back on the bus");
+    Counter &modemsDropped = registry.counter(
+        "cellularpi_modems_dropped_total", "Messaging modems taken out of rotation");
+    Gauge &modems = registry.gauge("cellularpi_modems", "Messaging modems in rotation");
+    Gauge &throttled = registry.gauge(
+        "cellularpi_sms_throttled", "Messages waiting for a rate limiter token");
+    Counter &delivered = registry.counter(
+        "cellularpi_sms_delivery_reports_total", "Final delivery outcome of sent messages",
+        {{"outcome", "delivered"}});
+    Counter &undelivered = registry.counter(
+        "cellularpi_sms_delivery_reports_total", "Final delivery outcome of sent messages",
+        {{"outcome", "failed"}});
+    Counter &unreported = registry.counter(
+        "cellularpi_sms_delivery_reports_total", "Final delivery outcome of sent messages",
+        {{"outcome", "unknown"}});
+    Gauge &awaitingDelivery = registry.gauge(
+        "cellularpi_sms_awaiting_delivery", "Sent messages waiting for their delivery report");
+    Counter &linkChanges = registry.counter(
+        "cellularpi_radio_link_changes_total", "Modem radio links moving between quality classes");
+
+    // One series per error shouldRetryOperation() lets through, plus Other
+    Counter &retries(QDBusError::ErrorType type)
+    {
+        static const QHash<int, Counter *> counters = [this] {
+            QHash<int, Counter *> counters;
+            for (QDBusError::ErrorType retryable : {QDBusError::InvalidArgs, QDBusError::UnknownObject,
+                                                    QDBusError::ServiceUnknown, QDBusError::Failed,
+                                                    QDBusError::NoReply, QDBusError::Timeout,
+                                                    QDBusError::TimedOut, QDBusError::LimitsExceeded}) {
+                counters.insert(retryable, &registry.counter(
+                                               "cellularpi_sms_retries_total", "Create/Send retries by D-Bus error",
+                                               {{"error", QDBusError::errorString(retryable)}}));
+            }
+            counters.insert(-1, &registry.counter("cellularpi_sms_retries_total",
+                                                  "Create/Send retries by D-Bus error",
+                                                  {{"error", "Other"}}));
+            return counters;
+        }();
+        return *counters.value(type, counters.value(-1));
+    }
+};
+
+DBusMetrics &metrics()
+{
+    static DBusMetrics metrics;
+    return metrics;
+}
+
+} // namespace
+
+qint64 SmsTimeline::now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
 
 ModemDBusManager::ModemDBusManager(QObject* parent)
+    : ModemDBusManager(defaultConnection(), parent)
+{
+}
+
+ModemDBusManager::ModemDBusManager(const QDBusConnection& connection, QObject* parent)
     : QObject(parent)
-    , m_dbusConnection(QDBusConnection::systemBus())
+    , m_dbusConnection(connection)
 {
+    qRegisterMetaType<SmsHandle>("SmsHandle");
+    qRegisterMetaType<SmsTimeline>();
+
     m_dbusInitTimer = std::make_unique<QTimer>(this);
     m_dbusInitTimer->setInterval(DBUS_INIT_RETRY_INTERVAL);
     m_dbusInitTimer->setSingleShot(false);
 
     connect(m_dbusInitTimer.get(), &QTimer::timeout, this, [this]() {
-        if (!m_dbusInterfaces.initialized) {
+        if (!m_ready) {
             if (m_dbusInitRetryCount < DBUS_INIT_MAX_RETRIES) {
                 m_dbusInitRetryCount++;
-                emit logInfo(QString("[Modem] Retrying D-Bus initialization (attempt %1 of %2)")
-                                 .arg(m_dbusInitRetryCount)
-                                 .arg(DBUS_INIT_MAX_RETRIES));
+                CPI_LOG_INFO("modem", "Retrying D-Bus initialization",
+                             {{"attempt", m_dbusInitRetryCount}, {"of", DBUS_INIT_MAX_RETRIES}});
                 initializeDBusInterfaces();
             } else {
                 m_dbusInitTimer->stop();
-                emit logError("[Modem] Failed to initialize D-Bus interfaces after maximum retries");
+                CPI_LOG_ERROR("modem", "Failed to initialize D-Bus interfaces after maximum retries");
+                // Parked messages have waited long enough
+                failWaitingMessages("No messaging-capable modem available");
             }
         } else {
             m_dbusInitTimer->stop();
         }
     });
 
+    m_statsTimer = std::make_unique<QTimer>(this);
+    m_statsTimer->setInterval(STATS_INTERVAL_MS);
+    connect(m_statsTimer.get(), &QTimer::timeout, this, &ModemDBusManager::publishStats);
+
+    m_throttleTimer = std::make_unique<QTimer>(this);
+    m_throttleTimer->setSingleShot(true);
+    m_throttleTimer->setTimerType(Qt::PreciseTimer);
+    connect(m_throttleTimer.get(), &QTimer::timeout, this, &ModemDBusManager::releaseThrottled);
+
+    m_deliveryTimer = std::make_unique<QTimer>(this);
+    m_deliveryTimer->setSingleShot(true);
+    m_deliveryTimer->setTimerType(Qt::VeryCoarseTimer);
+    connect(m_deliveryTimer.get(), &QTimer::timeout, this, &ModemDBusManager::expireDeliveries);
+
     auto* watcher = new QDBusServiceWatcher(
-        "org.freedesktop.ModemManager1",
+        ModemManagerProxy::Service,
         m_dbusConnection,
         QDBusServiceWatcher::WatchForRegistration |
             QDBusServiceWatcher::WatchForUnregistration,
@@ -46,145 +152,644 @@ ModemDBusManager::ModemDBusManager(QObject* parent)
             this, [this] { onModemManagerServiceChanged(false); });
 
     // Start initial initialization attempt
-    QMetaObject::invokeMethod(this, [this] {
-            if (!initializeDBusInterfaces()) {
-                emit logInfo("[Modem] Starting D-Bus initialization retry timer");
-                m_dbusInitTimer->start();
-            }
-        }, Qt::QueuedConnection);
+    QMetaObject::invokeMethod(this, &ModemDBusManager::initializeDBusInterfaces,
+                              Qt::QueuedConnection);
 }
 
 ModemDBusManager::~ModemDBusManager() = default;
 
-bool ModemDBusManager::initialize()
+QDBusConnection ModemDBusManager::defaultConnection()
 {
-    if (!initializeDBusInterfaces()) {
-        emit logInfo("[Modem] Starting D-Bus initialization retry timer");
-        m_dbusInitTimer->start();
-        return false;
+    // Lets benchmarks point the real stack at a mock on a private bus
+    if (qEnvironmentVariable("CELLULARPI_MODEM_BUS") == QLatin1String("session")) {
+        return QDBusConnection::sessionBus();
+    }
+    return QDBusConnection::systemBus();
+}
+
+void ModemDBusManager::setInboxPath(const QString &filePath)
+{
+    m_inboxPath = filePath;
+}
+
+void ModemDBusManager::initialize()
+{
+    if (!m_inboxPath.isEmpty() && !m_receiver) {
+        m_receiver = new SmsReceiver(m_dbusConnection, m_inboxPath, this);
+        connect(m_receiver, &SmsReceiver::inboxOpened, this, &ModemDBusManager::inboxOpened);
+        connect(m_receiver, &SmsReceiver::messagesStored, this, &ModemDBusManager::inboxMessagesStored);
+        m_receiver->start();
+        for (const QString &modemPath : m_scheduler.modems()) {
+            m_receiver->addModem(modemPath);
+        }
+    }
+    subscribeToObjectManager();
+    initializeDBusInterfaces();
+}
+
+// Called on the manager's own thread so signal delivery lands there too
+void ModemDBusManager::subscribeToObjectManager()
+{
+    if (m_subscribed) {
+        return;
+    }
+    m_subscribed =
+        m_dbusConnection.connect(ModemManagerProxy::Service, ModemManagerProxy::ManagerPath,
+                                 ModemManagerProxy::ObjectManagerInterface, "InterfacesAdded",
+                                 this, SLOT(onInterfacesAdded(QDBusMessage))) &&
+        m_dbusConnection.connect(ModemManagerProxy::Service, ModemManagerProxy::ManagerPath,
+                                 ModemManagerProxy::ObjectManagerInterface, "InterfacesRemoved",
+                                 this, SLOT(onInterfacesRemoved(QDBusMessage)));
+    if (!m_subscribed) {
+        CPI_LOG_ERROR("modem", "Failed to subscribe to ModemManager object signals, polling only");
+    }
+
+    // Delivery reports arrive as DeliveryState changes of the SMS objects
+    // messages were sent from. An empty path plus a match on the interface
+    // argument covers all of them with one rule, no proxy per message.
+    if (!m_dbusConnection.connect(ModemManagerProxy::Service, QString(),
+                                  ModemManagerProxy::PropertiesInterface, "PropertiesChanged",
+                                  {ModemManagerProxy::SmsInterface}, QString(),
+                                  this, SLOT(onSmsPropertiesChanged(QDBusMessage)))) {
+        CPI_LOG_ERROR("modem", "Failed to subscribe to SMS property changes, no delivery reports");
+    }
+
+    // Radio telemetry the same way: one rule per interface for all modems,
+    // ModemManager signals every change, nothing is polled
+    const char *const radioInterfaces[] = {ModemManagerProxy::ModemInterface,
+                                           ModemManagerProxy::Modem3gppInterface,
+                                           ModemManagerProxy::SignalInterface};
+    for (const char *interface : radioInterfaces) {
+        if (!m_dbusConnection.connect(ModemManagerProxy::Service, QString(),
+                                      ModemManagerProxy::PropertiesInterface, "PropertiesChanged",
+                                      {QString(interface)}, QString(),
+                                      this, SLOT(onModemPropertiesChanged(QDBusMessage)))) {
+            CPI_LOG_ERROR("modem", "Failed to subscribe to modem property changes", {{"interface", interface}});
+        }
+    }
+}
+
+bool ModemDBusManager::isReady() const
+{
+    return m_ready;
+}
+
+QStringList ModemDBusManager::modems() const
+{
+    return m_scheduler.modems();
+}
+
+void ModemDBusManager::setSchedulingPolicy(ModemScheduler::Policy policy)
+{
+    m_scheduler.setPolicy(policy);
+}
+
+void ModemDBusManager::setRateLimits(const SmsRateLimiter::Limits &limits)
+{
+    m_rateLimiter.setLimits(limits);
+    // Looser limits may let parked messages go right away
+    releaseThrottled();
+}
+
+void ModemDBusManager::setDeliveryReports(bool enabled)
+{
+    m_deliveryReports = enabled;
+}
+
+void ModemDBusManager::setLinkPacing(bool enabled)
+{
+    m_linkPacing = enabled;
+    const QStringList modems = m_scheduler.modems();
+    for (const QString &modemPath : modems) {
+        applyLinkPacing(modemPath);
+    }
+    releaseThrottled();
+}
+
+SmsHandle ModemDBusManager::reserveHandle()
+{
+    static std::atomic<SmsHandle> nextHandle{1};
+    return nextHandle.fetch_add(1, std::memory_order_relaxed);
+}
+
+void ModemDBusManager::submit(const QList<SmsRequest> &requests)
+{
+    const qint64 now = SmsTimeline::now();
+    for (const SmsRequest &request : requests) {
+        MessageRecord record;
+        record.properties["number"] = request.phoneNumber;
+        record.properties["text"] = request.message;
+        if (m_deliveryReports) {
+            record.properties[ModemManagerProxy::DeliveryReportRequestProperty] = true;
+        }
+        record.timeline.enqueuedNs = request.enqueuedNs > 0 ? request.enqueuedNs : now;
+        m_messages.insert(request.handle, record);
+
+        createSMS(request.handle, 0);
+    }
+}
+
+SmsHandle ModemDBusManager::sendSMS(const QString &phoneNumber, const QString &message, qint64 enqueuedNs)
+{
+    const SmsHandle handle = reserveHandle();
+    submit({{handle, phoneNumber, message, enqueuedNs}});
+    return handle;
+}
+
+std::optional<SmsTimeline> ModemDBusManager::timeline(SmsHandle handle) const
+{
+    const auto it = m_messages.constFind(handle);
+    if (it == m_messages.constEnd()) {
+        return std::nullopt;
     }
-    return true;
+    return it->timeline;
 }
 
-void ModemDBusManager::sendSMS(const QString &phoneNumber, const QString &message)
+void ModemDBusManager::createSMS(SmsHandle handle, int retryCount)
 {
-    if (!ensureValidInterfaces()) {
-        emit logError("[Modem] Failed to initialize D-Bus interfaces");
-        emit smsResult(false);
+    auto it = m_messages.find(handle);
+    if (it == m_messages.end()) {
+        return;
+    }
+
+    it->timeline.attempts = retryCount + 1;
+
+    if (m_scheduler.isEmpty()) {
+        // Parked until discovery answers, either way
+        m_waitingForModem.append(handle);
+        initializeDBusInterfaces();
         return;
     }
 
-    QVariantMap properties;
-    properties["number"] = phoneNumber;
-    properties["text"] = message;
+    qint64 waitNs = 0;
+    const QString modemPath = acquireModem(*it, waitNs);
+    if (modemPath.isEmpty()) {
+        throttle(handle, waitNs);
+        return;
+    }
 
-    QDBusPendingCall createCall = m_dbusInterfaces.messaging->asyncCall("Create", properties);
+    // Queue time, rate limiting included, ends at the first attempt,
+    // retries count towards Create
+    const qint64 now = SmsTimeline::now();
+    if (it->timeline.createStartedNs == 0) {
+        it->timeline.createStartedNs = now;
+    }
+    it->modemPath = modemPath;
+    it->attemptStartedNs = now;
+    m_scheduler.onDispatched(modemPath);
+
+    QDBusPendingCall createCall = ModemManagerProxy::createSms(
+        m_dbusConnection, it->modemPath, it->properties);
     auto* createWatcher = new QDBusPendingCallWatcher(createCall, this);
 
     connect(createWatcher, &QDBusPendingCallWatcher::finished,
-            this, [this, createWatcher, properties]() {
-                handleCreateSMSResponse(createWatcher, properties, 0);
+            this, [this, createWatcher, handle, retryCount]() {
+                handleCreateSMSResponse(createWatcher, handle, retryCount);
                 createWatcher->deleteLater();
             });
 }
 
-bool ModemDBusManager::initializeDBusInterfaces()
+// The scheduler's choice if it has a token, otherwise any modem that has
+// one. A retry prefers any modem but the one that just failed it. Returns
+// an empty path and the shortest wait when every modem is throttled.
+QString ModemDBusManager::acquireModem(const MessageRecord &record, qint64 &waitNs)
 {
-    QMutexLocker locker(&m_dbusInitMutex);
+    const QString number = record.properties.value("number").toString();
+    const qint64 now = SmsTimeline::now();
 
-    if (m_dbusInterfaces.initialized) {
-        return true;
+    const QString preferred = m_scheduler.pick(record.avoidModem);
+    waitNs = m_rateLimiter.acquire(preferred, number, now);
+    if (waitNs == 0) {
+        return preferred;
     }
 
-    // Reset any existing interface
-    m_dbusInterfaces.messaging.reset();
-    m_dbusInterfaces.messagingPath.clear();
-    m_dbusInterfaces.initialized = false;
+    const QStringList modems = m_scheduler.modems();
+    for (const QString &path : modems) {
+        if (path == preferred) {
+            continue;
+        }
+        const qint64 wait = m_rateLimiter.acquire(path, number, now);
+        if (wait == 0) {
+            return path;
+        }
+        waitNs = qMin(waitNs, wait);
+    }
+    return QString();
+}
 
-    // Create temporary manager interface
-    QDBusInterface manager("org.freedesktop.ModemManager1",
-                           "/org/freedesktop/ModemManager1",
-                           "org.freedesktop.DBus.ObjectManager",
-                           m_dbusConnection);
+void ModemDBusManager::throttle(SmsHandle handle, qint64 waitNs)
+{
+    m_throttled.append(handle);
+    metrics().throttled.set(m_throttled.size());
+    const int waitMs = int(qMax<qint64>(1, (waitNs + 999999) / 1000000));
+    if (!m_throttleTimer->isActive() || m_throttleTimer->remainingTime() > waitMs) {
+        m_throttleTimer->start(waitMs);
+    }
+}
 
-    if (!manager.isValid()) {
-        emit logError("[Modem] Failed to create ModemManager interface");
-        return false;
+void ModemDBusManager::releaseThrottled()
+{
+    m_throttleTimer->stop();
+    // Still throttled messages come straight back, in the same order
+    const QList<SmsHandle> throttled = std::exchange(m_throttled, {});
+    for (SmsHandle handle : throttled) {
+        const auto it = m_messages.constFind(handle);
+        if (it != m_messages.constEnd()) {
+            createSMS(handle, it->timeline.attempts - 1);
+        }
     }
+    metrics().throttled.set(m_throttled.size());
+}
 
-    // Get managed objects
-    QDBusMessage reply = manager.call("GetManagedObjects");
-    if (reply.type() != QDBusMessage::ReplyMessage) {
-        emit logError("[Modem] Failed to get ModemManager objects: " + reply.errorMessage());
-        return false;
+// Feeds the outcome of one Create+Send attempt back to the scheduler, the
+// rate limiter and the backoff
+void ModemDBusManager::endAttempt(MessageRecord &record, bool success, QDBusError::ErrorType error)
+{
+    if (success) {
+        m_backoff.recordSuccess();
+    } else {
+        m_backoff.recordError(error);
+    }
+    if (record.modemPath.isEmpty()) {
+        return;
+    }
+    const double latencyMs = (SmsTimeline::now() - record.attemptStartedNs) / 1e6;
+    m_scheduler.onCompleted(record.modemPath, success, latencyMs);
+    if (success) {
+        m_rateLimiter.onSuccess(record.modemPath);
+    } else {
+        if (RetryBackoff::classify(error) == RetryBackoff::ErrorClass::Congestion) {
+            m_rateLimiter.onCongestion(record.modemPath);
+        }
+        record.avoidModem = record.modemPath;
+    }
+    record.modemPath.clear();
+}
+
+void ModemDBusManager::finishMessage(SmsHandle handle, bool success, const QString &error,
+                                     bool noModem)
+{
+    const auto it = m_messages.constFind(handle);
+    if (it == m_messages.constEnd()) {
+        return;
+    }
+
+    SmsTimeline timeline = it->timeline;
+    timeline.completedNs = SmsTimeline::now();
+    m_messages.erase(it);
+
+    (success ? metrics().sent : metrics().failed).increment();
+    metrics().totalLatency.observe(timeline.totalMs());
+
+    if (!success) {
+        // Modem reports the failure with the recipient
+        CPI_LOG_DEBUG("modem", "SMS failed", {{"sms", handle}, {"error", error}});
+        emit smsError(handle, error, noModem);
+    }
+    emit smsResult(handle, success, timeline);
+}
+
+void ModemDBusManager::initializeDBusInterfaces()
+{
+    if (m_discoveryInProgress) {
+        return;
+    }
+    m_discoveryInProgress = true;
+
+    auto* watcher = new QDBusPendingCallWatcher(
+        ModemManagerProxy::getManagedObjects(m_dbusConnection), this);
+    connect(watcher, &QDBusPendingCallWatcher::finished,
+            this, [this, watcher]() {
+                m_discoveryInProgress = false;
+                handleManagedObjects(watcher);
+                watcher->deleteLater();
+            });
+}
+
+void ModemDBusManager::handleManagedObjects(const QDBusPendingCallWatcher *watcher)
+{
+    const QDBusMessage reply = watcher->reply();
+    if (reply.type() != QDBusMessage::ReplyMessage || reply.arguments().isEmpty()) {
+        // Parked messages keep waiting: the retry timer, InterfacesAdded or
+        // ModemManager coming back releases them
+        CPI_LOG_ERROR("modem", "Failed to get ModemManager objects", {{"error", reply.errorMessage()}});
+        if (!m_dbusInitTimer->isActive()) {
+            CPI_LOG_INFO("modem", "Starting D-Bus initialization retry timer");
+            m_dbusInitTimer->start();
+        }
+        return;
     }
 
     // Parse the reply
     const QDBusArgument arg = reply.arguments().at(0).value<QDBusArgument>();
     if (arg.currentType() != QDBusArgument::MapType) {
-        emit logError("[Modem] Invalid response format from ModemManager");
-        return false;
+        CPI_LOG_ERROR("modem", "Invalid response format from ModemManager");
+        if (!m_dbusInitTimer->isActive()) {
+            m_dbusInitTimer->start();
+        }
+        return;
     }
 
-    // Look for messaging interface
-    bool found = false;
+    // A full scan replaces the cache, signals keep it current from here on
+    m_objects.clear();
     arg.beginMap();
     while (!arg.atEnd()) {
-        QString path;
-        QVariantMap interfaces;
+        QDBusObjectPath path;
         arg.beginMapEntry();
-        arg >> path >> interfaces;
+        arg >> path;
+        m_objects.insert(path.path(), readInterfaces(arg));
         arg.endMapEntry();
+    }
+    arg.endMap();
 
-        if (interfaces.contains("org.freedesktop.ModemManager1.Modem.Messaging")) {
-            m_dbusInterfaces.messagingPath = path;
-            found = true;
-            break;
+    syncModems();
+    if (!m_ready) {
+        CPI_LOG_ERROR("modem", "No messaging-capable modem found");
+        if (!m_dbusInitTimer->isActive()) {
+            m_dbusInitTimer->start();
         }
     }
-    arg.endMap();
+}
 
-    if (!found) {
-        emit logError("[Modem] No messaging-capable modem found");
-        return false;
+ModemDBusManager::InterfaceProperties ModemDBusManager::readInterfaces(const QDBusArgument &argument)
+{
+    InterfaceProperties interfaces;
+    argument.beginMap();
+    while (!argument.atEnd()) {
+        QString name;
+        QVariantMap properties;
+        argument.beginMapEntry();
+        argument >> name >> properties;
+        argument.endMapEntry();
+        interfaces.insert(name, properties);
+    }
+    argument.endMap();
+    return interfaces;
+}
+
+// Brings the scheduler in line with the messaging modems in the cache
+void ModemDBusManager::syncModems()
+{
+    const QStringList known = m_scheduler.modems();
+    for (const QString &path : known) {
+        if (!m_objects.value(path).contains(ModemManagerProxy::MessagingInterface)) {
+            dropModem(path);
+        }
+    }
+
+    bool added = false;
+    for (auto it = m_objects.cbegin(); it != m_objects.cend(); ++it) {
+        if (it->contains(ModemManagerProxy::MessagingInterface) && !m_scheduler.contains(it.key())) {
+            m_scheduler.addModem(it.key());
+            if (m_receiver) {
+                m_receiver->addModem(it.key());
+            }
+            addRadio(it.key());
+            CPI_LOG_INFO("modem", "Using messaging modem", {{"modem", it.key()}});
+            added = true;
+        }
+    }
+
+    if (added || known.size() != m_scheduler.modems().size()) {
+        metrics().modems.set(m_scheduler.modems().size());
+        emit modemsChanged(m_scheduler.modems());
+    }
+    setReady(!m_scheduler.isEmpty());
+}
+
+// Takes a modem out of rotation and moves its not yet sent messages to the
+// remaining ones. A Send already on the wire reports back on its own.
+void ModemDBusManager::dropModem(const QString &modemPath)
+{
+    if (!m_scheduler.contains(modemPath)) {
+        return;
     }
+    m_scheduler.removeModem(modemPath);
+    m_rateLimiter.removeModem(modemPath);
+    if (m_receiver) {
+        m_receiver->removeModem(modemPath);
+    }
+    m_radio.removeModem(modemPath);
+    m_radioGauges.remove(modemPath);
+    m_radioChanged = true;
+    metrics().modemsDropped.increment();
+    CPI_LOG_ERROR("modem", "Messaging modem disappeared", {{"modem", modemPath}});
 
-    // Create messaging interface
-    try {
-        m_dbusInterfaces.messaging = std::make_unique<QDBusInterface>(
-            "org.freedesktop.ModemManager1",
-            m_dbusInterfaces.messagingPath,
-            "org.freedesktop.ModemManager1.Modem.Messaging",
-            m_dbusConnection,
-            this
-            );
+    // Reports for its messages can no longer arrive
+    const QList<DeliveryTracker::Result> unreported = m_delivery.drop(modemPath);
+    for (const DeliveryTracker::Result &result : unreported) {
+        finishDelivery(result);
+    }
 
-        if (!m_dbusInterfaces.messaging->isValid()) {
-            emit logError("[Modem] Failed to create messaging interface");
-            return false;
+    const SendStage stage = m_sendStages.take(modemPath);
+    for (const PendingSend &pending : stage.queue) {
+        const auto it = m_messages.find(pending.handle);
+        if (it == m_messages.end()) {
+            continue;
         }
+        it->modemPath.clear();
+        it->avoidModem = modemPath;
+        it->timeline.createdNs = 0;
+        CPI_LOG_DEBUG("modem", "SMS failing over", {{"sms", pending.handle}, {"from", modemPath}});
+        QMetaObject::invokeMethod(this, [this, handle = pending.handle, retryCount = pending.retryCount]() {
+                createSMS(handle, retryCount);
+            }, Qt::QueuedConnection);
+    }
+}
 
-        m_dbusInterfaces.initialized = true;
-        emit logInfo("[Modem] D-Bus interfaces initialized successfully");
-        m_dbusInitTimer->stop();  // Stop retry timer on success
-        m_dbusInitRetryCount = 0; // Reset retry count
-        return true;
+void ModemDBusManager::onInterfacesAdded(const QDBusMessage &message)
+{
+    if (message.arguments().size() < 2) {
+        return;
+    }
+    const QString path = message.arguments().at(0).value<QDBusObjectPath>().path();
+    const InterfaceProperties added = readInterfaces(message.arguments().at(1).value<QDBusArgument>());
 
-    } catch (const std::exception& e) {
-        emit logError(QString("[Modem] Exception during interface creation: %1").arg(e.what()));
-        return false;
+    InterfaceProperties &interfaces = m_objects[path];
+    for (auto it = added.cbegin(); it != added.cend(); ++it) {
+        interfaces.insert(it.key(), it.value());
+        // Modem3gpp and Signal show up once a modem in use is enabled
+        updateRadio(path, it.key(), it.value());
+    }
+    if (added.contains(ModemManagerProxy::SignalInterface) && m_radio.contains(path)) {
+        setupSignal(path);
+    }
+
+    if (added.contains(ModemManagerProxy::MessagingInterface)) {
+        CPI_LOG_INFO("modem", "Messaging-capable modem appeared", {{"modem", path}});
+        syncModems();
+    }
+}
+
+void ModemDBusManager::onInterfacesRemoved(const QDBusMessage &message)
+{
+    if (message.arguments().size() < 2) {
+        return;
+    }
+    const QString path = message.arguments().at(0).value<QDBusObjectPath>().path();
+    const QStringList removed = message.arguments().at(1).toStringList();
+
+    auto it = m_objects.find(path);
+    if (it == m_objects.end()) {
+        return;
+    }
+    for (const QString &name : removed) {
+        it->remove(name);
+    }
+    if (it->isEmpty()) {
+        m_objects.erase(it);
+    }
+
+    if (removed.contains(ModemManagerProxy::MessagingInterface) && m_scheduler.contains(path)) {
+        syncModems();
+        if (!m_ready) {
+            m_dbusInitTimer->start();
+        }
+    }
+}
+
+void ModemDBusManager::setReady(bool ready)
+{
+    if (ready == m_ready) {
+        return;
+    }
+    m_ready = ready;
+    emit readyChanged(ready);
+
+    if (!ready) {
+        m_statsTimer->stop();
+        publishStats();
+        return;
+    }
+
+    CPI_LOG_INFO("modem", "D-Bus interfaces initialized successfully");
+    m_dbusInitTimer->stop();  // Stop retry timer on success
+    m_dbusInitRetryCount = 0; // Reset retry count
+    m_statsClock.start();
+    m_statsTimer->start();
+
+    const QList<SmsHandle> waiting = std::exchange(m_waitingForModem, {});
+    for (SmsHandle handle : waiting) {
+        const auto it = m_messages.constFind(handle);
+        if (it != m_messages.constEnd()) {
+            createSMS(handle, it->timeline.attempts - 1);
+        }
+    }
+}
+
+void ModemDBusManager::publishStats()
+{
+    const qint64 elapsedMs = m_statsClock.isValid() ? m_statsClock.restart() : 0;
+    m_scheduler.tick(elapsedMs / 1000.0);
+
+    QVariantList stats = m_scheduler.snapshot();
+    for (QVariant &entry : stats) {
+        QVariantMap modem = entry.toMap();
+        modem["rateLimit"] = m_rateLimiter.currentRate(modem.value("path").toString());
+        entry = modem;
+    }
+    emit modemStatsChanged(stats);
+
+    if (std::exchange(m_radioChanged, false)) {
+        emit radioChanged(m_radio.snapshot());
+    }
+}
+
+// Telemetry for a new messaging modem starts from what discovery returned
+void ModemDBusManager::addRadio(const QString &modemPath)
+{
+    m_radio.addModem(modemPath);
+    const MetricLabels labels{{"modem", modemPath.section('/', -1)}};
+    MetricsRegistry &registry = MetricsRegistry::instance();
+    m_radioGauges.insert(modemPath, {
+        &registry.gauge("cellularpi_radio_signal_quality_percent", "Modem.SignalQuality", labels),
+        &registry.gauge("cellularpi_radio_signal_dbm", "RSRP on LTE/5G, RSCP or RSSI below, 0 unknown", labels),
+        &registry.gauge("cellularpi_radio_link", "0 unknown, 1 down, 2 poor, 3 fair, 4 good", labels)});
+
+    const InterfaceProperties interfaces = m_objects.value(modemPath);
+    for (auto it = interfaces.cbegin(); it != interfaces.cend(); ++it) {
+        updateRadio(modemPath, it.key(), it.value());
+    }
+    if (interfaces.contains(ModemManagerProxy::SignalInterface)) {
+        setupSignal(modemPath);
+    }
+}
+
+void ModemDBusManager::updateRadio(const QString &modemPath, const QString &interface,
+                                   const QVariantMap &properties)
+{
+    if (!m_radio.contains(modemPath)) {
+        return;
+    }
+    const bool linkChanged = m_radio.update(modemPath, interface, properties,
+                                            QDateTime::currentMSecsSinceEpoch());
+    m_radioChanged = true;
+
+    const RadioTelemetry::Sample now = m_radio.current(modemPath);
+    const RadioGauges gauges = m_radioGauges.value(modemPath);
+    gauges.quality->set(now.quality);
+    gauges.signalDbm->set(now.signalDbm);
+    gauges.link->set(int(now.link));
+
+    if (linkChanged) {
+        metrics().linkChanges.increment();
+        CPI_LOG_INFO("modem", "Radio link changed",
+                     {{"modem", modemPath}, {"link", RadioTelemetry::linkName(now.link)},
+                      {"technology", RadioTelemetry::technologyName(now.technology)},
+                      {"signalDbm", int(now.signalDbm)}, {"quality", int(now.quality)},
+                      {"roaming", m_radio.isRoaming(modemPath)}});
+        applyLinkPacing(modemPath);
+        // A modem that resumed or sped up may take parked messages now
+        releaseThrottled();
+    }
+}
+
+void ModemDBusManager::setupSignal(const QString &modemPath)
+{
+    auto *watcher = new QDBusPendingCallWatcher(
+        ModemManagerProxy::setupSignal(m_dbusConnection, modemPath, SIGNAL_REFRESH_S), this);
+    connect(watcher, &QDBusPendingCallWatcher::finished, this, [modemPath, watcher]() {
+        // Many modems have no extended signal values, SignalQuality still works
+        if (watcher->isError()) {
+            CPI_LOG_INFO("modem", "Extended signal values not available",
+                         {{"modem", modemPath}, {"error", watcher->error().message()}});
+        }
+        watcher->deleteLater();
+    });
+}
+
+void ModemDBusManager::applyLinkPacing(const QString &modemPath)
+{
+    m_rateLimiter.setLinkFactor(modemPath, m_linkPacing ? RadioTelemetry::pacing(m_radio.linkQuality(modemPath))
+                                                        : 1.0);
+}
+
+void ModemDBusManager::onModemPropertiesChanged(const QDBusMessage &message)
+{
+    const QString path = message.path();
+    if (!m_radio.contains(path) || message.arguments().size() < 2) {
+        return;
     }
+    const QString interface = message.arguments().at(0).toString();
+    const QVariantMap changed = qdbus_cast<QVariantMap>(message.arguments().at(1));
+
+    // The cache seeds telemetry again after a rediscovery
+    const auto object = m_objects.find(path);
+    if (object != m_objects.end() && object->contains(interface)) {
+        QVariantMap &properties = (*object)[interface];
+        for (auto it = changed.cbegin(); it != changed.cend(); ++it) {
+            properties.insert(it.key(), it.value());
+        }
+    }
+    updateRadio(path, interface, changed);
 }
 
-bool ModemDBusManager::ensureValidInterfaces()
+void ModemDBusManager::failWaitingMessages(const QString &error)
 {
-    if (!m_dbusInterfaces.initialized ||
-        !m_dbusInterfaces.messaging ||
-        !m_dbusInterfaces.messaging->isValid()) {
-        emit logInfo("[Modem] Cached D-Bus interfaces invalid, reinitializing...");
-        return initializeDBusInterfaces();
+    const QList<SmsHandle> waiting = std::exchange(m_waitingForModem, {});
+    for (SmsHandle handle : waiting) {
+        finishMessage(handle, false, error, true);
     }
-    return true;
 }
 
 bool ModemDBusManager::shouldRetryOperation(const QDBusError &error) const
@@ -194,101 +799,254 @@ bool ModemDBusManager::shouldRetryOperation(const QDBusError &error) const
     case QDBusError::UnknownObject:
     case QDBusError::ServiceUnknown:
     case QDBusError::Failed:
+    case QDBusError::NoReply:
+    case QDBusError::Timeout:
+    case QDBusError::TimedOut:
+    case QDBusError::LimitsExceeded:
         return true;
     default:
         return false;
     }
 }
 
-void ModemDBusManager::scheduleRetry(const QVariantMap &properties, int retryCount)
+void ModemDBusManager::scheduleRetry(SmsHandle handle, int retryCount, const QDBusError &error,
+                                     bool onModem)
 {
-    if (initializeDBusInterfaces()) {
-        QTimer::singleShot(RETRY_DELAY_MS, this, [this, properties, retryCount]() {
-            sendSMS(properties["number"].toString(),
-                    properties["text"].toString());
-        });
-    } else {
-        emit logError("[Modem] Failed to reinitialize D-Bus interfaces");
-        emit smsResult(false);
+    // The modem went away underneath us: stop routing to it and rescan,
+    // which puts it back if it is in fact still there. UnknownObject on
+    // Send only means that one SMS object is gone, the modem is fine.
+    if (error.type() == QDBusError::ServiceUnknown ||
+        (onModem && error.type() == QDBusError::UnknownObject)) {
+        const auto it = m_messages.constFind(handle);
+        if (it != m_messages.constEnd()) {
+            dropModem(it->avoidModem);
+            setReady(!m_scheduler.isEmpty());
+        }
+        initializeDBusInterfaces();
     }
+
+    metrics().retries(error.type()).increment();
+    const int delayMs = m_backoff.delayMs(error.type(), retryCount);
+    CPI_LOG_DEBUG("modem", "SMS retry scheduled",
+                  {{"sms", handle}, {"delayMs", delayMs}, {"congestion", m_backoff.congestion()}});
+    QTimer::singleShot(delayMs, this, [this, handle, retryCount]() {
+        createSMS(handle, retryCount);
+    });
 }
 
-void ModemDBusManager::handleCreateSMSResponse(const QDBusPendingCallWatcher *watcher, const QVariantMap &properties, int retryCount)
+void ModemDBusManager::handleCreateSMSResponse(const QDBusPendingCallWatcher *watcher, SmsHandle handle, int retryCount)
 {
     QDBusPendingReply<QDBusObjectPath> reply = *watcher;
+    auto it = m_messages.find(handle);
+    if (it == m_messages.end()) {
+        return;
+    }
+    metrics().createLatency.observe((SmsTimeline::now() - it->attemptStartedNs) / 1e6);
 
     if (reply.isError()) {
+        endAttempt(*it, false, reply.error().type());
         if (retryCount < MAX_RETRY_ATTEMPTS && shouldRetryOperation(reply.error())) {
-            emit logInfo(QString("[Modem] SMS creation failed, retrying (attempt %1)...")
-                             .arg(retryCount + 1));
-            scheduleRetry(properties, retryCount + 1);
+            CPI_LOG_DEBUG("modem", "SMS creation failed, retrying",
+                          {{"sms", handle}, {"attempt", retryCount + 1},
+                           {"error", QDBusError::errorString(reply.error().type())}});
+            scheduleRetry(handle, retryCount + 1, reply.error(), true);
             return;
         }
-        emit logError("[Modem] SMS creation failed: " + reply.error().message());
-        emit smsResult(false);
+        finishMessage(handle, false, "SMS creation failed: " + reply.error().message());
         return;
     }
 
-    // Create SMS interface for sending
-    QDBusInterface sms("org.freedesktop.ModemManager1",
-                       reply.value().path(),
-                       "org.freedesktop.ModemManager1.Sms",
-                       m_dbusConnection);
+    it->timeline.createdNs = SmsTimeline::now();
 
-    if (!sms.isValid()) {
-        if (retryCount < MAX_RETRY_ATTEMPTS) {
-            emit logInfo(QString("[Modem] SMS interface invalid, retrying (attempt %1)...")
-                             .arg(retryCount + 1));
-            scheduleRetry(properties, retryCount + 1);
-            return;
-        }
-        emit logError("[Modem] Failed to create SMS interface after retries");
-        emit smsResult(false);
+    // Hand the created object over to its modem's Send stage. The modem may
+    // have been dropped while Create was in flight, then it starts over.
+    if (!m_scheduler.contains(it->modemPath)) {
+        it->modemPath.clear();
+        createSMS(handle, retryCount);
+        return;
+    }
+    m_sendStages[it->modemPath].queue.enqueue({handle, it->modemPath, reply.value().path(), retryCount});
+    startNextSend(it->modemPath);
+}
+
+void ModemDBusManager::startNextSend(const QString &modemPath)
+{
+    const auto stage = m_sendStages.find(modemPath);
+    if (stage == m_sendStages.end() || stage->inProgress || stage->queue.isEmpty()) {
+        return;
+    }
+
+    const PendingSend pending = stage->queue.dequeue();
+    auto it = m_messages.find(pending.handle);
+    if (it == m_messages.end()) {
+        startNextSend(modemPath);
         return;
     }
 
     // Send the SMS
-    QDBusPendingCall sendCall = sms.asyncCall("Send");
+    stage->inProgress = true;
+    it->timeline.sendStartedNs = SmsTimeline::now();
+    QDBusPendingCall sendCall = ModemManagerProxy::sendSms(m_dbusConnection, pending.smsPath);
     auto* sendWatcher = new QDBusPendingCallWatcher(sendCall, this);
 
     connect(sendWatcher, &QDBusPendingCallWatcher::finished,
-            this, [this, sendWatcher, properties, retryCount]() {
-                handleSendSMSResponse(sendWatcher, properties, retryCount);
+            this, [this, sendWatcher, pending]() {
+                // The stage is gone if the modem was dropped meanwhile
+                const auto stage = m_sendStages.find(pending.modemPath);
+                if (stage != m_sendStages.end()) {
+                    stage->inProgress = false;
+                }
+                handleSendSMSResponse(sendWatcher, pending);
                 sendWatcher->deleteLater();
+                startNextSend(pending.modemPath);
             });
 }
 
-void ModemDBusManager::handleSendSMSResponse(const QDBusPendingCallWatcher *watcher, const QVariantMap &properties, int retryCount)
+void ModemDBusManager::handleSendSMSResponse(const QDBusPendingCallWatcher *watcher, const PendingSend &pending)
 {
     QDBusPendingReply<void> sendReply = *watcher;
+    const auto it = m_messages.find(pending.handle);
+    if (it == m_messages.end()) {
+        return;
+    }
+    metrics().sendLatency.observe((SmsTimeline::now() - it->timeline.sendStartedNs) / 1e6);
+    endAttempt(*it, !sendReply.isError(), sendReply.error().type());
 
     if (sendReply.isError()) {
-        if (retryCount < MAX_RETRY_ATTEMPTS && shouldRetryOperation(sendReply.error())) {
-            emit logInfo(QString("[Modem] SMS sending failed, retrying (attempt %1)...")
-                             .arg(retryCount + 1));
-            scheduleRetry(properties, retryCount + 1);
+        // A retry starts over with a new object, this one would be left in
+        // modem storage
+        ModemManagerProxy::deleteSms(m_dbusConnection, pending.modemPath, pending.smsPath);
+        if (pending.retryCount < MAX_RETRY_ATTEMPTS && shouldRetryOperation(sendReply.error())) {
+            CPI_LOG_DEBUG("modem", "SMS sending failed, retrying",
+                          {{"sms", pending.handle}, {"attempt", pending.retryCount + 1},
+                           {"error", QDBusError::errorString(sendReply.error().type())}});
+            scheduleRetry(pending.handle, pending.retryCount + 1, sendReply.error(), false);
             return;
         }
-        emit logError("[Modem] SMS sending failed: " + sendReply.error().message());
-        emit smsResult(false);
+        finishMessage(pending.handle, false, "SMS sending failed: " + sendReply.error().message());
     } else {
-        emit logInfo("[Modem] SMS sent successfully");
-        emit smsResult(true);
+        CPI_LOG_DEBUG("modem", "SMS sent", {{"sms", pending.handle}, {"modem", pending.modemPath}});
+        if (it->properties.contains(ModemManagerProxy::DeliveryReportRequestProperty)) {
+            // The report updates this object, it is deleted once it came
+            m_delivery.track(pending.smsPath, {pending.handle, it->properties.value("number").toString(),
+                                               pending.modemPath, it->timeline.enqueuedNs,
+                                               SmsTimeline::now()});
+            metrics().awaitingDelivery.set(m_delivery.size());
+            scheduleDeliveryExpiry();
+        } else {
+            // Sent messages would otherwise pile up in modem storage
+            ModemManagerProxy::deleteSms(m_dbusConnection, pending.modemPath, pending.smsPath);
+        }
+        finishMessage(pending.handle, true);
+    }
+}
+
+void ModemDBusManager::onSmsPropertiesChanged(const QDBusMessage &message)
+{
+    // Fires for every SMS object and property; the lookup rules out all
+    // but the tracked ones before anything is unmarshalled
+    if (!m_delivery.contains(message.path()) || message.arguments().size() < 2) {
+        return;
+    }
+    const QVariantMap changed = qdbus_cast<QVariantMap>(message.arguments().at(1));
+    const auto state = changed.constFind(ModemManagerProxy::DeliveryStateProperty);
+    if (state == changed.constEnd()) {
+        return;
+    }
+    if (const auto result = m_delivery.update(message.path(), state->toUInt())) {
+        finishDelivery(*result);
     }
 }
 
+void ModemDBusManager::finishDelivery(const DeliveryTracker::Result &result)
+{
+    const DeliveryTracker::Message &message = result.message;
+    // Gone already when the modem or ModemManager went away
+    if (m_scheduler.contains(message.modemPath)) {
+        ModemManagerProxy::deleteSms(m_dbusConnection, message.modemPath, result.smsPath);
+    }
+
+    double latencyMs = 0;
+    QString reason;
+    switch (result.outcome) {
+    case DeliveryTracker::Outcome::Delivered:
+        latencyMs = (SmsTimeline::now() - message.enqueuedNs) / 1e6;
+        deliveryLatency(DeliveryTracker::networkOf(message.number)).observe(latencyMs);
+        metrics().delivered.increment();
+        break;
+    case DeliveryTracker::Outcome::Failed:
+        reason = DeliveryTracker::describe(result.deliveryState);
+        metrics().undelivered.increment();
+        break;
+    case DeliveryTracker::Outcome::Unknown:
+        reason = QStringLiteral("No delivery report");
+        metrics().unreported.increment();
+        break;
+    }
+    metrics().awaitingDelivery.set(m_delivery.size());
+
+    const bool delivered = result.outcome == DeliveryTracker::Outcome::Delivered;
+    CPI_LOG_DEBUG("modem", "SMS delivery report",
+                  {{"sms", message.handle}, {"delivered", delivered}, {"state", result.deliveryState},
+                   {"latencyMs", latencyMs}});
+    emit deliveryReport(message.handle, message.number, delivered, latencyMs, reason);
+}
+
+void ModemDBusManager::scheduleDeliveryExpiry()
+{
+    const qint64 nextNs = m_delivery.nextExpiryNs();
+    if (nextNs == 0) {
+        m_deliveryTimer->stop();
+        return;
+    }
+    // Messages expire in send order, later ones never move the deadline up
+    if (m_deliveryTimer->isActive()) {
+        return;
+    }
+    const qint64 delayMs = (nextNs - SmsTimeline::now()) / 1000000 + 1;
+    m_deliveryTimer->start(int(qBound<qint64>(0, delayMs, INT_MAX)));
+}
+
+void ModemDBusManager::expireDeliveries()
+{
+    const QList<DeliveryTracker::Result> expired = m_delivery.expire(SmsTimeline::now());
+    for (const DeliveryTracker::Result &result : expired) {
+        finishDelivery(result);
+    }
+    scheduleDeliveryExpiry();
+}
+
+Histogram &ModemDBusManager::deliveryLatency(const QString &network)
+{
+    // Label values stay bounded however many networks are messaged
+    QString label = network;
+    if (!m_deliveryLatency.contains(label) && m_deliveryLatency.size() >= MAX_DELIVERY_NETWORKS) {
+        label = QStringLiteral("other");
+    }
+    Histogram *&histogram = m_deliveryLatency[label];
+    if (!histogram) {
+        histogram = &MetricsRegistry::instance().histogram(
+            "cellularpi_sms_delivery_duration_ms", "Enqueue to delivery report per delivered message",
+            DELIVERY_BOUNDS, {{"network", label}});
+    }
+    return *histogram;
+}
+
 void ModemDBusManager::onModemManagerServiceChanged(bool available)
 {
     if (available) {
-        m_dbusInterfaces.initialized = false;
+        metrics().reconnects.increment();
         m_dbusInitRetryCount = 0; // Reset retry count
-        if (!initializeDBusInterfaces()) {
-            m_dbusInitTimer->start();
-        }
+        initializeDBusInterfaces();
     } else {
         m_dbusInitTimer->stop();
-        m_dbusInterfaces.initialized = false;
-        m_dbusInterfaces.messaging.reset();
-        emit logError("[Modem] ModemManager service disappeared");
+        m_objects.clear();
+        CPI_LOG_ERROR("modem", "ModemManager service disappeared");
+        syncModems();
+        // A restarted ModemManager has none of the sent SMS objects
+        const QList<DeliveryTracker::Result> unreported = m_delivery.drop();
+        for (const DeliveryTracker::Result &result : unreported) {
+            finishDelivery(result);
+        }
     }
 }
@@ -3,58 +3,246 @@
 
 #include <QObject>
 #include <QDBusConnection>
-#include <QDBusInterface>
+#include <QHash>
+#include <QList>
+#include <QMap>
+#include <QQueue>
+#include <QVariantMap>
+#include <QVariantList>
+#include <QElapsedTimer>
+#include "deliverytracker.h"
+#include "modemscheduler.h"
+#include "radiotelemetry.h"
+#include "ratelimiter.h"
+#include <atomic>
 #include <memory>
-#include <QMutex>
+#include <optional>
 
 class QTimer;
+class Gauge;
+class Histogram;
+class SmsReceiver;
+class QDBusArgument;
+class QDBusMessage;
 class QDBusPendingCallWatcher;
 
+// Identifies one outbound SMS for its whole life in ModemDBusManager
+using SmsHandle = quint64;
+
+// Monotonic timestamps (ns) of the stages a message goes through
+struct SmsTimeline {
+    qint64 enqueuedNs{0};
+    qint64 createStartedNs{0};
+    qint64 createdNs{0};
+    qint64 sendStartedNs{0};
+    qint64 completedNs{0};
+    int attempts{0};
+
+    static qint64 now();
+
+    double queueMs() const { return spanMs(enqueuedNs, createStartedNs); }
+    double createMs() const { return spanMs(createStartedNs, createdNs); }
+    double sendWaitMs() const { return spanMs(createdNs, sendStartedNs); }
+    double sendMs() const { return spanMs(sendStartedNs, completedNs); }
+    double totalMs() const { return spanMs(enqueuedNs, completedNs); }
+
+private:
+    static double spanMs(qint64 from, qint64 to)
+    {
+        return (from > 0 && to >= from) ? (to - from) / 1e6 : 0.0;
+    }
+};
+Q_DECLARE_METATYPE(SmsTimeline)
+
+// One message handed over to ModemDBusManager
+struct SmsRequest {
+    SmsHandle handle{0};
+    QString phoneNumber;
+    QString message;
+    qint64 enqueuedNs{0};
+};
+
+// Thread ownership: a ModemDBusManager and everything it owns belongs to
+// the thread it lives on (Modem runs it on a dedicated worker). Other
+// threads talk to it only through queued calls and its signals; the only
+// member that is safe to call from anywhere is reserveHandle().
 class ModemDBusManager : public QObject {
     Q_OBJECT
 public:
+    // Uses the system bus, or the session bus when CELLULARPI_MODEM_BUS=session
     explicit ModemDBusManager(QObject* parent = nullptr);
+    explicit ModemDBusManager(const QDBusConnection& connection, QObject* parent = nullptr);
     ~ModemDBusManager();
 
-    bool initialize();
-    void sendSMS(const QString& phoneNumber, const QString& message);
+    // Enables the inbound pipeline, persisting to filePath. Must be called
+    // before initialize().
+    void setInboxPath(const QString& filePath);
+
+    // Starts asynchronous modem discovery, the retry timer covers failures
+    void initialize();
+    // True while at least one messaging-capable modem is known
+    bool isReady() const;
+    QStringList modems() const;
+    void setSchedulingPolicy(ModemScheduler::Policy policy);
+    void setRateLimits(const SmsRateLimiter::Limits& limits);
+    // Requests a delivery report for every message created from now on.
+    // Sent messages then stay in ModemManager until their report comes.
+    void setDeliveryReports(bool enabled);
+    // Paces each modem by its radio link (see RadioTelemetry::pacing()):
+    // paused while down, slowed while weak, full rate again once it recovers
+    void setLinkPacing(bool enabled);
+
+    // Thread-safe, lets callers on other threads name a message before
+    // posting it with submit()
+    static SmsHandle reserveHandle();
+
+    // Create calls are issued immediately, Send calls are serialised per
+    // modem. Each message goes to the modem the scheduler picks.
+    // enqueuedNs lets the caller account for time spent in its own queue.
+    void submit(const QList<SmsRequest>& requests);
+    SmsHandle sendSMS(const QString& phoneNumber, const QString& message,
+                      qint64 enqueuedNs = 0);
+    std::optional<SmsTimeline> timeline(SmsHandle handle) const;
 
 signals:
-    void smsResult(bool success);
-    void logInfo(const QString& message);
-    void logError(const QString& message);
+    void smsResult(SmsHandle handle, bool success, const SmsTimeline& timeline);
+    // noModem: no modem turned up before discovery gave up, the message
+    // never reached one and is safe to replay
+    void smsError(SmsHandle handle, const QString& error, bool noModem);
+    // Final delivery outcome of a message sent with a report requested.
+    // latencyMs runs from enqueue to the report and is 0 unless delivered;
+    // reason says why not.
+    void deliveryReport(SmsHandle handle, const QString& number, bool delivered, double latencyMs,
+                        const QString& reason);
+    void readyChanged(bool ready);
+    void modemsChanged(const QStringList& modems);
+    // Once a second while modems are present, see ModemScheduler::snapshot()
+    void modemStatsChanged(const QVariantList& stats);
+    // With the stats when readings came in since, see RadioTelemetry::snapshot()
+    void radioChanged(const QVariantList& radio);
+    // Inbound pipeline, see SmsReceiver
+    void inboxOpened(const QString& filePath, const QList<qint64>& offsets);
+    void inboxMessagesStored(const QList<qint64>& offsets);
 
 private:
-    struct DBusInterfaces {
-        QString messagingPath;
-        std::unique_ptr<QDBusInterface> messaging;
-        bool initialized{false};
+    // interface name -> properties, as reported by the ObjectManager
+    using InterfaceProperties = QMap<QString, QVariantMap>;
+
+    // Book-keeping for a message until its result is reported
+    struct MessageRecord {
+        QVariantMap properties;
+        SmsTimeline timeline;
+        QString modemPath;        // modem of the current attempt
+        QString avoidModem;       // modem the last attempt failed on
+        qint64 attemptStartedNs{0};
+    };
+
+    // A created SMS object waiting for its turn in the Send stage
+    struct PendingSend {
+        SmsHandle handle{0};
+        QString modemPath;
+        QString smsPath;
+        int retryCount{0};
+    };
+
+    // Each modem sends one SMS at a time, modems run in parallel
+    struct SendStage {
+        QQueue<PendingSend> queue;
+        bool inProgress{false};
+    };
+
+    // A modem's radio series, looked up once rather than on every update
+    struct RadioGauges {
+        Gauge* quality{nullptr};
+        Gauge* signalDbm{nullptr};
+        Gauge* link{nullptr};
     };
 
-    static constexpr int DBUS_INIT_RETRY_INTERVAL = 2000;
-    static constexpr int DBUS_INIT_MAX_RETRIES = 100;
+    // Modems are picked up from ObjectManager signals, polling is a fallback
+    static constexpr int DBUS_INIT_RETRY_INTERVAL = 10000;
+    static constexpr int DBUS_INIT_MAX_RETRIES = 30;
     static constexpr int MAX_RETRY_ATTEMPTS = 3;
-    static constexpr int RETRY_DELAY_MS = 1000;
+    static constexpr int STATS_INTERVAL_MS = 1000;
+    // Histogram series per destination network, the rest go to "other"
+    static constexpr int MAX_DELIVERY_NETWORKS = 32;
+    // Modem.Signal refresh; each refresh is one PropertiesChanged per modem
+    static constexpr uint SIGNAL_REFRESH_S = 10;
 
     QDBusConnection m_dbusConnection;
-    DBusInterfaces m_dbusInterfaces;
+    bool m_ready{false};
+    ModemScheduler m_scheduler;
     std::unique_ptr<QTimer> m_dbusInitTimer;
+    std::unique_ptr<QTimer> m_statsTimer;
+    QElapsedTimer m_statsClock;
+    SmsRateLimiter m_rateLimiter;
+    RetryBackoff m_backoff;
+    // Messages waiting for a rate limiter token, in arrival order
+    QList<SmsHandle> m_throttled;
+    std::unique_ptr<QTimer> m_throttleTimer;
     int m_dbusInitRetryCount{0};
-    QMutex m_dbusInitMutex;
+    bool m_discoveryInProgress{false};
+    bool m_subscribed{false};
+    QHash<QString, InterfaceProperties> m_objects;
+    QList<SmsHandle> m_waitingForModem;
+    QHash<QString, SendStage> m_sendStages;
+    QHash<SmsHandle, MessageRecord> m_messages;
+    QString m_inboxPath;
+    SmsReceiver* m_receiver{nullptr};
+    bool m_deliveryReports{true};
+    DeliveryTracker m_delivery;
+    std::unique_ptr<QTimer> m_deliveryTimer;
+    QHash<QString, Histogram*> m_deliveryLatency;
+    RadioTelemetry m_radio;
+    QHash<QString, RadioGauges> m_radioGauges;
+    bool m_linkPacing{true};
+    bool m_radioChanged{false};
+
+    static QDBusConnection defaultConnection();
+
+    static InterfaceProperties readInterfaces(const QDBusArgument& argument);
 
-    bool initializeDBusInterfaces();
-    bool ensureValidInterfaces();
+    void subscribeToObjectManager();
+    void initializeDBusInterfaces();
+    void handleManagedObjects(const QDBusPendingCallWatcher* watcher);
+    void syncModems();
+    void dropModem(const QString& modemPath);
+    void setReady(bool ready);
+    void publishStats();
+    void addRadio(const QString& modemPath);
+    void updateRadio(const QString& modemPath, const QString& interface,
+                     const QVariantMap& properties);
+    void setupSignal(const QString& modemPath);
+    void applyLinkPacing(const QString& modemPath);
+    void failWaitingMessages(const QString& error);
     bool shouldRetryOperation(const QDBusError& error) const;
-    void scheduleRetry(const QVariantMap& properties, int retryCount);
+    void createSMS(SmsHandle handle, int retryCount);
+    // onModem: the failed call was addressed to the modem (Create), not to
+    // an SMS object (Send)
+    void scheduleRetry(SmsHandle handle, int retryCount, const QDBusError& error, bool onModem);
+    QString acquireModem(const MessageRecord& record, qint64& waitNs);
+    void throttle(SmsHandle handle, qint64 waitNs);
+    void releaseThrottled();
+    void endAttempt(MessageRecord& record, bool success,
+                    QDBusError::ErrorType error = QDBusError::NoError);
+    void startNextSend(const QString& modemPath);
+    void finishMessage(SmsHandle handle, bool success, const QString& error = QString(),
+                       bool noModem = false);
     void handleCreateSMSResponse(const QDBusPendingCallWatcher* watcher,
-                                 const QVariantMap& properties,
+                                 SmsHandle handle,
                                  int retryCount);
     void handleSendSMSResponse(const QDBusPendingCallWatcher* watcher,
-                               const QVariantMap& properties,
-                               int retryCount);
+                               const PendingSend& pending);
+    void finishDelivery(const DeliveryTracker::Result& result);
+    void scheduleDeliveryExpiry();
+    void expireDeliveries();
+    Histogram& deliveryLatency(const QString& network);
 
 private slots:
     void onModemManagerServiceChanged(bool available);
+    void onInterfacesAdded(const QDBusMessage& message);
+    void onInterfacesRemoved(const QDBusMessage& message);
+    void onSmsPropertiesChanged(const QDBusMessage& message);
+    void onModemPropertiesChanged(const QDBusMessage& message);
 };
 
 #endif// MODEMDBUSMANAGER_H
@@ -0,0 +1,65 @@
+#include "modemmanagerproxy.h"
+#include <QDBusMessage>
+#include <QDBusObjectPath>
+
+namespace ModemManagerProxy {
+
+QDBusPendingCall getManagedObjects(const QDBusConnection &connection)
+{
+    const QDBusMessage call = QDBusMessage::createMethodCall(
+        Service, ManagerPath, ObjectManagerInterface, "GetManagedObjects");
+    return connection.asyncCall(call);
+}
+
+QDBusPendingCall createSms(const QDBusConnection &connection,
+                           const QString &modemPath,
+                           const QVariantMap &properties)
+{
+    QDBusMessage call = QDBusMessage::createMethodCall(
+        Service, modemPath, MessagingInterface, "Create");
+    call << properties;
+    return connection.asyncCall(call);
+}
+
+QDBusPendingCall sendSms(const QDBusConnection &connection, const QString &smsPath)
+{
+    const QDBusMessage call = QDBusMessage::createMethodCall(
+        Service, smsPath, SmsInterface, "Send");
+    return connection.asyncCall(call);
+}
+
+QDBusPendingCall listSms(const QDBusConnection &connection, const QString &modemPath)
+{
+    const QDBusMessage call = QDBusMessage::createMethodCall(
+        Service, modemPath, MessagingInterface, "List");
+    return connection.asyncCall(call);
+}
+
+QDBusPendingCall deleteSms(const QDBusConnection &connection,
+                           const QString &modemPath,
+                           const QString &smsPath)
+{
+    QDBusMessage call = QDBusMessage::createMethodCall(
+        Service, modemPath, MessagingInterface, "Delete");
+    call << QVariant::fromValue(QDBusObjectPath(smsPath));
+    return connection.asyncCall(call);
+}
+
+QDBusPendingCall getSmsProperties(const QDBusConnection &connection, const QString &smsPath)
+{
+    QDBusMessage call = QDBusMessage::createMethodCall(
+        Service, smsPath, PropertiesInterface, "GetAll");
+    call << QString(SmsInterface);
+    return connection.asyncCall(call);
+}
+
+QDBusPendingCall setupSignal(const QDBusConnection &connection, const QString &modemPath,
+                             uint rateSeconds)
+{
+    QDBusMessage call = QDBusMessage::createMethodCall(
+        Service, modemPath, SignalInterface, "Setup");
+    call << rateSeconds;
+    return connection.asyncCall(call);
+}
+
+} // namespace ModemManagerProxy
@@ -0,0 +1,69 @@
+#ifndef MODEMMANAGERPROXY_H
+#define MODEMMANAGERPROXY_H
+
+#include <QDBusConnection>
+#include <QDBusPendingCall>
+#include <QVariantMap>
+
+// Precompiled, introspection-free calls into ModemManager.
+//
+// QDBusInterface introspects the remote object synchronously when it is
+// constructed. These helpers build the method calls directly and always
+// return a pending call, so nothing on the hot path ever blocks on the bus.
+namespace ModemManagerProxy {
+
+inline constexpr char Service[] = "org.freedesktop.ModemManager1";
+inline constexpr char ManagerPath[] = "/org/freedesktop/ModemManager1";
+inline constexpr char ObjectManagerInterface[] = "org.freedesktop.DBus.ObjectManager";
+inline constexpr char ModemInterface[] = "org.freedesktop.ModemManager1.Modem";
+inline constexpr char Modem3gppInterface[] = "org.freedesktop.ModemManager1.Modem.Modem3gpp";
+inline constexpr char SignalInterface[] = "org.freedesktop.ModemManager1.Modem.Signal";
+inline constexpr char MessagingInterface[] = "org.freedesktop.ModemManager1.Modem.Messaging";
+inline constexpr char SmsInterface[] = "org.freedesktop.ModemManager1.Sms";
+inline constexpr char PropertiesInterface[] = "org.freedesktop.DBus.Properties";
+
+// Messaging.Create property asking the network for a delivery report, and
+// the Sms property (MMSmsDeliveryState) the report updates
+inline constexpr char DeliveryReportRequestProperty[] = "delivery-report-request";
+inline constexpr char DeliveryStateProperty[] = "DeliveryState";
+
+// org.freedesktop.ModemManager1.Sms "State" values (MMSmsState)
+enum SmsState : uint {
+    SmsStateUnknown = 0,
+    SmsStateStored = 1,
+    SmsStateReceiving = 2,
+    SmsStateReceived = 3,
+    SmsStateSending = 4,
+    SmsStateSent = 5
+};
+
+// org.freedesktop.DBus.ObjectManager.GetManagedObjects() -> a{oa{sa{sv}}}
+QDBusPendingCall getManagedObjects(const QDBusConnection& connection);
+
+// Modem.Messaging.Create(a{sv} properties) -> o
+QDBusPendingCall createSms(const QDBusConnection& connection,
+                           const QString& modemPath,
+                           const QVariantMap& properties);
+
+// Sms.Send()
+QDBusPendingCall sendSms(const QDBusConnection& connection, const QString& smsPath);
+
+// Modem.Messaging.List() -> ao
+QDBusPendingCall listSms(const QDBusConnection& connection, const QString& modemPath);
+
+// Modem.Messaging.Delete(o path)
+QDBusPendingCall deleteSms(const QDBusConnection& connection,
+                           const QString& modemPath,
+                           const QString& smsPath);
+
+// Properties.GetAll("org.freedesktop.ModemManager1.Sms") -> a{sv}
+QDBusPendingCall getSmsProperties(const QDBusConnection& connection, const QString& smsPath);
+
+// Modem.Signal.Setup(u rate): refresh the extended signal values every
+// rate seconds, 0 stops it
+QDBusPendingCall setupSignal(const QDBusConnection& connection, const QString& modemPath,
+                             uint rateSeconds);
+
+} // namespace ModemManagerProxy
+
+#endif // MODEMMANAGERPROXY_H
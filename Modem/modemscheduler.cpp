@@ -0,0 +1,182 @@
+#include "modemscheduler.h"
+#include <QVariantMap>
+#include <limits>
+#include <utility>
+
+void ModemScheduler::setPolicy(Policy policy)
+{
+    m_policy = policy;
+    for (ModemStats &stats : m_modems) {
+        stats.currentWeight = 0;
+    }
+}
+
+ModemScheduler::Policy ModemScheduler::policy() const
+{
+    return m_policy;
+}
+
+void ModemScheduler::addModem(const QString &path)
+{
+    if (m_modems.contains(path)) {
+        return;
+    }
+    ModemStats stats;
+    stats.path = path;
+    m_modems.insert(path, stats);
+    m_order.append(path);
+    m_order.sort();
+}
+
+void ModemScheduler::removeModem(const QString &path)
+{
+    if (m_modems.remove(path)) {
+        m_order.removeOne(path);
+    }
+}
+
+bool ModemScheduler::contains(const QString &path) const
+{
+    return m_modems.contains(path);
+}
+
+bool ModemScheduler::isEmpty() const
+{
+    return m_modems.isEmpty();
+}
+
+QStringList ModemScheduler::modems() const
+{
+    return m_order;
+}
+
+QString ModemScheduler::pick(const QString &avoid)
+{
+    if (m_modems.isEmpty()) {
+        return QString();
+    }
+
+    QSet<QString> candidates(m_order.cbegin(), m_order.cend());
+    if (candidates.size() > 1) {
+        candidates.remove(avoid);
+    }
+
+    switch (m_policy) {
+    case Policy::WeightedRoundRobin:
+        return pickWeightedRoundRobin(candidates);
+    case Policy::LeastOutstanding:
+    default:
+        return pickLeastOutstanding(candidates);
+    }
+}
+
+void ModemScheduler::onDispatched(const QString &path)
+{
+    const auto it = m_modems.find(path);
+    if (it != m_modems.end()) {
+        ++it->outstanding;
+    }
+}
+
+void ModemScheduler::onCompleted(const QString &path, bool success, double latencyMs)
+{
+    const auto it = m_modems.find(path);
+    if (it == m_modems.end()) {
+        return;
+    }
+    it->outstanding = qMax(0, it->outstanding - 1);
+    if (success) {
+        ++it->sent;
+        ++it->completedSinceTick;
+    } else {
+        ++it->failed;
+    }
+    if (latencyMs > 0) {
+        it->latencyEwmaMs = it->latencyEwmaMs > 0
+                                ? (1 - EWMA_ALPHA) * it->latencyEwmaMs + EWMA_ALPHA * latencyMs
+                                : latencyMs;
+    }
+    it->failureEwma = (1 - EWMA_ALPHA) * it->failureEwma + EWMA_ALPHA * (success ? 0.0 : 1.0);
+}
+
+void ModemScheduler::tick(double elapsedSeconds)
+{
+    for (ModemStats &stats : m_modems) {
+        stats.throughput = elapsedSeconds > 0 ? stats.completedSinceTick / elapsedSeconds : 0.0;
+        stats.completedSinceTick = 0;
+    }
+}
+
+QVariantList ModemScheduler::snapshot() const
+{
+    QVariantList list;
+    for (const QString &path : m_order) {
+        const ModemStats &stats = m_modems[path];
+        list.append(QVariantMap{
+            {"path", stats.path},
+            {"outstanding", stats.outstanding},
+            {"sent", stats.sent},
+            {"failed", stats.failed},
+            {"latencyMs", stats.latencyEwmaMs},
+            {"failureRate", stats.failureEwma},
+            {"throughput", stats.throughput},
+        });
+    }
+    return list;
+}
+
+double ModemScheduler::expectedLatency(const ModemStats &stats) const
+{
+    const double latency = stats.latencyEwmaMs > 0 ? stats.latencyEwmaMs : DEFAULT_LATENCY_MS;
+    // A failing modem costs a retry elsewhere, so inflate its latency
+    return latency / qMax(0.05, 1.0 - stats.failureEwma);
+}
+
+int ModemScheduler::weight(const ModemStats &stats) const
+{
+    return qMax(1, int(100000.0 / expectedLatency(stats)));
+}
+
+QString ModemScheduler::pickLeastOutstanding(const QSet<QString> &candidates)
+{
+    QString best;
+    double bestScore = std::numeric_limits<double>::max();
+    // Start after the last pick so equal scores rotate
+    for (int i = 0; i < m_order.size(); ++i) {
+        const QString &path = m_order.at((m_cursor + i) % m_order.size());
+        if (!candidates.contains(path)) {
+            continue;
+        }
+        const ModemStats &stats = m_modems[path];
+        const double score = (stats.outstanding + 1) * expectedLatency(stats);
+        if (score < bestScore) {
+            bestScore = score;
+            best = path;
+        }
+    }
+    m_cursor = (m_order.indexOf(best) + 1) % m_order.size();
+    return best;
+}
+
+QString ModemScheduler::pickWeightedRoundRobin(const QSet<QString> &candidates)
+{
+    ModemStats *best = nullptr;
+    int total = 0;
+    for (const QString &path : std::as_const(m_order)) {
+        if (!candidates.contains(path)) {
+            continue;
+        }
+        ModemStats &stats = m_modems[path];
+        const int w = weight(stats);
+        stats.currentWeight += w;
+        total += w;
+        if (!best || stats.currentWeight > best->currentWeight) {
+            best = &stats;
+        }
+    }
+    if (!best) {
+        return QString();
+    }
+    best->currentWeight -= total;
+    return best->path;
+}
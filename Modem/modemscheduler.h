@@ -0,0 +1,67 @@
+#ifndef MODEMSCHEDULER_H
+#define MODEMSCHEDULER_H
+
+#include <QString>
+#include <QStringList>
+#include <QVariantList>
+#include <QHash>
+#include <QSet>
+
+// Picks which modem carries the next SMS. Both policies weigh a modem by
+// its recent latency and failure rate, so a slow or flaky modem gets less
+// work but still enough to show it has recovered.
+class ModemScheduler {
+public:
+    enum class Policy {
+        LeastOutstanding,   // lowest expected wait given work already queued
+        WeightedRoundRobin  // smooth WRR, weight ~ speed x success rate
+    };
+
+    struct ModemStats {
+        QString path;
+        int outstanding{0};
+        quint64 sent{0};
+        quint64 failed{0};
+        double latencyEwmaMs{0.0};
+        double failureEwma{0.0};
+        double throughput{0.0};     // completed msgs/sec over the last tick
+        int completedSinceTick{0};
+        int currentWeight{0};       // smooth WRR state
+    };
+
+    void setPolicy(Policy policy);
+    Policy policy() const;
+
+    void addModem(const QString& path);
+    void removeModem(const QString& path);
+    bool contains(const QString& path) const;
+    bool isEmpty() const;
+    QStringList modems() const;
+
+    // Returns the chosen modem path, empty when there is none. A modem in
+    // avoid is only chosen when it is the last one left.
+    QString pick(const QString& avoid = QString());
+
+    void onDispatched(const QString& path);
+    void onCompleted(const QString& path, bool success, double latencyMs);
+
+    // Folds the completions since the last call into per-modem msgs/sec
+    void tick(double elapsedSeconds);
+    QVariantList snapshot() const;
+
+private:
+    static constexpr double EWMA_ALPHA = 0.2;
+    static constexpr double DEFAULT_LATENCY_MS = 500.0;
+
+    Policy m_policy{Policy::LeastOutstanding};
+    QHash<QString, ModemStats> m_modems;
+    QStringList m_order;
+    int m_cursor{0};
+
+    double expectedLatency(const ModemStats& stats) const;
+    int weight(const ModemStats& stats) const;
+    QString pickLeastOutstanding(const QSet<QString>& candidates);
+    QString pickWeightedRoundRobin(const QSet<QString>& candidates);
+};
+
+#endif // MODEMSCHEDULER_H
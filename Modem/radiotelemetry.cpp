@@ -0,0 +1,331 @@
+#include "radiotelemetry.h"
+#include "modemmanagerproxy.h"
+#include <QDBusArgument>
+#include <QStringList>
+
+namespace {
+
+using LinkQuality = RadioTelemetry::LinkQuality;
+using Technology = RadioTelemetry::Technology;
+
+// MMModemState
+constexpr int StateUnknown = 0;
+constexpr int StateRegistered = 8;
+
+// MMModem3gppRegistrationState
+constexpr uint RegistrationIdle = 0;
+constexpr uint RegistrationSearching = 2;
+constexpr uint RegistrationDenied = 3;
+constexpr uint RegistrationRoaming = 5;
+constexpr uint RegistrationRoamingSmsOnly = 7;
+constexpr uint RegistrationEmergencyOnly = 8;
+constexpr uint RegistrationRoamingCsfbNotPreferred = 10;
+
+// MMModemAccessTechnology bits
+constexpr uint AccessGsmMask = 0x1e;       // GSM, GSM compact, GPRS, EDGE
+constexpr uint AccessUmtsMask = 0x3e0;     // UMTS, HSDPA, HSUPA, HSPA, HSPA+
+constexpr uint AccessLteMask = 0x34000;    // LTE, LTE Cat-M, NB-IoT
+constexpr uint AccessNr = 0x8000;
+
+// dBm at which a link becomes Fair and Good: RSRP on LTE/5G, RSCP or
+// RSSI on 2G/3G. Percent for modems that only report SignalQuality.
+constexpr int RsrpFair = -110;
+constexpr int RsrpGood = -100;
+constexpr int RssiFair = -95;
+constexpr int RssiGood = -85;
+constexpr int QualityFair = 20;
+constexpr int QualityGood = 40;
+
+bool isRoamingRegistration(uint registration)
+{
+    return registration == RegistrationRoaming || registration == RegistrationRoamingSmsOnly
+           || registration == RegistrationRoamingCsfbNotPreferred;
+}
+
+Technology technologyOf(uint accessTechnologies)
+{
+    if (accessTechnologies & AccessNr) {
+        return Technology::Nr;
+    }
+    if (accessTechnologies & AccessLteMask) {
+        return Technology::Lte;
+    }
+    if (accessTechnologies & AccessUmtsMask) {
+        return Technology::Umts;
+    }
+    if (accessTechnologies & AccessGsmMask) {
+        return Technology::Gsm;
+    }
+    return accessTechnologies ? Technology::Other : Technology::Unknown;
+}
+
+// Poor, Fair or Good. Away from current only once value clears the
+// threshold by margin.
+LinkQuality grade(int value, int fairAt, int goodAt, int margin, LinkQuality current)
+{
+    const auto at = [fairAt, goodAt](int v) {
+        return v >= goodAt ? LinkQuality::Good : v >= fairAt ? LinkQuality::Fair : LinkQuality::Poor;
+    };
+    const LinkQuality plain = at(value);
+    if (current < LinkQuality::Poor || plain == current) {
+        return plain;
+    }
+    return plain > current ? qMax(current, at(value - margin)) : qMin(current, at(value + margin));
+}
+
+// Signal values are negative dBm; ModemManager leaves out what it does not know
+bool readDbm(const QVariantMap &values, const char *key, int &dbm)
+{
+    const auto it = values.constFind(QLatin1String(key));
+    if (it == values.constEnd()) {
+        return false;
+    }
+    const double value = it->toDouble();
+    if (!(value < 0 && value > -200)) {
+        return false;
+    }
+    dbm = qRound(value);
+    return true;
+}
+
+} // namespace
+
+void RadioTelemetry::addModem(const QString &modemPath)
+{
+    if (!m_radios.contains(modemPath)) {
+        m_radios.insert(modemPath, Radio());
+    }
+}
+
+void RadioTelemetry::removeModem(const QString &modemPath)
+{
+    m_radios.remove(modemPath);
+}
+
+bool RadioTelemetry::contains(const QString &modemPath) const
+{
+    return m_radios.contains(modemPath);
+}
+
+bool RadioTelemetry::update(const QString &modemPath, const QString &interface,
+                            const QVariantMap &properties, qint64 nowMs)
+{
+    const auto it = m_radios.find(modemPath);
+    if (it == m_radios.end()) {
+        return false;
+    }
+    Radio &radio = *it;
+    if (interface == QLatin1String(ModemManagerProxy::ModemInterface)) {
+        readModem(radio, properties);
+    } else if (interface == QLatin1String(ModemManagerProxy::Modem3gppInterface)) {
+        readModem3gpp(radio, properties);
+    } else if (interface == QLatin1String(ModemManagerProxy::SignalInterface)) {
+        readSignal(radio, properties);
+    } else {
+        return false;
+    }
+
+    const LinkQuality previous = radio.current.link;
+    radio.current.link = classify(radio);
+    radio.current.timestampMs = nowMs;
+    record(radio, nowMs);
+    return radio.current.link != previous;
+}
+
+RadioTelemetry::LinkQuality RadioTelemetry::linkQuality(const QString &modemPath) const
+{
+    const auto it = m_radios.constFind(modemPath);
+    return it != m_radios.constEnd() ? it->current.link : LinkQuality::Unknown;
+}
+
+RadioTelemetry::Sample RadioTelemetry::current(const QString &modemPath) const
+{
+    const auto it = m_radios.constFind(modemPath);
+    return it != m_radios.constEnd() ? it->current : Sample();
+}
+
+bool RadioTelemetry::isRoaming(const QString &modemPath) const
+{
+    const auto it = m_radios.constFind(modemPath);
+    return it != m_radios.constEnd() && it->hasRegistration
+           && isRoamingRegistration(it->current.registration);
+}
+
+QVariantList RadioTelemetry::snapshot() const
+{
+    QStringList paths = m_radios.keys();
+    paths.sort();
+
+    QVariantList modems;
+    modems.reserve(paths.size());
+    for (const QString &path : std::as_const(paths)) {
+        const Radio &radio = *m_radios.constFind(path);
+        QVariantList times;
+        QVariantList quality;
+        QVariantList signal;
+        QVariantList link;
+        times.reserve(radio.count);
+        quality.reserve(radio.count);
+        signal.reserve(radio.count);
+        link.reserve(radio.count);
+        for (int i = 0; i < radio.count; ++i) {
+            const Sample &sample = radio.history[(radio.head - radio.count + i + HISTORY_SIZE) % HISTORY_SIZE];
+            times << sample.timestampMs;
+            quality << int(sample.quality);
+            signal << int(sample.signalDbm);
+            link << int(sample.link);
+        }
+
+        const Sample &now = radio.current;
+        modems << QVariantMap{
+            {"path", path},
+            {"link", linkName(now.link)},
+            {"technology", technologyName(now.technology)},
+            {"quality", int(now.quality)},
+            {"signalDbm", int(now.signalDbm)},
+            {"snrDb", int(now.snrDb)},
+            {"roaming", isRoaming(path)},
+            {"history", QVariantMap{{"t", times}, {"quality", quality},
+                                    {"signalDbm", signal}, {"link", link}}}};
+    }
+    return modems;
+}
+
+double RadioTelemetry::pacing(LinkQuality link)
+{
+    switch (link) {
+    case LinkQuality::Down: return 0.0;
+    case LinkQuality::Poor: return 0.25;
+    case LinkQuality::Fair: return 0.5;
+    case LinkQuality::Good:
+    case LinkQuality::Unknown:
+    default: return 1.0;
+    }
+}
+
+const char *RadioTelemetry::linkName(LinkQuality link)
+{
+    switch (link) {
+    case LinkQuality::Down: return "down";
+    case LinkQuality::Poor: return "poor";
+    case LinkQuality::Fair: return "fair";
+    case LinkQuality::Good: return "good";
+    case LinkQuality::Unknown:
+    default: return "unknown";
+    }
+}
+
+const char *RadioTelemetry::technologyName(Technology technology)
+{
+    switch (technology) {
+    case Technology::Gsm: return "2G";
+    case Technology::Umts: return "3G";
+    case Technology::Lte: return "4G";
+    case Technology::Nr: return "5G";
+    case Technology::Other: return "other";
+    case Technology::Unknown:
+    default: return "unknown";
+    }
+}
+
+void RadioTelemetry::readModem(Radio &radio, const QVariantMap &properties)
+{
+    const auto state = properties.constFind(QStringLiteral("State"));
+    if (state != properties.constEnd()) {
+        radio.current.state = qint8(state->toInt());
+        radio.hasState = true;
+    }
+    const auto access = properties.constFind(QStringLiteral("AccessTechnologies"));
+    if (access != properties.constEnd()) {
+        radio.current.technology = technologyOf(access->toUInt());
+    }
+    // (ub): percent and whether it is recent
+    const auto quality = properties.constFind(QStringLiteral("SignalQuality"));
+    if (quality != properties.constEnd() && quality->canConvert<QDBusArgument>()) {
+        const QDBusArgument argument = quality->value<QDBusArgument>();
+        uint percent = 0;
+        bool recent = false;
+        argument.beginStructure();
+        argument >> percent >> recent;
+        argument.endStructure();
+        radio.current.quality = quint8(qMin(percent, 100u));
+        radio.hasQuality = recent || percent > 0;
+    }
+}
+
+void RadioTelemetry::readModem3gpp(Radio &radio, const QVariantMap &properties)
+{
+    const auto registration = properties.constFind(QStringLiteral("RegistrationState"));
+    if (registration != properties.constEnd()) {
+        radio.current.registration = quint8(registration->toUInt());
+        radio.hasRegistration = true;
+    }
+}
+
+void RadioTelemetry::readSignal(Radio &radio, const QVariantMap &properties)
+{
+    // The newest technology that reports anything is the one in use
+    static const char *const technologies[] = {"Nr5g", "Lte", "Umts", "Gsm"};
+    for (int i = 0; i < 4; ++i) {
+        const auto it = properties.constFind(QLatin1String(technologies[i]));
+        if (it == properties.constEnd()) {
+            continue;
+        }
+        const QVariantMap values = qdbus_cast<QVariantMap>(*it);
+        int dbm = 0;
+        const bool broadband = i < 2;   // 5G and LTE report RSRP
+        const bool found = broadband ? readDbm(values, "rsrp", dbm)
+                                     : readDbm(values, "rscp", dbm) || readDbm(values, "rssi", dbm);
+        if (!found) {
+            continue;
+        }
+        radio.current.signalDbm = qint16(dbm);
+        radio.current.snrDb = qint8(qBound(-128, qRound(values.value(QStringLiteral("snr")).toDouble()), 127));
+        radio.signalBroadband = broadband;
+        radio.hasSignalDbm = true;
+        return;
+    }
+}
+
+RadioTelemetry::LinkQuality RadioTelemetry::classify(const Radio &radio)
+{
+    const Sample &now = radio.current;
+    if (radio.hasState && now.state != StateUnknown && now.state < StateRegistered) {
+        return LinkQuality::Down;
+    }
+    if (radio.hasRegistration
+        && (now.registration == RegistrationIdle || now.registration == RegistrationSearching
+            || now.registration == RegistrationDenied || now.registration == RegistrationEmergencyOnly)) {
+        return LinkQuality::Down;
+    }
+
+    LinkQuality link = LinkQuality::Unknown;
+    if (radio.hasSignalDbm) {
+        link = radio.signalBroadband
+                   ? grade(now.signalDbm, RsrpFair, RsrpGood, HYSTERESIS_DB, now.link)
+                   : grade(now.signalDbm, RssiFair, RssiGood, HYSTERESIS_DB, now.link);
+    } else if (radio.hasQuality) {
+        link = grade(now.quality, QualityFair, QualityGood, HYSTERESIS_PERCENT, now.link);
+    }
+    // Roaming messages cost more and fail more, keep them to a trickle
+    const bool roaming = radio.hasRegistration && isRoamingRegistration(now.registration);
+    if (roaming && (link == LinkQuality::Good || link == LinkQuality::Unknown)) {
+        link = LinkQuality::Fair;
+    }
+    return link;
+}
+
+void RadioTelemetry::record(Radio &radio, qint64 nowMs)
+{
+    // Within the interval the newest sample is refreshed rather than a new one added
+    Sample &newest = radio.history[(radio.head + HISTORY_SIZE - 1) % HISTORY_SIZE];
+    if (radio.count > 0 && nowMs - newest.timestampMs < SAMPLE_INTERVAL_MS) {
+        const qint64 startedMs = newest.timestampMs;
+        newest = radio.current;
+        newest.timestampMs = startedMs;
+        return;
+    }
+    radio.history[radio.head] = radio.current;
+    radio.head = (radio.head + 1) % HISTORY_SIZE;
+    radio.count = qMin(radio.count + 1, HISTORY_SIZE);
+}
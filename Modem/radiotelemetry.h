@@ -0,0 +1,97 @@
+#ifndef RADIOTELEMETRY_H
+#define RADIOTELEMETRY_H
+
+#include <QHash>
+#include <QString>
+#include <QVariantList>
+#include <QVariantMap>
+#include <array>
+
+// Radio state of the messaging modems, fed from Modem, Modem3gpp and Signal
+// property changes. Each modem keeps its latest reading, condensed into a
+// LinkQuality, and a fixed ring of HISTORY_SIZE samples.
+class RadioTelemetry {
+public:
+    enum class LinkQuality : quint8 {
+        Unknown,    // nothing reported yet, sent to like Good
+        Down,       // not registered, searching, denied or emergency only
+        Poor,
+        Fair,
+        Good
+    };
+
+    enum class Technology : quint8 {
+        Unknown,
+        Gsm,
+        Umts,
+        Lte,
+        Nr,
+        Other
+    };
+
+    // 16 bytes, so a full history is a few KiB per modem
+    struct Sample {
+        qint64 timestampMs{0};      // wall clock, for plotting
+        qint16 signalDbm{0};        // RSRP on LTE/5G, RSCP/RSSI below that; 0 unknown
+        qint8 snrDb{0};
+        quint8 quality{0};          // Modem.SignalQuality, percent
+        qint8 state{0};             // MMModemState
+        quint8 registration{0};     // MMModem3gppRegistrationState
+        Technology technology{Technology::Unknown};
+        LinkQuality link{LinkQuality::Unknown};
+    };
+
+    static constexpr int HISTORY_SIZE = 360;
+    static constexpr qint64 SAMPLE_INTERVAL_MS = 10000;
+
+    void addModem(const QString& modemPath);
+    void removeModem(const QString& modemPath);
+    bool contains(const QString& modemPath) const;
+
+    // Properties of interface on modemPath, all of them or just the
+    // changed ones. True when the modem's LinkQuality changed.
+    bool update(const QString& modemPath, const QString& interface, const QVariantMap& properties,
+                qint64 nowMs);
+
+    LinkQuality linkQuality(const QString& modemPath) const;
+    Sample current(const QString& modemPath) const;
+    bool isRoaming(const QString& modemPath) const;
+
+    // Per modem: the current reading plus its history as parallel arrays
+    // (t, quality, signalDbm, link), oldest first, ready for a chart
+    QVariantList snapshot() const;
+
+    // Share of the per-modem rate a link gets, 0 pauses the modem. A roaming
+    // modem is paced as Fair at best.
+    static double pacing(LinkQuality link);
+    static const char* linkName(LinkQuality link);
+    static const char* technologyName(Technology technology);
+
+private:
+    // Margin a reading has to clear a threshold by before the link class
+    // moves, so a signal hovering at a threshold does not flap the pacing
+    static constexpr int HYSTERESIS_DB = 3;
+    static constexpr int HYSTERESIS_PERCENT = 5;
+
+    struct Radio {
+        Sample current;
+        bool hasSignalDbm{false};
+        bool signalBroadband{false};    // signalDbm is RSRP
+        bool hasQuality{false};
+        bool hasState{false};
+        bool hasRegistration{false};
+        std::array<Sample, HISTORY_SIZE> history{};
+        int head{0};    // next slot to write
+        int count{0};
+    };
+
+    QHash<QString, Radio> m_radios;
+
+    static void readModem(Radio& radio, const QVariantMap& properties);
+    static void readModem3gpp(Radio& radio, const QVariantMap& properties);
+    static void readSignal(Radio& radio, const QVariantMap& properties);
+    static LinkQuality classify(const Radio& radio);
+    static void record(Radio& radio, qint64 nowMs);
+};
+
+#endif // RADIOTELEMETRY_H
@@ -0,0 +1,241 @@
+#include "ratelimiter.h"
+#include "modemdbusmanager.h"
+#include <QRandomGenerator>
+#include <QList>
+#include <cmath>
+
+void TokenBucket::configure(double ratePerSecond, double burst)
+{
+    // Time so far is credited at the old rate, only what follows at the new one
+    refill(SmsTimeline::now());
+    m_rate = ratePerSecond;
+    m_burst = qMax(1.0, burst);
+    m_tokens = qMin(m_tokens, m_burst);
+}
+
+void TokenBucket::refill(qint64 nowNs)
+{
+    if (m_lastNs > 0 && nowNs > m_lastNs) {
+        m_tokens = qMin(m_burst, m_tokens + (nowNs - m_lastNs) / 1e9 * m_rate);
+    }
+    m_lastNs = nowNs;
+}
+
+bool TokenBucket::tryTake(qint64 nowNs)
+{
+    if (m_rate <= 0) {
+        return true;
+    }
+    refill(nowNs);
+    if (m_tokens < 1.0) {
+        return false;
+    }
+    m_tokens -= 1.0;
+    return true;
+}
+
+qint64 TokenBucket::waitNs(qint64 nowNs)
+{
+    if (m_rate <= 0) {
+        return 0;
+    }
+    refill(nowNs);
+    return m_tokens >= 1.0 ? 0 : qint64(std::ceil((1.0 - m_tokens) / m_rate * 1e9));
+}
+
+bool TokenBucket::isFull(qint64 nowNs)
+{
+    refill(nowNs);
+    return m_tokens >= m_burst;
+}
+
+void SmsRateLimiter::setLimits(const Limits &limits)
+{
+    m_limits = limits;
+    for (auto it = m_modems.begin(); it != m_modems.end(); ++it) {
+        it->configure(ceiling(it.key()), limits.modemBurst);
+    }
+    for (TokenBucket &bucket : m_destinations) {
+        bucket.configure(limits.destinationRate, limits.destinationBurst);
+    }
+}
+
+SmsRateLimiter::Limits SmsRateLimiter::limits() const
+{
+    return m_limits;
+}
+
+TokenBucket &SmsRateLimiter::modemBucket(const QString &modemPath)
+{
+    auto it = m_modems.find(modemPath);
+    if (it == m_modems.end()) {
+        it = m_modems.insert(modemPath, TokenBucket());
+        it->configure(ceiling(modemPath), m_limits.modemBurst);
+    }
+    return *it;
+}
+
+double SmsRateLimiter::ceiling(const QString &modemPath) const
+{
+    return m_limits.modemRate * m_linkFactors.value(modemPath, 1.0);
+}
+
+qint64 SmsRateLimiter::acquire(const QString &modemPath, const QString &destination, qint64 nowNs)
+{
+    if (m_paused.contains(modemPath)) {
+        return PAUSED_RETRY_NS;
+    }
+    TokenBucket &modem = modemBucket(modemPath);
+    const qint64 modemWait = modem.waitNs(nowNs);
+
+    qint64 destinationWait = 0;
+    TokenBucket *destinationBucket = nullptr;
+    if (m_limits.destinationRate > 0) {
+        auto it = m_destinations.find(destination);
+        if (it == m_destinations.end()) {
+            pruneDestinations(nowNs);
+            it = m_destinations.insert(destination, TokenBucket());
+            it->configure(m_limits.destinationRate, m_limits.destinationBurst);
+        }
+        destinationBucket = &*it;
+        destinationWait = destinationBucket->waitNs(nowNs);
+    }
+
+    if (modemWait > 0 || destinationWait > 0) {
+        return qMax(modemWait, destinationWait);
+    }
+    modem.tryTake(nowNs);
+    if (destinationBucket) {
+        destinationBucket->tryTake(nowNs);
+    }
+    return 0;
+}
+
+void SmsRateLimiter::onSuccess(const QString &modemPath)
+{
+    if (m_limits.modemRate <= 0) {
+        return;
+    }
+    TokenBucket &bucket = modemBucket(modemPath);
+    // Additive increase: back to the ceiling after ~20 clean sends
+    const double top = ceiling(modemPath);
+    bucket.configure(qMin(top, bucket.rate() + top / 20.0), m_limits.modemBurst);
+}
+
+void SmsRateLimiter::onCongestion(const QString &modemPath)
+{
+    if (m_limits.modemRate <= 0) {
+        return;
+    }
+    TokenBucket &bucket = modemBucket(modemPath);
+    bucket.configure(qMax(MIN_RATE, bucket.rate() * DECREASE_FACTOR), m_limits.modemBurst);
+}
+
+void SmsRateLimiter::removeModem(const QString &modemPath)
+{
+    m_modems.remove(modemPath);
+    m_linkFactors.remove(modemPath);
+    m_paused.remove(modemPath);
+}
+
+double SmsRateLimiter::currentRate(const QString &modemPath) const
+{
+    const auto it = m_modems.constFind(modemPath);
+    return it != m_modems.constEnd() ? it->rate() : ceiling(modemPath);
+}
+
+void SmsRateLimiter::setLinkFactor(const QString &modemPath, double factor)
+{
+    // A pause leaves the rate alone, the modem resumes where it stopped
+    if (factor <= 0) {
+        m_paused.insert(modemPath);
+        return;
+    }
+    m_paused.remove(modemPath);
+
+    factor = qMin(1.0, factor);
+    const double previous = m_linkFactors.value(modemPath, 1.0);
+    if (factor == previous) {
+        return;
+    }
+    if (factor < 1.0) {
+        m_linkFactors.insert(modemPath, factor);
+    } else {
+        m_linkFactors.remove(modemPath);
+    }
+    const auto it = m_modems.find(modemPath);
+    if (it != m_modems.end() && m_limits.modemRate > 0) {
+        it->configure(qBound(MIN_RATE, it->rate() * factor / previous, ceiling(modemPath)),
+                      m_limits.modemBurst);
+    }
+}
+
+bool SmsRateLimiter::isPaused(const QString &modemPath) const
+{
+    return m_paused.contains(modemPath);
+}
+
+// A full bucket behaves exactly like a missing one, so those can go
+void SmsRateLimiter::pruneDestinations(qint64 nowNs)
+{
+    if (m_destinations.size() < PRUNE_THRESHOLD) {
+        return;
+    }
+    for (auto it = m_destinations.begin(); it != m_destinations.end();) {
+        it = it->isFull(nowNs) ? m_destinations.erase(it) : std::next(it);
+    }
+}
+
+RetryBackoff::ErrorClass RetryBackoff::classify(QDBusError::ErrorType type)
+{
+    switch (type) {
+    case QDBusError::Failed:
+    case QDBusError::NoReply:
+    case QDBusError::Timeout:
+    case QDBusError::TimedOut:
+    case QDBusError::LimitsExceeded:
+        return ErrorClass::Congestion;
+    case QDBusError::UnknownObject:
+    case QDBusError::ServiceUnknown:
+        return ErrorClass::Stale;
+    default:
+        return ErrorClass::Other;
+    }
+}
+
+void RetryBackoff::recordSuccess()
+{
+    m_congestion *= (1 - EWMA_ALPHA);
+}
+
+void RetryBackoff::recordError(QDBusError::ErrorType type)
+{
+    const double sample = classify(type) == ErrorClass::Congestion ? 1.0 : 0.0;
+    m_congestion = (1 - EWMA_ALPHA) * m_congestion + EWMA_ALPHA * sample;
+}
+
+double RetryBackoff::congestion() const
+{
+    return m_congestion;
+}
+
+int RetryBackoff::delayMs(QDBusError::ErrorType type, int attempt) const
+{
+    double base = OTHER_BASE_MS;
+    switch (classify(type)) {
+    case ErrorClass::Congestion:
+        // Up to 5x longer while most of the recent traffic is failing
+        base = CONGESTION_BASE_MS * (1.0 + 4.0 * m_congestion);
+        break;
+    case ErrorClass::Stale:
+        base = STALE_BASE_MS;
+        break;
+    case ErrorClass::Other:
+        break;
+    }
+
+    const double delay = qMin<double>(MAX_DELAY_MS, base * std::ldexp(1.0, qMax(0, attempt - 1)));
+    // Equal jitter: never less than half the delay, spread over the rest
+    const int half = int(delay / 2);
+    return half + int(QRandomGenerator::global()->bounded(half + 1));
+}
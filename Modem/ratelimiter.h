@@ -0,0 +1,109 @@
+#ifndef RATELIMITER_H
+#define RATELIMITER_H
+
+#include <QHash>
+#include <QSet>
+#include <QString>
+#include <QDBusError>
+
+// Classic token bucket on a monotonic ns clock
+class TokenBucket {
+public:
+    // Takes effect from SmsTimeline::now(), the clock nowNs is read from
+    void configure(double ratePerSecond, double burst);
+    double rate() const { return m_rate; }
+
+    bool tryTake(qint64 nowNs);
+    // ns until one token is available, 0 if one is available now
+    qint64 waitNs(qint64 nowNs);
+    // True once the bucket has refilled completely, i.e. carries no state
+    bool isFull(qint64 nowNs);
+
+private:
+    double m_rate{0.0};
+    double m_burst{1.0};
+    double m_tokens{1e9};       // clamped to the burst, so new buckets start full
+    qint64 m_lastNs{0};
+
+    void refill(qint64 nowNs);
+};
+
+// Paces Create calls per modem and per destination number; a rate of 0
+// disables that limit. Per-modem rates adapt (AIMD): a congestion error
+// cuts the rate by DECREASE_FACTOR, each success steps it back towards the
+// ceiling. A link factor scales the ceiling to the radio link, 0 pauses.
+class SmsRateLimiter {
+public:
+    // Both limits are off until a deployment sets them
+    struct Limits {
+        double modemRate{0.0};          // msgs/sec per modem, e.g. 5
+        double modemBurst{5.0};
+        double destinationRate{0.0};    // msgs/sec per destination number, e.g. 0.2
+        double destinationBurst{5.0};
+    };
+
+    void setLimits(const Limits& limits);
+    Limits limits() const;
+
+    // Takes a token from both buckets and returns 0, or takes nothing and
+    // returns the ns to wait before asking again
+    qint64 acquire(const QString& modemPath, const QString& destination, qint64 nowNs);
+
+    void onSuccess(const QString& modemPath);
+    void onCongestion(const QString& modemPath);
+    void removeModem(const QString& modemPath);
+    double currentRate(const QString& modemPath) const;
+    // 0..1, see above. The current rate moves with it, so a modem that
+    // backed off for congestion stays backed off relative to its link.
+    void setLinkFactor(const QString& modemPath, double factor);
+    bool isPaused(const QString& modemPath) const;
+
+private:
+    static constexpr double DECREASE_FACTOR = 0.7;
+    static constexpr double MIN_RATE = 0.05;
+    // A paused modem is asked again this often, link changes wake it sooner
+    static constexpr qint64 PAUSED_RETRY_NS = 5'000'000'000;
+    static constexpr int PRUNE_THRESHOLD = 4096;
+
+    Limits m_limits;
+    QHash<QString, TokenBucket> m_modems;
+    QHash<QString, TokenBucket> m_destinations;
+    QHash<QString, double> m_linkFactors;   // only those below 1, never 0
+    QSet<QString> m_paused;
+
+    TokenBucket& modemBucket(const QString& modemPath);
+    double ceiling(const QString& modemPath) const;
+    void pruneDestinations(qint64 nowNs);
+};
+
+// Retry delays: exponential in the attempt number, scaled by how much of
+// the recent traffic ended in congestion errors, with jitter so that the
+// retries of one burst do not come back as another burst.
+class RetryBackoff {
+public:
+    enum class ErrorClass {
+        Congestion, // modem or network refused or timed out, back off hard
+        Stale,      // object or service vanished, rediscovery does the work
+        Other
+    };
+
+    static ErrorClass classify(QDBusError::ErrorType type);
+
+    void recordSuccess();
+    void recordError(QDBusError::ErrorType type);
+    // Recent share of outcomes that were congestion errors, 0..1
+    double congestion() const;
+
+    int delayMs(QDBusError::ErrorType type, int attempt) const;
+
+private:
+    static constexpr double EWMA_ALPHA = 0.1;
+    static constexpr int CONGESTION_BASE_MS = 500;
+    static constexpr int STALE_BASE_MS = 200;
+    static constexpr int OTHER_BASE_MS = 1000;
+    static constexpr int MAX_DELAY_MS = 30000;
+
+    double m_congestion{0.0};
+};
+
+#endif // RATELIMITER_H
@@ -0,0 +1,144 @@
+#include "smsbulk.h"
+#include <QHash>
+#include <QSet>
+
+namespace SmsBulk {
+
+QString normalizeE164(QStringView number, QStringView defaultCountryCode)
+{
+    QString digits;
+    digits.reserve(number.size() + defaultCountryCode.size());
+    bool international = false;
+    for (QChar c : number) {
+        if (c.isDigit()) {
+            digits.append(QChar(u'0' + c.digitValue()));
+        } else if (c == u'+' && digits.isEmpty() && !international) {
+            international = true;
+        } else if (c != u' ' && c != u'-' && c != u'.' && c != u'(' && c != u')') {
+            return QString();
+        }
+    }
+
+    if (!international) {
+        if (digits.startsWith(u"00")) {
+            digits.remove(0, 2);
+        } else if (digits.startsWith(u'0')) {
+            // National format, trunk prefix replaced by the country code
+            if (defaultCountryCode.isEmpty()) {
+                return QString();
+            }
+            digits.replace(0, 1, defaultCountryCode.toString());
+        }
+    }
+
+    if (digits.size() < 8 || digits.size() > 15 || digits.startsWith(u'0')) {
+        return QString();
+    }
+    return QStringLiteral("+") + digits;
+}
+
+Template::Template(const QString &text)
+{
+    qsizetype literalStart = 0;
+    qsizetype pos = 0;
+    while ((pos = text.indexOf(u'{', pos)) >= 0) {
+        const qsizetype end = text.indexOf(u'}', pos + 1);
+        if (end < 0) {
+            break;
+        }
+        const QString name = text.sliced(pos + 1, end - pos - 1).trimmed();
+        if (name.isEmpty() || name.contains(u'{')) {
+            pos = pos + 1;
+            continue;
+        }
+        m_literals.append(text.sliced(literalStart, pos - literalStart));
+        m_names.append(name);
+        literalStart = end + 1;
+        pos = literalStart;
+    }
+    m_literals.append(text.sliced(literalStart));
+
+    for (const QString &literal : std::as_const(m_literals)) {
+        m_literalSize += literal.size();
+    }
+}
+
+bool Template::hasPlaceholders() const
+{
+    return !m_names.isEmpty();
+}
+
+QString Template::expand(const QVariantMap &shared, const QVariantMap &own) const
+{
+    if (m_names.isEmpty()) {
+        return m_literals.first();
+    }
+
+    QString result;
+    result.reserve(m_literalSize + 16 * m_names.size());
+    for (qsizetype i = 0; i < m_names.size(); ++i) {
+        result.append(m_literals.at(i));
+        const QString &name = m_names.at(i);
+        if (const auto it = own.constFind(name); it != own.constEnd()) {
+            result.append(it->toString());
+        } else if (const auto it = shared.constFind(name); it != shared.constEnd()) {
+            result.append(it->toString());
+        } else {
+            result.append(u'{').append(name).append(u'}');
+        }
+    }
+    result.append(m_literals.last());
+    return result;
+}
+
+Batch prepare(const QStringList &recipients,
+              const QString &messageTemplate,
+              const QVariantMap &variables,
+              const QString &defaultCountryCode)
+{
+    Batch batch;
+    const Template compiled(messageTemplate);
+
+    // Split shared values from per-recipient maps once, keyed by E.164
+    QVariantMap shared;
+    QHash<QString, QVariantMap> perRecipient;
+    for (auto it = variables.cbegin(); it != variables.cend(); ++it) {
+        if (it->typeId() == QMetaType::QVariantMap) {
+            const QString number = normalizeE164(it.key(), defaultCountryCode);
+            perRecipient.insert(number.isEmpty() ? it.key() : number, it->toMap());
+        } else {
+            shared.insert(it.key(), *it);
+        }
+    }
+
+    QSet<QString> seen;
+    seen.reserve(recipients.size());
+    batch.messages.reserve(recipients.size());
+    for (const QString &recipient : recipients) {
+        const QString number = normalizeE164(recipient, defaultCountryCode);
+        if (number.isEmpty()) {
+            batch.rejected.append(recipient);
+            continue;
+        }
+        if (seen.contains(number)) {
+            ++batch.duplicates;
+            continue;
+        }
+        seen.insert(number);
+
+        QString text;
+        if (compiled.hasPlaceholders()) {
+            QVariantMap own = perRecipient.value(number);
+            if (!own.contains(QStringLiteral("phone"))) {
+                own.insert(QStringLiteral("phone"), number);
+            }
+            text = compiled.expand(shared, own);
+        } else {
+            text = messageTemplate;
+        }
+        batch.messages.append({number, text});
+    }
+    return batch;
+}
+
+} // namespace SmsBulk
@@ -0,0 +1,59 @@
+#ifndef SMSBULK_H
+#define SMSBULK_H
+
+#include <QString>
+#include <QStringList>
+#include <QStringView>
+#include <QVariantMap>
+#include <QList>
+
+// Recipient normalisation and template expansion for bulk sends.
+//
+// Everything here is pure and runs once per batch: numbers are normalised
+// and deduplicated in one pass, the template is parsed once and expanded
+// per recipient without rescanning it.
+namespace SmsBulk {
+
+// "+254 712-345 678", "00254712345678" and, with defaultCountryCode "254",
+// "0712345678" all become "+254712345678". Returns an empty string for
+// anything that is not 8 to 15 digits once normalised.
+QString normalizeE164(QStringView number, QStringView defaultCountryCode);
+
+// A message template with {name} placeholders. Unknown placeholders are
+// kept verbatim so a typo shows up in the sent text rather than vanishing.
+class Template {
+public:
+    explicit Template(const QString& text);
+
+    // own takes precedence over shared
+    QString expand(const QVariantMap& shared, const QVariantMap& own) const;
+    bool hasPlaceholders() const;
+
+private:
+    QStringList m_literals;      // always one more than m_names
+    QStringList m_names;
+    qsizetype m_literalSize{0};
+};
+
+struct Message {
+    QString phoneNumber;
+    QString text;
+};
+
+struct Batch {
+    QList<Message> messages;
+    int duplicates{0};
+    QStringList rejected;        // numbers that are not valid E.164
+};
+
+// variables: entries whose value is a map hold the placeholders of the
+// recipient they are keyed by (as written or in E.164 form), all other
+// entries are shared by every recipient. {phone} is the E.164 number.
+Batch prepare(const QStringList& recipients,
+              const QString& messageTemplate,
+              const QVariantMap& variables,
+              const QString& defaultCountryCode);
+
+} // namespace SmsBulk
+
+#endif // SMSBULK_H
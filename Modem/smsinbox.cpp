@@ -0,0 +1,200 @@
+#include "smsinbox.h"
+#include <QFileInfo>
+#include <QDir>
+#include <QtEndian>
+#include <cstring>
+#include <unistd.h>
+
+// Record layout (little endian):
+//   u32 payload size | u16 checksum | u16 reserved | payload
+// payload: i64 timestamp (ms since epoch, 0 if unknown) | u32 number size |
+//          number (UTF-8) | text (UTF-8)
+// The checksum covers the payload.
+
+SmsInbox::SmsInbox(const QString &filePath)
+    : m_file(filePath)
+{
+}
+
+SmsInbox::~SmsInbox()
+{
+    if (isOpen()) {
+        commit();
+    }
+}
+
+bool SmsInbox::open()
+{
+    if (isOpen()) {
+        return true;
+    }
+    QDir().mkpath(QFileInfo(m_file.fileName()).absolutePath());
+    if (!m_file.open(QIODevice::ReadWrite)) {
+        m_errorString = m_file.errorString();
+        return false;
+    }
+    if (!scan()) {
+        m_file.close();
+        return false;
+    }
+    return true;
+}
+
+bool SmsInbox::isOpen() const
+{
+    return m_file.isOpen();
+}
+
+QString SmsInbox::filePath() const
+{
+    return m_file.fileName();
+}
+
+QString SmsInbox::errorString() const
+{
+    return m_errorString;
+}
+
+QList<qint64> SmsInbox::offsets() const
+{
+    return m_offsets;
+}
+
+qint64 SmsInbox::count() const
+{
+    return m_offsets.size();
+}
+
+bool SmsInbox::scan()
+{
+    m_offsets.clear();
+    const qint64 size = m_file.size();
+
+    char header[HEADER_SIZE];
+    if (size < HEADER_SIZE || m_file.read(header, HEADER_SIZE) != HEADER_SIZE ||
+        qFromLittleEndian<quint32>(header) != FILE_MAGIC ||
+        qFromLittleEndian<quint32>(header + 4) != FILE_VERSION) {
+        if (size >= HEADER_SIZE) {
+            m_errorString = "not an inbox file, starting over";
+        }
+        qToLittleEndian<quint32>(FILE_MAGIC, header);
+        qToLittleEndian<quint32>(FILE_VERSION, header + 4);
+        if (!m_file.resize(0) || !m_file.seek(0) ||
+            m_file.write(header, HEADER_SIZE) != HEADER_SIZE) {
+            m_errorString = m_file.errorString();
+            return false;
+        }
+        return commit();
+    }
+
+    // Walk the headers only, payloads are checked so a torn tail is found
+    qint64 offset = HEADER_SIZE;
+    while (offset + RECORD_HEADER_SIZE <= size) {
+        m_file.seek(offset);
+        char record[RECORD_HEADER_SIZE];
+        if (m_file.read(record, RECORD_HEADER_SIZE) != RECORD_HEADER_SIZE) {
+            break;
+        }
+        const quint32 payloadSize = qFromLittleEndian<quint32>(record);
+        if (payloadSize == 0 || payloadSize > MAX_PAYLOAD_SIZE ||
+            offset + RECORD_HEADER_SIZE + payloadSize > size) {
+            break;
+        }
+        const QByteArray payload = m_file.read(payloadSize);
+        if (qChecksum(payload) != qFromLittleEndian<quint16>(record + 4)) {
+            break;
+        }
+        m_offsets.append(offset);
+        offset += RECORD_HEADER_SIZE + payloadSize;
+    }
+
+    if (offset < size && !m_file.resize(offset)) {
+        m_errorString = m_file.errorString();
+        return false;
+    }
+    return m_file.seek(offset);
+}
+
+qint64 SmsInbox::append(const InboundSms &message)
+{
+    if (!isOpen()) {
+        return -1;
+    }
+    const QByteArray payload = encode(message);
+    char header[RECORD_HEADER_SIZE] = {};
+    qToLittleEndian<quint32>(payload.size(), header);
+    qToLittleEndian<quint16>(qChecksum(payload), header + 4);
+
+    const qint64 offset = m_file.pos();
+    if (m_file.write(header, RECORD_HEADER_SIZE) != RECORD_HEADER_SIZE ||
+        m_file.write(payload) != payload.size()) {
+        m_errorString = m_file.errorString();
+        // Drop the partial record so the next append starts clean
+        m_file.resize(offset);
+        m_file.seek(offset);
+        return -1;
+    }
+    m_offsets.append(offset);
+    return offset;
+}
+
+bool SmsInbox::commit()
+{
+    if (!m_file.flush()) {
+        m_errorString = m_file.errorString();
+        return false;
+    }
+    return ::fdatasync(m_file.handle()) == 0;
+}
+
+std::optional<InboundSms> SmsInbox::read(QFile &file, qint64 offset)
+{
+    char header[RECORD_HEADER_SIZE];
+    if (!file.seek(offset) || file.read(header, RECORD_HEADER_SIZE) != RECORD_HEADER_SIZE) {
+        return std::nullopt;
+    }
+    const quint32 payloadSize = qFromLittleEndian<quint32>(header);
+    if (payloadSize == 0 || payloadSize > MAX_PAYLOAD_SIZE) {
+        return std::nullopt;
+    }
+    const QByteArray payload = file.read(payloadSize);
+    InboundSms message;
+    if (payload.size() != qsizetype(payloadSize) ||
+        qChecksum(payload) != qFromLittleEndian<quint16>(header + 4) ||
+        !decode(payload, message)) {
+        return std::nullopt;
+    }
+    return message;
+}
+
+QByteArray SmsInbox::encode(const InboundSms &message)
+{
+    const QByteArray number = message.number.toUtf8();
+    const QByteArray text = message.text.toUtf8();
+    const qint64 timestamp = message.timestamp.isValid() ? message.timestamp.toMSecsSinceEpoch() : 0;
+
+    QByteArray payload(12 + number.size() + text.size(), '\0');
+    char *out = payload.data();
+    qToLittleEndian<qint64>(timestamp, out);
+    qToLittleEndian<quint32>(number.size(), out + 8);
+    std::memcpy(out + 12, number.constData(), number.size());
+    std::memcpy(out + 12 + number.size(), text.constData(), text.size());
+    return payload;
+}
+
+bool SmsInbox::decode(const QByteArray &payload, InboundSms &message)
+{
+    if (payload.size() < 12) {
+        return false;
+    }
+    const char *data = payload.constData();
+    const qint64 timestamp = qFromLittleEndian<qint64>(data);
+    const quint32 numberSize = qFromLittleEndian<quint32>(data + 8);
+    if (12 + qint64(numberSize) > payload.size()) {
+        return false;
+    }
+    message.timestamp = timestamp > 0 ? QDateTime::fromMSecsSinceEpoch(timestamp) : QDateTime();
+    message.number = QString::fromUtf8(data + 12, numberSize);
+    message.text = QString::fromUtf8(data + 12 + numberSize, payload.size() - 12 - numberSize);
+    return true;
+}
@@ -0,0 +1,61 @@
+#ifndef SMSINBOX_H
+#define SMSINBOX_H
+
+#include <QString>
+#include <QDateTime>
+#include <QFile>
+#include <QList>
+#include <optional>
+
+// One received message as persisted in the inbox
+struct InboundSms {
+    QString number;
+    QString text;
+    QDateTime timestamp;    // as reported by the network
+};
+
+// Append-only store of received SMS.
+//
+// Records are only ever appended, so the file doubles as the index: open()
+// scans it once and offsets() lists where every record starts. Readers on
+// other threads open the file themselves and decode single records with
+// read(), which is what lets the inbox model page through a large inbox
+// without loading it. A torn tail left by a crash is cut off on open().
+class SmsInbox {
+public:
+    explicit SmsInbox(const QString& filePath);
+    ~SmsInbox();
+
+    bool open();
+    bool isOpen() const;
+    QString filePath() const;
+    QString errorString() const;
+
+    // Record offsets in arrival order, as of open() plus everything appended
+    QList<qint64> offsets() const;
+    qint64 count() const;
+
+    // Returns the record's offset, -1 on failure. Not durable before commit().
+    qint64 append(const InboundSms& message);
+    // Flushes and fdatasyncs everything appended so far
+    bool commit();
+
+    static std::optional<InboundSms> read(QFile& file, qint64 offset);
+
+private:
+    static constexpr quint32 FILE_MAGIC = 0x31495043; // "CPI1"
+    static constexpr quint32 FILE_VERSION = 1;
+    static constexpr qint64 HEADER_SIZE = 8;
+    static constexpr qint64 RECORD_HEADER_SIZE = 8;
+    static constexpr quint32 MAX_PAYLOAD_SIZE = 1024 * 1024;
+
+    QFile m_file;
+    QList<qint64> m_offsets;
+    QString m_errorString;
+
+    bool scan();
+    static QByteArray encode(const InboundSms& message);
+    static bool decode(const QByteArray& payload, InboundSms& message);
+};
+
+#endif // SMSINBOX_H
@@ -0,0 +1,495 @@
+#include "smsjournal.h"
+#include "logging.h"
+#include "metricsregistry.h"
+#include <QTimer>
+#include <QSaveFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QtEndian>
+#include <cstring>
+#include <unistd.h>
+
+SmsJournal::SmsJournal(const QString &filePath, Durability durability, QObject *parent)
+    : QObject(parent)
+    , m_filePath(filePath)
+    , m_durability(durability)
+    , m_file(filePath)
+{
+    m_commitTimer = std::make_unique<QTimer>(this);
+    m_commitTimer->setSingleShot(true);
+    m_commitTimer->setInterval(GROUP_COMMIT_INTERVAL_MS);
+    connect(m_commitTimer.get(), &QTimer::timeout, this, &SmsJournal::sync);
+
+    m_compactTimer = std::make_unique<QTimer>(this);
+    m_compactTimer->setInterval(COMPACT_CHECK_INTERVAL_MS);
+    connect(m_compactTimer.get(), &QTimer::timeout, this, &SmsJournal::maybeCompact);
+}
+
+SmsJournal::~SmsJournal()
+{
+    close();
+}
+
+bool SmsJournal::open()
+{
+    if (isOpen()) {
+        return true;
+    }
+
+    QDir().mkpath(QFileInfo(m_filePath).absolutePath());
+    if (!m_file.open(QIODevice::ReadWrite)) {
+        CPI_LOG_ERROR("journal", "Failed to open", {{"path", m_filePath}, {"error", m_file.errorString()}});
+        return false;
+    }
+
+    const bool fresh = m_file.size() < HEADER_SIZE;
+    if (!mapFile(qMax(m_file.size(), MIN_CAPACITY))) {
+        m_file.close();
+        return false;
+    }
+
+    if (fresh) {
+        if (!initializeHeader()) {
+            close();
+            return false;
+        }
+    } else if (qFromLittleEndian<quint32>(m_map) != FILE_MAGIC ||
+               qFromLittleEndian<quint32>(m_map + 4) != FILE_VERSION) {
+        CPI_LOG_ERROR("journal", "Not a journal, starting over", {{"path", m_filePath}});
+        if (!initializeHeader()) {
+            close();
+            return false;
+        }
+    }
+
+    replay();
+    setAvailable(true);
+    m_compactTimer->start();
+    maybeCompact();
+    return true;
+}
+
+void SmsJournal::close()
+{
+    m_reopenCapacity = 0;
+    if (!isOpen()) {
+        return;
+    }
+    sync();
+    m_compactTimer->stop();
+    unmapFile();
+    m_file.close();
+}
+
+bool SmsJournal::isOpen() const
+{
+    return m_map != nullptr;
+}
+
+QList<SmsJournal::Entry> SmsJournal::pendingEntries() const
+{
+    QList<Entry> entries;
+    entries.reserve(m_pending.size());
+    for (const PendingRecord &record : m_pending) {
+        entries.append(record.entry);
+    }
+    return entries;
+}
+
+int SmsJournal::pendingCount() const
+{
+    return m_pending.size();
+}
+
+quint64 SmsJournal::append(const QString &phoneNumber, const QString &message)
+{
+    if (!isOpen() && !recover()) {
+        return 0;
+    }
+
+    const quint64 sequence = writeEntry(phoneNumber, message);
+    if (sequence != 0) {
+        recordWritten();
+    }
+    return sequence;
+}
+
+QList<quint64> SmsJournal::appendBatch(const QList<Entry> &entries)
+{
+    QList<quint64> sequences;
+    if (!isOpen() && !recover()) {
+        sequences.fill(0, entries.size());
+        return sequences;
+    }
+
+    sequences.reserve(entries.size());
+    int written = 0;
+    for (const Entry &entry : entries) {
+        const quint64 sequence = writeEntry(entry.phoneNumber, entry.message);
+        sequences.append(sequence);
+        if (sequence != 0) {
+            ++written;
+        }
+    }
+    if (written > 0) {
+        recordWritten(written);
+    }
+    return sequences;
+}
+
+quint64 SmsJournal::writeEntry(const QString &phoneNumber, const QString &message)
+{
+    const quint64 sequence = m_nextSequence;
+    const qint64 size = writeRecord(EnqueueRecord, sequence, encodeEntry(phoneNumber, message));
+    if (size <= 0) {
+        return 0;
+    }
+
+    ++m_nextSequence;
+    m_pending.insert(sequence, {{sequence, phoneNumber, message}, size});
+    m_liveBytes += size;
+    return sequence;
+}
+
+void SmsJournal::acknowledge(quint64 sequence)
+{
+    const auto it = m_pending.constFind(sequence);
+    if (it == m_pending.constEnd() || (!isOpen() && !recover())) {
+        return;
+    }
+
+    if (writeRecord(AckRecord, sequence, QByteArray()) <= 0) {
+        return;
+    }
+    m_liveBytes -= it->size;
+    m_pending.erase(it);
+    ++m_deadRecords;
+    recordWritten();
+}
+
+void SmsJournal::sync()
+{
+    m_commitTimer->stop();
+    if (!isOpen() || m_uncommittedRecords == 0) {
+        return;
+    }
+    // Dirty pages of a shared mapping live in the page cache, so flushing
+    // the descriptor commits them together with the file size.
+    if (::fdatasync(m_file.handle()) != 0) {
+        CPI_LOG_ERROR("journal", "fdatasync failed", {{"path", m_filePath}});
+        return;
+    }
+    m_uncommittedRecords = 0;
+}
+
+bool SmsJournal::compact()
+{
+    if (!isOpen()) {
+        return false;
+    }
+
+    QSaveFile output(m_filePath);
+    if (!output.open(QIODevice::WriteOnly)) {
+        CPI_LOG_ERROR("journal", "Compaction failed", {{"error", output.errorString()}});
+        return false;
+    }
+
+    QByteArray header(HEADER_SIZE, '\0');
+    qToLittleEndian<quint32>(FILE_MAGIC, header.data());
+    qToLittleEndian<quint32>(FILE_VERSION, header.data() + 4);
+    output.write(header);
+
+    QMap<quint64, PendingRecord> compacted;
+    qint64 liveBytes = 0;
+    for (const PendingRecord &record : std::as_const(m_pending)) {
+        const QByteArray bytes = encodeRecord(EnqueueRecord, record.entry.sequence,
+                                              encodeEntry(record.entry.phoneNumber,
+                                                          record.entry.message));
+        output.write(bytes);
+        compacted.insert(record.entry.sequence, {record.entry, bytes.size()});
+        liveBytes += bytes.size();
+    }
+
+    sync();
+    unmapFile();
+    m_file.close();
+
+    if (!output.commit()) {
+        CPI_LOG_ERROR("journal", "Compaction failed", {{"error", output.errorString()}});
+        // The old file is untouched, keep using it
+        reopen(m_capacity);
+        return false;
+    }
+
+    const qint64 before = m_writeOffset;
+    m_pending = compacted;
+    m_liveBytes = liveBytes;
+    m_writeOffset = HEADER_SIZE + liveBytes;
+    m_deadRecords = 0;
+    if (!reopen(qMax(MIN_CAPACITY, 2 * m_writeOffset))) {
+        return false;
+    }
+
+    CPI_LOG_INFO("journal", "Compacted",
+                 {{"before", before}, {"after", m_writeOffset}, {"pending", int(m_pending.size())}});
+    return true;
+}
+
+SmsJournal::Durability SmsJournal::durability() const
+{
+    return m_durability;
+}
+
+void SmsJournal::setDurability(Durability durability)
+{
+    if (m_durability == durability) {
+        return;
+    }
+    m_durability = durability;
+    sync();
+}
+
+QString SmsJournal::filePath() const
+{
+    return m_filePath;
+}
+
+qint64 SmsJournal::logicalSize() const
+{
+    return m_writeOffset;
+}
+
+bool SmsJournal::mapFile(qint64 capacity)
+{
+    if (m_file.size() < capacity && !m_file.resize(capacity)) {
+        CPI_LOG_ERROR("journal", "Failed to grow", {{"path", m_filePath}, {"error", m_file.errorString()}});
+        return false;
+    }
+    m_map = m_file.map(0, capacity);
+    if (!m_map) {
+        CPI_LOG_ERROR("journal", "Failed to map", {{"path", m_filePath}, {"error", m_file.errorString()}});
+        return false;
+    }
+    m_capacity = capacity;
+    return true;
+}
+
+void SmsJournal::unmapFile()
+{
+    if (m_map) {
+        m_file.unmap(m_map);
+        m_map = nullptr;
+    }
+}
+
+// Back to the file after compact() closed it, the in-memory state is
+// already that of the file on disk
+bool SmsJournal::reopen(qint64 capacity)
+{
+    if (m_file.open(QIODevice::ReadWrite)) {
+        if (mapFile(capacity)) {
+            m_reopenCapacity = 0;
+            setAvailable(true);
+            return true;
+        }
+        m_file.close();
+    }
+    if (m_reopenCapacity == 0) {
+        CPI_LOG_ERROR("journal", "Failed to reopen, not journalling until it does",
+                      {{"path", m_filePath}, {"error", m_file.errorString()}});
+        setAvailable(false);
+    }
+    m_reopenCapacity = capacity;
+    m_reopenClock.start();
+    return false;
+}
+
+bool SmsJournal::recover()
+{
+    if (m_reopenCapacity == 0 || m_reopenClock.elapsed() < REOPEN_RETRY_INTERVAL_MS
+        || !reopen(m_reopenCapacity)) {
+        return false;
+    }
+    CPI_LOG_INFO("journal", "Reopened, journalling again", {{"path", m_filePath}});
+    return true;
+}
+
+void SmsJournal::setAvailable(bool available)
+{
+    static Gauge &gauge = MetricsRegistry::instance().gauge(
+        "cellularpi_journal_available", "1 while outbound messages are journalled");
+    gauge.set(available ? 1 : 0);
+}
+
+bool SmsJournal::ensureCapacity(qint64 extra)
+{
+    if (m_writeOffset + extra <= m_capacity) {
+        return true;
+    }
+    qint64 capacity = m_capacity;
+    while (capacity < m_writeOffset + extra) {
+        capacity *= 2;
+    }
+    unmapFile();
+    return mapFile(capacity);
+}
+
+bool SmsJournal::initializeHeader()
+{
+    std::memset(m_map, 0, m_capacity);
+    qToLittleEndian<quint32>(FILE_MAGIC, m_map);
+    qToLittleEndian<quint32>(FILE_VERSION, m_map + 4);
+    m_writeOffset = HEADER_SIZE;
+    ++m_uncommittedRecords;
+    sync();
+    return true;
+}
+
+void SmsJournal::replay()
+{
+    m_pending.clear();
+    m_liveBytes = 0;
+    m_deadRecords = 0;
+    m_nextSequence = 1;
+
+    qint64 offset = HEADER_SIZE;
+    while (offset + RECORD_HEADER_SIZE <= m_capacity) {
+        const uchar *record = m_map + offset;
+        const quint32 payloadSize = qFromLittleEndian<quint32>(record);
+        const quint16 checksum = qFromLittleEndian<quint16>(record + 4);
+        const quint8 type = record[6];
+        const quint64 sequence = qFromLittleEndian<quint64>(record + 8);
+
+        if (type != EnqueueRecord && type != AckRecord) {
+            break;
+        }
+        const qint64 size = RECORD_HEADER_SIZE + payloadSize;
+        if (offset + size > m_capacity) {
+            break;
+        }
+        if (qChecksum(QByteArrayView(reinterpret_cast<const char *>(record + 6), size - 6)) != checksum) {
+            break;
+        }
+
+        if (type == EnqueueRecord) {
+            Entry entry;
+            if (!decodeEntry(record + RECORD_HEADER_SIZE, payloadSize, entry)) {
+                break;
+            }
+            entry.sequence = sequence;
+            m_pending.insert(sequence, {entry, size});
+            m_liveBytes += size;
+            m_nextSequence = qMax(m_nextSequence, sequence + 1);
+        } else {
+            const auto it = m_pending.constFind(sequence);
+            if (it != m_pending.constEnd()) {
+                m_liveBytes -= it->size;
+                m_pending.erase(it);
+            }
+            ++m_deadRecords;
+        }
+        offset += size;
+    }
+
+    // Anything past the last good record is a torn write, wipe it so a
+    // shorter record written over it can't be followed by stale bytes
+    if (offset < m_capacity) {
+        std::memset(m_map + offset, 0, m_capacity - offset);
+    }
+    m_writeOffset = offset;
+
+    if (!m_pending.isEmpty()) {
+        CPI_LOG_INFO("journal", "Replayed unsent SMS",
+                     {{"count", int(m_pending.size())}, {"path", m_filePath}});
+    }
+}
+
+qint64 SmsJournal::writeRecord(RecordType type, quint64 sequence, const QByteArray &payload)
+{
+    const QByteArray bytes = encodeRecord(type, sequence, payload);
+    if (!ensureCapacity(bytes.size())) {
+        return -1;
+    }
+    std::memcpy(m_map + m_writeOffset, bytes.constData(), bytes.size());
+    m_writeOffset += bytes.size();
+    return bytes.size();
+}
+
+void SmsJournal::recordWritten(int count)
+{
+    m_uncommittedRecords += count;
+    switch (m_durability) {
+    case Durability::None:
+        break;
+    case Durability::Batched:
+        if (m_uncommittedRecords >= GROUP_COMMIT_MAX_RECORDS) {
+            sync();
+        } else if (!m_commitTimer->isActive()) {
+            m_commitTimer->start();
+        }
+        break;
+    case Durability::PerMessage:
+        sync();
+        break;
+    }
+}
+
+void SmsJournal::maybeCompact()
+{
+    if (!isOpen()) {
+        recover();
+        return;
+    }
+    if (m_deadRecords >= COMPACT_MIN_DEAD_RECORDS &&
+        m_writeOffset - HEADER_SIZE > 2 * m_liveBytes) {
+        compact();
+    }
+}
+
+QByteArray SmsJournal::encodeEntry(const QString &phoneNumber, const QString &message)
+{
+    const QByteArray number = phoneNumber.toUtf8();
+    const QByteArray text = message.toUtf8();
+
+    QByteArray payload(8 + number.size() + text.size(), '\0');
+    char *out = payload.data();
+    qToLittleEndian<quint32>(number.size(), out);
+    std::memcpy(out + 4, number.constData(), number.size());
+    out += 4 + number.size();
+    qToLittleEndian<quint32>(text.size(), out);
+    std::memcpy(out + 4, text.constData(), text.size());
+    return payload;
+}
+
+bool SmsJournal::decodeEntry(const uchar *data, qint64 size, Entry &entry)
+{
+    if (size < 4) {
+        return false;
+    }
+    const quint32 numberSize = qFromLittleEndian<quint32>(data);
+    if (4 + qint64(numberSize) + 4 > size) {
+        return false;
+    }
+    const quint32 textSize = qFromLittleEndian<quint32>(data + 4 + numberSize);
+    if (8 + qint64(numberSize) + textSize != size) {
+        return false;
+    }
+    entry.phoneNumber = QString::fromUtf8(reinterpret_cast<const char *>(data + 4), numberSize);
+    entry.message = QString::fromUtf8(reinterpret_cast<const char *>(data + 8 + numberSize), textSize);
+    return true;
+}
+
+// Record layout (little endian):
+//   u32 payload size | u16 checksum | u8 type | u8 reserved | u64 sequence | payload
+// The checksum covers everything from the type byte to the end of the payload.
+QByteArray SmsJournal::encodeRecord(RecordType type, quint64 sequence, const QByteArray &payload)
+{
+    QByteArray bytes(RECORD_HEADER_SIZE + payload.size(), '\0');
+    char *out = bytes.data();
+    qToLittleEndian<quint32>(payload.size(), out);
+    out[6] = char(type);
+    qToLittleEndian<quint64>(sequence, out + 8);
+    std::memcpy(out + RECORD_HEADER_SIZE, payload.constData(), payload.size());
+    qToLittleEndian<quint16>(qChecksum(QByteArrayView(bytes).sliced(6)), out + 4);
+    return bytes;
+}
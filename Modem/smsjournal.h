@@ -0,0 +1,122 @@
+#ifndef SMSJOURNAL_H
+#define SMSJOURNAL_H
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QMap>
+#include <QList>
+#include <memory>
+
+class QTimer;
+
+// Append-only, memory-mapped journal of outbound SMS: an Enqueue record per
+// message, retired by an Ack once it has a final result. open() replays it
+// (a torn tail fails its checksum and is dropped) and compact() rewrites the
+// live entries into a fresh file.
+class SmsJournal : public QObject {
+    Q_OBJECT
+public:
+    enum class Durability {
+        None,       // leave flushing to the kernel
+        Batched,    // group commit: one fdatasync per batch or interval
+        PerMessage  // fdatasync after every record
+    };
+    Q_ENUM(Durability)
+
+    struct Entry {
+        quint64 sequence{0};
+        QString phoneNumber;
+        QString message;
+    };
+
+    explicit SmsJournal(const QString& filePath,
+                        Durability durability = Durability::Batched,
+                        QObject* parent = nullptr);
+    ~SmsJournal();
+
+    bool open();
+    void close();
+    bool isOpen() const;
+
+    // Unacknowledged entries in the order they were appended
+    QList<Entry> pendingEntries() const;
+    int pendingCount() const;
+
+    // Returns the entry's sequence number, 0 if it could not be persisted
+    quint64 append(const QString& phoneNumber, const QString& message);
+    // Appends every entry (their sequence fields are ignored) and commits
+    // them as one group: a single fdatasync even under PerMessage
+    QList<quint64> appendBatch(const QList<Entry>& entries);
+    void acknowledge(quint64 sequence);
+
+    // Commit everything appended so far to stable storage
+    void sync();
+    // Should the file not reopen afterwards, nothing is journalled until a
+    // later call manages to (cellularpi_journal_available reads 0)
+    bool compact();
+
+    Durability durability() const;
+    void setDurability(Durability durability);
+    QString filePath() const;
+    qint64 logicalSize() const;
+
+private:
+    enum RecordType : quint8 {
+        EnqueueRecord = 1,
+        AckRecord = 2
+    };
+
+    struct PendingRecord {
+        Entry entry;
+        qint64 size{0};
+    };
+
+    static constexpr quint32 FILE_MAGIC = 0x314a5043; // "CPJ1"
+    static constexpr quint32 FILE_VERSION = 1;
+    static constexpr qint64 HEADER_SIZE = 16;
+    static constexpr qint64 RECORD_HEADER_SIZE = 16;
+    static constexpr qint64 MIN_CAPACITY = 1024 * 1024;
+    static constexpr int GROUP_COMMIT_INTERVAL_MS = 20;
+    static constexpr int GROUP_COMMIT_MAX_RECORDS = 256;
+    static constexpr int COMPACT_CHECK_INTERVAL_MS = 60000;
+    static constexpr int COMPACT_MIN_DEAD_RECORDS = 1024;
+    static constexpr int REOPEN_RETRY_INTERVAL_MS = 1000;
+
+    QString m_filePath;
+    Durability m_durability;
+    QFile m_file;
+    uchar* m_map{nullptr};
+    qint64 m_capacity{0};
+    qint64 m_writeOffset{HEADER_SIZE};
+    quint64 m_nextSequence{1};
+    QMap<quint64, PendingRecord> m_pending;
+    qint64 m_liveBytes{0};
+    int m_deadRecords{0};
+    int m_uncommittedRecords{0};
+    // Capacity to map the file with once it reopens, 0 unless compact()
+    // left it closed
+    qint64 m_reopenCapacity{0};
+    QElapsedTimer m_reopenClock;
+    std::unique_ptr<QTimer> m_commitTimer;
+    std::unique_ptr<QTimer> m_compactTimer;
+
+    bool mapFile(qint64 capacity);
+    void unmapFile();
+    bool reopen(qint64 capacity);
+    bool recover();
+    static void setAvailable(bool available);
+    bool ensureCapacity(qint64 extra);
+    bool initializeHeader();
+    void replay();
+    qint64 writeRecord(RecordType type, quint64 sequence, const QByteArray& payload);
+    quint64 writeEntry(const QString& phoneNumber, const QString& message);
+    void recordWritten(int count = 1);
+    void maybeCompact();
+
+    static QByteArray encodeEntry(const QString& phoneNumber, const QString& message);
+    static bool decodeEntry(const uchar* data, qint64 size, Entry& entry);
+    static QByteArray encodeRecord(RecordType type, quint64 sequence, const QByteArray& payload);
+};
+
+#endif // SMSJOURNAL_H
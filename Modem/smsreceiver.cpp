@@ -0,0 +1,309 @@
+#include "smsreceiver.h"
+#include "modemmanagerproxy.h"
+#include "modemdbusmanager.h"
+#include "metricsregistry.h"
+#include "logging.h"
+#include <QTimer>
+#include <QDBusMessage>
+#include <QDBusObjectPath>
+#include <QDBusPendingCallWatcher>
+#include <QDBusPendingReply>
+#include <iterator>
+#include <utility>
+
+SmsReceiver::SmsReceiver(const QDBusConnection &connection, const QString &inboxPath,
+                         QObject *parent)
+    : QObject(parent)
+    , m_connection(connection)
+    , m_inbox(inboxPath)
+{
+    m_persistTimer = std::make_unique<QTimer>(this);
+    m_persistTimer->setSingleShot(true);
+    m_persistTimer->setInterval(PERSIST_DELAY_MS);
+    connect(m_persistTimer.get(), &QTimer::timeout, this, &SmsReceiver::persist);
+
+    m_recheckTimer = std::make_unique<QTimer>(this);
+    m_recheckTimer->setInterval(INCOMPLETE_RECHECK_MS);
+    connect(m_recheckTimer.get(), &QTimer::timeout, this, &SmsReceiver::recheckIncomplete);
+
+    m_sweepTimer = std::make_unique<QTimer>(this);
+    m_sweepTimer->setInterval(SWEEP_INTERVAL_MS);
+    connect(m_sweepTimer.get(), &QTimer::timeout, this, [this]() {
+        const QSet<QString> deletePending = std::exchange(m_deletePending, {});
+        for (const QString &smsPath : deletePending) {
+            deleteFromModem(smsPath);
+        }
+        for (const QString &modemPath : std::as_const(m_modems)) {
+            listModem(modemPath);
+        }
+    });
+}
+
+SmsReceiver::~SmsReceiver() = default;
+
+void SmsReceiver::start()
+{
+    if (!m_inbox.open()) {
+        // Without somewhere to persist, nothing may be deleted from the modem
+        CPI_LOG_ERROR("inbox", "Failed to open the inbox",
+                      {{"path", m_inbox.filePath()}, {"error", m_inbox.errorString()}});
+        return;
+    }
+    if (!m_inbox.errorString().isEmpty()) {
+        CPI_LOG_WARNING("inbox", "Inbox recovered",
+                        {{"path", m_inbox.filePath()}, {"error", m_inbox.errorString()}});
+    }
+    emit inboxOpened(m_inbox.filePath(), m_inbox.offsets());
+
+    // An empty path matches the signal from every modem object
+    m_subscribed = m_connection.connect(ModemManagerProxy::Service, QString(),
+                                        ModemManagerProxy::MessagingInterface, "Added",
+                                        this, SLOT(onMessageAdded(QDBusMessage)));
+    if (!m_subscribed) {
+        CPI_LOG_ERROR("inbox", "Failed to subscribe to Messaging.Added, polling only");
+    }
+    m_sweepTimer->start();
+    for (const QString &modemPath : std::as_const(m_modems)) {
+        listModem(modemPath);
+    }
+}
+
+void SmsReceiver::addModem(const QString &modemPath)
+{
+    if (m_modems.contains(modemPath)) {
+        return;
+    }
+    m_modems.insert(modemPath);
+    if (m_inbox.isOpen()) {
+        listModem(modemPath);
+    }
+}
+
+void SmsReceiver::removeModem(const QString &modemPath)
+{
+    m_modems.remove(modemPath);
+    // Unpersisted messages of a vanished modem are found again by List
+    // once it is back; persisted ones are simply not deleted from it
+    for (auto it = m_modemOf.begin(); it != m_modemOf.end();) {
+        if (it.value() == modemPath) {
+            m_incomplete.remove(it.key());
+            m_deletePending.remove(it.key());
+            it = m_modemOf.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    for (auto it = m_ignored.begin(); it != m_ignored.end();) {
+        it = it.value() == modemPath ? m_ignored.erase(it) : std::next(it);
+    }
+}
+
+void SmsReceiver::onMessageAdded(const QDBusMessage &message)
+{
+    const QList<QVariant> arguments = message.arguments();
+    // Added(o path, b received): received is false for locally created SMS,
+    // i.e. our own outbound messages
+    if (arguments.size() < 2 || !arguments.at(1).toBool() || !m_inbox.isOpen()) {
+        return;
+    }
+    const QString modemPath = message.path();
+    if (!m_modems.contains(modemPath)) {
+        return;
+    }
+    discovered(modemPath, arguments.at(0).value<QDBusObjectPath>().path());
+}
+
+void SmsReceiver::listModem(const QString &modemPath)
+{
+    auto *watcher = new QDBusPendingCallWatcher(
+        ModemManagerProxy::listSms(m_connection, modemPath), this);
+    connect(watcher, &QDBusPendingCallWatcher::finished,
+            this, [this, watcher, modemPath]() {
+                QDBusPendingReply<QList<QDBusObjectPath>> reply = *watcher;
+                watcher->deleteLater();
+                if (reply.isError()) {
+                    CPI_LOG_ERROR("inbox", "Messaging.List failed",
+                                  {{"modem", modemPath}, {"error", reply.error().message()}});
+                    return;
+                }
+                if (!m_modems.contains(modemPath)) {
+                    return;
+                }
+                const QList<QDBusObjectPath> paths = reply.value();
+                QSet<QString> listed;
+                listed.reserve(paths.size());
+                for (const QDBusObjectPath &path : paths) {
+                    listed.insert(path.path());
+                    discovered(modemPath, path.path());
+                }
+                for (auto it = m_ignored.begin(); it != m_ignored.end();) {
+                    const bool gone = it.value() == modemPath && !listed.contains(it.key());
+                    it = gone ? m_ignored.erase(it) : std::next(it);
+                }
+            });
+}
+
+void SmsReceiver::discovered(const QString &modemPath, const QString &smsPath)
+{
+    // Added and List overlap, anything already in the pipeline is skipped
+    if (m_modemOf.contains(smsPath) || m_ignored.contains(smsPath)) {
+        return;
+    }
+    m_modemOf.insert(smsPath, modemPath);
+    m_fetchQueue.enqueue(smsPath);
+    fetchNext();
+}
+
+void SmsReceiver::fetchNext()
+{
+    while (m_fetchesInFlight < MAX_CONCURRENT_FETCHES && !m_fetchQueue.isEmpty()) {
+        const QString smsPath = m_fetchQueue.dequeue();
+        if (!m_modemOf.contains(smsPath)) {
+            continue;
+        }
+        ++m_fetchesInFlight;
+        auto *watcher = new QDBusPendingCallWatcher(
+            ModemManagerProxy::getSmsProperties(m_connection, smsPath), this);
+        connect(watcher, &QDBusPendingCallWatcher::finished,
+                this, [this, watcher, smsPath]() {
+                    --m_fetchesInFlight;
+                    handleProperties(watcher, smsPath);
+                    watcher->deleteLater();
+                    fetchNext();
+                });
+    }
+}
+
+void SmsReceiver::handleProperties(const QDBusPendingCallWatcher *watcher, const QString &smsPath)
+{
+    QDBusPendingReply<QVariantMap> reply = *watcher;
+    if (!m_modemOf.contains(smsPath)) {
+        return;
+    }
+    if (reply.isError()) {
+        // Gone already (deleted elsewhere) or the modem went away
+        forget(smsPath);
+        return;
+    }
+
+    const QVariantMap properties = reply.value();
+    const uint state = properties.value("State").toUInt();
+    if (state == ModemManagerProxy::SmsStateReceiving) {
+        const qint64 now = SmsTimeline::now();
+        const qint64 firstSeen = m_incomplete.value(smsPath, now);
+        if (now - firstSeen < qint64(INCOMPLETE_TIMEOUT_MS) * 1000000) {
+            m_incomplete.insert(smsPath, firstSeen);
+            if (!m_recheckTimer->isActive()) {
+                m_recheckTimer->start();
+            }
+            return;
+        }
+        CPI_LOG_WARNING("inbox", "Message still incomplete, storing the parts received", {{"sms", smsPath}});
+    } else if (state != ModemManagerProxy::SmsStateReceived) {
+        // Outbound or draft messages are not ours to ingest; remembered so
+        // that every sweep does not fetch them again
+        m_ignored.insert(smsPath, m_modemOf.value(smsPath));
+        forget(smsPath);
+        return;
+    }
+    m_incomplete.remove(smsPath);
+
+    InboundSms message;
+    message.number = properties.value("Number").toString();
+    message.text = properties.value("Text").toString();
+    message.timestamp = QDateTime::fromString(properties.value("Timestamp").toString(), Qt::ISODateWithMs);
+    m_received.append({smsPath, message});
+
+    if (m_received.size() >= PERSIST_BATCH) {
+        persist();
+    } else if (!m_persistTimer->isActive()) {
+        m_persistTimer->start();
+    }
+}
+
+void SmsReceiver::recheckIncomplete()
+{
+    if (m_incomplete.isEmpty()) {
+        m_recheckTimer->stop();
+        return;
+    }
+    for (auto it = m_incomplete.cbegin(); it != m_incomplete.cend(); ++it) {
+        if (!m_fetchQueue.contains(it.key())) {
+            m_fetchQueue.enqueue(it.key());
+        }
+    }
+    fetchNext();
+}
+
+void SmsReceiver::persist()
+{
+    m_persistTimer->stop();
+    const QList<Received> received = std::exchange(m_received, {});
+    if (received.isEmpty()) {
+        return;
+    }
+
+    QList<qint64> offsets;
+    offsets.reserve(received.size());
+    QStringList stored;
+    for (const Received &entry : received) {
+        const qint64 offset = m_inbox.append(entry.message);
+        if (offset < 0) {
+            CPI_LOG_ERROR("inbox", "Failed to store message",
+                          {{"sms", entry.smsPath}, {"error", m_inbox.errorString()}});
+            forget(entry.smsPath);
+            continue;
+        }
+        offsets.append(offset);
+        stored.append(entry.smsPath);
+    }
+    if (offsets.isEmpty()) {
+        return;
+    }
+    if (!m_inbox.commit()) {
+        // Kept on the modem, the next sweep stores them again
+        CPI_LOG_ERROR("inbox", "Failed to commit", {{"error", m_inbox.errorString()}});
+        for (const QString &smsPath : std::as_const(stored)) {
+            forget(smsPath);
+        }
+        return;
+    }
+
+    static Counter &received = MetricsRegistry::instance().counter(
+        "cellularpi_sms_received_total", "Inbound messages persisted to the inbox");
+    received.increment(offsets.size());
+    emit messagesStored(offsets);
+    for (const QString &smsPath : std::as_const(stored)) {
+        deleteFromModem(smsPath);
+    }
+}
+
+void SmsReceiver::deleteFromModem(const QString &smsPath)
+{
+    const QString modemPath = m_modemOf.value(smsPath);
+    if (modemPath.isEmpty()) {
+        return;
+    }
+    auto *watcher = new QDBusPendingCallWatcher(
+        ModemManagerProxy::deleteSms(m_connection, modemPath, smsPath), this);
+    connect(watcher, &QDBusPendingCallWatcher::finished,
+            this, [this, watcher, smsPath]() {
+                if (watcher->isError() && m_modemOf.contains(smsPath)) {
+                    // Still known, so the sweep retries the delete instead
+                    // of storing the message a second time
+                    CPI_LOG_WARNING("inbox", "Failed to delete message from the modem",
+                                    {{"sms", smsPath}, {"error", watcher->error().message()}});
+                    m_deletePending.insert(smsPath);
+                } else {
+                    forget(smsPath);
+                }
+                watcher->deleteLater();
+            });
+}
+
+void SmsReceiver::forget(const QString &smsPath)
+{
+    m_modemOf.remove(smsPath);
+    m_incomplete.remove(smsPath);
+    m_deletePending.remove(smsPath);
+}
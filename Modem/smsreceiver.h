@@ -0,0 +1,87 @@
+#ifndef SMSRECEIVER_H
+#define SMSRECEIVER_H
+
+#include <QObject>
+#include <QDBusConnection>
+#include <QHash>
+#include <QSet>
+#include <QQueue>
+#include <QList>
+#include <memory>
+#include "smsinbox.h"
+
+class QTimer;
+class QDBusMessage;
+class QDBusPendingCallWatcher;
+
+// Inbound half of the modem pipeline, owned by ModemDBusManager. New SMS
+// come from Messaging.Added plus a periodic List sweep, are fetched with
+// bounded concurrency, persisted in batches and only then deleted from
+// the modem.
+class SmsReceiver : public QObject {
+    Q_OBJECT
+public:
+    SmsReceiver(const QDBusConnection& connection, const QString& inboxPath,
+                QObject* parent = nullptr);
+    ~SmsReceiver();
+
+    // Opens the inbox (reported through inboxOpened) and subscribes
+    void start();
+    void addModem(const QString& modemPath);
+    void removeModem(const QString& modemPath);
+
+signals:
+    // Offsets of every record already in the inbox file
+    void inboxOpened(const QString& filePath, const QList<qint64>& offsets);
+    // Offsets of newly persisted records, in arrival order
+    void messagesStored(const QList<qint64>& offsets);
+
+private slots:
+    void onMessageAdded(const QDBusMessage& message);
+
+private:
+    struct Received {
+        QString smsPath;
+        InboundSms message;
+    };
+
+    static constexpr int MAX_CONCURRENT_FETCHES = 16;
+    static constexpr int PERSIST_BATCH = 64;
+    static constexpr int PERSIST_DELAY_MS = 20;
+    static constexpr int INCOMPLETE_RECHECK_MS = 2000;
+    static constexpr int INCOMPLETE_TIMEOUT_MS = 60000;
+    static constexpr int SWEEP_INTERVAL_MS = 30000;
+
+    QDBusConnection m_connection;
+    SmsInbox m_inbox;
+    bool m_subscribed{false};
+    QSet<QString> m_modems;
+
+    // Every SMS path between discovery and deletion, with its modem
+    QHash<QString, QString> m_modemOf;
+    QQueue<QString> m_fetchQueue;
+    int m_fetchesInFlight{0};
+    // Receiving-state SMS and when they were first seen (ns)
+    QHash<QString, qint64> m_incomplete;
+    QList<Received> m_received;
+    // Persisted but not yet deleted from the modem, retried by the sweep
+    QSet<QString> m_deletePending;
+    // Outbound and draft SMS, with their modem: never fetched again, and
+    // dropped once List no longer returns them
+    QHash<QString, QString> m_ignored;
+
+    std::unique_ptr<QTimer> m_persistTimer;
+    std::unique_ptr<QTimer> m_recheckTimer;
+    std::unique_ptr<QTimer> m_sweepTimer;
+
+    void listModem(const QString& modemPath);
+    void discovered(const QString& modemPath, const QString& smsPath);
+    void fetchNext();
+    void handleProperties(const QDBusPendingCallWatcher* watcher, const QString& smsPath);
+    void recheckIncomplete();
+    void persist();
+    void deleteFromModem(const QString& smsPath);
+    void forget(const QString& smsPath);
+};
+
+#endif // SMSRECEIVER_H
@@ -0,0 +1,217 @@
+#include "smssegmenter.h"
+#include <array>
+#include <algorithm>
+
+namespace {
+
+// GSM 03.38 default alphabet in code order, 0x1B (escape) stands in as a space
+constexpr char16_t GSM7_BASIC[] =
+    u"@£$¥èéùìòÇ\nØø\rÅåΔ_ΦΓΛΩΠΨΣΘΞ ÆæßÉ !\"#¤%&'()*+,-./0123456789:;<=>?"
+    u"¡ABCDEFGHIJKLMNOPQRSTUVWXYZÄÖÑÜ§¿abcdefghijklmnopqrstuvwxyzäöñüà";
+
+// Reached through the escape code, each costs two septets
+constexpr char16_t GSM7_EXTENSION[] = u"\f^{}\\[~]|€";
+
+// Every GSM-7 character except € sits below U+0400
+constexpr int COST_TABLE_SIZE = 0x400;
+
+constexpr std::array<quint8, COST_TABLE_SIZE> buildCostTable()
+{
+    std::array<quint8, COST_TABLE_SIZE> table{};
+    for (char16_t c : GSM7_BASIC) {
+        if (c != 0 && c < COST_TABLE_SIZE) {
+            table[c] = 1;
+        }
+    }
+    for (char16_t c : GSM7_EXTENSION) {
+        if (c != 0 && c < COST_TABLE_SIZE) {
+            table[c] = 2;
+        }
+    }
+    return table;
+}
+
+constexpr std::array<quint8, COST_TABLE_SIZE> COST_TABLE = buildCostTable();
+constexpr char16_t EURO_SIGN = 0x20AC;
+
+struct Transliteration {
+    char16_t from;
+    const char *to;
+};
+
+// Sorted by code point. Accented letters not listed here fall back to their
+// Unicode base letter.
+constexpr Transliteration TRANSLITERATIONS[] = {
+    {0x00A0, " "},   // no-break space
+    {0x00AB, "\""},  // «
+    {0x00B4, "'"},   // acute accent
+    {0x00B7, "."},   // middle dot
+    {0x00BB, "\""},  // »
+    {0x00E7, "\xC3\x87"}, // ç -> Ç, the only cedilla GSM-7 has
+    {0x00F0, "d"},   // ð
+    {0x0110, "D"},   // Đ
+    {0x0111, "d"},   // đ
+    {0x0141, "L"},   // Ł
+    {0x0142, "l"},   // ł
+    {0x0152, "OE"},  // Œ
+    {0x0153, "oe"},  // œ
+    {0x02BC, "'"},   // modifier apostrophe
+    {0x02C6, "^"},
+    {0x02DC, "~"},
+    {0x2002, " "},
+    {0x2003, " "},
+    {0x2009, " "},
+    {0x200B, ""},    // zero width space
+    {0x2010, "-"},
+    {0x2011, "-"},
+    {0x2012, "-"},
+    {0x2013, "-"},   // en dash
+    {0x2014, "-"},   // em dash
+    {0x2015, "-"},
+    {0x2018, "'"},
+    {0x2019, "'"},
+    {0x201A, "'"},
+    {0x201B, "'"},
+    {0x201C, "\""},
+    {0x201D, "\""},
+    {0x201E, "\""},
+    {0x201F, "\""},
+    {0x2022, "*"},   // bullet
+    {0x2026, "..."},
+    {0x2032, "'"},
+    {0x2033, "\""},
+    {0x2039, "<"},
+    {0x203A, ">"},
+    {0x2122, "TM"},
+    {0x2212, "-"},   // minus sign
+    {0xFEFF, ""},    // byte order mark
+};
+
+const Transliteration *findTransliteration(char16_t c)
+{
+    const auto it = std::lower_bound(std::begin(TRANSLITERATIONS), std::end(TRANSLITERATIONS), c,
+                                     [](const Transliteration &t, char16_t value) {
+                                         return t.from < value;
+                                     });
+    return (it != std::end(TRANSLITERATIONS) && it->from == c) ? it : nullptr;
+}
+
+} // namespace
+
+QVariantMap SmsSegmentInfo::toVariantMap() const
+{
+    return {
+        {"encoding", encoding == Gsm7 ? QStringLiteral("GSM-7") : QStringLiteral("UCS-2")},
+        {"units", units},
+        {"segments", segments},
+        {"unitsPerSegment", unitsPerSegment},
+        {"remaining", remaining},
+    };
+}
+
+int SmsSegmenter::gsm7Cost(char16_t c)
+{
+    if (c < COST_TABLE_SIZE) {
+        return COST_TABLE[c];
+    }
+    return c == EURO_SIGN ? 2 : 0;
+}
+
+bool SmsSegmenter::isGsm7(QStringView text)
+{
+    for (QChar c : text) {
+        if (gsm7Cost(c.unicode()) == 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+SmsSegmentInfo SmsSegmenter::analyze(QStringView text)
+{
+    SmsSegmentInfo info;
+
+    int septets = 0;
+    bool gsm7 = true;
+    for (QChar c : text) {
+        const int cost = gsm7Cost(c.unicode());
+        if (cost == 0) {
+            gsm7 = false;
+            break;
+        }
+        septets += cost;
+    }
+
+    int single = GSM7_SINGLE;
+    int multi = GSM7_MULTI;
+    if (gsm7) {
+        info.encoding = SmsSegmentInfo::Gsm7;
+        info.units = septets;
+    } else {
+        info.encoding = SmsSegmentInfo::Ucs2;
+        info.units = int(text.size());
+        single = UCS2_SINGLE;
+        multi = UCS2_MULTI;
+    }
+
+    if (info.units <= single) {
+        info.segments = info.units > 0 ? 1 : 0;
+        info.unitsPerSegment = single;
+        info.remaining = single - info.units;
+        return info;
+    }
+
+    // Only long texts need the boundary-aware walk
+    info.unitsPerSegment = multi;
+    info.segments = countSegments(text, info.encoding, multi);
+    info.remaining = info.segments * multi - info.units;
+    return info;
+}
+
+int SmsSegmenter::countSegments(QStringView text, SmsSegmentInfo::Encoding encoding, int perSegment)
+{
+    int segments = 1;
+    int used = 0;
+    for (qsizetype i = 0; i < text.size(); ++i) {
+        int width;
+        if (encoding == SmsSegmentInfo::Gsm7) {
+            width = gsm7Cost(text[i].unicode());
+        } else {
+            width = (text[i].isHighSurrogate() && i + 1 < text.size()
+                     && text[i + 1].isLowSurrogate()) ? 2 : 1;
+        }
+        if (used + width > perSegment) {
+            ++segments;
+            used = 0;
+        }
+        used += width;
+        if (width == 2 && encoding == SmsSegmentInfo::Ucs2) {
+            ++i;
+        }
+    }
+    return segments;
+}
+
+QString SmsSegmenter::transliterate(QStringView text)
+{
+    if (isGsm7(text)) {
+        return text.toString();
+    }
+
+    QString result;
+    result.reserve(text.size());
+    for (QChar c : text) {
+        if (gsm7Cost(c.unicode()) != 0) {
+            result.append(c);
+        } else if (const Transliteration *t = findTransliteration(c.unicode())) {
+            result.append(QString::fromUtf8(t->to));
+        } else if (c.decompositionTag() == QChar::Canonical
+                   && gsm7Cost(c.decomposition().at(0).unicode()) != 0) {
+            // á -> a, Ő -> O, ...
+            result.append(c.decomposition().at(0));
+        } else {
+            result.append(c);
+        }
+    }
+    return result;
+}
@@ -0,0 +1,52 @@
+#ifndef SMSSEGMENTER_H
+#define SMSSEGMENTER_H
+
+#include <QString>
+#include <QStringView>
+#include <QVariantMap>
+
+// How a text is packed into SMS PDUs
+struct SmsSegmentInfo {
+    enum Encoding {
+        Gsm7, // GSM 03.38 default alphabet, extension characters cost 2 septets
+        Ucs2  // anything else, counted in UTF-16 code units
+    };
+
+    Encoding encoding{Gsm7};
+    int units{0};            // septets for GSM-7, code units for UCS-2
+    int segments{0};
+    int unitsPerSegment{0};  // capacity of each segment at this encoding
+    int remaining{0};        // units still free in the last segment
+
+    QVariantMap toVariantMap() const;
+};
+
+// Encoding detection and segment counting for outbound SMS.
+//
+// Classification is a single pass over the text through a lookup table, so
+// it is cheap enough to price every message before it is queued. Segment
+// boundaries follow the rules a modem applies when it splits a long SMS: a
+// GSM-7 escape sequence or a UTF-16 surrogate pair is never split, which is
+// why a multipart count can exceed ceil(units / unitsPerSegment).
+class SmsSegmenter {
+public:
+    static constexpr int GSM7_SINGLE = 160;
+    static constexpr int GSM7_MULTI = 153;
+    static constexpr int UCS2_SINGLE = 70;
+    static constexpr int UCS2_MULTI = 67;
+
+    static SmsSegmentInfo analyze(QStringView text);
+    static bool isGsm7(QStringView text);
+
+    // Replaces characters outside GSM-7 with the closest GSM-7 spelling
+    // (typographic quotes and dashes, accented letters, ...). Characters
+    // without one are kept, so the result may still need UCS-2.
+    static QString transliterate(QStringView text);
+
+private:
+    // Septets per UTF-16 code unit: 0 = not in GSM-7, 1 = basic, 2 = extension
+    static int gsm7Cost(char16_t c);
+    static int countSegments(QStringView text, SmsSegmentInfo::Encoding encoding, int perSegment);
+};
+
+#endif // SMSSEGMENTER_H
@@ -1,3 +1,5 @@
+pragma ComponentBehavior: Bound
+
 import QtQuick
 import QtQuick.Controls
 import QtQuick.Layouts
@@ -5,6 +7,7 @@ import QtQuick.Controls.Universal
 import QtQuick.Window
 import Modem
 import REST
+import Diagnostics
 
 ApplicationWindow {
     id: window
@@ -20,7 +23,7 @@ ApplicationWindow {
     title: qsTr("CellularPi")
 
     property real fontScale: Math.min(Screen.width, Screen.height) / 1920
-    property real baseSize: Math.max(16 * fontScale, 12)
+    property real baseSize: Math.max(16 * window.fontScale, 12)
 
     Universal.theme: Universal.Light
     Universal.accent: Universal.Violet
@@ -48,7 +51,7 @@ ApplicationWindow {
 
             Label {
                 text: "CellularPi"
-                font.pixelSize: baseSize * 1.5
+                font.pixelSize: window.baseSize * 1.5
                 font.weight: Font.Medium
                 color: Universal.foreground
             }
@@ -59,219 +62,393 @@ ApplicationWindow {
 
                 TabButton {
                     text: qsTr("SMS")
-                    font.pixelSize: baseSize
+                    font.pixelSize: window.baseSize
                 }
                 TabButton {
                     text: qsTr("Internet")
-                    font.pixelSize: baseSize
+                    font.pixelSize: window.baseSize
+                }
+                TabButton {
+                    text: qsTr("Inbox (%1)").arg(Modem.inbox.count)
+                    font.pixelSize: window.baseSize
+                }
+                TabButton {
+                    text: qsTr("Log")
+                    font.pixelSize: window.baseSize
                 }
             }
 
             BusyIndicator {
                 running: window.isSending
                 visible: window.isSending
-                Layout.preferredWidth: baseSize * 1.5
-                Layout.preferredHeight: baseSize * 1.5
+                Layout.preferredWidth: window.baseSize * 1.5
+                Layout.preferredHeight: window.baseSize * 1.5
             }
         }
     }
 
+    // The newest entries only; older ones are in the log files. Kept here
+    // so that the Log tab shows what came before it was first opened.
+    LogModel {
+        id: logModel
+        feed: LogFeed
+    }
+
+    // A tab's page, created the first time the tab is shown and kept from
+    // then on. Only the shell is needed for the first frame.
+    component LazyPage: Loader {
+        active: StackLayout.isCurrentItem || status === Loader.Ready
+        asynchronous: true
+    }
+
     StackLayout {
         anchors.fill: parent
         currentIndex: tabBar.currentIndex
 
         // SMS Page
-        Page {
-            padding: window.width * 0.03
-
-            ColumnLayout {
-                anchors.fill: parent
-                spacing: window.height * 0.02
-
-                Label {
-                    text: window.statusMessage
-                    visible: text.length > 0
-                    Layout.fillWidth: true
-                    horizontalAlignment: Text.AlignHCenter
-                    wrapMode: Text.WordWrap
-                    font.pixelSize: baseSize
-                    color: {
-                        if (text.includes("successfully")) return Universal.color(Universal.Green)
-                        if (text.includes("Failed") || text.includes("Error")) return Universal.color(Universal.Red)
-                        return Universal.accent
+        LazyPage {
+            sourceComponent: Page {
+                padding: window.width * 0.03
+
+                ColumnLayout {
+                    anchors.fill: parent
+                    spacing: window.height * 0.02
+
+                    Label {
+                        text: window.statusMessage
+                        visible: text.length > 0
+                        Layout.fillWidth: true
+                        horizontalAlignment: Text.AlignHCenter
+                        wrapMode: Text.WordWrap
+                        font.pixelSize: window.baseSize
+                        color: {
+                            if (text.includes("successfully")) return Universal.color(Universal.Green)
+                            if (text.includes("Failed") || text.includes("Error")) return Universal.color(Universal.Red)
+                            return Universal.accent
+                        }
                     }
-                }
 
-                TextField {
-                    id: phoneNumberField
-                    placeholderText: qsTr("Phone Number")
-                    Layout.fillWidth: true
-                    font.pixelSize: baseSize
-                    selectByMouse: true
-                    Layout.preferredHeight: baseSize * 2.5
-                    validator: RegularExpressionValidator {
-                        regularExpression: /^\+?[\d\s-]{0,15}$/
+                    // Radio link of the first modem, sends pause while it is down
+                    Label {
+                        readonly property var radio: Modem.radio.length > 0 ? Modem.radio[0] : null
+                        visible: radio !== null
+                        text: radio ? qsTr("Signal: %1, %2, %3%").arg(radio.link).arg(radio.technology).arg(radio.quality)
+                                      + (radio.roaming ? qsTr(", roaming") : "") : ""
+                        Layout.fillWidth: true
+                        horizontalAlignment: Text.AlignHCenter
+                        font.pixelSize: window.baseSize * 0.75
+                        color: radio && (radio.link === "down" || radio.link === "poor") ?
+                               Universal.color(Universal.Red) :
+                               Universal.color(Universal.Chromium)
                     }
-                }
 
-                ScrollView {
-                    Layout.fillWidth: true
-                    Layout.fillHeight: true
-                    Layout.minimumHeight: window.height * 0.2
-                    clip: true
-
-                    TextArea {
-                        id: messageField
-                        placeholderText: qsTr("Type your message here...")
-                        wrapMode: TextArea.Wrap
-                        font.pixelSize: baseSize
+                    TextField {
+                        id: phoneNumberField
+                        placeholderText: qsTr("Phone Number")
+                        Layout.fillWidth: true
+                        font.pixelSize: window.baseSize
                         selectByMouse: true
+                        Layout.preferredHeight: window.baseSize * 2.5
+                        validator: RegularExpressionValidator {
+                            regularExpression: /^\+?[\d\s-]{0,15}$/
+                        }
                     }
-                }
 
-                Label {
-                    text: qsTr("%1/160 characters").arg(messageField.length)
-                    color: messageField.length > 160 ?
-                           Universal.color(Universal.Red) :
-                           Universal.color(Universal.Chromium)
-                    font.pixelSize: baseSize * 0.75
-                    Layout.alignment: Qt.AlignRight
-                }
+                    ScrollView {
+                        Layout.fillWidth: true
+                        Layout.fillHeight: true
+                        Layout.minimumHeight: window.height * 0.2
+                        clip: true
 
-                Button {
-                    text: qsTr("Send SMS")
-                    enabled: !window.isSending &&
-                            phoneNumberField.text.length > 0 &&
-                            messageField.text.length > 0 &&
-                            messageField.length <= 160
-                    Layout.fillWidth: true
-                    Layout.preferredHeight: Math.max(window.height * 0.08, baseSize * 3)
-
-                    contentItem: Text {
-                        text: parent.text
-                        font.pixelSize: baseSize
-                        font.weight: Font.Medium
-                        color: parent.enabled ?
-                               Universal.foreground :
+                        TextArea {
+                            id: messageField
+                            placeholderText: qsTr("Type your message here...")
+                            wrapMode: TextArea.Wrap
+                            font.pixelSize: window.baseSize
+                            selectByMouse: true
+                        }
+                    }
+
+                    Label {
+                        text: qsTr("%1/160 characters").arg(messageField.length)
+                        color: messageField.length > 160 ?
+                               Universal.color(Universal.Red) :
                                Universal.color(Universal.Chromium)
-                        horizontalAlignment: Text.AlignHCenter
-                        verticalAlignment: Text.AlignVCenter
+                        font.pixelSize: window.baseSize * 0.75
+                        Layout.alignment: Qt.AlignRight
+                    }
+
+                    Button {
+                        text: qsTr("Send SMS")
+                        enabled: !window.isSending &&
+                                phoneNumberField.text.length > 0 &&
+                                messageField.text.length > 0 &&
+                                messageField.length <= 160
+                        Layout.fillWidth: true
+                        Layout.preferredHeight: Math.max(window.height * 0.08, window.baseSize * 3)
+
+                        contentItem: Text {
+                            text: parent.text
+                            font.pixelSize: window.baseSize
+                            font.weight: Font.Medium
+                            color: parent.enabled ?
+                                   Universal.foreground :
+                                   Universal.color(Universal.Chromium)
+                            horizontalAlignment: Text.AlignHCenter
+                            verticalAlignment: Text.AlignVCenter
+                        }
+
+                        onClicked: {
+                            window.isSending = true
+                            window.statusMessage = "Sending message..."
+                            Modem.sendSMS(phoneNumberField.text, messageField.text)
+                        }
                     }
+                }
+
+                Connections {
+                    target: Modem
 
-                    onClicked: {
-                        window.isSending = true
-                        window.statusMessage = "Sending message..."
-                        Modem.sendSMS(phoneNumberField.text, messageField.text)
+                    function onSmsSent(recipient) {
+                        messageField.clear()
                     }
                 }
             }
         }
 
         // Internet/REST Page
-        Page {
-            padding: window.width * 0.03
+        LazyPage {
+            sourceComponent: Page {
+                id: internetPage
+                padding: window.width * 0.03
+
+                Component.onCompleted: {
+                    // Initialize REST client
+                    RestClient.baseUrl = "https://jsonplaceholder.typicode.com"
+                }
 
-            Component.onCompleted: {
-                // Initialize REST client
-                RestClient.baseUrl = "https://jsonplaceholder.typicode.com"
-            }
+                ColumnLayout {
+                    anchors.fill: parent
+                    spacing: window.height * 0.02
 
-            ColumnLayout {
-                anchors.fill: parent
-                spacing: window.height * 0.02
+                    GroupBox {
+                        title: "REST API Test"
+                        Layout.fillWidth: true
 
-                GroupBox {
-                    title: "REST API Test"
-                    Layout.fillWidth: true
+                        ColumnLayout {
+                            anchors.fill: parent
+                            spacing: window.height * 0.02
 
-                    ColumnLayout {
-                        anchors.fill: parent
-                        spacing: window.height * 0.02
+                            Label {
+                                text: "Base URL: " + RestClient.baseUrl
+                                font.pixelSize: window.baseSize
+                                Layout.fillWidth: true
+                            }
 
-                        Label {
-                            text: "Base URL: " + RestClient.baseUrl
-                            font.pixelSize: baseSize
-                            Layout.fillWidth: true
-                        }
+                            ComboBox {
+                                id: endpointCombo
+                                Layout.fillWidth: true
+                                model: ["/posts/1", "/users/1", "/todos/1"]
+                                font.pixelSize: window.baseSize
+                            }
 
-                        ComboBox {
-                            id: endpointCombo
-                            Layout.fillWidth: true
-                            model: ["/posts/1", "/users/1", "/todos/1"]
-                            font.pixelSize: baseSize
-                        }
+                            Button {
+                                text: "GET Request"
+                                Layout.fillWidth: true
+                                font.pixelSize: window.baseSize
+                                onClicked: RestClient.get(endpointCombo.currentText, internetPage.showResponse)
+                            }
 
-                        Button {
-                            text: "GET Request"
-                            Layout.fillWidth: true
-                            font.pixelSize: baseSize
-                            onClicked: RestClient.get(endpointCombo.currentText)
+                            ScrollView {
+                                Layout.fillWidth: true
+                                Layout.fillHeight: true
+                                Layout.minimumHeight: window.height * 0.3
+                                clip: true
+
+                                TextArea {
+                                    id: responseArea
+                                    readOnly: true
+                                    wrapMode: TextArea.Wrap
+                                    font.family: "Monospace"
+                                    font.pixelSize: window.baseSize * 0.9
+                                    placeholderText: "Response will appear here..."
+                                }
+                            }
                         }
+                    }
 
-                        ScrollView {
-                            Layout.fillWidth: true
-                            Layout.fillHeight: true
-                            Layout.minimumHeight: window.height * 0.3
-                            clip: true
+                    GroupBox {
+                        title: "POST Example"
+                        Layout.fillWidth: true
+
+                        ColumnLayout {
+                            anchors.fill: parent
+                            spacing: window.height * 0.02
 
                             TextArea {
-                                id: responseArea
-                                readOnly: true
+                                id: postDataField
+                                Layout.fillWidth: true
                                 wrapMode: TextArea.Wrap
+                                font.pixelSize: window.baseSize
+                                text: '{\n    "title": "foo",\n    "body": "bar",\n    "userId": 1\n}'
                                 font.family: "Monospace"
-                                font.pixelSize: baseSize * 0.9
-                                placeholderText: "Response will appear here..."
+                            }
+
+                            Button {
+                                text: "POST Request"
+                                Layout.fillWidth: true
+                                font.pixelSize: window.baseSize
+                                onClicked: {
+                                    try {
+                                        const data = JSON.parse(postDataField.text)
+                                        RestClient.post("/posts", data, internetPage.showResponse)
+                                    } catch (e) {
+                                        responseArea.text = "Error parsing JSON: " + e.message
+                                    }
+                                }
                             }
                         }
                     }
                 }
 
-                GroupBox {
-                    title: "POST Example"
-                    Layout.fillWidth: true
+                // Result callback for the REST page, see RestResponse::toVariantMap()
+                function showResponse(result) {
+                    const summary = "#%1 %2 %3 in %4 ms%5\n\n".arg(result.id).arg(result.method)
+                        .arg(result.status).arg(result.elapsedMs.toFixed(0))
+                        .arg(result.fromCache ? " (cached)" : "")
+                    if (!result.ok)
+                        responseArea.text = summary + "Error: " + result.error
+                    else if (result.json !== undefined && result.json !== null)
+                        responseArea.text = summary + JSON.stringify(result.json, null, 2)
+                    else
+                        responseArea.text = summary + result.body.byteLength + " bytes"
+                }
+            }
+        }
 
-                    ColumnLayout {
-                        anchors.fill: parent
-                        spacing: window.height * 0.02
+        // Inbox Page
+        LazyPage {
+            sourceComponent: Page {
+                padding: window.width * 0.03
 
-                        TextArea {
-                            id: postDataField
-                            Layout.fillWidth: true
-                            wrapMode: TextArea.Wrap
-                            font.pixelSize: baseSize
-                            text: '{\n    "title": "foo",\n    "body": "bar",\n    "userId": 1\n}'
-                            font.family: "Monospace"
-                        }
-
-                        Button {
-                            text: "POST Request"
-                            Layout.fillWidth: true
-                            font.pixelSize: baseSize
-                            onClicked: {
-                                try {
-                                    const data = JSON.parse(postDataField.text)
-                                    RestClient.post("/posts", data)
-                                } catch (e) {
-                                    responseArea.text = "Error parsing JSON: " + e.message
+                // The model pages older messages in as the view scrolls
+                ListView {
+                    id: inboxView
+                    anchors.fill: parent
+                    clip: true
+                    spacing: window.height * 0.01
+                    model: Modem.inbox
+                    ScrollBar.vertical: ScrollBar {}
+
+                    delegate: ItemDelegate {
+                        id: inboxDelegate
+                        width: inboxView.width
+
+                        required property var model
+
+                        contentItem: ColumnLayout {
+                            RowLayout {
+                                Label {
+                                    text: inboxDelegate.model.number
+                                    font.pixelSize: window.baseSize
+                                    font.weight: Font.Medium
+                                    Layout.fillWidth: true
                                 }
+                                Label {
+                                    text: Qt.formatDateTime(inboxDelegate.model.timestamp, "yyyy-MM-dd hh:mm")
+                                    font.pixelSize: window.baseSize * 0.75
+                                    color: Universal.color(Universal.Chromium)
+                                }
+                            }
+                            Label {
+                                text: inboxDelegate.model.text
+                                wrapMode: Text.Wrap
+                                font.pixelSize: window.baseSize * 0.9
+                                Layout.fillWidth: true
                             }
                         }
                     }
+
+                    Label {
+                        anchors.centerIn: parent
+                        visible: inboxView.count === 0
+                        text: qsTr("No messages received yet")
+                        font.pixelSize: window.baseSize
+                        color: Universal.color(Universal.Chromium)
+                    }
                 }
             }
         }
-    }
 
-    // REST Client connections
-    Connections {
-        target: RestClient
+        // Log Page
+        LazyPage {
+            sourceComponent: Page {
+                padding: window.width * 0.03
 
-        function onResponseReceived(response) {
-            responseArea.text = JSON.stringify(response, null, 2)
-        }
+                ColumnLayout {
+                    anchors.fill: parent
+                    spacing: window.height * 0.01
+
+                    RowLayout {
+                        Layout.fillWidth: true
 
-        function onErrorOccurred(error) {
-            responseArea.text = "Error: " + error
+                        ComboBox {
+                            id: levelFilter
+                            model: [qsTr("Info"), qsTr("Warnings"), qsTr("Errors")]
+                            font.pixelSize: window.baseSize
+                            onActivated: logModel.minimumLevel = [LogFeed.Info, LogFeed.Warning, LogFeed.Error][currentIndex]
+                        }
+                        ComboBox {
+                            id: sourceFilter
+                            model: [qsTr("All"), qsTr("Modem"), qsTr("REST")]
+                            font.pixelSize: window.baseSize
+                            onActivated: logModel.sources = [[], ["modem", "journal", "inbox"],
+                                                             ["rest", "upload"]][currentIndex]
+                        }
+                        Label {
+                            text: qsTr("%1 of %2").arg(logModel.count).arg(logModel.held)
+                            font.pixelSize: window.baseSize * 0.75
+                            color: Universal.color(Universal.Chromium)
+                            Layout.fillWidth: true
+                            horizontalAlignment: Text.AlignRight
+                        }
+                        Button {
+                            text: qsTr("Clear")
+                            font.pixelSize: window.baseSize
+                            onClicked: logModel.clear()
+                        }
+                    }
+
+                    ListView {
+                        id: logView
+                        Layout.fillWidth: true
+                        Layout.fillHeight: true
+                        clip: true
+                        model: logModel
+                        reuseItems: true
+                        ScrollBar.vertical: ScrollBar {}
+
+                        // Follow new entries unless scrolled back
+                        property bool following: true
+                        onMovementEnded: following = atYEnd
+                        onCountChanged: if (following) positionViewAtEnd()
+
+                        delegate: Label {
+                            id: logLine
+                            width: logView.width
+
+                            required property var model
+
+                            text: "%1 %2 %3".arg(Qt.formatTime(logLine.model.time, "hh:mm:ss"))
+                                .arg(logLine.model.source).arg(logLine.model.text)
+                            wrapMode: Text.Wrap
+                            font.pixelSize: window.baseSize * 0.75
+                            color: logLine.model.level >= LogFeed.Error ? "firebrick"
+                                 : logLine.model.level >= LogFeed.Warning ? "darkorange" : Universal.foreground
+                        }
+                    }
+                }
+            }
         }
     }
 
@@ -287,16 +464,25 @@ ApplicationWindow {
         function onSmsSent(recipient) {
             window.statusMessage = "Message sent successfully to " + recipient
             window.isSending = false
-            messageField.clear()
         }
 
         function onSmsFailed(recipient) {
             window.statusMessage = "Failed to send message to " + recipient
             window.isSending = false
         }
+    }
+
+    // Log lines arrive in batches, the newest error becomes the status
+    Connections {
+        target: LogFeed
 
-        function onLogError(message) {
-            window.statusMessage = message
+        function onEntriesAdded(entries, skipped) {
+            for (let i = entries.length - 1; i >= 0; --i) {
+                if (entries[i].level >= LogFeed.Error) {
+                    window.statusMessage = entries[i].text
+                    return
+                }
+            }
         }
     }
 
@@ -0,0 +1,499 @@
+#include "batchuploader.h"
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QNetworkInformation>
+#include <QRandomGenerator>
+#include <QStandardPaths>
+#include "gzip.h"
+#include "logging.h"
+#include "metricsregistry.h"
+#include "restclient.h"
+
+namespace {
+
+struct UploadMetrics {
+    MetricsRegistry &registry = MetricsRegistry::instance();
+    Counter &sent = registry.counter("cellularpi_upload_records_total", "Uploaded records by outcome",
+                                     {{"result", "sent"}});
+    Counter &dropped = registry.counter("cellularpi_upload_records_total", "Uploaded records by outcome",
+                                        {{"result", "dropped"}});
+    Counter &rawBytes = registry.counter("cellularpi_upload_bytes_total", "Upload payload bytes",
+                                         {{"stage", "raw"}});
+    Counter &sentBytes = registry.counter("cellularpi_upload_bytes_total", "Upload payload bytes",
+                                          {{"stage", "sent"}});
+    Counter &batches = registry.counter("cellularpi_upload_batches_total", "Upload batches sent");
+    Counter &retries = registry.counter("cellularpi_upload_retries_total", "Upload batches retried");
+};
+
+UploadMetrics &uploadMetrics()
+{
+    static UploadMetrics metrics;
+    return metrics;
+}
+
+} // namespace
+
+BatchUploader::BatchUploader(QObject *parent)
+    : QObject{parent}
+{
+    m_ageTimer.setSingleShot(true);
+    m_ageTimer.setInterval(DEFAULT_MAX_AGE_MS);
+    connect(&m_ageTimer, &QTimer::timeout, this, &BatchUploader::flush);
+    m_idleTimer.setSingleShot(true);
+    m_idleTimer.setInterval(DEFAULT_IDLE_MS);
+    connect(&m_idleTimer, &QTimer::timeout, this, &BatchUploader::flush);
+    m_retryTimer.setSingleShot(true);
+    connect(&m_retryTimer, &QTimer::timeout, this, &BatchUploader::sendNext);
+}
+
+BatchUploader::~BatchUploader()
+{
+    // Nothing buffered is lost on a clean exit. A batch on the wire is
+    // spooled as well and may be sent twice, hence X-Batch-Sequence.
+    if (!m_records.isEmpty()) {
+        m_queue.enqueue(seal());
+    }
+    spill();
+}
+
+RestClient *BatchUploader::client() const
+{
+    return m_client;
+}
+
+void BatchUploader::setClient(RestClient *client)
+{
+    if (m_client == client)
+        return;
+    m_client = client;
+    emit clientChanged();
+    sendNext();
+}
+
+QString BatchUploader::endpoint() const
+{
+    return m_endpoint;
+}
+
+void BatchUploader::setEndpoint(const QString &endpoint)
+{
+    if (m_endpoint == endpoint)
+        return;
+    flush();
+    m_endpoint = endpoint;
+    if (!m_endpoint.isEmpty()) {
+        watchReachability();
+    }
+    openSpool();
+    emit endpointChanged();
+    sendNext();
+}
+
+int BatchUploader::maxRecords() const
+{
+    return m_maxRecords;
+}
+
+void BatchUploader::setMaxRecords(int records)
+{
+    records = qMax(1, records);
+    if (m_maxRecords == records)
+        return;
+    m_maxRecords = records;
+    emit limitsChanged();
+}
+
+int BatchUploader::maxBytes() const
+{
+    return m_maxBytes;
+}
+
+void BatchUploader::setMaxBytes(int bytes)
+{
+    bytes = qMax(1, bytes);
+    if (m_maxBytes == bytes)
+        return;
+    m_maxBytes = bytes;
+    emit limitsChanged();
+}
+
+int BatchUploader::maxAge() const
+{
+    return m_ageTimer.interval();
+}
+
+void BatchUploader::setMaxAge(int ms)
+{
+    ms = qMax(0, ms);
+    if (m_ageTimer.interval() == ms)
+        return;
+    m_ageTimer.setInterval(ms);
+    emit limitsChanged();
+}
+
+int BatchUploader::idle() const
+{
+    return m_idleTimer.interval();
+}
+
+void BatchUploader::setIdle(int ms)
+{
+    ms = qMax(0, ms);
+    if (m_idleTimer.interval() == ms)
+        return;
+    m_idleTimer.setInterval(ms);
+    emit limitsChanged();
+}
+
+bool BatchUploader::compress() const
+{
+    return m_compress;
+}
+
+void BatchUploader::setCompress(bool compress)
+{
+    if (m_compress == compress)
+        return;
+    m_compress = compress;
+    emit compressChanged();
+}
+
+QString BatchUploader::spoolPath() const
+{
+    return m_spool.directory();
+}
+
+void BatchUploader::setSpoolPath(const QString &path)
+{
+    if (m_spoolPath == path)
+        return;
+    m_spoolPath = path;
+    openSpool();
+    emit spoolPathChanged();
+    sendNext();
+}
+
+bool BatchUploader::isOnline() const
+{
+    return m_online;
+}
+
+int BatchUploader::pendingRecords() const
+{
+    int records = m_records.size() + m_spool.records();
+    for (const Batch &batch : m_queue) {
+        records += batch.info.records;
+    }
+    return records;
+}
+
+int BatchUploader::spooledBatches() const
+{
+    return m_spool.count();
+}
+
+qint64 BatchUploader::recordsSent() const
+{
+    return m_recordsSent;
+}
+
+qint64 BatchUploader::recordsDropped() const
+{
+    return m_recordsDropped;
+}
+
+qint64 BatchUploader::batchesSent() const
+{
+    return m_batchesSent;
+}
+
+qint64 BatchUploader::rawBytes() const
+{
+    return m_rawBytes;
+}
+
+qint64 BatchUploader::sentBytes() const
+{
+    return m_sentBytes;
+}
+
+void BatchUploader::append(const QVariantMap &record)
+{
+    if (m_endpoint.isEmpty()) {
+        return;
+    }
+    QByteArray json = QJsonDocument(QJsonObject::fromVariantMap(record)).toJson(QJsonDocument::Compact);
+    // One record over the limit still goes, alone
+    if (!m_records.isEmpty() && m_recordBytes + json.size() + 1 > m_maxBytes) {
+        flush();
+    }
+    m_recordBytes += json.size() + 1;
+    m_records.append(std::move(json));
+    if (m_records.size() == 1) {
+        m_ageTimer.start();
+    }
+    m_idleTimer.start();
+
+    if (m_records.size() >= m_maxRecords || m_recordBytes >= m_maxBytes) {
+        flush();
+    } else {
+        emit statsChanged();
+    }
+}
+
+void BatchUploader::flush()
+{
+    m_ageTimer.stop();
+    m_idleTimer.stop();
+    if (m_records.isEmpty()) {
+        return;
+    }
+    enqueue(seal());
+    emit statsChanged();
+    sendNext();
+}
+
+BatchUploader::Batch BatchUploader::seal()
+{
+    QByteArray json;
+    json.reserve(m_recordBytes + 1);
+    json += '[';
+    json += m_records.join(',');
+    json += ']';
+
+    Batch batch;
+    batch.info.sequence = nextSequence();
+    batch.info.records = m_records.size();
+    batch.info.rawBytes = json.size();
+    batch.info.compressed = m_compress && json.size() >= COMPRESS_MIN_BYTES;
+    batch.payload = batch.info.compressed ? Gzip::compress(json) : std::move(json);
+    batch.info.size = batch.payload.size();
+    m_records.clear();
+    m_recordBytes = 0;
+    return batch;
+}
+
+void BatchUploader::openSpool()
+{
+    QString directory = m_spoolPath;
+    if (directory.isEmpty() && !m_endpoint.isEmpty()) {
+        QString base = qEnvironmentVariable("CELLULARPI_UPLOAD_SPOOL");
+        if (base.isEmpty()) {
+            base = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/uploads";
+        }
+        // Uploaders to different endpoints must not replay each other's batches
+        const QByteArray name = QCryptographicHash::hash(m_endpoint.toUtf8(), QCryptographicHash::Sha1);
+        directory = base + '/' + QString::fromLatin1(name.toHex().left(16));
+    }
+    if (directory == m_spool.directory()) {
+        return;
+    }
+    // Whatever the old directory still holds is replayed by whoever opens it next
+    m_spool.open(directory);
+    m_lastSequence = qMax(m_lastSequence, m_spool.lastSequence());
+    emit statsChanged();
+}
+
+quint64 BatchUploader::nextSequence()
+{
+    // Microseconds since the epoch, bumped past the last one: increasing
+    // across restarts without keeping a counter on disk
+    const quint64 now = quint64(QDateTime::currentMSecsSinceEpoch()) * 1000;
+    m_lastSequence = qMax(now, m_lastSequence + 1);
+    return m_lastSequence;
+}
+
+void BatchUploader::enqueue(Batch batch)
+{
+    // Once anything is spooled new batches queue up behind it on disk, so
+    // the replay keeps sequence order
+    if (m_spool.isOpen() && (!m_online || !m_spool.isEmpty())) {
+        QList<UploadSpool::Batch> evicted;
+        if (m_spool.store(batch.info, batch.payload, &evicted)) {
+            for (const UploadSpool::Batch &old : evicted) {
+                dropped(old.records, "spool full");
+            }
+            return;
+        }
+    }
+    m_queue.enqueue(std::move(batch));
+    // Without a spool an outage can only be ridden out in memory, up to a
+    // point; the head may be on the wire and stays
+    while (m_queue.size() > MAX_QUEUED_BATCHES) {
+        dropped(m_queue.takeAt(1).info.records, "queue full");
+    }
+}
+
+void BatchUploader::spill()
+{
+    if (!m_spool.isOpen()) {
+        return;
+    }
+    while (!m_queue.isEmpty()) {
+        const Batch batch = m_queue.dequeue();
+        QList<UploadSpool::Batch> evicted;
+        if (!m_spool.store(batch.info, batch.payload, &evicted)) {
+            dropped(batch.info.records, "spool failed");
+        }
+        for (const UploadSpool::Batch &old : evicted) {
+            dropped(old.records, "spool full");
+        }
+    }
+}
+
+void BatchUploader::sendNext()
+{
+    if (m_inFlight || m_retryTimer.isActive() || !m_client || m_endpoint.isEmpty()) {
+        return;
+    }
+
+    // Spooled batches are always the oldest
+    UploadSpool::Batch info;
+    QByteArray payload;
+    const bool spooled = !m_spool.isEmpty();
+    if (spooled) {
+        info = m_spool.first();
+        payload = m_spool.read(info);
+        if (payload.size() != info.size) {
+            CPI_LOG_ERROR("upload", "Spooled batch unreadable",
+                          {{"sequence", info.sequence}, {"path", m_spool.directory()}});
+            m_spool.remove(info);
+            dropped(info.records, "unreadable");
+            QMetaObject::invokeMethod(this, &BatchUploader::sendNext, Qt::QueuedConnection);
+            return;
+        }
+    } else if (!m_queue.isEmpty()) {
+        info = m_queue.head().info;
+        payload = m_queue.head().payload;
+    } else {
+        return;
+    }
+
+    QList<RestResponse::Header> headers{
+        {"Content-Type", "application/json"},
+        {"X-Batch-Sequence", QByteArray::number(info.sequence)},
+        {"X-Batch-Records", QByteArray::number(info.records)}};
+    if (info.compressed) {
+        headers.append({"Content-Encoding", "gzip"});
+    }
+    // Ahead of polling, and with time for a large batch on a slow link;
+    // the retries are ours, from the spool
+    RequestOptions options;
+    options.priority = RequestScheduler::Priority::High;
+    options.timeoutMs = SEND_TIMEOUT_MS;
+    options.retries = 0;
+    m_inFlight = true;
+    m_client->post(m_endpoint, payload, headers,
+                   [self = QPointer<BatchUploader>(this), info, spooled](const RestResponse &response) {
+                       if (self) {
+                           self->handleResult(info, spooled, response);
+                       }
+                   },
+                   options);
+}
+
+void BatchUploader::handleResult(const UploadSpool::Batch &info, bool spooled,
+                                 const RestResponse &response)
+{
+    m_inFlight = false;
+    const bool retry = !response.ok && isRetryable(response);
+
+    if (!retry) {
+        // Either way the batch is done with
+        if (spooled) {
+            m_spool.remove(info);
+        } else if (!m_queue.isEmpty() && m_queue.head().info.sequence == info.sequence) {
+            m_queue.dequeue();
+        }
+    }
+
+    if (response.ok) {
+        m_online = true;
+        m_attempt = 0;
+        m_recordsSent += info.records;
+        m_batchesSent += 1;
+        m_rawBytes += info.rawBytes;
+        m_sentBytes += info.size;
+        UploadMetrics &metrics = uploadMetrics();
+        metrics.sent.increment(info.records);
+        metrics.batches.increment();
+        metrics.rawBytes.increment(info.rawBytes);
+        metrics.sentBytes.increment(info.size);
+        emit statsChanged();
+        sendNext();
+        return;
+    }
+
+    if (!retry) {
+        CPI_LOG_ERROR("upload", "Batch rejected",
+                      {{"sequence", info.sequence}, {"records", info.records},
+                       {"status", response.status}, {"error", response.error}});
+        dropped(info.records, "rejected");
+        sendNext();
+        return;
+    }
+
+    if (m_online) {
+        CPI_LOG_WARNING("upload", "Upload failed, spooling",
+                        {{"status", response.status}, {"error", response.error},
+                         {"pending", pendingRecords()}});
+    }
+    m_online = false;
+    spill();
+    emit statsChanged();
+    scheduleRetry();
+}
+
+void BatchUploader::dropped(int records, const char *reason)
+{
+    m_recordsDropped += records;
+    uploadMetrics().dropped.increment(records);
+    CPI_LOG_WARNING("upload", "Records dropped", {{"records", records}, {"reason", reason}});
+    emit statsChanged();
+}
+
+void BatchUploader::scheduleRetry()
+{
+    // Exponential with +-20% jitter, so a fleet coming back online does
+    // not retry in lockstep
+    const int exponent = qMin(m_attempt++, 16);
+    const double delay = qMin<double>(RETRY_MAX_MS, double(RETRY_BASE_MS) * (1 << exponent));
+    const double jitter = 0.8 + 0.4 * QRandomGenerator::global()->generateDouble();
+    m_retryTimer.start(int(delay * jitter));
+    uploadMetrics().retries.increment();
+}
+
+// Replay as soon as the system sees a network again instead of waiting out
+// the backoff. Not every platform has a backend, then the timer alone does
+// it. Loaded with the first endpoint, an idle uploader has no use for it.
+void BatchUploader::watchReachability()
+{
+    if (m_watchingReachability) {
+        return;
+    }
+    m_watchingReachability = true;
+    if (QNetworkInformation::loadBackendByFeatures(QNetworkInformation::Feature::Reachability)) {
+        connect(QNetworkInformation::instance(), &QNetworkInformation::reachabilityChanged, this,
+                &BatchUploader::onReachabilityChanged);
+    }
+}
+
+void BatchUploader::onReachabilityChanged()
+{
+    if (QNetworkInformation::instance()->reachability() != QNetworkInformation::Reachability::Online
+        || !m_retryTimer.isActive()) {
+        return;
+    }
+    m_retryTimer.stop();
+    m_attempt = 0;
+    sendNext();
+}
+
+bool BatchUploader::isRetryable(const RestResponse &response)
+{
+    // No response at all, or the server or a proxy is overloaded
+    return response.status == 0 || response.status == 408 || response.status == 429
+           || response.status >= 500;
+}
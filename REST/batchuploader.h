@@ -0,0 +1,155 @@
+#ifndef BATCHUPLOADER_H
+#define BATCHUPLOADER_H
+
+#include <QQmlEngine>
+#include <QPointer>
+#include <QQueue>
+#include <QTimer>
+#include <QVariantMap>
+#include "uploadspool.h"
+
+class RestClient;
+struct RestResponse;
+
+// Collects small records (delivery results, telemetry) and POSTs them to
+// endpoint as one JSON array per batch, gzip-encoded, through client.
+//
+// A batch is sealed when it reaches maxRecords or maxBytes, when its first
+// record is maxAge old, or after idle ms without a new record. Batches go
+// out one at a time in sequence order; each carries X-Batch-Sequence so a
+// receiver can drop the duplicates an at-least-once replay may produce.
+// When the network or the server fails, everything not yet sent is
+// spilled to the spool directory and replayed with backoff, immediately
+// once the system reports connectivity again. Rejected batches (4xx) are
+// dropped. The spool defaults to a directory per endpoint under
+// AppDataLocation/uploads, or CELLULARPI_UPLOAD_SPOOL when set.
+class BatchUploader : public QObject {
+    Q_OBJECT
+    QML_ELEMENT
+
+    Q_PROPERTY(RestClient* client READ client WRITE setClient NOTIFY clientChanged)
+    Q_PROPERTY(QString endpoint READ endpoint WRITE setEndpoint NOTIFY endpointChanged)
+    Q_PROPERTY(int maxRecords READ maxRecords WRITE setMaxRecords NOTIFY limitsChanged)
+    Q_PROPERTY(int maxBytes READ maxBytes WRITE setMaxBytes NOTIFY limitsChanged)
+    Q_PROPERTY(int maxAge READ maxAge WRITE setMaxAge NOTIFY limitsChanged)
+    Q_PROPERTY(int idle READ idle WRITE setIdle NOTIFY limitsChanged)
+    Q_PROPERTY(bool compress READ compress WRITE setCompress NOTIFY compressChanged)
+    Q_PROPERTY(QString spoolPath READ spoolPath WRITE setSpoolPath NOTIFY spoolPathChanged)
+    Q_PROPERTY(bool online READ isOnline NOTIFY statsChanged)
+    Q_PROPERTY(int pendingRecords READ pendingRecords NOTIFY statsChanged)
+    Q_PROPERTY(int spooledBatches READ spooledBatches NOTIFY statsChanged)
+    Q_PROPERTY(qint64 recordsSent READ recordsSent NOTIFY statsChanged)
+    Q_PROPERTY(qint64 recordsDropped READ recordsDropped NOTIFY statsChanged)
+    Q_PROPERTY(qint64 batchesSent READ batchesSent NOTIFY statsChanged)
+    Q_PROPERTY(qint64 rawBytes READ rawBytes NOTIFY statsChanged)
+    Q_PROPERTY(qint64 sentBytes READ sentBytes NOTIFY statsChanged)
+public:
+    explicit BatchUploader(QObject *parent = nullptr);
+    ~BatchUploader() override;
+
+    RestClient *client() const;
+    void setClient(RestClient *client);
+    // Relative to the client's baseUrl; records are ignored while empty
+    QString endpoint() const;
+    void setEndpoint(const QString &endpoint);
+
+    int maxRecords() const;
+    void setMaxRecords(int records);
+    // Serialised JSON bytes, before compression
+    int maxBytes() const;
+    void setMaxBytes(int bytes);
+    // Milliseconds
+    int maxAge() const;
+    void setMaxAge(int ms);
+    int idle() const;
+    void setIdle(int ms);
+    bool compress() const;
+    void setCompress(bool compress);
+    QString spoolPath() const;
+    void setSpoolPath(const QString &path);
+
+    bool isOnline() const;
+    // Buffered, queued and spooled
+    int pendingRecords() const;
+    int spooledBatches() const;
+    qint64 recordsSent() const;
+    qint64 recordsDropped() const;
+    qint64 batchesSent() const;
+    // Payload bytes of sent batches before and after encoding
+    qint64 rawBytes() const;
+    qint64 sentBytes() const;
+
+    Q_INVOKABLE void append(const QVariantMap &record);
+    // Seals whatever is buffered into a batch now
+    Q_INVOKABLE void flush();
+
+signals:
+    void clientChanged();
+    void endpointChanged();
+    void limitsChanged();
+    void compressChanged();
+    void spoolPathChanged();
+    void statsChanged();
+
+private:
+    // A sealed batch that still lives in memory
+    struct Batch {
+        UploadSpool::Batch info;
+        QByteArray payload;
+    };
+
+    static constexpr int DEFAULT_MAX_RECORDS = 100;
+    static constexpr int DEFAULT_MAX_BYTES = 32 * 1024;
+    static constexpr int DEFAULT_MAX_AGE_MS = 60000;
+    static constexpr int DEFAULT_IDLE_MS = 5000;
+    // Below this gzip's framing costs more than it saves
+    static constexpr int COMPRESS_MIN_BYTES = 256;
+    static constexpr int RETRY_BASE_MS = 1000;
+    static constexpr int RETRY_MAX_MS = 5 * 60 * 1000;
+    static constexpr int MAX_QUEUED_BATCHES = 256;
+    static constexpr int SEND_TIMEOUT_MS = 120000;
+
+    QPointer<RestClient> m_client;
+    QString m_endpoint;
+    int m_maxRecords{DEFAULT_MAX_RECORDS};
+    int m_maxBytes{DEFAULT_MAX_BYTES};
+    bool m_compress{true};
+    QString m_spoolPath;
+
+    // Records not yet sealed, each serialised once on append()
+    QList<QByteArray> m_records;
+    qint64 m_recordBytes{0};
+    QTimer m_ageTimer;
+    QTimer m_idleTimer;
+
+    // Sealed, oldest first; all of them newer than anything spooled
+    QQueue<Batch> m_queue;
+    UploadSpool m_spool;
+    quint64 m_lastSequence{0};
+    bool m_inFlight{false};
+    bool m_online{true};
+    bool m_watchingReachability{false};
+    int m_attempt{0};
+    QTimer m_retryTimer;
+
+    qint64 m_recordsSent{0};
+    qint64 m_recordsDropped{0};
+    qint64 m_batchesSent{0};
+    qint64 m_rawBytes{0};
+    qint64 m_sentBytes{0};
+
+    void openSpool();
+    Batch seal();
+    quint64 nextSequence();
+    void enqueue(Batch batch);
+    void spill();
+    void sendNext();
+    void handleResult(const UploadSpool::Batch &info, bool spooled, const RestResponse &response);
+    void dropped(int records, const char *reason);
+    void scheduleRetry();
+    void watchReachability();
+    void onReachabilityChanged();
+    static bool isRetryable(const RestResponse &response);
+};
+
+#endif // BATCHUPLOADER_H
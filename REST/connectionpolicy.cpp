@@ -0,0 +1,119 @@
+#include "connectionpolicy.h"
+#include <QHttp1Configuration>
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QNetworkRequest>
+#include <QUrl>
+#if QT_CONFIG(ssl)
+#include <QSslConfiguration>
+#endif
+
+ConnectionPolicy::Settings ConnectionPolicy::settings() const
+{
+    return m_settings;
+}
+
+void ConnectionPolicy::setSettings(const Settings &settings)
+{
+    m_settings = settings;
+    m_settings.keepAliveSeconds = qMax(1, m_settings.keepAliveSeconds);
+    m_settings.maxConnections = qBound(1, m_settings.maxConnections, 16);
+    if (!m_settings.tlsSessionReuse) {
+        m_tickets.clear();
+    }
+}
+
+void ConnectionPolicy::apply(QNetworkRequest &request) const
+{
+    if (m_settings.keepAlive) {
+        request.setAttribute(QNetworkRequest::ConnectionCacheExpiryTimeoutSecondsAttribute,
+                             m_settings.keepAliveSeconds);
+    } else {
+        request.setRawHeader("Connection", "close");
+    }
+    request.setAttribute(QNetworkRequest::Http2AllowedAttribute, m_settings.http2);
+
+    QHttp1Configuration http1;
+    http1.setNumberOfConnectionsPerHost(m_settings.maxConnections);
+    request.setHttp1Configuration(http1);
+
+#if QT_CONFIG(ssl)
+    if (request.url().scheme() == QLatin1String("https")) {
+        QSslConfiguration configuration = request.sslConfiguration();
+        applyTls(configuration, request.url());
+        request.setSslConfiguration(configuration);
+    }
+#endif
+}
+
+void ConnectionPolicy::replyFinished(QNetworkReply *reply)
+{
+#if QT_CONFIG(ssl)
+    if (!m_settings.tlsSessionReuse || reply->url().scheme() != QLatin1String("https")) {
+        return;
+    }
+    // Servers may issue a fresh ticket at any time (TLS 1.3 does so after
+    // the handshake), keep the newest
+    const QByteArray ticket = reply->sslConfiguration().sessionTicket();
+    if (!ticket.isEmpty()) {
+        m_tickets.insert(hostKey(reply->url()), ticket);
+    }
+#else
+    Q_UNUSED(reply);
+#endif
+}
+
+void ConnectionPolicy::prewarm(QNetworkAccessManager &manager, const QUrl &url) const
+{
+    if (!url.isValid() || url.host().isEmpty()) {
+        return;
+    }
+#if QT_CONFIG(ssl)
+    if (url.scheme() == QLatin1String("https")) {
+        QSslConfiguration configuration = QSslConfiguration::defaultConfiguration();
+        applyTls(configuration, url);
+        // Must match what the requests negotiate, or they open their own
+        configuration.setAllowedNextProtocols(
+            m_settings.http2 ? QList<QByteArray>{QSslConfiguration::ALPNProtocolHTTP2, "http/1.1"}
+                             : QList<QByteArray>{"http/1.1"});
+        manager.connectToHostEncrypted(url.host(), quint16(url.port(443)), configuration);
+        return;
+    }
+#endif
+    manager.connectToHost(url.host(), quint16(url.port(80)));
+}
+
+bool ConnectionPolicy::hasTicket(const QUrl &url) const
+{
+    return m_tickets.contains(hostKey(url));
+}
+
+int ConnectionPolicy::ticketCount() const
+{
+    return m_tickets.size();
+}
+
+void ConnectionPolicy::clearTickets()
+{
+    m_tickets.clear();
+}
+
+QString ConnectionPolicy::hostKey(const QUrl &url)
+{
+    const int defaultPort = url.scheme() == QLatin1String("https") ? 443 : 80;
+    return url.host() + QLatin1Char(':') + QString::number(url.port(defaultPort));
+}
+
+#if QT_CONFIG(ssl)
+void ConnectionPolicy::applyTls(QSslConfiguration &configuration, const QUrl &url) const
+{
+    // Persistence is what makes sessionTicket() available at all
+    configuration.setSslOption(QSsl::SslOptionDisableSessionPersistence, !m_settings.tlsSessionReuse);
+    if (m_settings.tlsSessionReuse) {
+        const auto ticket = m_tickets.constFind(hostKey(url));
+        if (ticket != m_tickets.cend()) {
+            configuration.setSessionTicket(*ticket);
+        }
+    }
+}
+#endif
@@ -0,0 +1,59 @@
+#ifndef CONNECTIONPOLICY_H
+#define CONNECTIONPOLICY_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QString>
+
+class QNetworkAccessManager;
+class QNetworkReply;
+class QNetworkRequest;
+class QSslConfiguration;
+class QUrl;
+
+// How RestClient's connections are opened and kept.
+//
+// apply() puts the settings on every request: keep-alive and how long an
+// idle connection stays cached, HTTP/2 (multiplexed over one connection
+// per host), and the HTTP/1 connection cap per host. For TLS, session
+// persistence is switched on and the newest ticket of each host goes out
+// with every request, so a connection opened after the old one idled out
+// resumes the session with an abbreviated handshake. Qt itself shares a
+// session only within one cached connection; the tickets here outlive it.
+class ConnectionPolicy {
+public:
+    struct Settings {
+        bool keepAlive{true};
+        int keepAliveSeconds{120};   // Qt's own default
+        bool http2{true};
+        bool tlsSessionReuse{true};
+        int maxConnections{6};       // per host, HTTP/1 only
+
+        bool operator==(const Settings&) const = default;
+    };
+
+    Settings settings() const;
+    void setSettings(const Settings& settings);
+
+    void apply(QNetworkRequest& request) const;
+    // Picks up the session ticket of a finished TLS reply
+    void replyFinished(QNetworkReply* reply);
+    // Connects (and handshakes) with url's host ahead of the first request
+    void prewarm(QNetworkAccessManager& manager, const QUrl& url) const;
+
+    bool hasTicket(const QUrl& url) const;
+    int ticketCount() const;
+    void clearTickets();
+
+private:
+    Settings m_settings;
+    // host:port -> newest session ticket
+    QHash<QString, QByteArray> m_tickets;
+
+    static QString hostKey(const QUrl& url);
+#if QT_CONFIG(ssl)
+    void applyTls(QSslConfiguration& configuration, const QUrl& url) const;
+#endif
+};
+
+#endif // CONNECTIONPOLICY_H
@@ -0,0 +1,55 @@
+#include "gzip.h"
+#include <zlib.h>
+
+namespace {
+
+// zlib window bits plus 16 selects the gzip header and trailer
+constexpr int GZIP_WINDOW_BITS = 15 + 16;
+constexpr int MEMORY_LEVEL = 8;
+
+} // namespace
+
+namespace Gzip {
+
+QByteArray compress(QByteArrayView data, int level)
+{
+    z_stream stream{};
+    if (deflateInit2(&stream, level, Z_DEFLATED, GZIP_WINDOW_BITS, MEMORY_LEVEL,
+                     Z_DEFAULT_STRATEGY) != Z_OK) {
+        return {};
+    }
+    // deflateBound() covers the deflate stream, the gzip framing adds 18 bytes
+    QByteArray output(qsizetype(deflateBound(&stream, uLong(data.size())) + 18), Qt::Uninitialized);
+    stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data.data()));
+    stream.avail_in = uInt(data.size());
+    stream.next_out = reinterpret_cast<Bytef *>(output.data());
+    stream.avail_out = uInt(output.size());
+    const int result = deflate(&stream, Z_FINISH);
+    output.truncate(qsizetype(stream.total_out));
+    deflateEnd(&stream);
+    return result == Z_STREAM_END ? output : QByteArray();
+}
+
+QByteArray decompress(QByteArrayView data)
+{
+    z_stream stream{};
+    if (inflateInit2(&stream, GZIP_WINDOW_BITS) != Z_OK) {
+        return {};
+    }
+    QByteArray output;
+    stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data.data()));
+    stream.avail_in = uInt(data.size());
+    int result = Z_OK;
+    while (result == Z_OK) {
+        // Grow geometrically, starting from a guess at the ratio
+        output.resize(qMax<qsizetype>(4096, output.isEmpty() ? data.size() * 4 : output.size() * 2));
+        stream.next_out = reinterpret_cast<Bytef *>(output.data() + stream.total_out);
+        stream.avail_out = uInt(output.size() - qsizetype(stream.total_out));
+        result = inflate(&stream, Z_NO_FLUSH);
+    }
+    output.truncate(qsizetype(stream.total_out));
+    inflateEnd(&stream);
+    return result == Z_STREAM_END ? output : QByteArray();
+}
+
+} // namespace Gzip
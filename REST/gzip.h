@@ -0,0 +1,17 @@
+#ifndef GZIP_H
+#define GZIP_H
+
+#include <QByteArray>
+#include <QByteArrayView>
+
+// gzip (RFC 1952) around zlib's deflate, the framing HTTP's
+// Content-Encoding: gzip expects; qCompress() uses a format of its own.
+namespace Gzip {
+
+QByteArray compress(QByteArrayView data, int level = 6);
+// Empty on malformed or truncated input
+QByteArray decompress(QByteArrayView data);
+
+} // namespace Gzip
+
+#endif // GZIP_H
@@ -0,0 +1,161 @@
+#include "jsonstreamdecoder.h"
+#include <QJsonParseError>
+
+namespace {
+
+bool isJsonSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+} // namespace
+
+void JsonStreamDecoder::feed(QByteArrayView chunk)
+{
+    m_bytesFed += chunk.size();
+    if (!m_error.isEmpty()) {
+        return;
+    }
+    if (m_closed) {
+        checkTrailing(chunk);
+        return;
+    }
+
+    qsizetype i = 0;
+    if (m_mode == Mode::Unknown) {
+        while (i < chunk.size() && isJsonSpace(chunk.at(i))) {
+            ++i;
+        }
+        if (i == chunk.size()) {
+            return;
+        }
+        if (chunk.at(i) == '[') {
+            m_mode = Mode::Array;
+            ++i;
+        } else {
+            m_mode = Mode::Buffered;
+        }
+    }
+    if (m_mode == Mode::Buffered) {
+        m_pending.append(chunk.sliced(i));
+        return;
+    }
+
+    // Copy whole runs of bytes, not one at a time: an element that fits in
+    // the chunk is appended once when its end is found
+    qsizetype start = i;
+    for (; i < chunk.size(); ++i) {
+        const char c = chunk.at(i);
+        if (m_inString) {
+            if (m_escape) {
+                m_escape = false;
+            } else if (c == '\\') {
+                m_escape = true;
+            } else if (c == '"') {
+                m_inString = false;
+            }
+            continue;
+        }
+        switch (c) {
+        case '"':
+            m_inString = true;
+            break;
+        case '{':
+        case '[':
+            ++m_depth;
+            break;
+        case '}':
+            --m_depth;
+            break;
+        case ']':
+            if (m_depth == 0) {
+                m_pending.append(chunk.sliced(start, i - start));
+                flushElement(true);
+                m_closed = true;
+                if (m_error.isEmpty()) {
+                    checkTrailing(chunk.sliced(i + 1));
+                }
+                return;
+            }
+            --m_depth;
+            break;
+        case ',':
+            if (m_depth == 0) {
+                m_pending.append(chunk.sliced(start, i - start));
+                flushElement(false);
+                if (!m_error.isEmpty()) {
+                    return;
+                }
+                start = i + 1;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+    m_pending.append(chunk.sliced(start));
+}
+
+void JsonStreamDecoder::flushElement(bool closing)
+{
+    const QByteArray element = m_pending.trimmed();
+    m_pending.clear();
+    if (element.isEmpty()) {
+        // Only "[]" may end without an element, a comma never may:
+        // "[,1]", "[1,,2]" and "[1,]" fail as QJsonDocument::fromJson does
+        if (!closing || !m_items.isEmpty()) {
+            m_error = QStringLiteral("empty array element");
+        }
+        return;
+    }
+    // Wrapped, so scalars parse as well as objects and arrays
+    QJsonParseError parseError{};
+    const QJsonDocument document = QJsonDocument::fromJson('[' + element + ']', &parseError);
+    if (parseError.error != QJsonParseError::NoError) {
+        m_error = parseError.errorString();
+        return;
+    }
+    m_items.append(document.array().at(0));
+}
+
+// Only whitespace may follow the array, as for a buffered document
+void JsonStreamDecoder::checkTrailing(QByteArrayView rest)
+{
+    for (const char c : rest) {
+        if (!isJsonSpace(c)) {
+            m_error = QStringLiteral("garbage at the end of the document");
+            return;
+        }
+    }
+}
+
+QJsonDocument JsonStreamDecoder::finish(QString *error)
+{
+    QJsonDocument document;
+    switch (m_mode) {
+    case Mode::Unknown:
+        m_error = QStringLiteral("empty document");
+        break;
+    case Mode::Array:
+        if (m_error.isEmpty() && !m_closed) {
+            m_error = QStringLiteral("unterminated array");
+        }
+        if (m_error.isEmpty()) {
+            document = QJsonDocument(std::move(m_items));
+        }
+        break;
+    case Mode::Buffered: {
+        QJsonParseError parseError{};
+        document = QJsonDocument::fromJson(m_pending, &parseError);
+        if (parseError.error != QJsonParseError::NoError) {
+            m_error = parseError.errorString();
+        }
+        m_pending.clear();
+        break;
+    }
+    }
+    if (error) {
+        *error = m_error;
+    }
+    return document;
+}
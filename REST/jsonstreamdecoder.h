@@ -0,0 +1,48 @@
+#ifndef JSONSTREAMDECODER_H
+#define JSONSTREAMDECODER_H
+
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QString>
+
+// Incremental JSON decoding for bodies that arrive in chunks.
+//
+// A top-level array, the usual shape of large payloads, is decoded element
+// by element: a light scanner tracks strings and nesting and every
+// complete element is parsed and released as soon as its closing byte
+// arrives, so neither the raw body nor the parse work piles up at the end.
+// Any other document is buffered and parsed in finish().
+// Not thread-safe; feed it from one thread at a time.
+class JsonStreamDecoder {
+public:
+    void feed(QByteArrayView chunk);
+    // The decoded document, or a null one with error set
+    QJsonDocument finish(QString* error = nullptr);
+
+    qint64 bytesFed() const { return m_bytesFed; }
+
+private:
+    enum class Mode {
+        Unknown,   // nothing but whitespace so far
+        Array,     // streaming a top-level array
+        Buffered   // anything else, parsed at the end
+    };
+
+    Mode m_mode{Mode::Unknown};
+    bool m_closed{false};       // saw the array's closing bracket
+    bool m_inString{false};
+    bool m_escape{false};
+    int m_depth{0};             // nesting inside the current element
+    QByteArray m_pending;       // current element, or the whole document
+    QJsonArray m_items;
+    QString m_error;
+    qint64 m_bytesFed{0};
+
+    // closing: ended by the array's ']' rather than a ','
+    void flushElement(bool closing);
+    void checkTrailing(QByteArrayView rest);
+};
+
+#endif // JSONSTREAMDECODER_H
@@ -0,0 +1,126 @@
+#include "requestscheduler.h"
+#include <limits>
+
+int RequestScheduler::maxConcurrent() const
+{
+    return m_maxConcurrent;
+}
+
+void RequestScheduler::setMaxConcurrent(int requests)
+{
+    m_maxConcurrent = qMax(1, requests);
+}
+
+int RequestScheduler::reservedSlots() const
+{
+    return m_reservedSlots;
+}
+
+void RequestScheduler::setReservedSlots(int slots)
+{
+    m_reservedSlots = qMax(0, slots);
+}
+
+void RequestScheduler::enqueue(int id, Priority priority, qint64 notBeforeMs)
+{
+    m_queues[int(priority)].append({id, notBeforeMs});
+}
+
+bool RequestScheduler::remove(int id)
+{
+    for (QList<Entry> &queue : m_queues) {
+        for (qsizetype i = 0; i < queue.size(); ++i) {
+            if (queue.at(i).id == id) {
+                queue.removeAt(i);
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void RequestScheduler::raise(int id, Priority priority)
+{
+    for (int level = 0; level < int(priority); ++level) {
+        QList<Entry> &queue = m_queues[level];
+        for (qsizetype i = 0; i < queue.size(); ++i) {
+            if (queue.at(i).id == id) {
+                // Joins the back of the higher queue, as if it had been sent there
+                m_queues[int(priority)].append(queue.takeAt(i));
+                return;
+            }
+        }
+    }
+}
+
+bool RequestScheduler::isQueued(int id) const
+{
+    for (const QList<Entry> &queue : m_queues) {
+        for (const Entry &entry : queue) {
+            if (entry.id == id) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+int RequestScheduler::takeNext(qint64 nowMs)
+{
+    for (int level = PRIORITY_COUNT - 1; level >= 0; --level) {
+        if (m_running.size() >= capacity(Priority(level))) {
+            // Lower priorities get no more room than this one
+            return 0;
+        }
+        QList<Entry> &queue = m_queues[level];
+        for (qsizetype i = 0; i < queue.size(); ++i) {
+            if (queue.at(i).notBeforeMs <= nowMs) {
+                const int id = queue.takeAt(i).id;
+                m_running.append(id);
+                return id;
+            }
+        }
+    }
+    return 0;
+}
+
+void RequestScheduler::finished(int id)
+{
+    m_running.removeOne(id);
+}
+
+int RequestScheduler::queued() const
+{
+    int count = 0;
+    for (const QList<Entry> &queue : m_queues) {
+        count += queue.size();
+    }
+    return count;
+}
+
+int RequestScheduler::running() const
+{
+    return m_running.size();
+}
+
+qint64 RequestScheduler::nextDueMs(qint64 nowMs) const
+{
+    qint64 due = std::numeric_limits<qint64>::max();
+    for (const QList<Entry> &queue : m_queues) {
+        for (const Entry &entry : queue) {
+            if (entry.notBeforeMs > nowMs) {
+                due = qMin(due, entry.notBeforeMs);
+            }
+        }
+    }
+    return due == std::numeric_limits<qint64>::max() ? 0 : due;
+}
+
+int RequestScheduler::capacity(Priority priority) const
+{
+    if (priority >= Priority::High) {
+        return m_maxConcurrent;
+    }
+    // Never reserve the only slot there is
+    return qMax(1, m_maxConcurrent - m_reservedSlots);
+}
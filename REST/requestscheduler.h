@@ -0,0 +1,69 @@
+#ifndef REQUESTSCHEDULER_H
+#define REQUESTSCHEDULER_H
+
+#include <QList>
+#include <QtGlobal>
+#include <array>
+
+// Decides which of RestClient's requests go on the wire next.
+//
+// At most maxConcurrent requests are out at once; the rest wait in one FIFO
+// per priority and the highest non-empty one goes first. The last
+// reservedSlots of the cap only take High and Critical requests, so a
+// backlog of polling cannot hold up a delivery report. A job waiting out a
+// retry backoff stays queued but is skipped until its time has come.
+// Knows nothing of the network: RestClient enqueues ids, takes the next
+// one to start and reports it finished. Times are ms of one monotonic clock.
+class RequestScheduler {
+public:
+    enum class Priority {
+        Low,        // polling, prefetch
+        Normal,
+        High,       // may use the reserved slots
+        Critical
+    };
+    static constexpr int PRIORITY_COUNT = 4;
+
+    int maxConcurrent() const;
+    void setMaxConcurrent(int requests);
+    int reservedSlots() const;
+    void setReservedSlots(int slots);
+
+    // notBeforeMs holds the job back until then
+    void enqueue(int id, Priority priority, qint64 notBeforeMs = 0);
+    // Drops a queued job; false when it is not queued
+    bool remove(int id);
+    // Moves a queued job up, never down
+    void raise(int id, Priority priority);
+    bool isQueued(int id) const;
+
+    // Marks the next startable job as running and returns it, 0 when the
+    // cap is reached or nothing is due
+    int takeNext(qint64 nowMs);
+    // Frees the slot of a job takeNext() returned
+    void finished(int id);
+
+    int queued() const;
+    int running() const;
+    // Earliest time after nowMs a held-back job becomes due, 0 when none is
+    // held back
+    qint64 nextDueMs(qint64 nowMs) const;
+
+private:
+    struct Entry {
+        int id;
+        qint64 notBeforeMs;
+    };
+
+    static constexpr int DEFAULT_MAX_CONCURRENT = 4;
+
+    int m_maxConcurrent{DEFAULT_MAX_CONCURRENT};
+    int m_reservedSlots{1};
+    std::array<QList<Entry>, PRIORITY_COUNT> m_queues;
+    QList<int> m_running;
+
+    // Running jobs allowed when the next one has this priority
+    int capacity(Priority priority) const;
+};
+
+#endif // REQUESTSCHEDULER_H
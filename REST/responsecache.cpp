@@ -0,0 +1,77 @@
+#include "responsecache.h"
+#include <QList>
+
+ResponseCache::ResponseCache(qint64 maxBytes)
+    : m_entries(maxBytes)
+{
+}
+
+ResponseCache::Entry *ResponseCache::find(const QString &key)
+{
+    return m_entries.object(key);
+}
+
+void ResponseCache::insert(const QString &key, Entry entry)
+{
+    const qsizetype cost = qMax<qsizetype>(1, qMax<qint64>(entry.body.size(), entry.bodySize)
+                                                      + entry.etag.size() + key.size());
+    m_entries.insert(key, new Entry(std::move(entry)), cost);
+}
+
+void ResponseCache::remove(const QString &key)
+{
+    m_entries.remove(key);
+}
+
+void ResponseCache::clear()
+{
+    m_entries.clear();
+}
+
+qint64 ResponseCache::maxBytes() const
+{
+    return m_entries.maxCost();
+}
+
+void ResponseCache::setMaxBytes(qint64 maxBytes)
+{
+    m_entries.setMaxCost(maxBytes);
+}
+
+qint64 ResponseCache::totalBytes() const
+{
+    return m_entries.totalCost();
+}
+
+int ResponseCache::count() const
+{
+    return int(m_entries.count());
+}
+
+bool ResponseCache::freshness(const QByteArray &cacheControl, qint64 defaultMaxAgeMs, qint64 &maxAgeMs)
+{
+    maxAgeMs = defaultMaxAgeMs;
+    // Every directive counts: no-store wins over all others, no-cache over
+    // max-age, whatever the order
+    bool noCache = false;
+    const QList<QByteArray> directives = cacheControl.toLower().split(',');
+    for (const QByteArray &raw : directives) {
+        const QByteArray directive = raw.trimmed();
+        if (directive == "no-store") {
+            return false;
+        }
+        if (directive == "no-cache") {
+            noCache = true;
+        } else if (directive.startsWith("max-age=")) {
+            bool ok = false;
+            const qint64 seconds = directive.mid(8).toLongLong(&ok);
+            if (ok && seconds >= 0) {
+                maxAgeMs = seconds * 1000;
+            }
+        }
+    }
+    if (noCache) {
+        maxAgeMs = 0;
+    }
+    return true;
+}
@@ -0,0 +1,59 @@
+#ifndef RESPONSECACHE_H
+#define RESPONSECACHE_H
+
+#include <QByteArray>
+#include <QCache>
+#include <QJsonDocument>
+#include <QList>
+#include <QPair>
+#include <QString>
+#include <QVariant>
+
+// In-memory LRU cache of GET responses, bounded by body bytes.
+//
+// Freshness follows the response's Cache-Control (max-age, no-cache,
+// no-store) with a caller-supplied default when there is none. A stale
+// entry is kept as long as it has a validator (ETag or Last-Modified), so
+// the next request can be made conditional and a 304 refreshes it.
+class ResponseCache {
+public:
+    struct Entry {
+        QByteArray body;
+        qint64 bodySize{0};       // body may be empty if the JSON was streamed
+        QJsonDocument json;       // parsed once, shared with every hit
+        QVariant jsonVariant;     // the QML view of json, when it was built
+        QList<QPair<QByteArray, QByteArray>> headers;
+        QByteArray etag;
+        QByteArray lastModified;
+        qint64 storedMs{0};
+        qint64 maxAgeMs{0};
+
+        bool isFresh(qint64 nowMs) const { return nowMs - storedMs < maxAgeMs; }
+        bool canRevalidate() const { return !etag.isEmpty() || !lastModified.isEmpty(); }
+    };
+
+    static constexpr qint64 DEFAULT_MAX_BYTES = 4 * 1024 * 1024;
+
+    explicit ResponseCache(qint64 maxBytes = DEFAULT_MAX_BYTES);
+
+    // Marks the entry most recently used, nullptr if absent
+    Entry* find(const QString& key);
+    // Entries larger than the whole cache are not stored
+    void insert(const QString& key, Entry entry);
+    void remove(const QString& key);
+    void clear();
+
+    qint64 maxBytes() const;
+    void setMaxBytes(qint64 maxBytes);
+    qint64 totalBytes() const;
+    int count() const;
+
+    // False for no-store. maxAgeMs is 0 under no-cache (always revalidate),
+    // max-age when given, otherwise defaultMaxAgeMs.
+    static bool freshness(const QByteArray& cacheControl, qint64 defaultMaxAgeMs, qint64& maxAgeMs);
+
+private:
+    QCache<QString, Entry> m_entries;
+};
+
+#endif // RESPONSECACHE_H
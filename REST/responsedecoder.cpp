@@ -0,0 +1,181 @@
+#include "responsedecoder.h"
+#include <QNetworkReply>
+#include <QRestReply>
+#include <QThreadPool>
+#include <QtConcurrent>
+
+ResponseDecoder::ResponseDecoder(QThreadPool *pool, bool wantVariant)
+    : m_pool(pool)
+    , m_wantVariant(wantVariant)
+{
+}
+
+std::shared_ptr<ResponseDecoder> ResponseDecoder::create(QThreadPool *pool, bool wantVariant)
+{
+    return std::shared_ptr<ResponseDecoder>(new ResponseDecoder(pool, wantVariant));
+}
+
+void ResponseDecoder::attach(QNetworkReply *reply)
+{
+    m_clock.start();
+    // The reply is the context: the connections die with it, the decoder
+    // lives on in whoever holds the pointer
+    const auto self = shared_from_this();
+    QObject::connect(reply, &QNetworkReply::readyRead, reply,
+                     [self, reply]() { self->readAvailable(reply); });
+    QObject::connect(reply, &QNetworkReply::socketStartedConnecting, reply,
+                     [self]() { self->m_milestones.connecting = self->m_clock.nsecsElapsed(); });
+#if QT_CONFIG(ssl)
+    QObject::connect(reply, &QNetworkReply::encrypted, reply,
+                     [self]() { self->m_milestones.encrypted = self->m_clock.nsecsElapsed(); });
+#endif
+    QObject::connect(reply, &QNetworkReply::requestSent, reply,
+                     [self]() { self->m_milestones.requestSent = self->m_clock.nsecsElapsed(); });
+    QObject::connect(reply, &QNetworkReply::metaDataChanged, reply, [self]() {
+        if (self->m_milestones.headers < 0) {
+            self->m_milestones.headers = self->m_clock.nsecsElapsed();
+        }
+    });
+}
+
+void ResponseDecoder::readAvailable(QNetworkReply *reply)
+{
+    if (m_body == Body::Unknown) {
+        const QByteArray contentType = reply->header(QNetworkRequest::ContentTypeHeader)
+                                           .toByteArray().toLower();
+        m_declaredJson = contentType.contains("json");
+        m_body = (m_declaredJson || contentType.isEmpty()) ? Body::Json : Body::Raw;
+    }
+
+    QByteArray chunk = reply->readAll();
+    m_received += chunk.size();
+    if (m_streaming) {
+        enqueue(std::move(chunk));
+        return;
+    }
+    m_buffer.append(chunk);
+    // Only a body declared as JSON is worth streaming, an untyped one may
+    // turn out to be anything and is kept as is
+    if (m_declaredJson && m_buffer.size() >= STREAM_THRESHOLD) {
+        startStreaming();
+    }
+}
+
+void ResponseDecoder::startStreaming()
+{
+    m_streaming = true;
+    m_chain = QtFuture::makeReadyVoidFuture();
+    enqueue(std::exchange(m_buffer, {}));
+}
+
+void ResponseDecoder::enqueue(QByteArray chunk)
+{
+    if (chunk.isEmpty()) {
+        return;
+    }
+    // Each continuation starts after the previous one, so chunks are
+    // decoded in arrival order without a lock
+    m_chain = m_chain.then(m_pool, [self = shared_from_this(), chunk = std::move(chunk)]() {
+        self->m_decoder.feed(chunk);
+    });
+}
+
+QFuture<RestResponse> ResponseDecoder::finish(QRestReply &reply)
+{
+    QNetworkReply *networkReply = reply.networkReply();
+    readAvailable(networkReply);
+
+    RestResponse response;
+    response.url = networkReply->url();
+    response.status = reply.httpStatus();
+    response.headers = networkReply->rawHeaderPairs();
+    response.bodySize = m_received;
+    response.timing = timing(networkReply);
+    response.ok = reply.isSuccess();
+    if (!response.ok) {
+        response.error = reply.errorString();
+    }
+
+    if (m_streaming) {
+        // The pool finishes the document; the body was consumed on the way,
+        // so an error response is decoded too or its body would be lost
+        return m_chain.then(m_pool, [self = shared_from_this(), response]() mutable {
+            decode(response, self->m_decoder, self->m_declaredJson, self->m_wantVariant);
+            return response;
+        });
+    }
+
+    if (m_body == Body::Raw || !response.ok || m_buffer.isEmpty()) {
+        response.body = std::move(m_buffer);
+        return QtFuture::makeReadyValueFuture(std::move(response));
+    }
+
+    if (m_buffer.size() > STREAM_THRESHOLD) {
+        // An untyped body was kept whole, it is still too large to parse here
+        return QtConcurrent::run(m_pool, [self = shared_from_this()](RestResponse response) {
+            self->m_decoder.feed(self->m_buffer);
+            response.body = std::move(self->m_buffer);
+            decode(response, self->m_decoder, self->m_declaredJson, self->m_wantVariant);
+            return response;
+        }, std::move(response));
+    }
+
+    m_decoder.feed(m_buffer);
+    response.body = std::move(m_buffer);
+    decode(response, m_decoder, m_declaredJson, m_wantVariant);
+    return QtFuture::makeReadyValueFuture(std::move(response));
+}
+
+RestResponse::Timing ResponseDecoder::timing(QNetworkReply *reply) const
+{
+    const auto span = [](qint64 from, qint64 to) {
+        return (from >= 0 && to >= from) ? (to - from) / 1e6 : 0.0;
+    };
+    const Milestones &m = m_milestones;
+    const qint64 end = m_clock.nsecsElapsed();
+
+    RestResponse::Timing timing;
+    timing.newConnection = m.connecting >= 0;
+    timing.http2 = reply->attribute(QNetworkRequest::Http2WasUsedAttribute).toBool();
+    // Each phase ends where the next one starts; missing milestones (a
+    // reused connection, plain HTTP, an error) fold into the neighbours
+    qint64 from = 0;
+    if (timing.newConnection) {
+        timing.dnsMs = span(0, m.connecting);
+        const qint64 connected = m.encrypted >= 0 ? m.encrypted : m.requestSent;
+        timing.connectMs = span(m.connecting, connected);
+        from = connected >= 0 ? connected : m.connecting;
+    }
+    if (m.requestSent >= 0) {
+        timing.sendMs = span(from, m.requestSent);
+        from = m.requestSent;
+    }
+    if (m.headers >= 0) {
+        timing.ttfbMs = span(from, m.headers);
+        from = m.headers;
+    }
+    timing.transferMs = span(from, end);
+    return timing;
+}
+
+void ResponseDecoder::decode(RestResponse &response, JsonStreamDecoder &decoder, bool declaredJson,
+                             bool wantVariant)
+{
+    QString error;
+    response.json = decoder.finish(&error);
+    if (!error.isEmpty()) {
+        response.json = QJsonDocument();
+        // Declared JSON must parse, an untyped body is passed on raw. A
+        // failed request keeps its own error.
+        if (declaredJson && response.ok) {
+            response.ok = false;
+            response.error = "Invalid JSON: " + error;
+        }
+        return;
+    }
+    if (wantVariant) {
+        // Building the QML view of a large document is as costly as the
+        // parse itself, so it happens here as well
+        response.jsonVariant = response.json.toVariant();
+    }
+}
@@ -0,0 +1,79 @@
+#ifndef RESPONSEDECODER_H
+#define RESPONSEDECODER_H
+
+#include <QElapsedTimer>
+#include <QFuture>
+#include <memory>
+#include "jsonstreamdecoder.h"
+#include "restresponse.h"
+
+class QNetworkReply;
+class QRestReply;
+class QThreadPool;
+
+// Turns a network reply into a RestResponse without parsing on the thread
+// the reply lives on (the GUI thread for RestClient).
+//
+// attach() follows readyRead. Raw bodies are only collected. A JSON body
+// is collected until it passes STREAM_THRESHOLD; from then on every chunk
+// is queued to the pool, in order, through a chain of QFuture
+// continuations, so a large array is decoded while it is still arriving.
+// finish() returns the response once the last chunk is decoded. A body
+// without a Content-Type is kept whole and, past STREAM_THRESHOLD, decoded
+// on the pool in one go. Small bodies are decoded in place, a thread hop
+// would cost more than it saves.
+// The reply's progress signals are timestamped on the way for
+// RestResponse::timing.
+class ResponseDecoder : public std::enable_shared_from_this<ResponseDecoder> {
+public:
+    static constexpr qint64 STREAM_THRESHOLD = 64 * 1024;
+
+    // wantVariant also builds RestResponse::jsonVariant on the pool
+    static std::shared_ptr<ResponseDecoder> create(QThreadPool* pool, bool wantVariant);
+
+    // Starts following the reply, before control returns to the event
+    // loop; the timing is measured from here
+    void attach(QNetworkReply* reply);
+
+    // Call from the reply's finished handler. The future resolves on a
+    // pool thread, or is already resolved for small and raw bodies.
+    QFuture<RestResponse> finish(QRestReply& reply);
+
+private:
+    enum class Body {
+        Unknown,
+        Json,
+        Raw
+    };
+
+    // Reply milestones in ns since attach(), -1 until reached
+    struct Milestones {
+        qint64 connecting{-1};
+        qint64 encrypted{-1};
+        qint64 requestSent{-1};
+        qint64 headers{-1};
+    };
+
+    QThreadPool* m_pool{nullptr};
+    QElapsedTimer m_clock;
+    Milestones m_milestones;
+    bool m_wantVariant{false};
+    Body m_body{Body::Unknown};
+    bool m_declaredJson{false};
+    QByteArray m_buffer;
+    qint64 m_received{0};
+    // Set once streaming starts; only the chain touches m_decoder after that
+    bool m_streaming{false};
+    QFuture<void> m_chain;
+    JsonStreamDecoder m_decoder;
+
+    ResponseDecoder(QThreadPool* pool, bool wantVariant);
+    void readAvailable(QNetworkReply* reply);
+    void startStreaming();
+    void enqueue(QByteArray chunk);
+    RestResponse::Timing timing(QNetworkReply* reply) const;
+    static void decode(RestResponse& response, JsonStreamDecoder& decoder, bool declaredJson,
+                       bool wantVariant);
+};
+
+#endif // RESPONSEDECODER_H
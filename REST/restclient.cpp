@@ -2,16 +2,170 @@
 #include <QRestAccessManager>
 #include <QNetworkRequestFactory>
 #include <QRestReply>
+#include <QNetworkReply>
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QSslSocket>
+#include <QElapsedTimer>
+#include <QDateTime>
+#include <QNetworkDiskCache>
+#include <QNetworkInformation>
+#include <QMetaMethod>
+#include <QRandomGenerator>
+#include <algorithm>
+#include <limits>
+#include "metricsregistry.h"
+#include "logging.h"
+#include "responsedecoder.h"
+
+namespace {
+
+struct RequestMetrics {
+    Histogram *latency;
+    Counter *errors;
+};
+
+// Series per HTTP method, registered on first use
+const RequestMetrics &requestMetrics(const QString &method)
+{
+    static const QHash<QString, RequestMetrics> metrics = [] {
+        MetricsRegistry &registry = MetricsRegistry::instance();
+        QHash<QString, RequestMetrics> metrics;
+        for (const QString &name : {QStringLiteral("GET"), QStringLiteral("POST"),
+                                    QStringLiteral("PUT"), QStringLiteral("DELETE")}) {
+            metrics.insert(name, {&registry.histogram("cellularpi_rest_request_duration_ms",
+                                                      "REST request to reply",
+                                                      Histogram::latencyBounds(), {{"method", name}}),
+                                  &registry.counter("cellularpi_rest_errors_total",
+                                                    "REST requests that failed",
+                                                    {{"method", name}})});
+        }
+        return metrics;
+    }();
+    return *metrics.constFind(method);
+}
+
+struct CacheMetrics {
+    MetricsRegistry &registry = MetricsRegistry::instance();
+    Counter &hits = registry.counter("cellularpi_rest_cache_total", "GET requests by cache outcome",
+                                     {{"result", "hit"}});
+    Counter &misses = registry.counter("cellularpi_rest_cache_total", "GET requests by cache outcome",
+                                       {{"result", "miss"}});
+    Counter &revalidated = registry.counter("cellularpi_rest_cache_total", "GET requests by cache outcome",
+                                            {{"result", "revalidated"}});
+    Counter &coalesced = registry.counter("cellularpi_rest_cache_total", "GET requests by cache outcome",
+                                          {{"result", "coalesced"}});
+};
+
+CacheMetrics &cacheMetrics()
+{
+    static CacheMetrics metrics;
+    return metrics;
+}
+
+struct ConnectionMetrics {
+    MetricsRegistry &registry = MetricsRegistry::instance();
+    Counter &opened = registry.counter("cellularpi_rest_connections_total", "REST requests by connection",
+                                       {{"connection", "new"}});
+    Counter &reused = registry.counter("cellularpi_rest_connections_total", "REST requests by connection",
+                                       {{"connection", "reused"}});
+    Counter &http2 = registry.counter("cellularpi_rest_http2_responses_total", "REST responses over HTTP/2");
+    Counter &resumptionAttempts = registry.counter("cellularpi_rest_tls_resumption_attempts_total",
+                                                   "New TLS connections that offered a session ticket");
+    Histogram &dns = phase("dns");
+    Histogram &connect = phase("connect");
+    Histogram &ttfb = phase("ttfb");
+    Histogram &transfer = phase("transfer");
+
+    Histogram &phase(const char *name)
+    {
+        return registry.histogram("cellularpi_rest_phase_duration_ms", "REST request time per phase",
+                                  Histogram::latencyBounds(), {{"phase", name}});
+    }
+};
+
+ConnectionMetrics &connectionMetrics()
+{
+    static ConnectionMetrics metrics;
+    return metrics;
+}
+
+struct SchedulerMetrics {
+    MetricsRegistry &registry = MetricsRegistry::instance();
+    Gauge &queued = registry.gauge("cellularpi_rest_queued_requests",
+                                   "REST requests waiting for a slot or a retry");
+    Gauge &active = registry.gauge("cellularpi_rest_active_requests", "REST requests on the wire");
+    Histogram &queueWait = registry.histogram("cellularpi_rest_queue_wait_ms",
+                                              "REST request queued to sent",
+                                              Histogram::latencyBounds());
+    Counter &retries = registry.counter("cellularpi_rest_retries_total", "REST requests sent again");
+    Counter &cancelled = registry.counter("cellularpi_rest_dropped_total",
+                                          "REST calls failed before their response",
+                                          {{"reason", "cancelled"}});
+    Counter &timedOut = registry.counter("cellularpi_rest_dropped_total",
+                                         "REST calls failed before their response",
+                                         {{"reason", "timeout"}});
+};
+
+SchedulerMetrics &schedulerMetrics()
+{
+    static SchedulerMetrics metrics;
+    return metrics;
+}
+
+// Orders the requests QNetworkAccessManager queues for a free connection
+QNetworkRequest::Priority networkPriority(RequestScheduler::Priority priority)
+{
+    switch (priority) {
+    case RequestScheduler::Priority::Low:
+        return QNetworkRequest::LowPriority;
+    case RequestScheduler::Priority::Normal:
+        return QNetworkRequest::NormalPriority;
+    default:
+        return QNetworkRequest::HighPriority;
+    }
+}
+
+const QString CANCELLED = QStringLiteral("Cancelled");
+const QString TIMED_OUT = QStringLiteral("Timed out");
+
+} // namespace
 
 RestClient::RestClient(QObject *parent)
     : QObject(parent)
 {
     m_qnam.setAutoDeleteReplies(true);
+    m_decodePool.setMaxThreadCount(DECODE_THREADS);
     m_manager = std::make_shared<QRestAccessManager>(&m_qnam);
     m_requestFactory = std::make_shared<QNetworkRequestFactory>();
+    m_clock.start();
+    m_scheduleTimer.setSingleShot(true);
+    connect(&m_scheduleTimer, &QTimer::timeout, this, &RestClient::expireCalls);
+
+    QQmlEngine::setObjectOwnership(&m_reports, QQmlEngine::CppOwnership);
+    m_reports.setClient(this);
+}
+
+void RestClient::start()
+{
+    if (m_started)
+        return;
+    m_started = true;
+
+    // A link that comes back has lost its connections, open one early
+    if (QNetworkInformation::loadBackendByFeatures(QNetworkInformation::Feature::Reachability)) {
+        connect(QNetworkInformation::instance(), &QNetworkInformation::reachabilityChanged, this,
+                [this](QNetworkInformation::Reachability reachability) {
+                    if (m_autoPrewarm && reachability == QNetworkInformation::Reachability::Online) {
+                        prewarm();
+                    }
+                });
+    }
+
+    const QString reportUrl = qEnvironmentVariable("CELLULARPI_REPORT_URL");
+    if (!reportUrl.isEmpty()) {
+        m_reports.setEndpoint(reportUrl);
+    }
 }
 
 QUrl RestClient::baseUrl() const
@@ -25,6 +179,9 @@ void RestClient::setBaseUrl(const QUrl &url)
         return;
     m_requestFactory->setBaseUrl(url);
     emit baseUrlChanged();
+    if (m_autoPrewarm) {
+        prewarm();
+    }
 }
 
 bool RestClient::sslSupported() const
@@ -36,74 +193,852 @@ bool RestClient::sslSupported() const
 #endif
 }
 
-void RestClient::get(const QString &endpoint)
+bool RestClient::cacheEnabled() const
 {
-    try {
-        auto request = m_requestFactory->createRequest(endpoint);
-        m_manager->get(request, this, [this](QRestReply &reply) {
-            if (const auto json = reply.readJson()) {
-                if (json->isObject()) {
-                    emit responseReceived(json->object());
-                }
-            } else {
-                emit errorOccurred(reply.errorString());
+    return m_cacheEnabled;
+}
+
+void RestClient::setCacheEnabled(bool enabled)
+{
+    if (m_cacheEnabled == enabled)
+        return;
+    m_cacheEnabled = enabled;
+    if (!enabled)
+        m_cache.clear();
+    emit cacheEnabledChanged();
+}
+
+int RestClient::cacheMaxAge() const
+{
+    return m_cacheMaxAge;
+}
+
+void RestClient::setCacheMaxAge(int seconds)
+{
+    seconds = qMax(0, seconds);
+    if (m_cacheMaxAge == seconds)
+        return;
+    m_cacheMaxAge = seconds;
+    emit cacheMaxAgeChanged();
+}
+
+QString RestClient::diskCachePath() const
+{
+    return m_diskCachePath;
+}
+
+void RestClient::setDiskCachePath(const QString &path)
+{
+    if (m_diskCachePath == path)
+        return;
+    m_diskCachePath = path;
+    if (path.isEmpty()) {
+        m_qnam.setCache(nullptr);
+    } else {
+        // QNAM takes ownership and handles validation against it itself
+        auto *diskCache = new QNetworkDiskCache;
+        diskCache->setCacheDirectory(path);
+        diskCache->setMaximumCacheSize(DISK_CACHE_MAX_BYTES);
+        m_qnam.setCache(diskCache);
+    }
+    emit diskCachePathChanged();
+}
+
+int RestClient::cacheHits() const
+{
+    return m_cacheHits;
+}
+
+int RestClient::cacheMisses() const
+{
+    return m_cacheMisses;
+}
+
+int RestClient::cacheRevalidations() const
+{
+    return m_cacheRevalidations;
+}
+
+int RestClient::coalescedRequests() const
+{
+    return m_coalescedRequests;
+}
+
+void RestClient::clearCache()
+{
+    m_cache.clear();
+    if (QAbstractNetworkCache *diskCache = m_qnam.cache()) {
+        diskCache->clear();
+    }
+}
+
+bool RestClient::keepAlive() const
+{
+    return m_connections.settings().keepAlive;
+}
+
+void RestClient::setKeepAlive(bool enabled)
+{
+    ConnectionPolicy::Settings settings = m_connections.settings();
+    settings.keepAlive = enabled;
+    updateConnectionSettings(settings);
+}
+
+int RestClient::keepAliveTimeout() const
+{
+    return m_connections.settings().keepAliveSeconds;
+}
+
+void RestClient::setKeepAliveTimeout(int seconds)
+{
+    ConnectionPolicy::Settings settings = m_connections.settings();
+    settings.keepAliveSeconds = seconds;
+    updateConnectionSettings(settings);
+}
+
+bool RestClient::http2Enabled() const
+{
+    return m_connections.settings().http2;
+}
+
+void RestClient::setHttp2Enabled(bool enabled)
+{
+    ConnectionPolicy::Settings settings = m_connections.settings();
+    settings.http2 = enabled;
+    updateConnectionSettings(settings);
+}
+
+bool RestClient::tlsSessionReuse() const
+{
+    return m_connections.settings().tlsSessionReuse;
+}
+
+void RestClient::setTlsSessionReuse(bool enabled)
+{
+    ConnectionPolicy::Settings settings = m_connections.settings();
+    settings.tlsSessionReuse = enabled;
+    updateConnectionSettings(settings);
+}
+
+int RestClient::maxConnections() const
+{
+    return m_connections.settings().maxConnections;
+}
+
+void RestClient::setMaxConnections(int connections)
+{
+    ConnectionPolicy::Settings settings = m_connections.settings();
+    settings.maxConnections = connections;
+    updateConnectionSettings(settings);
+}
+
+bool RestClient::autoPrewarm() const
+{
+    return m_autoPrewarm;
+}
+
+void RestClient::setAutoPrewarm(bool enabled)
+{
+    if (m_autoPrewarm == enabled)
+        return;
+    m_autoPrewarm = enabled;
+    emit connectionSettingsChanged();
+    if (enabled) {
+        prewarm();
+    }
+}
+
+int RestClient::connectionsOpened() const
+{
+    return m_connectionsOpened;
+}
+
+int RestClient::connectionsReused() const
+{
+    return m_connectionsReused;
+}
+
+int RestClient::http2Responses() const
+{
+    return m_http2Responses;
+}
+
+int RestClient::tlsResumptionAttempts() const
+{
+    return m_tlsResumptionAttempts;
+}
+
+void RestClient::prewarm()
+{
+    m_connections.prewarm(m_qnam, baseUrl());
+}
+
+void RestClient::updateConnectionSettings(const ConnectionPolicy::Settings &settings)
+{
+    if (m_connections.settings() == settings)
+        return;
+    m_connections.setSettings(settings);
+    emit connectionSettingsChanged();
+}
+
+int RestClient::maxConcurrentRequests() const
+{
+    return m_scheduler.maxConcurrent();
+}
+
+void RestClient::setMaxConcurrentRequests(int requests)
+{
+    if (m_scheduler.maxConcurrent() == qMax(1, requests))
+        return;
+    m_scheduler.setMaxConcurrent(requests);
+    emit schedulingChanged();
+    schedule();
+}
+
+int RestClient::reservedRequests() const
+{
+    return m_scheduler.reservedSlots();
+}
+
+void RestClient::setReservedRequests(int requests)
+{
+    if (m_scheduler.reservedSlots() == qMax(0, requests))
+        return;
+    m_scheduler.setReservedSlots(requests);
+    emit schedulingChanged();
+    schedule();
+}
+
+int RestClient::defaultTimeout() const
+{
+    return m_defaultTimeout;
+}
+
+void RestClient::setDefaultTimeout(int ms)
+{
+    ms = qMax(0, ms);
+    if (m_defaultTimeout == ms)
+        return;
+    m_defaultTimeout = ms;
+    emit schedulingChanged();
+}
+
+int RestClient::maxRetries() const
+{
+    return m_maxRetries;
+}
+
+void RestClient::setMaxRetries(int retries)
+{
+    retries = qMax(0, retries);
+    if (m_maxRetries == retries)
+        return;
+    m_maxRetries = retries;
+    emit schedulingChanged();
+}
+
+int RestClient::queuedRequests() const
+{
+    return m_scheduler.queued();
+}
+
+int RestClient::activeRequests() const
+{
+    return m_scheduler.running();
+}
+
+int RestClient::retriedRequests() const
+{
+    return m_retriedRequests;
+}
+
+int RestClient::cancelledRequests() const
+{
+    return m_cancelledRequests;
+}
+
+int RestClient::timedOutRequests() const
+{
+    return m_timedOutRequests;
+}
+
+bool RestClient::cancel(int requestId)
+{
+    for (auto job = m_jobs.cbegin(); job != m_jobs.cend(); ++job) {
+        for (const PendingCall &call : job->calls) {
+            if (call.id == requestId) {
+                dropCall(job.key(), requestId, CANCELLED);
+                schedule();
+                return true;
             }
-        });
-    } catch (const std::exception &e) {
-        emit errorOccurred(QString("Request failed: %1").arg(e.what()));
+        }
     }
+    return false;
 }
 
-void RestClient::post(const QString &endpoint, const QVariantMap &data)
+BatchUploader *RestClient::reports()
 {
-    try {
-        auto request = m_requestFactory->createRequest(endpoint);
-        m_manager->post(request, data, this, [this](QRestReply &reply) {
-            if (const auto json = reply.readJson()) {
-                if (json->isObject()) {
-                    emit responseReceived(json->object());
-                }
-            } else {
-                emit errorOccurred(reply.errorString());
+    return &m_reports;
+}
+
+int RestClient::get(const QString &endpoint, const QJSValue &callback, const QVariantMap &options)
+{
+    return startGet(endpoint, newCall(QStringLiteral("GET"), callback, {}, requestOptions(options)));
+}
+
+int RestClient::get(const QString &endpoint, Callback callback, const RequestOptions &options)
+{
+    return startGet(endpoint, newCall(QStringLiteral("GET"), {}, std::move(callback), options));
+}
+
+int RestClient::post(const QString &endpoint, const QVariant &data, const QJSValue &callback,
+                     const QVariantMap &options)
+{
+    return startWrite(endpoint, data, newCall(QStringLiteral("POST"), callback, {}, requestOptions(options)));
+}
+
+int RestClient::post(const QString &endpoint, const QVariant &data, Callback callback,
+                     const RequestOptions &options)
+{
+    return startWrite(endpoint, data, newCall(QStringLiteral("POST"), {}, std::move(callback), options));
+}
+
+int RestClient::post(const QString &endpoint, const QByteArray &body,
+                     const QList<RestResponse::Header> &headers, Callback callback,
+                     const RequestOptions &options)
+{
+    return startWrite(endpoint, body, newCall(QStringLiteral("POST"), {}, std::move(callback), options),
+                      headers);
+}
+
+int RestClient::put(const QString &endpoint, const QVariant &data, const QJSValue &callback,
+                    const QVariantMap &options)
+{
+    return startWrite(endpoint, data, newCall(QStringLiteral("PUT"), callback, {}, requestOptions(options)));
+}
+
+int RestClient::put(const QString &endpoint, const QVariant &data, Callback callback,
+                    const RequestOptions &options)
+{
+    return startWrite(endpoint, data, newCall(QStringLiteral("PUT"), {}, std::move(callback), options));
+}
+
+int RestClient::deleteResource(const QString &endpoint, const QJSValue &callback,
+                               const QVariantMap &options)
+{
+    return startWrite(endpoint, QVariant(),
+                      newCall(QStringLiteral("DELETE"), callback, {}, requestOptions(options)));
+}
+
+int RestClient::deleteResource(const QString &endpoint, Callback callback, const RequestOptions &options)
+{
+    return startWrite(endpoint, QVariant(),
+                      newCall(QStringLiteral("DELETE"), {}, std::move(callback), options));
+}
+
+RestClient::PendingCall RestClient::newCall(const QString &method, QJSValue jsCallback, Callback callback,
+                                            const RequestOptions &options)
+{
+    PendingCall call;
+    call.id = m_nextRequestId++;
+    call.method = method;
+    call.timer.start();
+    call.jsCallback = std::move(jsCallback);
+    call.callback = std::move(callback);
+    call.priority = options.priority;
+    const int timeoutMs = options.timeoutMs < 0 ? m_defaultTimeout : options.timeoutMs;
+    call.deadlineMs = timeoutMs > 0 ? m_clock.elapsed() + timeoutMs : 0;
+    call.retries = options.retries < 0 ? m_maxRetries : options.retries;
+    return call;
+}
+
+RequestOptions RestClient::requestOptions(const QVariantMap &options)
+{
+    RequestOptions result;
+    const int priority = options.value(QStringLiteral("priority"), int(result.priority)).toInt();
+    result.priority = RequestScheduler::Priority(qBound(0, priority, RequestScheduler::PRIORITY_COUNT - 1));
+    result.timeoutMs = options.value(QStringLiteral("timeout"), result.timeoutMs).toInt();
+    result.retries = options.value(QStringLiteral("retries"), result.retries).toInt();
+    return result;
+}
+
+QNetworkRequest RestClient::createRequest(const QString &endpoint) const
+{
+    const QUrl url(endpoint);
+    QNetworkRequest request = url.isRelative() ? m_requestFactory->createRequest(endpoint)
+                                               : m_requestFactory->createRequest();
+    if (!url.isRelative()) {
+        request.setUrl(url);
+    }
+    m_connections.apply(request);
+    return request;
+}
+
+int RestClient::startGet(const QString &endpoint, PendingCall call)
+{
+    const int id = call.id;
+    QNetworkRequest request = createRequest(endpoint);
+    const QString key = request.url().toString();
+
+    // Someone asked for this already, the one reply answers everybody. The
+    // request goes out as urgently as the most urgent of them needs.
+    if (const auto existing = m_getJobs.constFind(key); existing != m_getJobs.cend()) {
+        Job &job = m_jobs[*existing];
+        if (call.priority > job.priority) {
+            job.priority = call.priority;
+            m_scheduler.raise(*existing, call.priority);
+        }
+        job.retries = qMax(job.retries, call.retries);
+        job.calls.append(std::move(call));
+        ++m_coalescedRequests;
+        cacheMetrics().coalesced.increment();
+        emit cacheStatsChanged();
+        schedule();
+        return id;
+    }
+
+    bool conditional = false;
+    if (ResponseCache::Entry *entry = m_cacheEnabled ? m_cache.find(key) : nullptr) {
+        if (entry->isFresh(QDateTime::currentMSecsSinceEpoch())) {
+            ++m_cacheHits;
+            cacheMetrics().hits.increment();
+            emit cacheStatsChanged();
+
+            RestResponse response;
+            response.url = request.url();
+            response.status = 200;
+            response.ok = true;
+            response.headers = entry->headers;
+            response.body = entry->body;
+            response.bodySize = entry->bodySize;
+            response.json = entry->json;
+            response.jsonVariant = entry->jsonVariant;
+            response.fromCache = true;
+            // Keep the result asynchronous, as it is for a network reply
+            QMetaObject::invokeMethod(this, [this, call = std::move(call), response]() mutable {
+                    deliver(call, response);
+                }, Qt::QueuedConnection);
+            return id;
+        }
+        if (!entry->etag.isEmpty()) {
+            request.setRawHeader("If-None-Match", entry->etag);
+            conditional = true;
+        }
+        if (!entry->lastModified.isEmpty()) {
+            request.setRawHeader("If-Modified-Since", entry->lastModified);
+            conditional = true;
+        }
+    }
+    request.setPriority(networkPriority(call.priority));
+    Job job;
+    job.method = call.method;
+    job.key = key;
+    job.request = request;
+    job.calls.append(std::move(call));
+    submitGet(std::move(job), conditional);
+    return id;
+}
+
+void RestClient::submitGet(Job job, bool conditional)
+{
+    if (!conditional) {
+        ++m_cacheMisses;
+        cacheMetrics().misses.increment();
+        emit cacheStatsChanged();
+    }
+    job.send = [this, request = job.request](ReplyHandler handler) {
+        return m_manager->get(request, this, std::move(handler));
+    };
+    const QString key = job.key;
+    m_getJobs.insert(key, submit(std::move(job)));
+}
+
+int RestClient::startWrite(const QString &endpoint, const QVariant &data, PendingCall call,
+                           const QList<RestResponse::Header> &headers)
+{
+    const int id = call.id;
+    const QString method = call.method;
+    QNetworkRequest request = createRequest(endpoint);
+    for (const RestResponse::Header &header : headers) {
+        request.setRawHeader(header.first, header.second);
+    }
+    request.setPriority(networkPriority(call.priority));
+    // A write makes whatever we cached for the resource stale
+    m_cache.remove(request.url().toString());
+
+    Job job;
+    job.method = method;
+    job.request = request;
+    job.calls.append(std::move(call));
+    if (method == QLatin1String("DELETE")) {
+        job.send = [this, request](ReplyHandler handler) {
+            return m_manager->deleteResource(request, this, std::move(handler));
+        };
+    } else {
+        // Objects and arrays go as JSON, anything else as raw bytes
+        const bool isPost = method == QLatin1String("POST");
+        const QJsonDocument json = QJsonDocument::fromVariant(data);
+        if (!json.isNull()) {
+            job.send = [this, request, json, isPost](ReplyHandler handler) {
+                return isPost ? m_manager->post(request, json, this, std::move(handler))
+                              : m_manager->put(request, json, this, std::move(handler));
+            };
+        } else {
+            const QByteArray body = data.typeId() == QMetaType::QByteArray ? data.toByteArray()
+                                                                           : data.toString().toUtf8();
+            job.send = [this, request, body, isPost](ReplyHandler handler) {
+                return isPost ? m_manager->post(request, body, this, std::move(handler))
+                              : m_manager->put(request, body, this, std::move(handler));
+            };
+        }
+    }
+    submit(std::move(job));
+    return id;
+}
+
+int RestClient::submit(Job job)
+{
+    const int id = m_nextJobId++;
+    job.priority = RequestScheduler::Priority::Low;
+    job.retries = 0;
+    for (const PendingCall &call : std::as_const(job.calls)) {
+        job.priority = qMax(job.priority, call.priority);
+        job.retries = qMax(job.retries, call.retries);
+    }
+    job.queuedMs = m_clock.elapsed();
+    m_scheduler.enqueue(id, job.priority);
+    m_jobs.insert(id, std::move(job));
+    schedule();
+    return id;
+}
+
+void RestClient::schedule()
+{
+    const qint64 nowMs = m_clock.elapsed();
+    while (const int id = m_scheduler.takeNext(nowMs)) {
+        launch(id);
+    }
+
+    qint64 wakeMs = m_scheduler.nextDueMs(nowMs);
+    for (const Job &job : std::as_const(m_jobs)) {
+        for (const PendingCall &call : job.calls) {
+            if (call.deadlineMs > 0 && (wakeMs == 0 || call.deadlineMs < wakeMs)) {
+                wakeMs = call.deadlineMs;
             }
+        }
+    }
+    if (wakeMs > 0) {
+        m_scheduleTimer.start(int(qBound<qint64>(0, wakeMs - nowMs, std::numeric_limits<int>::max())));
+    } else {
+        m_scheduleTimer.stop();
+    }
+
+    SchedulerMetrics &metrics = schedulerMetrics();
+    metrics.queued.set(m_scheduler.queued());
+    metrics.active.set(m_scheduler.running());
+    emit schedulerStatsChanged();
+}
+
+void RestClient::launch(int id)
+{
+    Job &job = m_jobs[id];
+    ++job.attempts;
+    schedulerMetrics().queueWait.observe(double(m_clock.elapsed() - job.queuedMs));
+
+    // Decided when it goes out; a coalesced JS caller that arrives later
+    // converts on delivery instead
+    const bool wantVariant = std::any_of(job.calls.cbegin(), job.calls.cend(),
+                                         [this](const PendingCall &call) { return wantsVariant(call); });
+    const auto decoder = ResponseDecoder::create(&m_decodePool, wantVariant);
+    const bool resumable = m_connections.hasTicket(job.request.url());
+    job.reply = job.send([this, id, decoder, resumable](QRestReply &reply) {
+        m_connections.replyFinished(reply.networkReply());
+        decoder->finish(reply).then(this, [this, id, resumable](RestResponse response) {
+            recordConnection(response, resumable);
+            finishJob(id, std::move(response));
         });
-    } catch (const std::exception &e) {
-        emit errorOccurred(QString("Request failed: %1").arg(e.what()));
+    });
+    decoder->attach(job.reply);
+}
+
+void RestClient::finishJob(int id, RestResponse response)
+{
+    m_scheduler.finished(id);
+    const auto it = m_jobs.find(id);
+    if (it == m_jobs.end()) {
+        schedule();
+        return;
+    }
+    Job job = std::move(*it);
+    m_jobs.erase(it);
+    if (!job.key.isEmpty() && m_getJobs.value(job.key) == id) {
+        m_getJobs.remove(job.key);
+    }
+    job.reply.clear();
+    response.attempts = job.attempts;
+
+    if (!job.abortReason.isEmpty()) {
+        response.ok = false;
+        response.error = job.abortReason;
+    } else if (const qint64 delayMs = retryDelay(job, response); delayMs >= 0) {
+        ++m_retriedRequests;
+        schedulerMetrics().retries.increment();
+        CPI_LOG_INFO("rest", "Retrying request",
+                     {{"method", job.method}, {"url", response.url.toString()},
+                      {"status", response.status}, {"error", response.error},
+                      {"attempt", job.attempts}, {"delayMs", delayMs}});
+        const qint64 dueMs = m_clock.elapsed() + delayMs;
+        job.queuedMs = dueMs;
+        m_scheduler.enqueue(id, job.priority, dueMs);
+        if (!job.key.isEmpty()) {
+            m_getJobs.insert(job.key, id);
+        }
+        m_jobs.insert(id, std::move(job));
+        schedule();
+        return;
     }
+
+    if (!job.key.isEmpty() && !job.calls.isEmpty()) {
+        handleGetResponse(std::move(job), std::move(response));
+    } else {
+        for (PendingCall &call : job.calls) {
+            deliver(call, response);
+        }
+    }
+    schedule();
 }
 
-void RestClient::put(const QString &endpoint, const QVariantMap &data)
+qint64 RestClient::retryDelay(const Job &job, const RestResponse &response) const
 {
-    try {
-        auto request = m_requestFactory->createRequest(endpoint);
-        m_manager->put(request, data, this, [this](QRestReply &reply) {
-            if (const auto json = reply.readJson()) {
-                if (json->isObject()) {
-                    emit responseReceived(json->object());
-                }
-            } else {
-                emit errorOccurred(reply.errorString());
+    // No response at all, or a server or proxy that asks to come back later
+    const int status = response.status;
+    const bool transient = status == 0 || status == 408 || status == 429 || status == 502
+                           || status == 503 || status == 504;
+    // Sending a POST twice may do it twice
+    const bool idempotent = job.method != QLatin1String("POST");
+    if (!transient || !idempotent || job.attempts > job.retries || job.calls.isEmpty()) {
+        return -1;
+    }
+
+    bool hasRetryAfter = false;
+    const qint64 retryAfterS = response.header("Retry-After").toLongLong(&hasRetryAfter);
+    qint64 delayMs = 0;
+    if (hasRetryAfter) {
+        delayMs = qBound<qint64>(0, retryAfterS * 1000, RETRY_MAX_MS);
+    } else {
+        // Exponential with +-20% jitter
+        const int exponent = qMin(job.attempts - 1, 16);
+        const double delay = qMin<double>(RETRY_MAX_MS, double(RETRY_BASE_MS) * (1 << exponent));
+        delayMs = qint64(delay * (0.8 + 0.4 * QRandomGenerator::global()->generateDouble()));
+    }
+
+    // Not worth waiting for when every caller will have timed out by then
+    qint64 deadlineMs = 0;
+    for (const PendingCall &call : job.calls) {
+        if (call.deadlineMs == 0) {
+            return delayMs;
+        }
+        deadlineMs = qMax(deadlineMs, call.deadlineMs);
+    }
+    return m_clock.elapsed() + delayMs < deadlineMs ? delayMs : -1;
+}
+
+void RestClient::dropCall(int jobId, int callId, const QString &reason)
+{
+    const auto it = m_jobs.find(jobId);
+    if (it == m_jobs.end()) {
+        return;
+    }
+    const auto call = std::find_if(it->calls.begin(), it->calls.end(),
+                                   [callId](const PendingCall &call) { return call.id == callId; });
+    if (call == it->calls.end()) {
+        return;
+    }
+    PendingCall dropped = std::move(*call);
+    it->calls.erase(call);
+
+    RestResponse response;
+    response.url = it->request.url();
+    response.error = reason;
+    response.attempts = it->attempts;
+
+    if (it->calls.isEmpty()) {
+        // Later callers of the URL start afresh
+        if (!it->key.isEmpty()) {
+            m_getJobs.remove(it->key);
+        }
+        if (m_scheduler.remove(jobId)) {
+            // Never sent, or waiting to be sent again
+            m_jobs.erase(it);
+        } else if (it->reply) {
+            // finishJob() sees the reply come back aborted. Queued, as the
+            // reply may finish synchronously and take the job with it.
+            it->abortReason = reason;
+            QMetaObject::invokeMethod(it->reply.data(), &QNetworkReply::abort, Qt::QueuedConnection);
+        }
+    }
+
+    if (reason == CANCELLED) {
+        ++m_cancelledRequests;
+        schedulerMetrics().cancelled.increment();
+    } else {
+        ++m_timedOutRequests;
+        schedulerMetrics().timedOut.increment();
+    }
+    deliver(dropped, std::move(response));
+}
+
+void RestClient::expireCalls()
+{
+    const qint64 nowMs = m_clock.elapsed();
+    // Collected first, dropping a call may take its job with it
+    QList<QPair<int, int>> expired;
+    for (auto job = m_jobs.cbegin(); job != m_jobs.cend(); ++job) {
+        for (const PendingCall &call : job->calls) {
+            if (call.deadlineMs > 0 && call.deadlineMs <= nowMs) {
+                expired.append({job.key(), call.id});
             }
-        });
-    } catch (const std::exception &e) {
-        emit errorOccurred(QString("Request failed: %1").arg(e.what()));
+        }
+    }
+    for (const auto &[jobId, callId] : std::as_const(expired)) {
+        dropCall(jobId, callId, TIMED_OUT);
+    }
+    // Also starts the jobs whose backoff ended
+    schedule();
+}
+
+void RestClient::handleGetResponse(Job job, RestResponse response)
+{
+    const qint64 nowMs = QDateTime::currentMSecsSinceEpoch();
+    const QString &key = job.key;
+
+    if (response.status == 304) {
+        ResponseCache::Entry *entry = m_cache.find(key);
+        if (!entry) {
+            // Evicted while the request was out, ask again without validators
+            job.request.setRawHeader("If-None-Match", QByteArray());
+            job.request.setRawHeader("If-Modified-Since", QByteArray());
+            job.attempts = 0;
+            submitGet(std::move(job), false);
+            return;
+        }
+        response.ok = true;
+        response.error.clear();
+        response.body = entry->body;
+        response.bodySize = entry->bodySize;
+        response.json = entry->json;
+        response.jsonVariant = entry->jsonVariant;
+        // Served this once more, but a no-store revalidation ends its caching
+        if (ResponseCache::freshness(response.header("Cache-Control"), m_cacheMaxAge * 1000LL,
+                                     entry->maxAgeMs)) {
+            entry->storedMs = nowMs;
+        } else {
+            m_cache.remove(key);
+        }
+        ++m_cacheRevalidations;
+        cacheMetrics().revalidated.increment();
+        emit cacheStatsChanged();
+
+        response.fromCache = true;
+        for (PendingCall &call : job.calls) {
+            deliver(call, response);
+        }
+        return;
+    }
+
+    qint64 maxAgeMs = 0;
+    if (response.ok && m_cacheEnabled
+        && ResponseCache::freshness(response.header("Cache-Control"), m_cacheMaxAge * 1000LL, maxAgeMs)) {
+        ResponseCache::Entry entry;
+        entry.body = response.body;
+        entry.bodySize = response.bodySize;
+        entry.json = response.json;
+        entry.jsonVariant = response.jsonVariant;
+        entry.headers = response.headers;
+        entry.etag = response.header("ETag");
+        entry.lastModified = response.header("Last-Modified");
+        entry.storedMs = nowMs;
+        entry.maxAgeMs = maxAgeMs;
+        // Nothing to serve it for: neither fresh nor revalidatable
+        if (maxAgeMs > 0 || entry.canRevalidate()) {
+            m_cache.insert(key, std::move(entry));
+        }
+    }
+
+    for (PendingCall &call : job.calls) {
+        deliver(call, response);
+    }
+}
+
+void RestClient::recordConnection(const RestResponse &response, bool resumable)
+{
+    const RestResponse::Timing &timing = response.timing;
+    ConnectionMetrics &metrics = connectionMetrics();
+    if (timing.newConnection) {
+        ++m_connectionsOpened;
+        metrics.opened.increment();
+        metrics.dns.observe(timing.dnsMs);
+        metrics.connect.observe(timing.connectMs);
+        if (resumable) {
+            ++m_tlsResumptionAttempts;
+            metrics.resumptionAttempts.increment();
+        }
+    } else {
+        ++m_connectionsReused;
+        metrics.reused.increment();
+    }
+    if (timing.http2) {
+        ++m_http2Responses;
+        metrics.http2.increment();
     }
+    metrics.ttfb.observe(timing.ttfbMs);
+    metrics.transfer.observe(timing.transferMs);
+    emit connectionStatsChanged();
 }
 
-void RestClient::deleteResource(const QString &endpoint)
+bool RestClient::wantsVariant(const PendingCall &call) const
 {
-    try {
-        auto request = m_requestFactory->createRequest(endpoint);
-        m_manager->deleteResource(request, this, [this](QRestReply &reply) {
-            if (const auto json = reply.readJson()) {
-                if (json->isObject()) {
-                    emit responseReceived(json->object());
+    return call.jsCallback.isCallable()
+           || isSignalConnected(QMetaMethod::fromSignal(&RestClient::finished));
+}
+
+void RestClient::deliver(PendingCall &call, RestResponse response)
+{
+    response.requestId = call.id;
+    response.method = call.method;
+    response.elapsedMs = call.timer.nsecsElapsed() / 1e6;
+
+    const RequestMetrics &metrics = requestMetrics(call.method);
+    if (!response.fromCache) {
+        metrics.latency->observe(response.elapsedMs);
+    }
+    if (!response.ok) {
+        metrics.errors->increment();
+        CPI_LOG_WARNING("rest", "Request failed",
+                        {{"id", call.id}, {"method", call.method}, {"url", response.url.toString()},
+                         {"status", response.status}, {"error", response.error}});
+    }
+
+    if (call.callback) {
+        call.callback(response);
+    }
+    if (wantsVariant(call)) {
+        const QVariantMap result = response.toVariantMap();
+        if (call.jsCallback.isCallable()) {
+            if (QJSEngine *engine = qjsEngine(this)) {
+                const QJSValue value = call.jsCallback.call({engine->toScriptValue(result)});
+                if (value.isError()) {
+                    CPI_LOG_ERROR("rest", "Callback threw",
+                                  {{"id", call.id}, {"error", value.toString()}});
                 }
-            } else {
-                emit errorOccurred(reply.errorString());
             }
-        });
-    } catch (const std::exception &e) {
-        emit errorOccurred(QString("Request failed: %1").arg(e.what()));
+        }
+        emit finished(call.id, result);
+    }
+
+    if (!response.ok) {
+        emit errorOccurred(response.error);
+    } else if (response.json.isObject()) {
+        emit responseReceived(response.json.object());
     }
 }
@@ -3,46 +3,320 @@
 
 #include <QQmlEngine>
 #include <QNetworkAccessManager>
+#include <QNetworkReply>
 #include <QJsonObject>
 #include <QUrl>
+#include <QHash>
+#include <QJSValue>
+#include <QElapsedTimer>
+#include <QNetworkRequest>
+#include <QPointer>
+#include <QThreadPool>
+#include <QTimer>
+#include <functional>
 #include <memory>
+#include "batchuploader.h"
+#include "connectionpolicy.h"
+#include "requestscheduler.h"
+#include "responsecache.h"
+#include "restresponse.h"
 
 class QRestAccessManager;
+class QRestReply;
 class QNetworkRequestFactory;
 
+// How one call is scheduled, see RestClient
+struct RequestOptions {
+    RequestScheduler::Priority priority{RequestScheduler::Priority::Normal};
+    // ms from the call to its result, queueing and retries included;
+    // -1 takes defaultTimeout, 0 waits forever
+    int timeoutMs{-1};
+    // -1 takes maxRetries; only GET, PUT and DELETE are ever retried
+    int retries{-1};
+};
+
 class RestClient : public QObject
 {
     Q_OBJECT
 
     Q_PROPERTY(QUrl baseUrl READ baseUrl WRITE setBaseUrl NOTIFY baseUrlChanged)
     Q_PROPERTY(bool sslSupported READ sslSupported CONSTANT)
+    Q_PROPERTY(bool cacheEnabled READ cacheEnabled WRITE setCacheEnabled NOTIFY cacheEnabledChanged)
+    Q_PROPERTY(int cacheMaxAge READ cacheMaxAge WRITE setCacheMaxAge NOTIFY cacheMaxAgeChanged)
+    Q_PROPERTY(QString diskCachePath READ diskCachePath WRITE setDiskCachePath NOTIFY diskCachePathChanged)
+    Q_PROPERTY(int cacheHits READ cacheHits NOTIFY cacheStatsChanged)
+    Q_PROPERTY(int cacheMisses READ cacheMisses NOTIFY cacheStatsChanged)
+    Q_PROPERTY(int cacheRevalidations READ cacheRevalidations NOTIFY cacheStatsChanged)
+    Q_PROPERTY(int coalescedRequests READ coalescedRequests NOTIFY cacheStatsChanged)
+    Q_PROPERTY(bool keepAlive READ keepAlive WRITE setKeepAlive NOTIFY connectionSettingsChanged)
+    Q_PROPERTY(int keepAliveTimeout READ keepAliveTimeout WRITE setKeepAliveTimeout NOTIFY connectionSettingsChanged)
+    Q_PROPERTY(bool http2Enabled READ http2Enabled WRITE setHttp2Enabled NOTIFY connectionSettingsChanged)
+    Q_PROPERTY(bool tlsSessionReuse READ tlsSessionReuse WRITE setTlsSessionReuse NOTIFY connectionSettingsChanged)
+    Q_PROPERTY(int maxConnections READ maxConnections WRITE setMaxConnections NOTIFY connectionSettingsChanged)
+    Q_PROPERTY(bool autoPrewarm READ autoPrewarm WRITE setAutoPrewarm NOTIFY connectionSettingsChanged)
+    Q_PROPERTY(int connectionsOpened READ connectionsOpened NOTIFY connectionStatsChanged)
+    Q_PROPERTY(int connectionsReused READ connectionsReused NOTIFY connectionStatsChanged)
+    Q_PROPERTY(int http2Responses READ http2Responses NOTIFY connectionStatsChanged)
+    Q_PROPERTY(int tlsResumptionAttempts READ tlsResumptionAttempts NOTIFY connectionStatsChanged)
+    Q_PROPERTY(int maxConcurrentRequests READ maxConcurrentRequests WRITE setMaxConcurrentRequests NOTIFY schedulingChanged)
+    Q_PROPERTY(int reservedRequests READ reservedRequests WRITE setReservedRequests NOTIFY schedulingChanged)
+    Q_PROPERTY(int defaultTimeout READ defaultTimeout WRITE setDefaultTimeout NOTIFY schedulingChanged)
+    Q_PROPERTY(int maxRetries READ maxRetries WRITE setMaxRetries NOTIFY schedulingChanged)
+    Q_PROPERTY(int queuedRequests READ queuedRequests NOTIFY schedulerStatsChanged)
+    Q_PROPERTY(int activeRequests READ activeRequests NOTIFY schedulerStatsChanged)
+    Q_PROPERTY(int retriedRequests READ retriedRequests NOTIFY schedulerStatsChanged)
+    Q_PROPERTY(int cancelledRequests READ cancelledRequests NOTIFY schedulerStatsChanged)
+    Q_PROPERTY(int timedOutRequests READ timedOutRequests NOTIFY schedulerStatsChanged)
+    Q_PROPERTY(BatchUploader* reports READ reports CONSTANT)
     QML_ELEMENT
     QML_SINGLETON
 
 public:
+    // RequestScheduler::Priority, for QML: RestClient.High
+    enum Priority {
+        Low = int(RequestScheduler::Priority::Low),
+        Normal = int(RequestScheduler::Priority::Normal),
+        High = int(RequestScheduler::Priority::High),
+        Critical = int(RequestScheduler::Priority::Critical)
+    };
+    Q_ENUM(Priority)
+
     explicit RestClient(QObject *parent = nullptr);
     ~RestClient() override = default;
 
+    // Watches reachability and takes the report endpoint from
+    // CELLULARPI_REPORT_URL, which opens its spool. Requests work without
+    // it; the application calls it once the first frame is on screen.
+    void start();
+
     // Property getters/setters
     QUrl baseUrl() const;
     void setBaseUrl(const QUrl &url);
     bool sslSupported() const;
 
-    // QML invokable methods
-    Q_INVOKABLE void get(const QString &endpoint);
-    Q_INVOKABLE void post(const QString &endpoint, const QVariantMap &data);
-    Q_INVOKABLE void put(const QString &endpoint, const QVariantMap &data);
-    Q_INVOKABLE void deleteResource(const QString &endpoint);
+    // GET responses are kept in memory and served while fresh; stale ones
+    // with an ETag or Last-Modified are revalidated with a conditional GET.
+    // Concurrent GETs of one URL always share a single request.
+    bool cacheEnabled() const;
+    void setCacheEnabled(bool enabled);
+    // Seconds a response stays fresh when the server sends no max-age
+    int cacheMaxAge() const;
+    void setCacheMaxAge(int seconds);
+    // Backs the network layer with a QNetworkDiskCache, empty disables it
+    QString diskCachePath() const;
+    void setDiskCachePath(const QString &path);
+    int cacheHits() const;
+    int cacheMisses() const;
+    int cacheRevalidations() const;
+    int coalescedRequests() const;
+
+    Q_INVOKABLE void clearCache();
+
+    // Connection handling, see ConnectionPolicy. Every result carries a
+    // timing breakdown (result.timing) to compare the settings by.
+    bool keepAlive() const;
+    void setKeepAlive(bool enabled);
+    // Seconds an idle connection is kept for reuse
+    int keepAliveTimeout() const;
+    void setKeepAliveTimeout(int seconds);
+    bool http2Enabled() const;
+    void setHttp2Enabled(bool enabled);
+    bool tlsSessionReuse() const;
+    void setTlsSessionReuse(bool enabled);
+    // Per host, for HTTP/1; HTTP/2 multiplexes over a single one
+    int maxConnections() const;
+    void setMaxConnections(int connections);
+    // Prewarms whenever baseUrl changes or the network comes back
+    bool autoPrewarm() const;
+    void setAutoPrewarm(bool enabled);
+    // Requests that had to open a connection, and that found one open
+    int connectionsOpened() const;
+    int connectionsReused() const;
+    int http2Responses() const;
+    // New TLS connections that offered a session ticket
+    int tlsResumptionAttempts() const;
+
+    // Opens a connection to baseUrl (TCP, TLS and ALPN) ahead of requests
+    Q_INVOKABLE void prewarm();
+
+    // Scheduling, see RequestScheduler. At most maxConcurrentRequests are
+    // on the wire; the last reservedRequests of them only take High and
+    // Critical calls. A call that is still queued or out when its timeout
+    // runs out fails with "Timed out". GET, PUT and DELETE calls that got
+    // no response, or a 408, 429, 502, 503 or 504, are sent again after an
+    // exponential backoff (or the server's Retry-After) while their
+    // timeout allows; a POST never is.
+    int maxConcurrentRequests() const;
+    void setMaxConcurrentRequests(int requests);
+    int reservedRequests() const;
+    void setReservedRequests(int requests);
+    // Milliseconds, 0 for none
+    int defaultTimeout() const;
+    void setDefaultTimeout(int ms);
+    int maxRetries() const;
+    void setMaxRetries(int retries);
+    int queuedRequests() const;
+    int activeRequests() const;
+    int retriedRequests() const;
+    int cancelledRequests() const;
+    int timedOutRequests() const;
+
+    // Fails the call with "Cancelled", aborting its request unless a
+    // coalesced caller still waits for it. False when the call is already
+    // done or unknown.
+    Q_INVOKABLE bool cancel(int requestId);
+
+    // Batched delivery results and telemetry, sent to CELLULARPI_REPORT_URL;
+    // disabled (records are dropped) when that is unset
+    BatchUploader *reports();
+
+    using Callback = std::function<void(const RestResponse &)>;
+
+    // Every call returns a request id, which comes back in the result. The
+    // optional callback is called once with RestResponse::toVariantMap(),
+    // so concurrent requests never need to be told apart by the caller:
+    //     RestClient.get("/todos", result => model = result.json)
+    // data may be an object, an array or a string / ArrayBuffer sent as is.
+    // options are RequestOptions by name:
+    //     RestClient.get("/status", cb, {priority: RestClient.Low, timeout: 5000, retries: 0})
+    Q_INVOKABLE int get(const QString &endpoint, const QJSValue &callback = QJSValue(),
+                        const QVariantMap &options = {});
+    Q_INVOKABLE int post(const QString &endpoint, const QVariant &data,
+                         const QJSValue &callback = QJSValue(), const QVariantMap &options = {});
+    Q_INVOKABLE int put(const QString &endpoint, const QVariant &data,
+                        const QJSValue &callback = QJSValue(), const QVariantMap &options = {});
+    Q_INVOKABLE int deleteResource(const QString &endpoint, const QJSValue &callback = QJSValue(),
+                                   const QVariantMap &options = {});
+
+    // C++ callers
+    int get(const QString &endpoint, Callback callback, const RequestOptions &options = {});
+    int post(const QString &endpoint, const QVariant &data, Callback callback,
+             const RequestOptions &options = {});
+    int put(const QString &endpoint, const QVariant &data, Callback callback,
+            const RequestOptions &options = {});
+    int deleteResource(const QString &endpoint, Callback callback, const RequestOptions &options = {});
+    // A pre-encoded body with its own headers (Content-Type, Content-Encoding)
+    int post(const QString &endpoint, const QByteArray &body,
+             const QList<RestResponse::Header> &headers, Callback callback,
+             const RequestOptions &options = {});
 
 signals:
     void baseUrlChanged();
+    void cacheEnabledChanged();
+    void cacheMaxAgeChanged();
+    void diskCachePathChanged();
+    void cacheStatsChanged();
+    void connectionSettingsChanged();
+    void connectionStatsChanged();
+    void schedulingChanged();
+    void schedulerStatsChanged();
+    // Every result, see RestResponse::toVariantMap()
+    void finished(int requestId, const QVariantMap &result);
+    // Broadcast of JSON object responses and of errors, kept for listeners
+    // that do not track their requests
     void responseReceived(const QJsonObject &response);
     void errorOccurred(const QString &error);
 
 private:
+    // One caller waiting for a result
+    struct PendingCall {
+        int id{0};
+        QString method;
+        QElapsedTimer timer;
+        QJSValue jsCallback;
+        Callback callback;
+        RequestScheduler::Priority priority{RequestScheduler::Priority::Normal};
+        qint64 deadlineMs{0};     // on m_clock, 0 for none
+        int retries{0};
+    };
+
+    using ReplyHandler = std::function<void(QRestReply &)>;
+
+    // One network request under the scheduler and the callers it answers;
+    // a GET has as many as were coalesced onto it, a write exactly one
+    struct Job {
+        QString method;
+        QString key;              // GETs: the cache key
+        QNetworkRequest request;
+        // Puts the request on the wire
+        std::function<QNetworkReply *(ReplyHandler)> send;
+        QList<PendingCall> calls;
+        RequestScheduler::Priority priority{RequestScheduler::Priority::Normal};
+        int retries{0};
+        int attempts{0};
+        qint64 queuedMs{0};
+        QPointer<QNetworkReply> reply;
+        QString abortReason;      // set when the reply was aborted on purpose
+    };
+
     QNetworkAccessManager m_qnam;
+    // Response bodies are decoded here, never on the GUI thread
+    QThreadPool m_decodePool;
     std::shared_ptr<QRestAccessManager> m_manager;
     std::shared_ptr<QNetworkRequestFactory> m_requestFactory;
+    ResponseCache m_cache;
+    bool m_cacheEnabled{true};
+    int m_cacheMaxAge{0};
+    QString m_diskCachePath;
+    int m_nextRequestId{1};
+    RequestScheduler m_scheduler;
+    int m_nextJobId{1};
+    QHash<int, Job> m_jobs;
+    // URL -> the GET job that callers of it join
+    QHash<QString, int> m_getJobs;
+    QElapsedTimer m_clock;
+    // Next backoff ending or deadline
+    QTimer m_scheduleTimer;
+    int m_defaultTimeout{DEFAULT_TIMEOUT_MS};
+    int m_maxRetries{DEFAULT_MAX_RETRIES};
+    int m_retriedRequests{0};
+    int m_cancelledRequests{0};
+    int m_timedOutRequests{0};
+    int m_cacheHits{0};
+    int m_cacheMisses{0};
+    int m_cacheRevalidations{0};
+    int m_coalescedRequests{0};
+    ConnectionPolicy m_connections;
+    bool m_autoPrewarm{false};
+    bool m_started{false};
+    int m_connectionsOpened{0};
+    int m_connectionsReused{0};
+    int m_http2Responses{0};
+    int m_tlsResumptionAttempts{0};
+    BatchUploader m_reports;
+
+    static constexpr qint64 DISK_CACHE_MAX_BYTES = 16 * 1024 * 1024;
+    static constexpr int DECODE_THREADS = 2;
+    static constexpr int DEFAULT_TIMEOUT_MS = 30000;
+    static constexpr int DEFAULT_MAX_RETRIES = 2;
+    static constexpr int RETRY_BASE_MS = 500;
+    static constexpr int RETRY_MAX_MS = 10000;
+
+    // endpoint is a path under baseUrl or an absolute URL
+    QNetworkRequest createRequest(const QString &endpoint) const;
+    PendingCall newCall(const QString &method, QJSValue jsCallback, Callback callback,
+                        const RequestOptions &options);
+    static RequestOptions requestOptions(const QVariantMap &options);
+    int startGet(const QString &endpoint, PendingCall call);
+    int startWrite(const QString &endpoint, const QVariant &data, PendingCall call,
+                   const QList<RestResponse::Header> &headers = {});
+    void submitGet(Job job, bool conditional);
+    int submit(Job job);
+    // Starts whatever the scheduler lets through and rearms m_scheduleTimer
+    void schedule();
+    void launch(int id);
+    void finishJob(int id, RestResponse response);
+    // ms to wait before sending the job again, -1 when it is not retried
+    qint64 retryDelay(const Job &job, const RestResponse &response) const;
+    // Fails one call of a job, dropping or aborting the job if it was the last
+    void dropCall(int jobId, int callId, const QString &reason);
+    void expireCalls();
+    void handleGetResponse(Job job, RestResponse response);
+    void recordConnection(const RestResponse &response, bool resumable);
+    void updateConnectionSettings(const ConnectionPolicy::Settings &settings);
+    // True when the result will be handed to QML
+    bool wantsVariant(const PendingCall &call) const;
+    void deliver(PendingCall &call, RestResponse response);
 };
 
 #endif // RESTCLIENT_H
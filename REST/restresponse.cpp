@@ -0,0 +1,53 @@
+#include "restresponse.h"
+
+QByteArray RestResponse::header(const QByteArray &name) const
+{
+    for (const Header &entry : headers) {
+        if (entry.first.compare(name, Qt::CaseInsensitive) == 0) {
+            return entry.second;
+        }
+    }
+    return QByteArray();
+}
+
+QVariantMap RestResponse::toVariantMap() const
+{
+    QVariantMap headerMap;
+    for (const Header &entry : headers) {
+        headerMap.insert(QString::fromLatin1(entry.first).toLower(), QString::fromUtf8(entry.second));
+    }
+
+    QVariant jsonValue = jsonVariant;
+    if (!jsonValue.isValid() && !json.isNull()) {
+        jsonValue = json.toVariant();
+    }
+
+    return {
+        {"id", requestId},
+        {"method", method},
+        {"url", url},
+        {"status", status},
+        {"ok", ok},
+        {"error", error},
+        {"headers", headerMap},
+        {"elapsedMs", elapsedMs},
+        {"attempts", attempts},
+        {"fromCache", fromCache},
+        {"timing", timing.toVariantMap()},
+        {"json", jsonValue},
+        {"body", body},
+    };
+}
+
+QVariantMap RestResponse::Timing::toVariantMap() const
+{
+    return {
+        {"dnsMs", dnsMs},
+        {"connectMs", connectMs},
+        {"sendMs", sendMs},
+        {"ttfbMs", ttfbMs},
+        {"transferMs", transferMs},
+        {"newConnection", newConnection},
+        {"http2", http2},
+    };
+}
@@ -0,0 +1,54 @@
+#ifndef RESTRESPONSE_H
+#define RESTRESPONSE_H
+
+#include <QByteArray>
+#include <QJsonDocument>
+#include <QList>
+#include <QPair>
+#include <QString>
+#include <QUrl>
+#include <QVariantMap>
+
+// Outcome of one RestClient call, handed to its callback
+struct RestResponse {
+    using Header = QPair<QByteArray, QByteArray>;
+
+    // Where the time of a network reply went, in ms. Qt signals nothing
+    // between TCP connect and the TLS handshake, so connectMs covers both.
+    struct Timing {
+        double dnsMs{0};          // host lookup and waiting for a connection
+        double connectMs{0};      // TCP connect plus TLS handshake
+        double sendMs{0};         // writing the request
+        double ttfbMs{0};         // request written to response headers
+        double transferMs{0};     // headers to last byte
+        bool newConnection{false};
+        bool http2{false};
+
+        QVariantMap toVariantMap() const;
+    };
+
+    int requestId{0};
+    QString method;
+    QUrl url;
+    int status{0};            // HTTP status, 0 when no response arrived
+    bool ok{false};           // 2xx (or served from cache) and well-formed
+    QString error;
+    QList<Header> headers;
+    QByteArray body;          // empty for JSON decoded while streaming
+    qint64 bodySize{0};       // bytes received, streamed or not
+    QJsonDocument json;       // null unless the body is JSON
+    QVariant jsonVariant;     // json.toVariant(), when built off-thread
+    double elapsedMs{0};
+    int attempts{0};          // times the request went out, 0 if it never did
+    bool fromCache{false};
+    Timing timing;            // all zero for cached responses
+
+    QByteArray header(const QByteArray& name) const;
+
+    // For QML callbacks: {id, method, url, status, ok, error, headers,
+    // elapsedMs, attempts, fromCache, timing, json (object, array or null),
+    // body (ArrayBuffer)}
+    QVariantMap toVariantMap() const;
+};
+
+#endif // RESTRESPONSE_H
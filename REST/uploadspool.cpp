@@ -0,0 +1,163 @@
+#include "uploadspool.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include "logging.h"
+
+void UploadSpool::open(const QString &directory)
+{
+    m_directory = directory;
+    m_batches.clear();
+    m_totalBytes = 0;
+    m_records = 0;
+    if (m_directory.isEmpty()) {
+        return;
+    }
+
+    QDir dir(m_directory);
+    if (!dir.mkpath(QStringLiteral("."))) {
+        CPI_LOG_ERROR("upload", "Cannot create spool directory", {{"path", m_directory}});
+        m_directory.clear();
+        return;
+    }
+    const QFileInfoList files = dir.entryInfoList({QStringLiteral("*.json"), QStringLiteral("*.json.gz")},
+                                                  QDir::Files);
+    for (const QFileInfo &file : files) {
+        Batch batch;
+        if (!parseFileName(file.fileName(), batch)) {
+            continue;
+        }
+        batch.size = file.size();
+        m_batches.insert(batch.sequence, batch);
+        m_totalBytes += batch.size;
+        m_records += batch.records;
+    }
+    if (!m_batches.isEmpty()) {
+        CPI_LOG_INFO("upload", "Spooled batches found",
+                     {{"path", m_directory}, {"batches", m_batches.size()}, {"records", m_records}});
+    }
+}
+
+bool UploadSpool::isOpen() const
+{
+    return !m_directory.isEmpty();
+}
+
+QString UploadSpool::directory() const
+{
+    return m_directory;
+}
+
+qint64 UploadSpool::maxBytes() const
+{
+    return m_maxBytes;
+}
+
+void UploadSpool::setMaxBytes(qint64 maxBytes)
+{
+    m_maxBytes = qMax<qint64>(0, maxBytes);
+}
+
+qint64 UploadSpool::totalBytes() const
+{
+    return m_totalBytes;
+}
+
+bool UploadSpool::isEmpty() const
+{
+    return m_batches.isEmpty();
+}
+
+int UploadSpool::count() const
+{
+    return m_batches.size();
+}
+
+int UploadSpool::records() const
+{
+    return m_records;
+}
+
+quint64 UploadSpool::lastSequence() const
+{
+    return m_batches.isEmpty() ? 0 : m_batches.lastKey();
+}
+
+UploadSpool::Batch UploadSpool::first() const
+{
+    return m_batches.isEmpty() ? Batch() : m_batches.first();
+}
+
+bool UploadSpool::store(const Batch &batch, const QByteArray &payload, QList<Batch> *dropped)
+{
+    if (!isOpen() || payload.size() > m_maxBytes) {
+        return false;
+    }
+    while (m_totalBytes + payload.size() > m_maxBytes && !m_batches.isEmpty()) {
+        const Batch oldest = m_batches.first();
+        remove(oldest);
+        if (dropped) {
+            dropped->append(oldest);
+        }
+    }
+
+    Batch stored = batch;
+    stored.size = payload.size();
+    QSaveFile file(filePath(stored));
+    if (!file.open(QIODevice::WriteOnly) || file.write(payload) != payload.size() || !file.commit()) {
+        CPI_LOG_ERROR("upload", "Cannot spool batch",
+                      {{"path", file.fileName()}, {"error", file.errorString()}});
+        return false;
+    }
+    m_batches.insert(stored.sequence, stored);
+    m_totalBytes += stored.size;
+    m_records += stored.records;
+    return true;
+}
+
+QByteArray UploadSpool::read(const Batch &batch) const
+{
+    QFile file(filePath(batch));
+    if (!file.open(QIODevice::ReadOnly)) {
+        return {};
+    }
+    return file.readAll();
+}
+
+void UploadSpool::remove(const Batch &batch)
+{
+    if (m_batches.remove(batch.sequence) == 0) {
+        return;
+    }
+    m_totalBytes -= batch.size;
+    m_records -= batch.records;
+    QFile::remove(filePath(batch));
+}
+
+QString UploadSpool::filePath(const Batch &batch) const
+{
+    // Zero-padded, so lexical order is sequence order for anyone listing it
+    return QStringLiteral("%1/%2-%3-%4.json%5")
+        .arg(m_directory)
+        .arg(batch.sequence, 20, 10, QLatin1Char('0'))
+        .arg(batch.records)
+        .arg(batch.rawBytes)
+        .arg(batch.compressed ? QStringLiteral(".gz") : QString());
+}
+
+bool UploadSpool::parseFileName(const QString &fileName, Batch &batch)
+{
+    const QStringList parts = fileName.section(QLatin1Char('.'), 0, 0).split(QLatin1Char('-'));
+    if (parts.size() != 3) {
+        return false;
+    }
+    bool sequenceOk = false;
+    bool recordsOk = false;
+    bool rawBytesOk = false;
+    batch.sequence = parts.at(0).toULongLong(&sequenceOk);
+    batch.records = parts.at(1).toInt(&recordsOk);
+    batch.rawBytes = parts.at(2).toLongLong(&rawBytesOk);
+    batch.compressed = fileName.endsWith(QLatin1String(".gz"));
+    return sequenceOk && recordsOk && rawBytesOk && batch.sequence > 0;
+}
@@ -0,0 +1,60 @@
+#ifndef UPLOADSPOOL_H
+#define UPLOADSPOOL_H
+
+#include <QByteArray>
+#include <QList>
+#include <QMap>
+#include <QString>
+
+// Upload batches kept on disk while they cannot be sent.
+//
+// One file per batch, named <sequence>-<records>-<raw bytes>.json[.gz], so the sorted
+// directory listing is the replay order and there is no index to keep
+// consistent with it. Each file is written with QSaveFile and either
+// exists whole or not at all. Bounded by maxBytes: when a new batch does
+// not fit, the oldest ones are given up first.
+class UploadSpool {
+public:
+    struct Batch {
+        quint64 sequence{0};
+        int records{0};
+        qint64 rawBytes{0};       // before compression
+        bool compressed{false};
+        qint64 size{0};           // as stored and sent
+    };
+
+    static constexpr qint64 DEFAULT_MAX_BYTES = 8 * 1024 * 1024;
+
+    // Picks up the batches already in directory; an empty one disables it
+    void open(const QString& directory);
+    bool isOpen() const;
+    QString directory() const;
+
+    qint64 maxBytes() const;
+    void setMaxBytes(qint64 maxBytes);
+    qint64 totalBytes() const;
+
+    bool isEmpty() const;
+    int count() const;
+    int records() const;
+    quint64 lastSequence() const;
+    // Oldest batch, the next one to send
+    Batch first() const;
+
+    // Batches dropped to make room are appended to dropped
+    bool store(const Batch& batch, const QByteArray& payload, QList<Batch>* dropped = nullptr);
+    QByteArray read(const Batch& batch) const;
+    void remove(const Batch& batch);
+
+private:
+    QString m_directory;
+    qint64 m_maxBytes{DEFAULT_MAX_BYTES};
+    qint64 m_totalBytes{0};
+    int m_records{0};
+    QMap<quint64, Batch> m_batches;
+
+    QString filePath(const Batch& batch) const;
+    static bool parseFileName(const QString& fileName, Batch& batch);
+};
+
+#endif // UPLOADSPOOL_H
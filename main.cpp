@@ -1,9 +1,126 @@
+#include <QCommandLineParser>
+#include <QDateTime>
 #include <QGuiApplication>
 #include <QQmlApplicationEngine>
+#include <QQuickWindow>
+#include <QStandardPaths>
+#include <cstring>
+#include "controlserver.h"
+#include "logging.h"
+#include "metricsexporter.h"
+#include "modem.h"
+#include "restclient.h"
+#include "startupreport.h"
+
+namespace {
+
+void startLogging()
+{
+    Log::setLevelFromEnvironment();
+    Log::WriterOptions logOptions;
+    logOptions.directory = qEnvironmentVariable("CELLULARPI_LOG_DIR",
+        QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/logs");
+    Log::startWriter(logOptions);
+}
+
+// What construction of the two deferred: journal, D-Bus, reachability and
+// the report spool. Delivery results go to the report endpoint, if any.
+void startCore(Modem &modem, RestClient &client)
+{
+    QObject::connect(&modem, &Modem::readyChanged, &modem, [&modem]() {
+        if (modem.isReady()) {
+            Startup::mark(Startup::Phase::ModemReady);
+            Startup::report();
+        }
+    });
+
+    client.start();
+    if (!client.reports()->endpoint().isEmpty()) {
+        const auto report = [&client](const QString &recipient, bool ok) {
+            client.reports()->append({{"type", "delivery"}, {"recipient", recipient}, {"ok", ok},
+                                      {"ts", QDateTime::currentMSecsSinceEpoch()}});
+        };
+        QObject::connect(&modem, &Modem::smsSent, &client,
+                         [report](const QString &recipient) { report(recipient, true); });
+        QObject::connect(&modem, &Modem::smsFailed, &client,
+                         [report](const QString &recipient) { report(recipient, false); });
+        // What the network said afterwards, when delivery reports are on
+        QObject::connect(&modem, &Modem::smsDelivered, &client,
+                         [&client](const QString &recipient, double latencyMs) {
+            client.reports()->append({{"type", "delivery_report"}, {"recipient", recipient},
+                                      {"delivered", true}, {"latencyMs", latencyMs},
+                                      {"ts", QDateTime::currentMSecsSinceEpoch()}});
+        });
+        QObject::connect(&modem, &Modem::smsUndelivered, &client,
+                         [&client](const QString &recipient, const QString &reason) {
+            client.reports()->append({{"type", "delivery_report"}, {"recipient", recipient},
+                                      {"delivered", false}, {"reason", reason},
+                                      {"ts", QDateTime::currentMSecsSinceEpoch()}});
+        });
+    }
+    modem.start();
+}
+
+// Modem and RestClient without QML or a window, driven by local services
+// over the control socket (see ControlProtocol)
+int runHeadless(QCoreApplication &app)
+{
+    QCommandLineParser parser;
+    parser.setApplicationDescription("CellularPi");
+    parser.addHelpOption();
+    parser.addOption({"headless", "Run without the GUI, controlled over a local socket."});
+    parser.addOption({"socket",
+                      "Control socket, default $CELLULARPI_CONTROL_SOCKET or <runtime dir>/cellularpi.sock.",
+                      "path"});
+    parser.process(app);
+
+    QString socketPath = parser.value("socket");
+    if (socketPath.isEmpty()) {
+        socketPath = qEnvironmentVariable("CELLULARPI_CONTROL_SOCKET",
+            QStandardPaths::writableLocation(QStandardPaths::RuntimeLocation) + "/cellularpi.sock");
+    }
+
+    Modem modem;
+    RestClient client;
+    // What the Metrics singleton does for the GUI, without its refresh timer
+    MetricsExporter exporter;
+    exporter.setFilePath(qEnvironmentVariable("CELLULARPI_METRICS_FILE"));
+    exporter.setSocketName(qEnvironmentVariable("CELLULARPI_METRICS_SOCKET"));
+
+    ControlServer server(&modem, &client);
+    if (!server.listen(socketPath)) {
+        qCritical("Cannot listen on %s: %s", qPrintable(socketPath), qPrintable(server.errorString()));
+        return 1;
+    }
+    startCore(modem, client);
+    return app.exec();
+}
+
+} // namespace
 
 int main(int argc, char *argv[])
 {
+    Startup::begin();
+    Startup::mark(Startup::Phase::Main);
+    QCoreApplication::setApplicationVersion(CELLULARPI_VERSION);
+
+    // Decided before an application object exists: the GUI one wants a
+    // display and a GPU, which field units may not have
+    bool headless = false;
+    for (int i = 1; i < argc; ++i) {
+        headless = headless || std::strcmp(argv[i], "--headless") == 0;
+    }
+    if (headless) {
+        QCoreApplication app(argc, argv);
+        startLogging();
+        const int result = runHeadless(app);
+        Startup::report();
+        Log::stopWriter();
+        return result;
+    }
+
     QGuiApplication app(argc, argv);
+    startLogging();
 
     QQmlApplicationEngine engine;
     QObject::connect(
@@ -13,6 +130,25 @@ int main(int argc, char *argv[])
         []() { QCoreApplication::exit(-1); },
         Qt::QueuedConnection);
     engine.loadFromModule("Qml", "Main");
+    Startup::mark(Startup::Phase::QmlLoaded);
 
-    return app.exec();
+    // Nothing touches D-Bus, the disk or the network before the first
+    // frame is on screen. frameSwapped comes from the render thread.
+    if (auto *window = qobject_cast<QQuickWindow *>(engine.rootObjects().value(0))) {
+        QObject::connect(
+            window,
+            &QQuickWindow::frameSwapped,
+            &app,
+            [&engine]() {
+                Startup::mark(Startup::Phase::FirstFrame);
+                startCore(*engine.singletonInstance<Modem *>("Modem", "Modem"),
+                          *engine.singletonInstance<RestClient *>("REST", "RestClient"));
+            },
+            static_cast<Qt::ConnectionType>(Qt::QueuedConnection | Qt::SingleShotConnection));
+    }
+
+    const int result = app.exec();
+    Startup::report();
+    Log::stopWriter();
+    return result;
 }